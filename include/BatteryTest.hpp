@@ -0,0 +1,89 @@
+#ifndef __H_BATTERYTEST__
+#define __H_BATTERYTEST__
+
+#include <Arduino.h>
+#include "mcp4726.hpp"
+#include "Calibration.hpp"
+#include "SamplerListener.hpp"
+
+// Integrates charge and energy from every ADC sample and cuts the
+// load from the sampler task as soon as the cutoff voltage is seen,
+// without waiting for the control or main tasks
+class BatteryTest : public SamplerListener
+{
+public:
+    enum State
+    {
+        BT_IDLE,
+        BT_RUNNING,
+        BT_CUTOFF,
+        BT_DONE,
+        BT_STOPPED
+    };
+
+    struct Result
+    {
+        State state;
+        int64_t charge_uAh;
+        int64_t energy_uWh;
+        uint32_t elapsed_ms;
+        int32_t lastVoltage_uV;
+        uint32_t cutoffLatency_us;
+        uint32_t gaps;
+    };
+
+public:
+    BatteryTest(MCP4726 *dac);
+
+    void start(int32_t cutoff_uV, uint32_t confirmSamples, const Calibration &calibration);
+    void stop();
+    void finish();
+
+    State state();
+    bool loadCut();
+    int32_t cutoff_uV();
+
+    void result(Result *result);
+
+    virtual void samplesAcquired(Sampler *source, const Sample *samples, size_t count);
+
+public:
+    static const char *stateName(State state);
+
+private:
+    void _cutLoad(uint32_t sample_us);
+
+private:
+    static const int64_t g_usPerHour;
+    static const uint32_t g_maxGap_us;
+
+private:
+    MCP4726 *_dac;
+
+    SemaphoreHandle_t _mutex;
+
+    Calibration _calibration;
+
+    volatile State _state;
+    int32_t _cutoff_uV;
+    uint32_t _confirmSamples;
+    uint32_t _belowCount;
+
+    bool _havePrevious;
+    uint32_t _previous_us;
+    // Summed sample to sample, as the timestamps wrap every 71 minutes
+    uint64_t _elapsed_us;
+
+    // Whole uAh/uWh plus the remainder in uA.us/uW.us, so
+    // neither side can overflow however long the test runs
+    int64_t _charge_uAh;
+    int64_t _charge_uAus;
+    int64_t _energy_uWh;
+    int64_t _energy_uWus;
+
+    int32_t _lastVoltage_uV;
+    uint32_t _cutoffLatency_us;
+    uint32_t _gaps;
+};
+
+#endif
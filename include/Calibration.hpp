@@ -0,0 +1,86 @@
+#ifndef __H_CALIBRATION__
+#define __H_CALIBRATION__
+
+#include <stdlib.h>
+#include <stdint.h>
+
+// Per-channel correction applied on top of the nominal Measurement
+// conversions. With fewer than two reference points a channel is a
+// Q16 gain plus offset; with two or more it is a piecewise-linear
+// table searched in O(log n). All math is integer.
+class Calibration
+{
+public:
+    enum Channel
+    {
+        CH_LOAD_VOLTAGE,
+        CH_LOAD_CURRENT,
+        CH_DAC_CURRENT,
+        CH_COUNT
+    };
+
+    struct Point
+    {
+        int32_t x;
+        int32_t y;
+    };
+
+    struct Stored;
+
+public:
+    Calibration();
+
+    void reset(Channel ch);
+    void setLinear(Channel ch, int32_t gain_q16, int32_t offset);
+    bool addPoint(Channel ch, int32_t x, int32_t y);
+
+    int32_t apply(Channel ch, int32_t value) const;
+
+    int32_t gain_q16(Channel ch) const;
+    int32_t offset(Channel ch) const;
+    size_t pointCount(Channel ch) const;
+    const Point *points(Channel ch) const;
+
+    void store(Stored *stored) const;
+    bool restore(const Stored &stored);
+
+public:
+    static const char *channelName(Channel ch);
+    static bool channelFromName(const char *name, Channel *ch);
+
+public:
+    static const int32_t g_unityGain_q16 = 65536;
+    static const size_t g_maxPoints = 16;
+
+public:
+    // Everything needed to rebuild a Calibration, laid out for storage
+    struct Stored
+    {
+        struct
+        {
+            int32_t gain_q16;
+            int32_t offset;
+            uint32_t count;
+            Point points[g_maxPoints];
+        } channels[CH_COUNT];
+    };
+
+private:
+    struct ChannelCal
+    {
+        int32_t gain_q16;
+        int32_t offset;
+        size_t count;
+        Point points[g_maxPoints];
+        // slope_q32[i] is the slope from points[i] to points[i + 1]
+        int64_t slope_q32[g_maxPoints];
+    };
+
+private:
+    void _updateSlopes(ChannelCal *cal);
+
+private:
+    ChannelCal _channels[CH_COUNT];
+};
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef __H_CONSOLE__
+#define __H_CONSOLE__
+
+#include <Arduino.h>
+#include "ConsoleListener.hpp"
+
+class Console
+{
+public:
+    Console();
+
+    void setListener(ConsoleListener *listener);
+
+    bool start();
+
+    void consoleTask();
+
+public:
+    static int split(char *line, char **argv, int maxArgs);
+
+public:
+    static const size_t g_maxLineLen = 96;
+
+private:
+    ConsoleListener *_listener;
+
+    TaskHandle_t _consoleTaskHandle;
+
+    char _line[g_maxLineLen];
+    size_t _lineLen;
+};
+
+#endif
@@ -0,0 +1,12 @@
+#ifndef __H_CONSOLELISTENER__
+#define __H_CONSOLELISTENER__
+
+class Console;
+
+class ConsoleListener
+{
+public:
+    virtual void lineReceived(Console *source, const char *line) = 0;
+};
+
+#endif
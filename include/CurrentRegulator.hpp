@@ -0,0 +1,40 @@
+#ifndef __H_CURRENTREGULATOR__
+#define __H_CURRENTREGULATOR__
+
+#include <stdint.h>
+
+// Fixed-point PI controller that trims the open-loop current command
+// so the measured load current tracks the setpoint. Called once per
+// control period; the integral gain is therefore per period.
+class CurrentRegulator
+{
+public:
+    CurrentRegulator();
+
+    void setGains(int32_t kp_q16, int32_t ki_q16);
+    void setLimits(int32_t maxCommand_uA, int32_t maxTrim_uA);
+    void reset();
+
+    int32_t update(int32_t setpoint_uA, int32_t measured_uA);
+
+    int32_t kp_q16();
+    int32_t ki_q16();
+    int32_t integral_uA();
+    int32_t lastError_uA();
+
+public:
+    static const int32_t g_defaultKp_q16;
+    static const int32_t g_defaultKi_q16;
+    static const int32_t g_defaultMaxTrim_uA;
+
+private:
+    int32_t _kp_q16;
+    int32_t _ki_q16;
+    int32_t _maxCommand_uA;
+    int32_t _maxTrim_uA;
+
+    int32_t _integral_uA;
+    int32_t _lastError_uA;
+};
+
+#endif
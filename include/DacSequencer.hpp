@@ -0,0 +1,108 @@
+#ifndef __H_DACSEQUENCER__
+#define __H_DACSEQUENCER__
+
+#include <Arduino.h>
+#include <esp_timer.h>
+#include "mcp4726.hpp"
+
+// Plays a table of pre-encoded DAC frames, each held for its dwell
+// time. Steps are timed by a one-shot esp_timer against absolute
+// deadlines and written from a high-priority task, so the table is
+// only read, never computed, while playing.
+class DacSequencer
+{
+public:
+    struct Step
+    {
+        MCP4726::Frame frame;
+        uint16_t dwell_10us;
+    };
+
+public:
+    DacSequencer(MCP4726 *dac);
+
+    bool init();
+
+    void stepperTask();
+
+    // The table must stay untouched until stop() returns or
+    // running() goes false
+    void play(const Step *steps, size_t count, bool loop);
+    void stop();
+    bool running();
+
+    void resetStats();
+    uint32_t stepsPlayed();
+    uint32_t writesIssued();
+    uint32_t failedWrites();
+    uint32_t missedSteps();
+    uint32_t meanLate_us();
+    uint32_t maxLate_us();
+    uint32_t elapsed_us();
+
+public:
+    static size_t fill(Step *steps,
+                       size_t maxSteps,
+                       const MCP4726::Frame &frame,
+                       uint32_t dwell_us);
+
+public:
+    static const uint32_t g_dwellUnit_us = 10;
+    static const uint32_t g_maxStepDwell_us = 0xffff * g_dwellUnit_us;
+
+private:
+    static void g_timerExpired(void *arg);
+
+    void _command(const Step *steps, size_t count, bool loop);
+    void _applyCommand();
+    void _playStep();
+    void _arm(int32_t wait_us);
+
+private:
+    static const UBaseType_t g_taskPriority;
+    static const uint32_t g_stepBit;
+    static const uint32_t g_commandBit;
+    static const uint32_t g_startDelay_us;
+    static const int32_t g_minWait_us;
+    static const int32_t g_timerSlack_us;
+
+private:
+    MCP4726 *_dac;
+
+    TaskHandle_t _stepperTaskHandle;
+
+    esp_timer_handle_t _timer;
+    esp_timer_create_args_t _timerArgs;
+
+    SemaphoreHandle_t _mutex;
+
+    // Requested by play()/stop(), applied by the stepper task
+    const Step *_newSteps;
+    size_t _newCount;
+    bool _newLoop;
+    volatile uint32_t _commandSeq;
+    volatile uint32_t _appliedSeq;
+
+    // Owned by the stepper task
+    const Step *_steps;
+    size_t _count;
+    bool _loop;
+    size_t _index;
+    uint32_t _deadline_us;
+    bool _frameWritten;
+    MCP4726::Frame _lastFrame;
+
+    volatile bool _running;
+
+    volatile uint32_t _stepsPlayed;
+    volatile uint32_t _writesIssued;
+    volatile uint32_t _failedWrites;
+    volatile uint32_t _missedSteps;
+    volatile uint32_t _maxLate_us;
+    volatile uint32_t _firstStep_us;
+    volatile uint32_t _lastStep_us;
+    uint64_t _lateSum_us;
+    volatile uint32_t _lateCount;
+};
+
+#endif
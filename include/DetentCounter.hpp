@@ -0,0 +1,31 @@
+#ifndef __H_DETENTCOUNTER__
+#define __H_DETENTCOUNTER__
+
+#include <stdint.h>
+
+// Turns readings of a free-running pulse counter into whole detents.
+// The counter goes back to zero on reaching +/-limit, so a reading
+// only holds the position modulo the limit, and the difference from
+// the last reading is taken the same way; that is right as long as
+// fewer than half the limit's counts pass between readings.
+class DetentCounter
+{
+public:
+    DetentCounter(int countsPerDetent, int limit);
+
+    void reset(int reading);
+
+    // Whole detents moved since the last reading; counts short of a
+    // detent carry over to the next reading
+    int update(int reading);
+
+    int residual();
+
+private:
+    int _countsPerDetent;
+    int _limit;
+    int _last;
+    int _residual;
+};
+
+#endif
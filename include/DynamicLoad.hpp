@@ -0,0 +1,47 @@
+#ifndef __H_DYNAMICLOAD__
+#define __H_DYNAMICLOAD__
+
+#include <stdint.h>
+#include "DacSequencer.hpp"
+#include "Calibration.hpp"
+
+// Square-wave transient load between two currents, played by
+// a DacSequencer from a looping table compiled at start
+class DynamicLoad
+{
+public:
+    struct Config
+    {
+        int32_t high_uA;
+        int32_t low_uA;
+        int32_t frequency_Hz;
+        int32_t duty_pct;
+    };
+
+public:
+    DynamicLoad(DacSequencer *sequencer);
+
+    bool start(const Config &config, const Calibration &calibration);
+    void stop();
+    bool running();
+
+    uint32_t period_us();
+
+public:
+    static MCP4726::Frame encodeCurrent(int32_t current_uA, const Calibration &calibration);
+
+public:
+    static const int32_t g_maxFrequency_Hz;
+    static const uint32_t g_minDwell_us;
+
+private:
+    static const size_t g_maxSteps = 4;
+
+private:
+    DacSequencer *_sequencer;
+    DacSequencer::Step _steps[g_maxSteps];
+    uint32_t _period_us;
+    bool _started;
+};
+
+#endif
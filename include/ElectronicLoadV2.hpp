@@ -1,13 +1,31 @@
 #ifndef __H_ELECTRONICLOADV2__
 #define __H_ELECTRONICLOADV2__
 
+#include "InstrumentedMutex.hpp"
 #include "RotaryEncoder.hpp"
 #include "mcp4726.hpp"
 #include "max11645.hpp"
+#include "SampleBuffer.hpp"
+#include "Sampler.hpp"
+#include "Measurement.hpp"
+#include "Calibration.hpp"
+#include "Statistics.hpp"
+#include "Trace.hpp"
+#include "CurrentRegulator.hpp"
+#include "ModeEngine.hpp"
+#include "DacSequencer.hpp"
+#include "DynamicLoad.hpp"
+#include "ListMode.hpp"
+#include "BatteryTest.hpp"
+#include "SettingsStore.hpp"
+#include "Telemetry.hpp"
+#include "Console.hpp"
+#include "ConsoleListener.hpp"
 #include "TextUI.hpp"
 #include "TextUIListener.hpp"
 
-class ElectronicLoadV2 : public TextUIListener
+class ElectronicLoadV2 : public TextUIListener,
+                         public ConsoleListener
 {
 public:
     ElectronicLoadV2();
@@ -15,14 +33,88 @@ public:
     bool start();
 
     void mainTask();
+    void controlTask();
 
-    virtual void desiredCurrentChanged(TextUI *source, double desiredCurrent);
+    virtual void modeChanged(TextUI *source, ModeEngine::Mode mode);
+    virtual void setpointChanged(TextUI *source, ModeEngine::Mode mode, int32_t setpoint);
+    virtual void dynamicChanged(TextUI *source, const DynamicLoad::Config &config);
     virtual void enabledChanged(TextUI *source, bool isEnabled);
+    virtual void graphChanged(TextUI *source, bool visible, Statistics::Quantity quantity);
+
+    virtual void lineReceived(Console *source, const char *line);
 
 private:
-    bool _readADC();
-    void _updateSettings(double newDesiredCurrent,
-                         bool newIsEnabled);
+    struct Settings
+    {
+        ModeEngine::Mode mode;
+        int32_t setpoints[ModeEngine::MODE_COUNT];
+        DynamicLoad::Config dynamic;
+        bool isEnabled;
+    };
+
+    // An encoder edit on its way from the knob to the DAC, timed
+    // from the first encoder edge behind it
+    struct KnobEvent
+    {
+        uint32_t edge_us;
+        uint32_t edit_us;
+        uint32_t applied_us;
+    };
+
+    // Loop gains set from the console, for the control task to
+    // apply between passes
+    struct Gains
+    {
+        int32_t kp_q16;
+        int32_t ki_q16;
+        int32_t voltageKp_q16;
+        int32_t voltageKi_q16;
+    };
+
+    struct KnobLatency
+    {
+        uint32_t count;
+        uint32_t overTarget;
+        uint32_t last_us;
+        uint32_t max_us;
+        uint64_t sum_us;
+        KnobEvent lastEvent;
+    };
+
+private:
+    void _drainSamples();
+    bool _updateReadings();
+    void _reportSamplerStats();
+    void _updateSettings(const Settings &newSettings, const KnobEvent *knobEvent = 0);
+    void _noteKnobEvent(TextUI *source);
+    void _recordKnobLatency(const KnobEvent &knobEvent, uint32_t dac_us);
+    void _wakeMainTask();
+    void _updateSequencer(bool dynamicChanged);
+    void _checkListFinished();
+    void _checkBatteryTest();
+    void _updateGraph(bool visible, Statistics::Quantity quantity, uint32_t column_us);
+    void _initDac();
+    void _loadStoredSettings();
+    void _stageSettings();
+    void _runCommand(char *line);
+    void _calibrationCommand(int argc, char **argv);
+    void _telemetryCommand(int argc, char **argv);
+    void _loopCommand(int argc, char **argv);
+    void _modeCommand(int argc, char **argv);
+    void _dynamicCommand(int argc, char **argv);
+    void _listCommand(int argc, char **argv);
+    void _batteryCommand(int argc, char **argv);
+    void _printBatteryTest();
+    void _adcCommand(int argc, char **argv);
+    bool _voltageNeeded();
+    void _storeCommand(int argc, char **argv);
+    void _graphCommand(int argc, char **argv);
+    void _knobCommand(int argc, char **argv);
+    void _locksCommand(int argc, char **argv);
+    void _logCommand(int argc, char **argv);
+    void _printHistogram(const char *label, const uint32_t *buckets);
+    void _printList();
+    void _printCalibration();
 
 private:
     static const int g_aPin;
@@ -30,26 +122,97 @@ private:
     static const int g_zPin;
     static const uint8_t g_screenI2cAddr;
     static const int g_encoderDetentsPerRev;
+    static const TickType_t g_mainTaskPeriod_ticks;
+    static const unsigned long g_readingsInterval_ms;
+    static const unsigned long g_samplerStatsInterval_ms;
+    static const size_t g_drainChunkSamples = 32;
+    static const size_t g_calCaptureSamples = 64;
+    static const TickType_t g_controlPeriod_ticks;
+    static const UBaseType_t g_controlTaskPriority;
+    static const uint32_t g_controlMaxSampleAge_us;
+    static const int g_eepromWritePolls;
+    static const unsigned long g_eepromWritePoll_ms;
+    static const uint32_t g_defaultGraphColumn_us;
+    static const uint32_t g_knobLatencyTarget_us;
 
 private:
     MCP4726 _mcp4726;
     MAX11645 _max11645;
-    uint16_t _data[2];
+    SampleBuffer _samples;
+    Sampler _sampler;
+    uint32_t _lastSamplesTaken;
+    uint32_t _lastSamplesSent;
+    uint32_t _lastModeUpdates;
+    unsigned long _lastSamplerStats_ms;
+
+    SampleBuffer::Reader _statsReader;
+    Statistics _statistics;
+    unsigned long _lastReadings_ms;
+
+    Trace _trace;
+    bool _graphVisible;
+
+    Telemetry _telemetry;
+
+    DacSequencer _dacSequencer;
+    DynamicLoad _dynamicLoad;
+    ListMode _listMode;
+    bool _listLoop;
+
+    BatteryTest _batteryTest;
+
+    SettingsStore _settingsStore;
+    uint32_t _storedCalibrationVersion;
+
+    Calibration _calibration;
+    volatile uint32_t _calibrationVersion;
+
+    CurrentRegulator _regulator;
+    ModeEngine _modeEngine;
+    SampleBuffer::Reader _controlReader;
+    Calibration _controlCalibration;
+    TaskHandle_t _controlTaskHandle;
+    volatile ModeEngine::Mode _controlMode;
+    volatile int32_t _controlSetpoint;
+    volatile bool _controlEnabled;
+    Gains _gains;
+    volatile uint32_t _gainsVersion;
+    volatile bool _closedLoop;
+    volatile int32_t _dacCommand_uA;
+    // The command after DAC calibration, what the DAC was asked for
+    volatile int32_t _dacApplied_uA;
+    volatile uint32_t _controlMaxPeriod_us;
+    volatile uint32_t _controlOverruns;
+    volatile int32_t _modeTarget_uA;
+    volatile uint32_t _modeUpdates;
+    KnobEvent _controlKnobEvent;
+    volatile bool _controlKnobEventPending;
+    KnobLatency _knobLatency;
+    volatile bool _knobLatencyReset;
+
+    Console _console;
 
     TextUI _textUI;
 
     RotaryEncoder _encoder;
 
-    SemaphoreHandle_t _mutex;
+    InstrumentedMutex _mutex;
 
     TaskHandle_t _mainTaskHandle;
 
-    double _desiredCurrent;
-    bool _isEnabled;
+    Settings _settings;
 
     bool _settingsChanged;
-    double _newDesiredCurrent;
-    bool _newIsEnabled;
+    Settings _newSettings;
+    bool _newKnobEventValid;
+    KnobEvent _newKnobEvent;
+
+    bool _graphChanged;
+    bool _newGraphVisible;
+    Statistics::Quantity _newGraphQuantity;
+
+    bool _commandPending;
+    char _pendingCommand[Console::g_maxLineLen];
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,42 @@
+#ifndef __H_ENCODERPCNT__
+#define __H_ENCODERPCNT__
+
+#include <stdint.h>
+#include <driver/pcnt.h>
+#include "DetentCounter.hpp"
+
+// The pulse counter side of RotaryEncoder's PCNT backend, kept apart
+// so the same setup and reads can be driven against a model of the
+// counter on the host. A clocks the count unit and B sets its
+// direction; the count unit runs free and is never cleared, so no
+// edge is lost between reading and clearing it. A second unit counts
+// any edge of A and only interrupts on the first one after a take().
+class EncoderPcnt
+{
+public:
+    // Inverted when A leads B turning up
+    EncoderPcnt(int aPin, int bPin, bool invert);
+
+    // Sets up and starts both units, with handler called from the
+    // wake unit's interrupt
+    bool begin(void (*handler)(void *), void *arg);
+
+    // Rearms the wake-up and returns the whole detents turned since
+    // the last take, up positive
+    int take();
+
+public:
+    static const pcnt_unit_t g_countUnit;
+    static const pcnt_unit_t g_wakeUnit;
+    static const uint16_t g_filter;
+    static const int16_t g_limit;
+    static const int g_countsPerDetent;
+
+private:
+    int _aPin;
+    int _bPin;
+    bool _invert;
+    DetentCounter _detentCounter;
+};
+
+#endif
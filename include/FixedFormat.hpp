@@ -0,0 +1,121 @@
+#ifndef __H_FIXEDFORMAT__
+#define __H_FIXEDFORMAT__
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Formats fixed-point integers as text without printf, allocation
+// or floating point. Fields are right aligned to a fixed width so
+// that redrawing one never leaves stale characters behind.
+class FixedFormat
+{
+public:
+    enum Padding
+    {
+        PAD_SPACE,
+        PAD_ZERO
+    };
+
+public:
+    // Writes value, a count of 10^-fracDigits, as intDigits.fracDigits
+    // and a terminator. A field that doesn't fit is filled with '#'.
+    // Returns the field width.
+    static size_t format(char *buf, int32_t value,
+                         int intDigits, int fracDigits,
+                         Padding padding = PAD_SPACE);
+
+    // As above from a count of 1/scale, rounded half away from zero
+    static size_t formatScaled(char *buf, int32_t value, int32_t scale,
+                               int intDigits, int fracDigits,
+                               Padding padding = PAD_SPACE);
+
+    // Appends text and returns the new end of buf
+    static char *append(char *buf, const char *text);
+
+    static constexpr size_t width(int intDigits, int fracDigits)
+    {
+        return size_t(intDigits) + (fracDigits > 0 ? size_t(fracDigits) + 1 : 0);
+    }
+
+    static constexpr int32_t pow10(int n)
+    {
+        return n <= 0 ? 1 : 10 * pow10(n - 1);
+    }
+};
+
+// A field with its width and precision fixed at compile time. Values
+// are counts of 1/Scale, micro-units by default.
+template <int IntDigits, int FracDigits,
+          int32_t Scale = 1000000,
+          FixedFormat::Padding Pad = FixedFormat::PAD_SPACE>
+class Fixed
+{
+public:
+    // Below one whole unit a milli field, with at least the
+    // same resolution, takes over
+    static const int g_milliFracDigits = FracDigits > 3 ? FracDigits - 3 : 0;
+    static const size_t g_width = FixedFormat::width(IntDigits, FracDigits);
+    static const size_t g_milliWidth = FixedFormat::width(3, g_milliFracDigits);
+    static const size_t g_numberWidth = g_width > g_milliWidth ? g_width : g_milliWidth;
+
+    // Buffer sizes, terminator included; engineering adds a space,
+    // the prefix or a pad, and the unit
+    static const size_t g_size = g_width + 1;
+    static const size_t g_engineeringSize = g_numberWidth + 2 + 1;
+
+    static size_t format(char *buf, int32_t value)
+    {
+        return FixedFormat::formatScaled(buf, value, Scale, IntDigits, FracDigits, Pad);
+    }
+
+    // Auto-ranges between milli and whole units, keeping the width
+    // the same either way, e.g. "12.345 V " and "   999 mV"; buf
+    // needs g_engineeringSize plus the length of unit
+    static size_t engineering(char *buf, int32_t value, const char *unit)
+    {
+        char number[g_numberWidth + 1];
+        const char *prefix = " ";
+        size_t len = FixedFormat::formatScaled(number, value, Scale / 1000,
+                                               3, g_milliFracDigits, Pad);
+        if (number[0] == '#')
+        {
+            len = format(number, value);
+            prefix = "";
+        }
+        else
+        {
+            prefix = "m";
+        }
+
+        char *p = buf;
+        for (size_t i = len; i < g_numberWidth; i++)
+        {
+            *p++ = ' ';
+        }
+        p = FixedFormat::append(p, number);
+        p = FixedFormat::append(p, " ");
+        p = FixedFormat::append(p, prefix);
+        p = FixedFormat::append(p, unit);
+        if (*prefix == '\0')
+        {
+            p = FixedFormat::append(p, " ");
+        }
+
+        return p - buf;
+    }
+};
+
+template <int IntDigits, int FracDigits, int32_t Scale, FixedFormat::Padding Pad>
+const int Fixed<IntDigits, FracDigits, Scale, Pad>::g_milliFracDigits;
+template <int IntDigits, int FracDigits, int32_t Scale, FixedFormat::Padding Pad>
+const size_t Fixed<IntDigits, FracDigits, Scale, Pad>::g_width;
+template <int IntDigits, int FracDigits, int32_t Scale, FixedFormat::Padding Pad>
+const size_t Fixed<IntDigits, FracDigits, Scale, Pad>::g_milliWidth;
+template <int IntDigits, int FracDigits, int32_t Scale, FixedFormat::Padding Pad>
+const size_t Fixed<IntDigits, FracDigits, Scale, Pad>::g_numberWidth;
+template <int IntDigits, int FracDigits, int32_t Scale, FixedFormat::Padding Pad>
+const size_t Fixed<IntDigits, FracDigits, Scale, Pad>::g_size;
+template <int IntDigits, int FracDigits, int32_t Scale, FixedFormat::Padding Pad>
+const size_t Fixed<IntDigits, FracDigits, Scale, Pad>::g_engineeringSize;
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef __H_INSTRUMENTEDMUTEX__
+#define __H_INSTRUMENTEDMUTEX__
+
+#include <Arduino.h>
+
+// Build with -DLOCK_STATS=0 to reduce take() and give() to the
+// bare semaphore calls
+#ifndef LOCK_STATS
+#define LOCK_STATS 1
+#endif
+
+// A FreeRTOS mutex that keeps log2 histograms of how long each task
+// waited for it and then held it. Every instance is linked into a
+// list so that they can all be dumped from the console.
+class InstrumentedMutex
+{
+public:
+    // Bucket 0 counts times under 1 us, bucket n (n > 0) times from
+    // 2^(n-1) to 2^n - 1 us and the last bucket everything longer
+    static const int g_bucketCount = 18;
+    static const int g_maxTasks = 6;
+
+    struct TaskStats
+    {
+        char taskName[configMAX_TASK_NAME_LEN];
+        uint32_t count;
+        uint32_t maxWait_us;
+        uint32_t maxHold_us;
+        uint32_t wait[g_bucketCount];
+        uint32_t hold[g_bucketCount];
+    };
+
+public:
+    InstrumentedMutex(const char *name);
+
+    void take();
+    void give();
+
+    const char *name();
+
+    // Copies the stats of one task slot, false once past the used slots
+    bool taskStats(int slot, TaskStats *stats);
+    // Takes by tasks that came after every slot was used, and so
+    // aren't in any of them
+    uint32_t overflowTakes();
+    void resetStats();
+
+    InstrumentedMutex *next();
+
+    static InstrumentedMutex *first();
+    static uint32_t bucketFloor_us(int bucket);
+
+private:
+    InstrumentedMutex(const InstrumentedMutex &);
+    InstrumentedMutex &operator=(const InstrumentedMutex &);
+
+#if LOCK_STATS
+    int _taskSlot();
+    static int _bucket(uint32_t time_us);
+#endif
+
+private:
+    const char *_name;
+    SemaphoreHandle_t _mutex;
+    InstrumentedMutex *_next;
+
+#if LOCK_STATS
+    // Only written by whoever holds the mutex; the extra slot at
+    // the end collects any tasks that didn't get one of their own
+    TaskStats _tasks[g_maxTasks + 1];
+    TaskHandle_t _taskHandles[g_maxTasks];
+    int _taskCount;
+    int _holderSlot;
+    uint32_t _taken_us;
+    volatile bool _reset;
+#endif
+
+private:
+    static InstrumentedMutex *g_first;
+};
+
+#endif
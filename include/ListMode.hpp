@@ -0,0 +1,89 @@
+#ifndef __H_LISTMODE__
+#define __H_LISTMODE__
+
+#include <stdint.h>
+#include "DacSequencer.hpp"
+#include "Calibration.hpp"
+
+// User-defined current profiles. A profile is either a generated
+// ramp or staircase, or a list of uploaded points; compile() turns
+// it into a packed DacSequencer table so playback does no math.
+class ListMode
+{
+public:
+    enum Shape
+    {
+        SHAPE_POINTS,
+        SHAPE_RAMP,
+        SHAPE_STAIRCASE
+    };
+
+    struct Point
+    {
+        int32_t current_uA;
+        uint32_t dwell_us;
+    };
+
+    struct Profile
+    {
+        Shape shape;
+        int32_t start_uA;
+        int32_t end_uA;
+        uint32_t steps;
+        uint32_t dwell_us;
+    };
+
+public:
+    ListMode(DacSequencer *sequencer);
+
+    void clear();
+    bool addPoint(int32_t current_uA, uint32_t dwell_us);
+    bool setRamp(int32_t start_uA, int32_t end_uA, uint32_t steps, uint32_t dwell_us);
+    bool setStaircase(int32_t start_uA, int32_t step_uA, uint32_t steps, uint32_t dwell_us);
+
+    const Profile &profile();
+    size_t pointCount();
+
+    bool compile(const Calibration &calibration);
+    size_t tableSize();
+    uint64_t tableDuration_us();
+
+    bool start(bool loop);
+    void stop();
+    bool running();
+    bool finished();
+
+    bool save();
+    bool load();
+
+public:
+    static const char *shapeName(Shape shape);
+
+public:
+    static const size_t g_maxPoints = 512;
+    static const size_t g_maxTableSteps = 4096;
+    static const uint32_t g_minDwell_us;
+
+private:
+    bool _append(int32_t current_uA, uint32_t dwell_us, const Calibration &calibration);
+
+    static bool _profileValid(const Profile &profile, size_t pointCount);
+
+private:
+    static const char *g_prefsNamespace;
+
+private:
+    DacSequencer *_sequencer;
+
+    Profile _profile;
+    Point _points[g_maxPoints];
+    size_t _pointCount;
+
+    DacSequencer::Step _table[g_maxTableSteps];
+    size_t _tableSize;
+    uint64_t _tableDuration_us;
+    bool _compiled;
+    bool _started;
+};
+
+#endif
@@ -0,0 +1,150 @@
+#ifndef __H_LOG__
+#define __H_LOG__
+
+#include <Arduino.h>
+#include <atomic>
+
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_INFO 3
+#define LOG_LEVEL_DEBUG 4
+
+// Set with -DLOG_LEVEL=... in build_flags; anything above it
+// compiles to nothing, arguments included
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_ERROR(...) Log::getInstance()->write(Log::LL_ERROR, __VA_ARGS__)
+#else
+#define LOG_ERROR(...) \
+    do                 \
+    {                  \
+    } while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_WARN
+#define LOG_WARN(...) Log::getInstance()->write(Log::LL_WARN, __VA_ARGS__)
+#else
+#define LOG_WARN(...) \
+    do                \
+    {                 \
+    } while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_INFO(...) Log::getInstance()->write(Log::LL_INFO, __VA_ARGS__)
+#else
+#define LOG_INFO(...) \
+    do                \
+    {                 \
+    } while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(...) Log::getInstance()->write(Log::LL_DEBUG, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) \
+    do                 \
+    {                  \
+    } while (0)
+#endif
+
+// Deferred-format logger. A call site only copies the format string
+// pointer and up to eight 32-bit arguments into a lock-free queue;
+// the low-priority log task does the formatting and the UART writes.
+// Format strings and %s arguments must therefore be string literals
+// or otherwise outlive the call. Floating point arguments are
+// rejected at compile time.
+class Log
+{
+public:
+    enum Level
+    {
+        LL_ERROR = LOG_LEVEL_ERROR,
+        LL_WARN = LOG_LEVEL_WARN,
+        LL_INFO = LOG_LEVEL_INFO,
+        LL_DEBUG = LOG_LEVEL_DEBUG
+    };
+
+public:
+    static Log *getInstance();
+
+    bool start();
+
+    void logTask();
+
+    template <typename... Args>
+    void write(Level level, const char *fmt, Args... args)
+    {
+        static_assert(sizeof...(Args) <= g_maxArgs, "too many log arguments");
+
+        uint32_t start = ESP.getCycleCount();
+
+        const uint32_t packed[] = {0, _pack(args)...};
+        _push(level, fmt, packed + 1, sizeof...(Args));
+
+        uint32_t cycles = ESP.getCycleCount() - start;
+        if (cycles > _maxWriteCycles)
+        {
+            _maxWriteCycles = cycles;
+        }
+    }
+
+    uint32_t written();
+    uint32_t dropped();
+    uint32_t maxWriteCycles();
+
+public:
+    static const size_t g_maxArgs = 8;
+
+private:
+    struct Entry
+    {
+        std::atomic<uint32_t> seq;
+        const char *fmt;
+        uint32_t timestamp_ms;
+        uint8_t level;
+        uint8_t argc;
+        uint32_t args[g_maxArgs];
+    };
+
+private:
+    Log();
+
+    void _push(Level level, const char *fmt, const uint32_t *args, size_t argc);
+    bool _pop(Entry *out);
+    void _print(const Entry &entry);
+
+    static uint32_t _pack(int value) { return uint32_t(value); }
+    static uint32_t _pack(unsigned int value) { return uint32_t(value); }
+    static uint32_t _pack(long value) { return uint32_t(value); }
+    static uint32_t _pack(unsigned long value) { return uint32_t(value); }
+    static uint32_t _pack(const char *value) { return uint32_t(uintptr_t(value)); }
+    static uint32_t _pack(const void *value) { return uint32_t(uintptr_t(value)); }
+    static uint32_t _pack(double value) = delete;
+
+private:
+    static const size_t g_capacity = 64;
+
+private:
+    Entry _entries[g_capacity];
+    std::atomic<uint32_t> _enqueuePos;
+    std::atomic<uint32_t> _dequeuePos;
+
+    std::atomic<uint32_t> _written;
+    std::atomic<uint32_t> _dropped;
+    volatile uint32_t _maxWriteCycles;
+
+    TaskHandle_t _logTaskHandle;
+
+private:
+    // Constructed before setup() runs and any task exists, so
+    // getInstance() is safe from any task or ISR. Other static
+    // constructors mustn't log, they may run before this one.
+    static Log g_instance;
+};
+
+#endif
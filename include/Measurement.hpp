@@ -0,0 +1,68 @@
+#ifndef __H_MEASUREMENT__
+#define __H_MEASUREMENT__
+
+#include <stdint.h>
+
+static constexpr int64_t measurementGcd(int64_t a, int64_t b)
+{
+    return b == 0 ? a : measurementGcd(b, a % b);
+}
+
+// Integer conversions between MAX11645/MCP4726 codes and micro-units.
+// The scale factors are reduced from the analog front end constants
+// at compile time so the hot path is one multiply and one divide.
+class Measurement
+{
+public:
+    static int32_t countsToMicroVolts(uint16_t counts);
+    static int32_t countsToMicroAmps(uint16_t counts);
+    static uint16_t microAmpsToDacCode(int32_t current_uA);
+
+public:
+    // Both converters use the same 2.048V reference / 4096 codes
+    static const int64_t g_lsb_uV = 500;
+    static const int64_t g_voltageDivider = 15;
+    static const int64_t g_senseGain = 67;
+    static const int64_t g_shunt_uOhm = 10000;
+    static const uint16_t g_maxCode = 4095;
+
+private:
+    // uA = counts * lsb_uV / gain / shunt_Ohm
+    //    = counts * (lsb_uV * 1000000) / (gain * shunt_uOhm)
+    static const int64_t g_currentNumFull = g_lsb_uV * 1000000;
+    static const int64_t g_currentDenFull = g_senseGain * g_shunt_uOhm;
+    static const int64_t g_currentGcd = measurementGcd(g_currentNumFull, g_currentDenFull);
+
+public:
+    static const uint32_t g_voltagePerCount_uV = uint32_t(g_lsb_uV * g_voltageDivider);
+    static const uint32_t g_currentNum = uint32_t(g_currentNumFull / g_currentGcd);
+    static const uint32_t g_currentDen = uint32_t(g_currentDenFull / g_currentGcd);
+};
+
+static_assert(uint64_t(Measurement::g_maxCode) * Measurement::g_currentNum < (uint64_t(1) << 31),
+              "ADC current scale overflows 32 bits");
+
+inline int32_t Measurement::countsToMicroVolts(uint16_t counts)
+{
+    return int32_t(uint32_t(counts) * g_voltagePerCount_uV);
+}
+
+inline int32_t Measurement::countsToMicroAmps(uint16_t counts)
+{
+    return int32_t(((uint32_t(counts) * g_currentNum) + (g_currentDen / 2)) / g_currentDen);
+}
+
+inline uint16_t Measurement::microAmpsToDacCode(int32_t current_uA)
+{
+    if (current_uA <= 0)
+    {
+        return 0;
+    }
+
+    // In 64 bits so any current saturates rather than wrapping
+    uint64_t code = ((uint64_t(current_uA) * g_currentDen) + (g_currentNum / 2)) / g_currentNum;
+
+    return code > g_maxCode ? g_maxCode : uint16_t(code);
+}
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef __H_MODEENGINE__
+#define __H_MODEENGINE__
+
+#include <stdint.h>
+
+// Turns the operating mode and its setpoint into a current target,
+// recomputed from the latest voltage every control period. Setpoint
+// units are uA (CC), uV (CV), milliohm (CR) and uW (CP). In the
+// dynamic and list modes a DacSequencer drives the DAC and the
+// target is zero.
+class ModeEngine
+{
+public:
+    enum Mode
+    {
+        MODE_CC,
+        MODE_CV,
+        MODE_CR,
+        MODE_CP,
+        MODE_DYNAMIC,
+        MODE_LIST,
+        MODE_COUNT
+    };
+
+public:
+    ModeEngine();
+
+    void setMode(Mode mode);
+    Mode mode();
+
+    void setSetpoint(int32_t setpoint);
+    int32_t setpoint();
+
+    void setVoltageGains(int32_t kp_q16, int32_t ki_q16);
+    int32_t voltageKp_q16();
+    int32_t voltageKi_q16();
+
+    void setMaxCurrent(int32_t maxCurrent_uA);
+
+    void reset();
+
+    int32_t update(int32_t voltage_uV);
+
+public:
+    static const char *modeName(Mode mode);
+    static bool modeFromName(const char *name, Mode *mode);
+
+public:
+    static const int32_t g_defaultVoltageKp_q16;
+    static const int32_t g_defaultVoltageKi_q16;
+    static const int32_t g_minVoltage_uV;
+
+private:
+    int32_t _clamp(int64_t current_uA);
+
+private:
+    Mode _mode;
+    int32_t _setpoint;
+    int32_t _maxCurrent_uA;
+
+    int32_t _voltageKp_q16;
+    int32_t _voltageKi_q16;
+    int32_t _voltageIntegral_uA;
+};
+
+#endif
@@ -0,0 +1,109 @@
+#ifndef __H_PAGEFRAME__
+#define __H_PAGEFRAME__
+
+#include <stdlib.h>
+#include <stdint.h>
+
+// A monochrome frame laid out like SSD1306 display RAM: pages of 8
+// pixel rows, one byte per column of a page. Drawing into the back
+// buffer widens a column window on each page it touches; present()
+// copies only those windows to the front buffer and flush() sends
+// them. Kept free of hardware, and of locking, which is up to the
+// owner, so the bus cost of a frame can be tested on the host.
+class PageFrame
+{
+public:
+    // Sends one transaction to the display: the control byte, then
+    // len bytes of commands or data
+    typedef bool (*Writer)(void *context, uint8_t control, const uint8_t *bytes, size_t len);
+
+    enum GlyphStyle
+    {
+        GS_NORMAL,
+        GS_INVERTED,
+        GS_COUNT
+    };
+
+public:
+    PageFrame(int width, int height);
+    ~PageFrame();
+
+    // Draws into back, which must hold width * height / 8 bytes
+    bool begin(uint8_t *back);
+
+    uint8_t *buffer();
+    int width();
+    int pages();
+
+    void clear();
+    void markDirty(int pixX, int pixY, int pixWidth, int pixHeight);
+
+    // Draws 6x8 text from character cell (col, row); rows line up
+    // with the pages, so each character is one copy of whole bytes
+    void drawText(int col, int row, const char *text, size_t len,
+                  GlyphStyle style = GS_NORMAL);
+
+    // For a trace across a band of pages: shift the band left by count
+    // columns, set one column's pixel rows top to bottom, counted from
+    // the band's top, and clear the rest of it, or clear the band
+    void scrollLeft(int pageLo, int pageCount, int count);
+    void drawColumn(int x, int pageLo, int pageCount, int top, int bottom);
+    void clearPages(int pageLo, int pageCount);
+
+    // True if anything was drawn since the last call
+    bool takeDrawn();
+
+    // Copies what was drawn to the front buffer; the flush must not
+    // be running
+    void present();
+
+    // Sends each page window of the front buffer as a page/column
+    // address command followed by the data, in short transactions
+    // that let go of the bus in between. A window that fails to go
+    // out stays marked for the next flush.
+    bool flush(Writer writer, void *context);
+
+    // Bus bytes of the last flush, control bytes included, in all
+    // and for one page
+    uint32_t lastFlushBytes();
+    uint32_t lastPageBytes(int page);
+
+public:
+    static const int g_glyphFirst = 0x20;
+    static const int g_glyphCount = 95;
+    static const int g_glyphWidth = 6;
+    static const uint8_t g_font[g_glyphCount][g_glyphWidth - 1];
+    static const size_t g_chunkBytes;
+    static const uint8_t g_commands;
+    static const uint8_t g_data;
+    static const uint8_t g_columnAddr;
+    static const uint8_t g_pageAddr;
+
+private:
+    // Span of pixel columns of one page, -1 when there is none
+    struct Window
+    {
+        Window();
+
+        int colLo;
+        int colHi;
+    };
+
+private:
+    PageFrame(const PageFrame &);
+    PageFrame &operator=(const PageFrame &);
+
+private:
+    int _width;
+    int _pages;
+    uint8_t *_back;
+    uint8_t *_front;
+    Window *_backWindows;
+    Window *_frontWindows;
+    uint32_t *_pageBytes;
+    uint32_t _lastFlushBytes;
+    bool _drawn;
+    uint8_t _glyphs[GS_COUNT][g_glyphCount][g_glyphWidth];
+};
+
+#endif
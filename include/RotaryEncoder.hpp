@@ -5,6 +5,17 @@
 #include <esp_timer.h>
 #include "RotaryEncoderListener.hpp"
 
+// Build with -DENCODER_BACKEND_PCNT to count the knob with the pulse
+// counter and its glitch filter instead of decoding it in software
+// from pin interrupts
+#ifndef ENCODER_BACKEND_PCNT
+#define ENCODER_BACKEND_PCNT 0
+#endif
+
+#if ENCODER_BACKEND_PCNT
+#include "EncoderPcnt.hpp"
+#endif
+
 class RotaryEncoder
 {
 public:
@@ -17,15 +28,43 @@ public:
 
     void eventTask();
 
+    // When the first edge behind the turn being reported happened;
+    // only meaningful inside the listener's turned()
+    uint32_t eventEdge_us();
+
+    // Times the event task has woken up
+    uint32_t wakeups();
+
+    // Work done for the encoder outside its task: entries into its
+    // interrupt handlers and its debounce timer callbacks, the CPU
+    // cycles spent in each, and the detents they added up to
+    uint32_t isrEntries();
+    uint32_t isrCycles();
+    uint32_t callbackEntries();
+    uint32_t callbackCycles();
+    uint32_t detentsCounted();
+
+    static const char *backendName();
+
 private:
-    void IRAM_ATTR _aPinHandler();
+    void _takeCounts(int *delta, int *triggers);
     void IRAM_ATTR _zPinHandler();
-    void IRAM_ATTR _aPinDebounce();
     void IRAM_ATTR _zPinDebounce();
+    void IRAM_ATTR _startEdge();
+#if ENCODER_BACKEND_PCNT
+    void IRAM_ATTR _pcntHandler();
+#else
+    void IRAM_ATTR _aPinHandler();
+    void IRAM_ATTR _aPinDebounce();
+#endif
 
 private:
-    static void IRAM_ATTR g_aPinDebounce(void *);
     static void IRAM_ATTR g_zPinDebounce(void *);
+#if ENCODER_BACKEND_PCNT
+    static void IRAM_ATTR g_pcntHandler(void *);
+#else
+    static void IRAM_ATTR g_aPinDebounce(void *);
+#endif
 
 private:
     static const int g_debounceTime_us;
@@ -40,18 +79,33 @@ private:
 
     TaskHandle_t _eventTaskHandle;
 
-    esp_timer_handle_t _aPinTimer;
     esp_timer_handle_t _zPinTimer;
+    esp_timer_create_args_t _zPinTimerArgs;
 
+#if ENCODER_BACKEND_PCNT
+    EncoderPcnt _pcnt;
+#else
+    esp_timer_handle_t _aPinTimer;
     esp_timer_create_args_t _aPinTimerArgs;
-    esp_timer_create_args_t _zPinTimerArgs;
 
     volatile bool _aPinPending;
-    volatile bool _zPinPending;
     volatile int _aPinDelta;
     volatile int _aPinTotalTriggers;
     volatile bool _bPinValue;
+#endif
+
+    volatile bool _zPinPending;
     volatile bool _zPinTriggered;
+    volatile bool _edgePending;
+    volatile uint32_t _edge_us;
+    uint32_t _eventEdge_us;
+    uint32_t _wakeups;
+
+    volatile uint32_t _isrEntries;
+    volatile uint32_t _isrCycles;
+    volatile uint32_t _callbackEntries;
+    volatile uint32_t _callbackCycles;
+    uint32_t _detentsCounted;
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,68 @@
+#ifndef __H_SAMPLEBUFFER__
+#define __H_SAMPLEBUFFER__
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <atomic>
+
+struct Sample
+{
+    uint32_t timestamp_us;
+    uint16_t ain0;
+    uint16_t ain1;
+};
+
+// Single-producer/multi-consumer ring of ADC samples. The producer
+// never waits on consumers; each consumer keeps its own Reader and
+// finds out how many samples it missed if it falls behind.
+class SampleBuffer
+{
+public:
+    class Reader
+    {
+    public:
+        Reader();
+
+        uint32_t dropped() const;
+
+    private:
+        friend class SampleBuffer;
+
+        uint32_t _next;
+        uint32_t _dropped;
+    };
+
+public:
+    SampleBuffer();
+
+    void push(const Sample &sample);
+
+    void attach(Reader *reader);
+    size_t read(Reader *reader, Sample *buf, size_t bufLen);
+    bool latest(Sample *sample);
+    size_t recent(Sample *buf, size_t count);
+
+    uint32_t totalPushed();
+
+public:
+    static const uint32_t g_capacity = 1024;
+
+private:
+    struct Slot
+    {
+        std::atomic<uint32_t> seq;
+        Sample sample;
+    };
+
+private:
+    bool _readSlot(uint32_t idx, Sample *sample);
+
+private:
+    static const uint32_t g_mask = g_capacity - 1;
+
+private:
+    Slot _slots[g_capacity];
+    std::atomic<uint32_t> _head;
+};
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef __H_SAMPLER__
+#define __H_SAMPLER__
+
+#include <Arduino.h>
+#include "max11645.hpp"
+#include "SampleBuffer.hpp"
+#include "SamplerListener.hpp"
+
+class Sampler
+{
+public:
+    // PROFILE_FAST scans AIN0..AIN1 in bursts, PROFILE_AVERAGE_8X
+    // converts each channel eight times per sample and averages the
+    // results, PROFILE_CURRENT_ONLY streams AIN1 alone (ain0 then
+    // holds the last voltage seen by another profile, so it is only
+    // for modes that regulate on current)
+    enum Profile
+    {
+        PROFILE_FAST,
+        PROFILE_AVERAGE_8X,
+        PROFILE_CURRENT_ONLY,
+        PROFILE_COUNT
+    };
+
+public:
+    Sampler(MAX11645 *adc, SampleBuffer *buffer);
+
+    bool start();
+
+    void setListener(SamplerListener *listener);
+
+    void samplerTask();
+
+    void setProfile(Profile profile);
+    Profile profile();
+
+    uint32_t samplesTaken();
+    uint32_t failedReads();
+
+public:
+    static const char *profileName(Profile profile);
+    static bool profileFromName(const char *name, Profile *profile);
+
+private:
+    bool _applyProfile(Profile profile);
+    size_t _acquireScan();
+    size_t _acquireAveraged();
+    size_t _acquireCurrentOnly();
+    void _pushFrames(const uint16_t *ain0, const uint16_t *ain1,
+                     size_t frames,
+                     uint32_t start_us, uint32_t end_us);
+
+private:
+    static const TickType_t g_period_ticks;
+    static const UBaseType_t g_taskPriority;
+    static const size_t g_framesPerBurst = 4;
+    static const size_t g_currentOnlyFramesPerBurst = 16;
+    static const size_t g_averageCount = 8;
+
+private:
+    MAX11645 *_adc;
+    SampleBuffer *_buffer;
+
+    TaskHandle_t _samplerTaskHandle;
+
+    volatile Profile _requestedProfile;
+    Profile _activeProfile;
+    bool _profileApplied;
+    uint16_t _lastAin0;
+
+    volatile uint32_t _samplesTaken;
+    volatile uint32_t _failedReads;
+
+    SamplerListener *_listener;
+};
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef __H_SAMPLERLISTENER__
+#define __H_SAMPLERLISTENER__
+
+#include <stddef.h>
+#include "SampleBuffer.hpp"
+
+class Sampler;
+
+class SamplerListener
+{
+public:
+    // Called on the sampler task right after each burst is pushed,
+    // so implementations have to be quick
+    virtual void samplesAcquired(Sampler *source, const Sample *samples, size_t count) = 0;
+};
+
+#endif
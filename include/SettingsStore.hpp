@@ -0,0 +1,71 @@
+#ifndef __H_SETTINGSSTORE__
+#define __H_SETTINGSSTORE__
+
+#include <stdlib.h>
+#include <stdint.h>
+
+// Keeps small blobs in NVS. Changes are staged in RAM and written
+// once they have been quiet for a while, and no more often than the
+// minimum interval for their slot, so turning the encoder doesn't
+// wear the flash.
+class SettingsStore
+{
+public:
+    enum Slot
+    {
+        SLOT_SETTINGS,
+        SLOT_CALIBRATION,
+        SLOT_COUNT
+    };
+
+public:
+    SettingsStore();
+
+    bool load(Slot slot, void *data, size_t len);
+    void stage(Slot slot, const void *data, size_t len);
+
+    void service(unsigned long now_ms);
+    bool flush();
+
+    bool pending();
+    uint32_t staged();
+    uint32_t written();
+    uint32_t skipped();
+    uint32_t failed();
+
+public:
+    static const unsigned long g_quietTime_ms;
+    static const unsigned long g_minWriteInterval_ms;
+
+private:
+    struct SlotState
+    {
+        uint8_t *data;
+        // What is in flash, once known
+        uint8_t *stored;
+        size_t len;
+        bool dirty;
+        bool known;
+        bool hasWritten;
+        unsigned long lastChange_ms;
+        unsigned long lastWrite_ms;
+    };
+
+private:
+    bool _reserve(Slot slot, size_t len);
+    bool _write(Slot slot);
+
+private:
+    static const char *g_prefsNamespace;
+    static const char *g_keys[SLOT_COUNT];
+
+private:
+    SlotState _slots[SLOT_COUNT];
+
+    uint32_t _staged;
+    uint32_t _written;
+    uint32_t _skipped;
+    uint32_t _failed;
+};
+
+#endif
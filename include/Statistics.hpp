@@ -0,0 +1,91 @@
+#ifndef __H_STATISTICS__
+#define __H_STATISTICS__
+
+#include <stdlib.h>
+#include <stdint.h>
+
+// Running min/max/mean/RMS/ripple of voltage, current and power over
+// a few time windows. Each window is split into buckets that are
+// rotated as samples arrive, so an update is O(1) and the window
+// slides with one bucket (a tenth of the window) of granularity.
+class Statistics
+{
+public:
+    enum Quantity
+    {
+        Q_VOLTAGE,
+        Q_CURRENT,
+        Q_POWER,
+        Q_COUNT
+    };
+
+    struct Summary
+    {
+        int32_t min;
+        int32_t max;
+        int32_t mean;
+        int32_t rms;
+        int32_t ripple;
+    };
+
+    struct Snapshot
+    {
+        uint32_t window_us;
+        uint32_t count;
+        Summary q[Q_COUNT];
+    };
+
+public:
+    Statistics();
+
+    void setWindow(int idx, uint32_t duration_us);
+    void reset();
+
+    void update(uint32_t timestamp_us,
+                int32_t voltage_uV,
+                int32_t current_uA);
+
+    bool snapshot(int idx, Snapshot *snap);
+
+public:
+    static const int g_windowCount = 3;
+    static const int g_bucketCount = 10;
+
+private:
+    struct Accumulator
+    {
+        int32_t min;
+        int32_t max;
+        int64_t sum;
+        uint64_t sumSq;
+    };
+
+    struct Bucket
+    {
+        uint32_t count;
+        Accumulator acc[Q_COUNT];
+    };
+
+    struct Window
+    {
+        uint32_t duration_us;
+        uint32_t bucket_us;
+        uint32_t bucketStart_us;
+        bool started;
+        int current;
+        Bucket buckets[g_bucketCount];
+    };
+
+private:
+    void _clearBucket(Bucket *bucket);
+    void _advance(Window *window, uint32_t timestamp_us);
+
+private:
+    static const int g_squareShift;
+    static const uint32_t g_defaultWindows_us[g_windowCount];
+
+private:
+    Window _windows[g_windowCount];
+};
+
+#endif
@@ -2,27 +2,69 @@
 #define __H_TASKSYNCSHARED__
 
 #include <Arduino.h>
+#include <atomic>
+#include "InstrumentedMutex.hpp"
 
 class TaskSyncShared
 {
+public:
+    // Lower values win the bus when several classes are waiting
+    enum I2cPriority
+    {
+        I2C_PRIO_CONTROL,
+        I2C_PRIO_MEASUREMENT,
+        I2C_PRIO_DISPLAY,
+        I2C_PRIO_COUNT
+    };
+
+    struct I2cStats
+    {
+        uint32_t count;
+        uint32_t meanWait_us;
+        uint32_t maxWait_us;
+        uint32_t maxHold_us;
+    };
+
 public:
     static TaskSyncShared *getInstance();
 
-    void takeI2c();
+    void takeI2c(I2cPriority priority = I2C_PRIO_CONTROL);
     void giveI2c();
 
+    void i2cStats(I2cPriority priority, I2cStats *stats);
+    void resetI2cStats();
+
     void takeSerial();
     void giveSerial();
 
+    static const char *i2cPriorityName(I2cPriority priority);
+
 private:
     TaskSyncShared();
 
+    bool _higherWaiting(I2cPriority priority);
+
 private:
-    SemaphoreHandle_t _i2cMutex;
-    SemaphoreHandle_t _serialMutex;
+    struct I2cClass
+    {
+        std::atomic<uint32_t> waiting;
+        uint32_t count;
+        uint64_t totalWait_us;
+        uint32_t maxWait_us;
+        uint32_t maxHold_us;
+    };
+
+    InstrumentedMutex _i2cMutex;
+    InstrumentedMutex _serialMutex;
+
+    I2cClass _i2cClasses[I2C_PRIO_COUNT];
+    I2cPriority _i2cHolder;
+    uint32_t _i2cTaken_us;
+    volatile bool _resetI2cStats;
 
 private:
+    static const TickType_t g_i2cBackoff_ticks;
     static TaskSyncShared *g_instance;
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,57 @@
+#ifndef __H_TELEMETRY__
+#define __H_TELEMETRY__
+
+#include <Arduino.h>
+#include "SampleBuffer.hpp"
+#include "TelemetryFrame.hpp"
+
+// Streams every ADC sample over serial from a background task,
+// either as CSV text lines or as COBS framed binary records
+// (see TelemetryFrame)
+class Telemetry
+{
+public:
+    enum Mode
+    {
+        TM_OFF,
+        TM_TEXT,
+        TM_BINARY
+    };
+
+public:
+    Telemetry(SampleBuffer *buffer);
+
+    bool start();
+
+    void telemetryTask();
+
+    void setMode(Mode mode);
+    Mode mode();
+
+    uint32_t samplesSent();
+    uint32_t dropped();
+
+public:
+    static const char *modeName(Mode mode);
+    static bool modeFromName(const char *name, Mode *mode);
+
+private:
+    void _sendText(const Sample *samples, size_t count);
+    void _sendBinary(const Sample *samples, size_t count);
+
+private:
+    SampleBuffer *_buffer;
+    SampleBuffer::Reader _reader;
+
+    TaskHandle_t _telemetryTaskHandle;
+
+    volatile Mode _mode;
+    Mode _activeMode;
+
+    TelemetryFrame _frameEncoder;
+    volatile uint32_t _samplesSent;
+
+    uint8_t _frame[TelemetryFrame::g_maxFrameLen];
+};
+
+#endif
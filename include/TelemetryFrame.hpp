@@ -0,0 +1,45 @@
+#ifndef __H_TELEMETRYFRAME__
+#define __H_TELEMETRYFRAME__
+
+#include <stdlib.h>
+#include <stdint.h>
+#include "SampleBuffer.hpp"
+
+// Builds the COBS framed binary sample records that Telemetry streams
+// (decoded on the host by tools/telemetry_decode.py). Kept free of
+// hardware so the format can be tested on the host.
+class TelemetryFrame
+{
+public:
+    TelemetryFrame();
+
+    // Encodes the first record's worth of samples into frame, which
+    // must hold g_maxFrameLen bytes. Returns the frame length and sets
+    // used to the number of samples it carries.
+    size_t encode(const Sample *samples, size_t count, uint8_t *frame, size_t *used);
+
+    uint8_t sequence() const;
+
+public:
+    static size_t recordLength(const Sample *samples, size_t count);
+    static size_t cobsEncode(const uint8_t *in, size_t len, uint8_t *out);
+    static uint16_t crc16(const uint8_t *data, size_t len);
+
+public:
+    static const size_t g_samplesPerRecord = 32;
+    // type, sequence, timestamp, count, then up to 3 bytes of
+    // timestamp delta and 3 bytes of counts per sample, then CRC
+    static const size_t g_maxPayloadLen = 7 + (g_samplesPerRecord * 6) + 2;
+    static const size_t g_maxFrameLen = g_maxPayloadLen + (g_maxPayloadLen / 254) + 3;
+    static const uint8_t g_recordTypeSamples;
+    static const uint32_t g_maxDelta_us;
+
+private:
+    size_t _encodeRecord(const Sample *samples, size_t count);
+
+private:
+    uint8_t _sequence;
+    uint8_t _payload[g_maxPayloadLen];
+};
+
+#endif
@@ -5,8 +5,14 @@
 #include <Wire.h>
 #include <Adafruit_GFX.h>
 #include <Adafruit_SSD1306.h>
+#include "InstrumentedMutex.hpp"
+#include "PageFrame.hpp"
 #include "RotaryEncoderListener.hpp"
 #include "TextUIListener.hpp"
+#include "ModeEngine.hpp"
+#include "DynamicLoad.hpp"
+#include "Statistics.hpp"
+#include "Trace.hpp"
 
 class TextUI : public RotaryEncoderListener
 {
@@ -18,6 +24,7 @@ public:
     void setListener(TextUIListener *listener);
 
     void uiTask();
+    void flushTask();
 
     void clear();
     void splash();
@@ -25,13 +32,52 @@ public:
     virtual void turned(RotaryEncoder *source, int deltaClicks, int rpm);
     virtual void clicked(RotaryEncoder *source);
 
-    void loadVoltageChanged(double newVoltage);
-    void loadCurrentChanged(double newCurrent);
+    // When the encoder edge behind the edit being reported happened;
+    // only meaningful inside the listener's callbacks
+    uint32_t editEdge_us();
 
-    void setDesiredCurrent(double desiredCurrent);
+    void loadVoltageChanged(int32_t newVoltage_uV);
+    void loadCurrentChanged(int32_t newCurrent_uA);
+
+    void setMode(ModeEngine::Mode mode);
+    void setSetpoint(ModeEngine::Mode mode, int32_t setpoint);
+    void setDynamic(const DynamicLoad::Config &config);
 
     void setEnabled(bool isEnabled);
 
+    void batteryChanged(bool visible, int32_t charge_uAh, int32_t energy_uWh);
+
+    // Swaps the mode's settings for a scrolling graph of quantity,
+    // fed one decimated column at a time
+    void setGraph(bool visible, Statistics::Quantity quantity);
+    void graphColumn(const Trace::Column &column);
+
+    // UI task time per pass, not counting its sleep, and frames
+    // drawn over before the flush task could take them
+    uint32_t stackHighWater();
+    uint32_t lastLoop_us();
+    uint32_t maxLoop_us();
+    uint32_t framesDropped();
+    uint32_t wakeups();
+
+    // Time spent drawing dirty text into the frame buffer
+    uint32_t lastRender_us();
+    uint32_t maxRender_us();
+
+    // Bus traffic to the display, counting control bytes
+    uint32_t displayFlushes();
+    uint32_t displayBytes();
+    uint32_t lastFlushBytes();
+
+    // Graph columns drawn and lost, time to scroll and draw one new
+    // column or the whole graph, and bytes sent per graph update
+    uint32_t graphColumns();
+    uint32_t graphColumnsDropped();
+    uint32_t lastColumn_us();
+    uint32_t maxColumn_us();
+    uint32_t lastGraphRedraw_us();
+    uint32_t lastGraphBytes();
+
 private:
     struct Dirty
     {
@@ -54,14 +100,112 @@ private:
         int y;
     };
 
+    struct ValueFormat
+    {
+        const char *unit;
+        int intDigits;
+        int fracDigits;
+        int32_t unitScale;
+        int32_t min;
+        int32_t max;
+    };
+
+    // The model values widgets are bound to; every change bumps the
+    // value's version so that only the widgets showing it are redrawn
+    enum Value
+    {
+        V_NONE,
+        V_LOAD_VOLTAGE,
+        V_LOAD_CURRENT,
+        V_BATTERY_VISIBLE,
+        V_BATTERY_CHARGE,
+        V_BATTERY_ENERGY,
+        V_MODE,
+        // In ModeEngine::Mode order
+        V_SETPOINT_CC,
+        V_SETPOINT_CV,
+        V_SETPOINT_CR,
+        V_SETPOINT_CP,
+        V_DYNAMIC_HIGH,
+        V_DYNAMIC_LOW,
+        V_DYNAMIC_FREQUENCY,
+        V_DYNAMIC_DUTY,
+        V_ENABLED,
+        V_VIEW, // Zero for the settings, else 1 + the graphed quantity
+        V_GRAPH,
+        V_GRAPH_SPAN,
+        V_COUNT
+    };
+
+    enum WidgetType
+    {
+        W_LABEL,   // Fixed text
+        W_READOUT, // Value through a formatter
+        W_SETTING, // Value in a ValueFormat, edited a digit at a time
+        W_MODE,    // ModeEngine::Mode, edited by stepping through them
+        W_TOGGLE,  // On or off
+        W_VIEW,    // Settings or the graphed quantity, edited by stepping
+        W_GRAPH,   // The trace, drawn straight into the frame buffer
+        W_SPAN     // Graph span in the unit of the graphed quantity
+    };
+
+    typedef size_t (*Formatter)(char *buf, int32_t value);
+
+    struct Widget
+    {
+        WidgetType type;
+        int x;
+        int y;
+        Value value;
+        Value visibleIf; // Drawn blank while this is zero
+        const char *text;
+        const ValueFormat *format;
+        Formatter formatter;
+    };
+
+    struct Screen
+    {
+        const Widget *widgets;
+        int count;
+    };
+
+private:
+    static const int g_maxWidgetChars = 24;
+    static const int g_maxWidgets = 16;
+    static const int g_maxSections = 4;
+    static const int g_maxPendingColumns = 32;
+    static const int g_graphRows = 4;
+
 private:
     void _drawUI();
     void _moveCursor(int newCursorIdx);
     void _drawCursor();
+    void _drawWidget(const Widget &widget, const int32_t *values, bool visible);
+    int _sections(int screen, const Screen **sections);
+    int _widgetCount();
+    const Widget &_widget(int idx);
+    int _widgetStops(const Widget &widget);
+    int _stopCount();
+    bool _locateStop(int cursorIdx, const Widget **widget, int *digit);
+    int _findStop(WidgetType type, int digit);
+    Point _cursorPoint(int cursorIdx);
+    int32_t _digitStep(const ValueFormat &format, int digit);
+    void _edit(int encoderDelta);
+    void _setValue(Value value, int32_t newValue);
+    void _wake();
+    void _drawGraph(const Widget &widget);
+    bool _rescaleGraph();
+    void _drawGraphColumn(const Widget &widget, int x, int idx);
+    int _graphRow(const Widget &widget, int32_t value);
+    void _clearGraph(const Widget &widget);
+    void _snapshot(int32_t *values, uint32_t *versions);
     void _writeChars(int x, int y, const char *text);
-    void _printf(int x, int y, const char *fmt, ...);
     void _commitChangesToDisplay(bool *cursorAffected = 0);
-    void _writeTextToDisplay(int x, int y, const char *text, size_t len);
+    void _presentFrame();
+    bool _flushDisplay();
+    bool _writeDisplay(uint8_t control, const uint8_t *bytes, size_t len);
+
+    static bool _displayWriter(void *context, uint8_t control, const uint8_t *bytes, size_t len);
 
     Dirty *_getDirtyForRow(int y);
 
@@ -76,18 +220,47 @@ private:
     char *_screenBuf;
     Dirty *_dirtyRegions;
     Adafruit_SSD1306 _display;
+    PageFrame _frame;
 
     TaskHandle_t _uiTaskHandle;
 
-    SemaphoreHandle_t _mutex;
+    InstrumentedMutex _mutex;
+
+    int32_t _values[V_COUNT];
+    uint32_t _versions[V_COUNT];
 
-    double _loadVoltage;
-    double _loadCurrent;
-    double _desiredCurrent;
-    bool _isEnabled;
+    // Screen last drawn, a mode or the graph, and the versions its
+    // widgets were drawn at
+    int _drawnScreen;
+    int32_t _drawnView;
+    uint32_t _drawnStamps[g_maxWidgets];
+
+    // Columns from graphColumn() waiting for the UI task
+    Trace::Column _pendingColumns[g_maxPendingColumns];
+    int _pendingColumnCount;
+    uint32_t _graphColumnsDropped;
+
+    // What the graph shows, oldest column first from _graphHead less
+    // _graphFilled round the ring, and the value range it spans
+    Trace::Column *_graphHistory;
+    int _graphHead;
+    int _graphFilled;
+    int32_t _graphBottom;
+    int32_t _graphSpan;
+    bool _graphRedraw;
+    volatile uint8_t _graphPages;
+    uint32_t _graphColumns;
+    uint32_t _lastColumn_us;
+    uint32_t _maxColumn_us;
+    uint32_t _lastGraphRedraw_us;
+    uint32_t _lastGraphBytes;
 
     int _encoderDelta;
     bool _encoderClicked;
+    bool _encoderEdgePending;
+    uint32_t _encoderEdge_us;
+    uint32_t _editEdge_us;
+    uint32_t _wakeups;
 
     bool _uiDirty;
 
@@ -95,9 +268,50 @@ private:
 
     TextUIListener *_listener;
 
+    uint32_t _displayFlushes;
+    uint32_t _displayBytes;
+    uint32_t _lastFlushBytes;
+    uint32_t _lastRender_us;
+    uint32_t _maxRender_us;
+
+    // The UI task draws into the Adafruit_SSD1306 buffer through
+    // _frame, which copies the changes aside for the flush task
+    TaskHandle_t _flushTaskHandle;
+    InstrumentedMutex _frameMutex;
+    bool _flushBusy;
+    bool _frameWaiting;
+    uint32_t _framesDrawn;
+    uint32_t _framesDropped;
+    uint32_t _lastLoop_us;
+    uint32_t _maxLoop_us;
+
 private:
-    static const int g_cursorPointsCount;
-    static const Point g_cursorPoints[];
+    static const ValueFormat g_ampsFormat;
+    static const ValueFormat g_voltsFormat;
+    static const ValueFormat g_ohmsFormat;
+    static const ValueFormat g_wattsFormat;
+    static const ValueFormat g_hertzFormat;
+    static const ValueFormat g_percentFormat;
+    static const Widget g_headerWidgets[];
+    static const Widget g_controlWidgets[];
+    static const Widget g_footerWidgets[];
+    static const Widget g_graphWidgets[];
+    static const Widget g_ccWidgets[];
+    static const Widget g_cvWidgets[];
+    static const Widget g_crWidgets[];
+    static const Widget g_cpWidgets[];
+    static const Widget g_dynamicWidgets[];
+    static const Screen g_header;
+    static const Screen g_controls;
+    static const Screen g_footer;
+    static const Screen g_graph;
+    static const int g_graphScreen;
+    static const int32_t g_minGraphSpan;
+    static const char *const g_graphUnits[Statistics::Q_COUNT];
+    static const Screen g_screens[ModeEngine::MODE_COUNT];
+    static const uint32_t g_displayClock_Hz;
+    static const UBaseType_t g_flushTaskPriority;
+    static const uint32_t g_uiTaskStack;
 };
 
 #endif
\ No newline at end of file
@@ -1,13 +1,21 @@
 #ifndef __H_TEXTUILISTENER__
 #define __H_TEXTUILISTENER__
 
+#include <stdint.h>
+#include "ModeEngine.hpp"
+#include "DynamicLoad.hpp"
+#include "Statistics.hpp"
+
 class TextUI;
 
 class TextUIListener
 {
 public:
-    virtual void desiredCurrentChanged(TextUI *source, double desiredCurrent) = 0;
+    virtual void modeChanged(TextUI *source, ModeEngine::Mode mode) = 0;
+    virtual void setpointChanged(TextUI *source, ModeEngine::Mode mode, int32_t setpoint) = 0;
+    virtual void dynamicChanged(TextUI *source, const DynamicLoad::Config &config) = 0;
     virtual void enabledChanged(TextUI *source, bool isEnabled) = 0;
+    virtual void graphChanged(TextUI *source, bool visible, Statistics::Quantity quantity) = 0;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,46 @@
+#ifndef __H_TRACE__
+#define __H_TRACE__
+
+#include <stdint.h>
+#include "Statistics.hpp"
+
+// Min/max decimation of one quantity into fixed-period columns for
+// the graph. Every sample lands in a column, so a spike far shorter
+// than a column still shows at its full height.
+class Trace
+{
+public:
+    struct Column
+    {
+        int32_t min;
+        int32_t max;
+    };
+
+public:
+    Trace();
+
+    void configure(Statistics::Quantity quantity, uint32_t column_us);
+    void reset();
+
+    // Returns true when the sample closed a column, which is copied
+    // to *column; the sample itself starts the next one
+    bool update(uint32_t timestamp_us,
+                int32_t voltage_uV,
+                int32_t current_uA,
+                Column *column);
+
+    Statistics::Quantity quantity();
+    uint32_t column_us();
+
+    static const char *quantityName(Statistics::Quantity quantity);
+    static bool quantityFromName(const char *name, Statistics::Quantity *quantity);
+
+private:
+    Statistics::Quantity _quantity;
+    uint32_t _column_us;
+    uint32_t _columnStart_us;
+    bool _started;
+    Column _column;
+};
+
+#endif
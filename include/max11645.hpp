@@ -73,6 +73,22 @@ public:
                   DiffSubMode subMode);
 
     uint16_t *readSamples(uint16_t *buf, size_t bufLen);
+    size_t readFrames(uint16_t *const *channels,
+                      size_t channelCount,
+                      size_t frameCount);
+
+    void invalidate();
+
+    bool configValid();
+    ScanMode scanMode();
+    ChanSel chanSel();
+    Mode mode();
+
+    uint32_t writesIssued();
+    uint32_t writesSuppressed();
+
+public:
+    static const size_t g_maxReadBytes;
 
 private:
     uint8_t makeConfig(ScanMode scanMode,
@@ -85,11 +101,22 @@ private:
 
     bool writeData(uint8_t *data,
                    uint8_t len);
+    bool readWords(size_t wordCount);
+    uint16_t readResult();
 
 private:
     uint8_t _address;
     TwoWire *_i2c;
     uint32_t _frequency;
+
+    // Shadow of the write-only registers as last written
+    bool _configValid;
+    uint8_t _config;
+    bool _setupValid;
+    uint8_t _setup;
+
+    volatile uint32_t _writesIssued;
+    volatile uint32_t _writesSuppressed;
 };
 
 #endif
\ No newline at end of file
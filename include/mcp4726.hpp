@@ -29,6 +29,24 @@ public:
         G_2X = 0b1
     };
 
+    // A ready-to-send fast-write command, so timed writers can
+    // encode ahead of time and only move bytes when the step is due
+    struct Frame
+    {
+        uint8_t bytes[2];
+    };
+
+    // One half of a read: the volatile registers or the EEPROM
+    struct Memory
+    {
+        bool ready;
+        bool powerOnReset;
+        Reference ref;
+        PowerDown pd;
+        Gain gain;
+        uint16_t dacValue;
+    };
+
 public:
     MCP4726(uint8_t address = 0x60,
             TwoWire *i2c = &Wire,
@@ -36,6 +54,7 @@ public:
 
     bool writeDAC(uint16_t value,
                   PowerDown pd = PD_RUN);
+    bool writeFrame(const Frame &frame);
     bool writeMem(Reference ref,
                   PowerDown pd,
                   Gain g,
@@ -44,8 +63,24 @@ public:
     bool writeVolatileConfig(Reference ref,
                              PowerDown pd,
                              Gain g);
+    bool readMem(Memory *volatileMem,
+                 Memory *nonVolatileMem);
+
+    void invalidate();
+
+    bool dacValid();
+    uint16_t dacValue();
+
+    uint32_t writesIssued();
+    uint32_t writesSuppressed();
+
+public:
+    static Frame encodeDAC(uint16_t value,
+                           PowerDown pd = PD_RUN);
 
 private:
+    static void decodeMem(const uint8_t *data, Memory *mem);
+
     uint16_t getWord(uint8_t reg);
     bool writeData(uint8_t *data,
                    uint8_t len);
@@ -54,6 +89,17 @@ private:
     uint8_t _address;
     TwoWire *_i2c;
     uint32_t _frequency;
+
+    // Shadow of the volatile registers as last written
+    bool _dacValid;
+    uint16_t _dacValue;
+    PowerDown _powerDown;
+    bool _configValid;
+    Reference _ref;
+    Gain _gain;
+
+    volatile uint32_t _writesIssued;
+    volatile uint32_t _writesSuppressed;
 };
 
 #endif
\ No newline at end of file
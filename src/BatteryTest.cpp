@@ -0,0 +1,206 @@
+#include <esp_timer.h>
+#include "TaskSyncShared.hpp"
+#include "Measurement.hpp"
+#include "BatteryTest.hpp"
+
+const int64_t BatteryTest::g_usPerHour = 3600000000LL;
+const uint32_t BatteryTest::g_maxGap_us = 100000;
+
+BatteryTest::BatteryTest(MCP4726 *dac)
+    : _dac(dac),
+      _mutex(0),
+      _calibration(),
+      _state(BT_IDLE),
+      _cutoff_uV(0),
+      _confirmSamples(1),
+      _belowCount(0),
+      _havePrevious(false),
+      _previous_us(0),
+      _elapsed_us(0),
+      _charge_uAh(0),
+      _charge_uAus(0),
+      _energy_uWh(0),
+      _energy_uWus(0),
+      _lastVoltage_uV(0),
+      _cutoffLatency_us(0),
+      _gaps(0)
+{
+    _mutex = xSemaphoreCreateMutex();
+}
+
+void BatteryTest::start(int32_t cutoff_uV, uint32_t confirmSamples, const Calibration &calibration)
+{
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    _calibration = calibration;
+    _cutoff_uV = cutoff_uV;
+    _confirmSamples = (confirmSamples > 0) ? confirmSamples : 1;
+    _belowCount = 0;
+    _havePrevious = false;
+    _elapsed_us = 0;
+    _charge_uAh = 0;
+    _charge_uAus = 0;
+    _energy_uWh = 0;
+    _energy_uWus = 0;
+    _cutoffLatency_us = 0;
+    _gaps = 0;
+    _state = BT_RUNNING;
+    xSemaphoreGive(_mutex);
+}
+
+void BatteryTest::stop()
+{
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    if (_state == BT_RUNNING)
+    {
+        _state = BT_STOPPED;
+    }
+    xSemaphoreGive(_mutex);
+}
+
+void BatteryTest::finish()
+{
+    // The owner has turned the load off, so it no longer has
+    // to be held at zero
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    if (_state == BT_CUTOFF)
+    {
+        _state = BT_DONE;
+    }
+    xSemaphoreGive(_mutex);
+}
+
+BatteryTest::State BatteryTest::state()
+{
+    return _state;
+}
+
+bool BatteryTest::loadCut()
+{
+    return _state == BT_CUTOFF;
+}
+
+int32_t BatteryTest::cutoff_uV()
+{
+    return _cutoff_uV;
+}
+
+void BatteryTest::result(Result *result)
+{
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    result->state = _state;
+    result->charge_uAh = _charge_uAh;
+    result->energy_uWh = _energy_uWh;
+    result->elapsed_ms = uint32_t(_elapsed_us / 1000);
+    result->lastVoltage_uV = _lastVoltage_uV;
+    result->cutoffLatency_us = _cutoffLatency_us;
+    result->gaps = _gaps;
+    xSemaphoreGive(_mutex);
+}
+
+void BatteryTest::samplesAcquired(Sampler *source, const Sample *samples, size_t count)
+{
+    if (_state != BT_RUNNING)
+    {
+        return;
+    }
+
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    for (size_t i = 0; (i < count) && (_state == BT_RUNNING); i++)
+    {
+        int32_t voltage_uV = _calibration.apply(Calibration::CH_LOAD_VOLTAGE,
+                                                Measurement::countsToMicroVolts(samples[i].ain0));
+        int32_t current_uA = _calibration.apply(Calibration::CH_LOAD_CURRENT,
+                                                Measurement::countsToMicroAmps(samples[i].ain1));
+        _lastVoltage_uV = voltage_uV;
+
+        // The load only sinks, so noise around zero mustn't add up
+        if (current_uA < 0)
+        {
+            current_uA = 0;
+        }
+        if (voltage_uV < 0)
+        {
+            voltage_uV = 0;
+        }
+
+        // Each sample stands for the time since the one before it;
+        // across a stall there is nothing to integrate
+        if (!_havePrevious)
+        {
+            _havePrevious = true;
+        }
+        else
+        {
+            uint32_t dt_us = samples[i].timestamp_us - _previous_us;
+            if (dt_us > g_maxGap_us)
+            {
+                _gaps++;
+            }
+            else
+            {
+                int64_t power_uW = (int64_t(voltage_uV) * current_uA) / 1000000;
+
+                _charge_uAus += int64_t(current_uA) * dt_us;
+                _energy_uWus += power_uW * dt_us;
+                if (_charge_uAus >= g_usPerHour)
+                {
+                    _charge_uAh += _charge_uAus / g_usPerHour;
+                    _charge_uAus %= g_usPerHour;
+                }
+                if (_energy_uWus >= g_usPerHour)
+                {
+                    _energy_uWh += _energy_uWus / g_usPerHour;
+                    _energy_uWus %= g_usPerHour;
+                }
+            }
+            _elapsed_us += dt_us;
+        }
+        _previous_us = samples[i].timestamp_us;
+
+        if (voltage_uV < _cutoff_uV)
+        {
+            _belowCount++;
+            if (_belowCount >= _confirmSamples)
+            {
+                _cutLoad(samples[i].timestamp_us);
+            }
+        }
+        else
+        {
+            _belowCount = 0;
+        }
+    }
+    xSemaphoreGive(_mutex);
+}
+
+const char *BatteryTest::stateName(State state)
+{
+    switch (state)
+    {
+    case BT_RUNNING:
+        return "running";
+    case BT_CUTOFF:
+        return "cutoff";
+    case BT_DONE:
+        return "done";
+    case BT_STOPPED:
+        return "stopped";
+    default:
+        return "idle";
+    }
+}
+
+void BatteryTest::_cutLoad(uint32_t sample_us)
+{
+    // Set the state first; the control task checks it under the
+    // I2C lock before each write, so whichever of us gets the bus
+    // last, the DAC ends up at zero
+    _state = BT_CUTOFF;
+
+    TaskSyncShared *tss = TaskSyncShared::getInstance();
+    tss->takeI2c();
+    _dac->writeDAC(0);
+    tss->giveI2c();
+
+    _cutoffLatency_us = uint32_t(esp_timer_get_time()) - sample_us;
+}
@@ -0,0 +1,236 @@
+#include <string.h>
+#include "Calibration.hpp"
+
+const int32_t Calibration::g_unityGain_q16;
+const size_t Calibration::g_maxPoints;
+
+Calibration::Calibration()
+{
+    for (int i = 0; i < CH_COUNT; i++)
+    {
+        reset(Channel(i));
+    }
+}
+
+void Calibration::reset(Channel ch)
+{
+    if (ch >= CH_COUNT)
+    {
+        return;
+    }
+
+    ChannelCal *cal = &_channels[ch];
+    cal->gain_q16 = g_unityGain_q16;
+    cal->offset = 0;
+    cal->count = 0;
+}
+
+void Calibration::setLinear(Channel ch, int32_t gain_q16, int32_t offset)
+{
+    if (ch >= CH_COUNT)
+    {
+        return;
+    }
+
+    _channels[ch].gain_q16 = gain_q16;
+    _channels[ch].offset = offset;
+}
+
+bool Calibration::addPoint(Channel ch, int32_t x, int32_t y)
+{
+    if (ch >= CH_COUNT)
+    {
+        return false;
+    }
+
+    ChannelCal *cal = &_channels[ch];
+
+    // Keep the table sorted by x; a repeated x replaces the old point
+    size_t idx = 0;
+    while ((idx < cal->count) && (cal->points[idx].x < x))
+    {
+        idx++;
+    }
+
+    if ((idx < cal->count) && (cal->points[idx].x == x))
+    {
+        cal->points[idx].y = y;
+    }
+    else
+    {
+        if (cal->count == g_maxPoints)
+        {
+            return false;
+        }
+
+        memmove(&cal->points[idx + 1], &cal->points[idx], (cal->count - idx) * sizeof(Point));
+        cal->points[idx].x = x;
+        cal->points[idx].y = y;
+        cal->count++;
+    }
+
+    // A single point can only tell us the offset
+    if (cal->count == 1)
+    {
+        cal->gain_q16 = g_unityGain_q16;
+        cal->offset = y - x;
+    }
+
+    _updateSlopes(cal);
+
+    return true;
+}
+
+int32_t Calibration::apply(Channel ch, int32_t value) const
+{
+    if (ch >= CH_COUNT)
+    {
+        return value;
+    }
+
+    const ChannelCal *cal = &_channels[ch];
+
+    if (cal->count < 2)
+    {
+        return int32_t((int64_t(value) * cal->gain_q16) >> 16) + cal->offset;
+    }
+
+    // Find the last point at or below value, clamping to the end
+    // segments so values outside the table are extrapolated
+    size_t lo = 0;
+    size_t hi = cal->count - 2;
+    while (lo < hi)
+    {
+        size_t mid = (lo + hi + 1) / 2;
+        if (cal->points[mid].x <= value)
+        {
+            lo = mid;
+        }
+        else
+        {
+            hi = mid - 1;
+        }
+    }
+
+    // Past the end work from the last point, so it comes back exact
+    // rather than through the truncated slope of the segment before
+    const Point &last = cal->points[cal->count - 1];
+    const Point &p = value >= last.x ? last : cal->points[lo];
+
+    return p.y + int32_t(((int64_t(value) - p.x) * cal->slope_q32[lo]) >> 32);
+}
+
+int32_t Calibration::gain_q16(Channel ch) const
+{
+    return ch < CH_COUNT ? _channels[ch].gain_q16 : g_unityGain_q16;
+}
+
+int32_t Calibration::offset(Channel ch) const
+{
+    return ch < CH_COUNT ? _channels[ch].offset : 0;
+}
+
+size_t Calibration::pointCount(Channel ch) const
+{
+    return ch < CH_COUNT ? _channels[ch].count : 0;
+}
+
+const Calibration::Point *Calibration::points(Channel ch) const
+{
+    return ch < CH_COUNT ? _channels[ch].points : 0;
+}
+
+void Calibration::store(Stored *stored) const
+{
+    memset(stored, 0, sizeof(Stored));
+    for (int i = 0; i < CH_COUNT; i++)
+    {
+        stored->channels[i].gain_q16 = _channels[i].gain_q16;
+        stored->channels[i].offset = _channels[i].offset;
+        stored->channels[i].count = _channels[i].count;
+        memcpy(stored->channels[i].points, _channels[i].points, _channels[i].count * sizeof(Point));
+    }
+}
+
+bool Calibration::restore(const Stored &stored)
+{
+    // Check everything before touching anything, the tables
+    // have to be sorted with distinct x for the search and slopes
+    for (int i = 0; i < CH_COUNT; i++)
+    {
+        if (stored.channels[i].count > g_maxPoints)
+        {
+            return false;
+        }
+        for (size_t j = 1; j < stored.channels[i].count; j++)
+        {
+            if (stored.channels[i].points[j - 1].x >= stored.channels[i].points[j].x)
+            {
+                return false;
+            }
+        }
+    }
+
+    for (int i = 0; i < CH_COUNT; i++)
+    {
+        ChannelCal *cal = &_channels[i];
+        cal->gain_q16 = stored.channels[i].gain_q16;
+        cal->offset = stored.channels[i].offset;
+        cal->count = stored.channels[i].count;
+        memcpy(cal->points, stored.channels[i].points, cal->count * sizeof(Point));
+        _updateSlopes(cal);
+    }
+
+    return true;
+}
+
+const char *Calibration::channelName(Channel ch)
+{
+    switch (ch)
+    {
+    case CH_LOAD_VOLTAGE:
+        return "v";
+    case CH_LOAD_CURRENT:
+        return "i";
+    case CH_DAC_CURRENT:
+        return "dac";
+    default:
+        return "?";
+    }
+}
+
+bool Calibration::channelFromName(const char *name, Channel *ch)
+{
+    for (int i = 0; i < CH_COUNT; i++)
+    {
+        if (strcmp(name, channelName(Channel(i))) == 0)
+        {
+            *ch = Channel(i);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void Calibration::_updateSlopes(ChannelCal *cal)
+{
+    for (size_t i = 0; (i + 1) < cal->count; i++)
+    {
+        int64_t dx = int64_t(cal->points[i + 1].x) - cal->points[i].x;
+        int64_t dy = int64_t(cal->points[i + 1].y) - cal->points[i].y;
+
+        // Kept to 31 bits so the Q32 product fits; no real front end
+        // needs a segment that steep
+        if (dy > INT32_MAX)
+        {
+            dy = INT32_MAX;
+        }
+        else if (dy < -INT32_MAX)
+        {
+            dy = -INT32_MAX;
+        }
+
+        cal->slope_q32[i] = (dy * (int64_t(1) << 32)) / dx;
+    }
+}
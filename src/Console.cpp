@@ -0,0 +1,102 @@
+#include "Console.hpp"
+
+static void consoleTaskHelper(void *objPtr);
+
+const size_t Console::g_maxLineLen;
+
+Console::Console()
+    : _listener(0),
+      _consoleTaskHandle(NULL),
+      _line(),
+      _lineLen(0) {}
+
+void Console::setListener(ConsoleListener *listener)
+{
+    _listener = listener;
+}
+
+bool Console::start()
+{
+    if (xTaskCreate(consoleTaskHelper,
+                    "console",
+                    2000,
+                    (void *)this,
+                    1,
+                    &_consoleTaskHandle) != pdPASS)
+    {
+        return false;
+    }
+
+    return true;
+}
+
+void Console::consoleTask()
+{
+    while (true)
+    {
+        while (Serial.available() > 0)
+        {
+            int c = Serial.read();
+
+            if ((c == '\r') || (c == '\n'))
+            {
+                if (_lineLen > 0)
+                {
+                    _line[_lineLen] = '\0';
+                    _lineLen = 0;
+
+                    if (_listener != 0)
+                    {
+                        _listener->lineReceived(this, _line);
+                    }
+                }
+            }
+            else if (_lineLen < (g_maxLineLen - 1))
+            {
+                _line[_lineLen++] = char(c);
+            }
+        }
+
+        vTaskDelay(20 / portTICK_PERIOD_MS);
+    }
+}
+
+int Console::split(char *line, char **argv, int maxArgs)
+{
+    int argc = 0;
+    char *p = line;
+
+    while ((*p != '\0') && (argc < maxArgs))
+    {
+        while ((*p == ' ') || (*p == '\t'))
+        {
+            *p++ = '\0';
+        }
+
+        if (*p == '\0')
+        {
+            break;
+        }
+
+        argv[argc++] = p;
+
+        while ((*p != '\0') && (*p != ' ') && (*p != '\t'))
+        {
+            p++;
+        }
+    }
+
+    return argc;
+}
+
+void consoleTaskHelper(void *objPtr)
+{
+    if (objPtr != 0)
+    {
+        Console *console = (Console *)objPtr;
+
+        console->consoleTask();
+    }
+
+    vTaskDelete(NULL);
+}
@@ -0,0 +1,95 @@
+#include "CurrentRegulator.hpp"
+
+const int32_t CurrentRegulator::g_defaultKp_q16 = 13107; // 0.2
+const int32_t CurrentRegulator::g_defaultKi_q16 = 3277;  // 0.05 per period
+const int32_t CurrentRegulator::g_defaultMaxTrim_uA = 200000;
+
+CurrentRegulator::CurrentRegulator()
+    : _kp_q16(g_defaultKp_q16),
+      _ki_q16(g_defaultKi_q16),
+      _maxCommand_uA(3000000),
+      _maxTrim_uA(g_defaultMaxTrim_uA),
+      _integral_uA(0),
+      _lastError_uA(0) {}
+
+void CurrentRegulator::setGains(int32_t kp_q16, int32_t ki_q16)
+{
+    _kp_q16 = kp_q16;
+    _ki_q16 = ki_q16;
+}
+
+void CurrentRegulator::setLimits(int32_t maxCommand_uA, int32_t maxTrim_uA)
+{
+    _maxCommand_uA = maxCommand_uA;
+    _maxTrim_uA = maxTrim_uA;
+}
+
+void CurrentRegulator::reset()
+{
+    _integral_uA = 0;
+    _lastError_uA = 0;
+}
+
+int32_t CurrentRegulator::update(int32_t setpoint_uA, int32_t measured_uA)
+{
+    int32_t error_uA = setpoint_uA - measured_uA;
+    _lastError_uA = error_uA;
+
+    int32_t proportional_uA = int32_t((int64_t(error_uA) * _kp_q16) >> 16);
+
+    int32_t integral_uA = _integral_uA + int32_t((int64_t(error_uA) * _ki_q16) >> 16);
+    if (integral_uA > _maxTrim_uA)
+    {
+        integral_uA = _maxTrim_uA;
+    }
+    if (integral_uA < -_maxTrim_uA)
+    {
+        integral_uA = -_maxTrim_uA;
+    }
+
+    // The setpoint is the feed-forward term; the PI terms only
+    // correct for drift in the shunt, amplifier and DAC
+    int32_t command_uA = setpoint_uA + proportional_uA + integral_uA;
+
+    // Anti-windup: stop integrating further into saturation
+    if (command_uA > _maxCommand_uA)
+    {
+        command_uA = _maxCommand_uA;
+        if (integral_uA > _integral_uA)
+        {
+            integral_uA = _integral_uA;
+        }
+    }
+    else if (command_uA < 0)
+    {
+        command_uA = 0;
+        if (integral_uA < _integral_uA)
+        {
+            integral_uA = _integral_uA;
+        }
+    }
+
+    _integral_uA = integral_uA;
+
+    return command_uA;
+}
+
+int32_t CurrentRegulator::kp_q16()
+{
+    return _kp_q16;
+}
+
+int32_t CurrentRegulator::ki_q16()
+{
+    return _ki_q16;
+}
+
+int32_t CurrentRegulator::integral_uA()
+{
+    return _integral_uA;
+}
+
+int32_t CurrentRegulator::lastError_uA()
+{
+    return _lastError_uA;
+}
@@ -0,0 +1,336 @@
+#include "TaskSyncShared.hpp"
+#include "Log.hpp"
+#include "DacSequencer.hpp"
+
+static void stepperTaskHelper(void *objPtr);
+
+const uint32_t DacSequencer::g_dwellUnit_us;
+const uint32_t DacSequencer::g_maxStepDwell_us;
+const UBaseType_t DacSequencer::g_taskPriority = 4;
+const uint32_t DacSequencer::g_stepBit = 0x01;
+const uint32_t DacSequencer::g_commandBit = 0x02;
+const uint32_t DacSequencer::g_startDelay_us = 500;
+const int32_t DacSequencer::g_minWait_us = 20;
+const int32_t DacSequencer::g_timerSlack_us = 10;
+
+DacSequencer::DacSequencer(MCP4726 *dac)
+    : _dac(dac),
+      _stepperTaskHandle(NULL),
+      _timer(0),
+      _timerArgs(),
+      _mutex(0),
+      _newSteps(0),
+      _newCount(0),
+      _newLoop(false),
+      _commandSeq(0),
+      _appliedSeq(0),
+      _steps(0),
+      _count(0),
+      _loop(false),
+      _index(0),
+      _deadline_us(0),
+      _frameWritten(false),
+      _lastFrame(),
+      _running(false),
+      _stepsPlayed(0),
+      _writesIssued(0),
+      _failedWrites(0),
+      _missedSteps(0),
+      _maxLate_us(0),
+      _firstStep_us(0),
+      _lastStep_us(0),
+      _lateSum_us(0),
+      _lateCount(0) {}
+
+bool DacSequencer::init()
+{
+    _mutex = xSemaphoreCreateMutex();
+
+    _timerArgs.callback = &DacSequencer::g_timerExpired;
+    _timerArgs.arg = this;
+    if (esp_timer_create(&_timerArgs, &_timer) != ESP_OK)
+    {
+        return false;
+    }
+
+    if (xTaskCreate(stepperTaskHelper,
+                    "stepper",
+                    2000,
+                    (void *)this,
+                    g_taskPriority,
+                    &_stepperTaskHandle) != pdPASS)
+    {
+        return false;
+    }
+
+    return true;
+}
+
+void DacSequencer::stepperTask()
+{
+    while (true)
+    {
+        uint32_t bits = 0;
+        xTaskNotifyWait(0, 0xffffffff, &bits, portMAX_DELAY);
+
+        if (bits & g_commandBit)
+        {
+            _applyCommand();
+        }
+        else if ((bits & g_stepBit) && _running)
+        {
+            _playStep();
+        }
+    }
+}
+
+void DacSequencer::play(const Step *steps, size_t count, bool loop)
+{
+    _command(steps, count, loop);
+}
+
+void DacSequencer::stop()
+{
+    _command(0, 0, false);
+}
+
+bool DacSequencer::running()
+{
+    return _running;
+}
+
+void DacSequencer::resetStats()
+{
+    _stepsPlayed = 0;
+    _writesIssued = 0;
+    _failedWrites = 0;
+    _missedSteps = 0;
+    _maxLate_us = 0;
+    _firstStep_us = 0;
+    _lastStep_us = 0;
+    _lateSum_us = 0;
+    _lateCount = 0;
+}
+
+uint32_t DacSequencer::stepsPlayed()
+{
+    return _stepsPlayed;
+}
+
+uint32_t DacSequencer::writesIssued()
+{
+    return _writesIssued;
+}
+
+uint32_t DacSequencer::failedWrites()
+{
+    return _failedWrites;
+}
+
+uint32_t DacSequencer::missedSteps()
+{
+    return _missedSteps;
+}
+
+uint32_t DacSequencer::meanLate_us()
+{
+    uint32_t count = _lateCount;
+    if (count == 0)
+    {
+        return 0;
+    }
+
+    return uint32_t(_lateSum_us / count);
+}
+
+uint32_t DacSequencer::maxLate_us()
+{
+    return _maxLate_us;
+}
+
+uint32_t DacSequencer::elapsed_us()
+{
+    // From the first step written to the last
+    return _lastStep_us - _firstStep_us;
+}
+
+size_t DacSequencer::fill(Step *steps,
+                          size_t maxSteps,
+                          const MCP4726::Frame &frame,
+                          uint32_t dwell_us)
+{
+    // Dwells longer than one step can hold are split into
+    // repeats of the same frame, which cost no extra writes
+    size_t used = 0;
+    while ((dwell_us > 0) && (used < maxSteps))
+    {
+        uint32_t stepDwell_us = dwell_us;
+        if (stepDwell_us > g_maxStepDwell_us)
+        {
+            stepDwell_us = g_maxStepDwell_us;
+        }
+
+        steps[used].frame = frame;
+        steps[used].dwell_10us = uint16_t(stepDwell_us / g_dwellUnit_us);
+        used++;
+
+        dwell_us -= stepDwell_us;
+        if (dwell_us < g_dwellUnit_us)
+        {
+            break;
+        }
+    }
+
+    return used;
+}
+
+void DacSequencer::g_timerExpired(void *arg)
+{
+    DacSequencer *obj = (DacSequencer *)arg;
+    xTaskNotify(obj->_stepperTaskHandle, g_stepBit, eSetBits);
+}
+
+void DacSequencer::_command(const Step *steps, size_t count, bool loop)
+{
+    if (_stepperTaskHandle == NULL)
+    {
+        return;
+    }
+
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    _newSteps = steps;
+    _newCount = count;
+    _newLoop = loop;
+    uint32_t seq = ++_commandSeq;
+    xSemaphoreGive(_mutex);
+
+    xTaskNotify(_stepperTaskHandle, g_commandBit, eSetBits);
+
+    // Callers reuse the table once stopped and poll running()
+    // once started, so wait for the stepper task to catch up
+    while (_appliedSeq != seq)
+    {
+        vTaskDelay(1);
+    }
+}
+
+void DacSequencer::_applyCommand()
+{
+    esp_timer_stop(_timer);
+
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    _steps = _newSteps;
+    _count = _newCount;
+    _loop = _newLoop;
+    uint32_t seq = _commandSeq;
+    xSemaphoreGive(_mutex);
+
+    _index = 0;
+    _frameWritten = false;
+    _running = (_steps != 0) && (_count > 0);
+    _appliedSeq = seq;
+
+    if (_running)
+    {
+        _deadline_us = uint32_t(esp_timer_get_time()) + g_startDelay_us;
+        _arm(g_startDelay_us);
+    }
+}
+
+void DacSequencer::_playStep()
+{
+    uint32_t now_us = uint32_t(esp_timer_get_time());
+    int32_t early_us = int32_t(_deadline_us - now_us);
+    if (early_us > g_timerSlack_us)
+    {
+        // A leftover expiry from before the last command
+        _arm(early_us);
+        return;
+    }
+
+    if (_index >= _count)
+    {
+        // The last step's dwell is up; its frame stays on the DAC
+        // until its owner takes over again
+        _running = false;
+        return;
+    }
+
+    uint32_t late_us = (early_us < 0) ? uint32_t(-early_us) : 0;
+    if (late_us > _maxLate_us)
+    {
+        _maxLate_us = late_us;
+    }
+    _lateSum_us += late_us;
+    if (_lateCount == 0)
+    {
+        _firstStep_us = now_us;
+    }
+    _lateCount++;
+    _lastStep_us = now_us;
+
+    const Step &step = _steps[_index];
+    if (!_frameWritten ||
+        (step.frame.bytes[0] != _lastFrame.bytes[0]) ||
+        (step.frame.bytes[1] != _lastFrame.bytes[1]))
+    {
+        TaskSyncShared *tss = TaskSyncShared::getInstance();
+        tss->takeI2c();
+        bool success = _dac->writeFrame(step.frame);
+        tss->giveI2c();
+
+        _writesIssued++;
+        if (!success)
+        {
+            _failedWrites++;
+        }
+        _frameWritten = success;
+        _lastFrame = step.frame;
+    }
+    _stepsPlayed++;
+
+    _deadline_us += uint32_t(step.dwell_10us) * g_dwellUnit_us;
+
+    // Past the end of a table that doesn't loop, the timer still
+    // runs out the last step's dwell before playing stops
+    _index++;
+    if ((_index >= _count) && _loop)
+    {
+        _index = 0;
+    }
+
+    now_us = uint32_t(esp_timer_get_time());
+    int32_t wait_us = int32_t(_deadline_us - now_us);
+    if ((_index < _count) &&
+        (wait_us < -int32_t(uint32_t(_steps[_index].dwell_10us) * g_dwellUnit_us)))
+    {
+        // More than a whole step behind; start counting from
+        // now instead of bursting through the backlog
+        _missedSteps++;
+        _deadline_us = now_us + g_minWait_us;
+    }
+    if (wait_us < g_minWait_us)
+    {
+        wait_us = g_minWait_us;
+    }
+
+    _arm(wait_us);
+}
+
+void DacSequencer::_arm(int32_t wait_us)
+{
+    esp_timer_stop(_timer);
+    esp_timer_start_once(_timer, uint64_t(wait_us));
+}
+
+void stepperTaskHelper(void *objPtr)
+{
+    if (objPtr != 0)
+    {
+        DacSequencer *sequencer = (DacSequencer *)objPtr;
+
+        sequencer->stepperTask();
+    }
+
+    vTaskDelete(NULL);
+}
@@ -0,0 +1,40 @@
+#include "DetentCounter.hpp"
+
+DetentCounter::DetentCounter(int countsPerDetent, int limit)
+    : _countsPerDetent(countsPerDetent),
+      _limit(limit),
+      _last(0),
+      _residual(0) {}
+
+void DetentCounter::reset(int reading)
+{
+    _last = reading;
+    _residual = 0;
+}
+
+int DetentCounter::update(int reading)
+{
+    int counts = (reading - _last) % _limit;
+    if (counts > (_limit / 2))
+    {
+        counts -= _limit;
+    }
+    else if (counts < -(_limit / 2))
+    {
+        counts += _limit;
+    }
+    _last = reading;
+
+    // Truncating towards zero keeps a half detent either way of
+    // the last whole one as the residual
+    counts += _residual;
+    int detents = counts / _countsPerDetent;
+    _residual = counts - (detents * _countsPerDetent);
+
+    return detents;
+}
+
+int DetentCounter::residual()
+{
+    return _residual;
+}
@@ -0,0 +1,79 @@
+#include "Measurement.hpp"
+#include "DynamicLoad.hpp"
+
+const int32_t DynamicLoad::g_maxFrequency_Hz = 5000;
+const uint32_t DynamicLoad::g_minDwell_us = 100;
+const size_t DynamicLoad::g_maxSteps;
+
+DynamicLoad::DynamicLoad(DacSequencer *sequencer)
+    : _sequencer(sequencer),
+      _steps(),
+      _period_us(0),
+      _started(false) {}
+
+bool DynamicLoad::start(const Config &config, const Calibration &calibration)
+{
+    if ((config.frequency_Hz <= 0) || (config.frequency_Hz > g_maxFrequency_Hz))
+    {
+        return false;
+    }
+
+    _sequencer->stop();
+
+    _period_us = 1000000 / uint32_t(config.frequency_Hz);
+
+    // Each half has to last long enough for the write to land
+    uint32_t high_us = uint32_t((uint64_t(_period_us) * uint32_t(config.duty_pct)) / 100);
+    if (high_us < g_minDwell_us)
+    {
+        high_us = g_minDwell_us;
+    }
+    if (high_us > (_period_us - g_minDwell_us))
+    {
+        high_us = _period_us - g_minDwell_us;
+    }
+
+    size_t count = DacSequencer::fill(_steps, g_maxSteps / 2,
+                                      encodeCurrent(config.high_uA, calibration),
+                                      high_us);
+    count += DacSequencer::fill(_steps + count, g_maxSteps - count,
+                                encodeCurrent(config.low_uA, calibration),
+                                _period_us - high_us);
+
+    _sequencer->play(_steps, count, true);
+    _started = true;
+
+    return true;
+}
+
+void DynamicLoad::stop()
+{
+    // The sequencer is shared, only stop what we started
+    if (_started)
+    {
+        _sequencer->stop();
+        _started = false;
+    }
+}
+
+bool DynamicLoad::running()
+{
+    return _started && _sequencer->running();
+}
+
+uint32_t DynamicLoad::period_us()
+{
+    return _period_us;
+}
+
+MCP4726::Frame DynamicLoad::encodeCurrent(int32_t current_uA, const Calibration &calibration)
+{
+    // Same mapping as the control task: zero is always code 0
+    uint16_t code = 0;
+    if (current_uA > 0)
+    {
+        code = Measurement::microAmpsToDacCode(calibration.apply(Calibration::CH_DAC_CURRENT, current_uA));
+    }
+
+    return MCP4726::encodeDAC(code);
+}
@@ -1,4 +1,8 @@
+#include <string.h>
+#include <stdlib.h>
 #include "TaskSyncShared.hpp"
+#include <esp_timer.h>
+#include "Log.hpp"
 #include "ElectronicLoadV2.hpp"
 
 const int ElectronicLoadV2::g_aPin = 33;
@@ -6,33 +10,106 @@ const int ElectronicLoadV2::g_bPin = 32;
 const int ElectronicLoadV2::g_zPin = 25;
 const uint8_t ElectronicLoadV2::g_screenI2cAddr = 0x3C;
 const int ElectronicLoadV2::g_encoderDetentsPerRev = 24;
+const TickType_t ElectronicLoadV2::g_mainTaskPeriod_ticks = 10 / portTICK_PERIOD_MS;
+const unsigned long ElectronicLoadV2::g_readingsInterval_ms = 500;
+const unsigned long ElectronicLoadV2::g_samplerStatsInterval_ms = 5000;
+const size_t ElectronicLoadV2::g_drainChunkSamples;
+const size_t ElectronicLoadV2::g_calCaptureSamples;
+const TickType_t ElectronicLoadV2::g_controlPeriod_ticks = 1;
+const UBaseType_t ElectronicLoadV2::g_controlTaskPriority = 2;
+const uint32_t ElectronicLoadV2::g_controlMaxSampleAge_us = 5000;
+const int ElectronicLoadV2::g_eepromWritePolls = 20;
+const unsigned long ElectronicLoadV2::g_eepromWritePoll_ms = 5;
+// 128 columns make a graph of 2.56 s
+const uint32_t ElectronicLoadV2::g_defaultGraphColumn_us = 20000;
+const uint32_t ElectronicLoadV2::g_knobLatencyTarget_us = 10000;
 
 static void mainTaskHelper(void *objPtr);
+static void controlTaskHelper(void *objPtr);
+static void delayUntilOrNotified(TickType_t *lastWake, TickType_t period);
 
 ElectronicLoadV2::ElectronicLoadV2()
     : _mcp4726(),
       _max11645(),
-      _data(),
+      _samples(),
+      _sampler(&_max11645, &_samples),
+      _lastSamplesTaken(0),
+      _lastSamplesSent(0),
+      _lastModeUpdates(0),
+      _lastSamplerStats_ms(0),
+      _statsReader(),
+      _statistics(),
+      _lastReadings_ms(0),
+      _trace(),
+      _graphVisible(false),
+      _telemetry(&_samples),
+      _dacSequencer(&_mcp4726),
+      _dynamicLoad(&_dacSequencer),
+      _listMode(&_dacSequencer),
+      _listLoop(false),
+      _batteryTest(&_mcp4726),
+      _settingsStore(),
+      _storedCalibrationVersion(0),
+      _calibration(),
+      _calibrationVersion(0),
+      _regulator(),
+      _modeEngine(),
+      _controlReader(),
+      _controlCalibration(),
+      _controlTaskHandle(NULL),
+      _controlMode(ModeEngine::MODE_CC),
+      _controlSetpoint(0),
+      _controlEnabled(false),
+      _gains(),
+      _gainsVersion(0),
+      _closedLoop(false),
+      _dacCommand_uA(0),
+      _dacApplied_uA(0),
+      _controlMaxPeriod_us(0),
+      _controlOverruns(0),
+      _modeTarget_uA(0),
+      _modeUpdates(0),
+      _controlKnobEvent(),
+      _controlKnobEventPending(false),
+      _knobLatency(),
+      _knobLatencyReset(false),
+      _console(),
       _textUI(g_screenI2cAddr),
       _encoder(g_aPin, g_bPin, g_zPin,
                g_encoderDetentsPerRev),
-      _mutex(0),
+      _mutex("load"),
       _mainTaskHandle(NULL),
-      _desiredCurrent(0.0),
-      _isEnabled(false),
-      _settingsChanged(false),
-      _newDesiredCurrent(0.0),
-      _newIsEnabled(false)
+      _settings(),
+      _settingsChanged(true),
+      _newSettings(),
+      _newKnobEventValid(false),
+      _newKnobEvent(),
+      _graphChanged(false),
+      _newGraphVisible(false),
+      _newGraphQuantity(Statistics::Q_CURRENT),
+      _commandPending(false),
+      _pendingCommand()
 {
     _encoder.setListener(&_textUI);
 
-    _mutex = xSemaphoreCreateMutex();
+    _settings.mode = ModeEngine::MODE_CC;
+    _settings.dynamic.frequency_Hz = 100;
+    _settings.dynamic.duty_pct = 50;
+    _settings.isEnabled = false;
+    _newSettings = _settings;
+
+    _gains.kp_q16 = CurrentRegulator::g_defaultKp_q16;
+    _gains.ki_q16 = CurrentRegulator::g_defaultKi_q16;
+    _gains.voltageKp_q16 = ModeEngine::g_defaultVoltageKp_q16;
+    _gains.voltageKi_q16 = ModeEngine::g_defaultVoltageKi_q16;
+
+    _trace.configure(Statistics::Q_CURRENT, g_defaultGraphColumn_us);
 }
 
 bool ElectronicLoadV2::start()
 {
     if (xTaskCreate(mainTaskHelper,
-                    "ElectronicLoadV2::mainTask",
+                    "main",
                     4000,
                     (void *)this,
                     1,
@@ -54,41 +131,46 @@ void ElectronicLoadV2::mainTask()
     Serial.printf("\r\nelectronic-load-v2 %s %s\r\n", __DATE__, __TIME__);
     tss->giveSerial();
 
+    if (!Log::getInstance()->start())
+    {
+        tss->takeSerial();
+        Serial.println("Failed to start log task");
+        tss->giveSerial();
+    }
+
     // Join I2C bus
     tss->takeI2c();
     bool success = Wire.begin();
     tss->giveI2c();
     if (!success)
     {
-        tss->takeSerial();
-        Serial.println("Wire.begin() failed");
-        tss->giveSerial();
+        LOG_ERROR("Wire.begin() failed");
         vTaskDelete(NULL);
     }
 
     _textUI.setListener(this);
     if (!_textUI.init())
     {
-        tss->takeSerial();
-        Serial.println("Failed to initialize text UI");
-        tss->giveSerial();
+        LOG_ERROR("Failed to initialize text UI");
         vTaskDelete(NULL);
     }
 
     _encoder.init();
 
-    tss->takeSerial();
-    Serial.print("Initializing MCP4726...");
-    tss->giveSerial();
-    tss->takeI2c();
-    _mcp4726.writeMem(MCP4726::REF_VREF_BUFFERED, MCP4726::PD_RUN, MCP4726::G_1X, 0, true);
-    tss->giveI2c();
-    delay(200);
-    tss->takeSerial();
-    Serial.println("done.");
+    _loadStoredSettings();
 
-    Serial.print("Initializing MAX11645...");
-    tss->giveSerial();
+    _initDac();
+
+    if (!_dacSequencer.init())
+    {
+        LOG_ERROR("Failed to start DAC sequencer");
+    }
+    if (_listMode.load())
+    {
+        LOG_INFO("Loaded %s list profile", ListMode::shapeName(_listMode.profile().shape));
+    }
+
+    LOG_INFO("Initializing MAX11645...");
     tss->takeI2c();
     _max11645.writeAll(MAX11645::SM_UP_FROM_AIN0_TO_CS0,
                        MAX11645::CS_AIN1,
@@ -98,123 +180,1747 @@ void ElectronicLoadV2::mainTask()
                        MAX11645::DSM_UNIPOLAR);
     tss->giveI2c();
     delay(200);
-    tss->takeSerial();
-    Serial.println("done.");
-    tss->giveSerial();
 
+    _sampler.setListener(&_batteryTest);
+    if (!_sampler.start())
+    {
+        LOG_ERROR("Failed to start sampler");
+        vTaskDelete(NULL);
+    }
+    _samples.attach(&_statsReader);
+    _samples.attach(&_controlReader);
+
+    if (xTaskCreate(controlTaskHelper,
+                    "control",
+                    3000,
+                    (void *)this,
+                    g_controlTaskPriority,
+                    &_controlTaskHandle) != pdPASS)
+    {
+        LOG_ERROR("Failed to start control task");
+        vTaskDelete(NULL);
+    }
+
+    if (!_telemetry.start())
+    {
+        LOG_ERROR("Failed to start telemetry");
+    }
+
+    _lastSamplerStats_ms = millis();
+    _lastReadings_ms = _lastSamplerStats_ms;
+
+    _console.setListener(this);
+    if (!_console.start())
+    {
+        LOG_ERROR("Failed to start console");
+    }
+
+    TickType_t lastWake = xTaskGetTickCount();
     while (true)
     {
         bool settingsChanged = false;
-        double newDesiredCurrent = _desiredCurrent;
-        bool newIsEnabled = _isEnabled;
+        Settings newSettings;
+        bool knobEventValid = false;
+        KnobEvent knobEvent;
+        bool commandPending = false;
+        char command[Console::g_maxLineLen];
+        bool graphChanged = false;
+        bool graphVisible = false;
+        Statistics::Quantity graphQuantity = Statistics::Q_CURRENT;
 
-        xSemaphoreTake(_mutex, portMAX_DELAY);
+        _mutex.take();
         if (_settingsChanged)
         {
             _settingsChanged = false;
             settingsChanged = true;
-            newDesiredCurrent = _newDesiredCurrent;
-            newIsEnabled = _newIsEnabled;
+            newSettings = _newSettings;
+            knobEventValid = _newKnobEventValid;
+            knobEvent = _newKnobEvent;
+            _newKnobEventValid = false;
+        }
+        if (_commandPending)
+        {
+            _commandPending = false;
+            commandPending = true;
+            strcpy(command, _pendingCommand);
         }
-        xSemaphoreGive(_mutex);
+        if (_graphChanged)
+        {
+            _graphChanged = false;
+            graphChanged = true;
+            graphVisible = _newGraphVisible;
+            graphQuantity = _newGraphQuantity;
+        }
+        _mutex.give();
 
         if (settingsChanged)
         {
-            _updateSettings(newDesiredCurrent, newIsEnabled);
+            _updateSettings(newSettings, knobEventValid ? &knobEvent : 0);
+        }
+
+        if (commandPending)
+        {
+            _runCommand(command);
+        }
+
+        if (graphChanged)
+        {
+            _updateGraph(graphVisible, graphQuantity, _trace.column_us());
+        }
+
+        _checkListFinished();
+        _checkBatteryTest();
+
+        if (_calibrationVersion != _storedCalibrationVersion)
+        {
+            _storedCalibrationVersion = _calibrationVersion;
+
+            Calibration::Stored stored;
+            _mutex.take();
+            _calibration.store(&stored);
+            _mutex.give();
+            _settingsStore.stage(SettingsStore::SLOT_CALIBRATION, &stored, sizeof(stored));
+        }
+        _settingsStore.service(millis());
+
+        _drainSamples();
+
+        if ((millis() - _lastReadings_ms) >= g_readingsInterval_ms)
+        {
+            _lastReadings_ms = millis();
+            _updateReadings();
+        }
+
+        _reportSamplerStats();
+
+        // UI edits and console commands wake us early
+        delayUntilOrNotified(&lastWake, g_mainTaskPeriod_ticks);
+    }
+}
+
+void ElectronicLoadV2::controlTask()
+{
+    TaskSyncShared *tss = TaskSyncShared::getInstance();
+
+    Sample samples[g_drainChunkSamples];
+    uint32_t calibrationVersion = _calibrationVersion - 1;
+    uint32_t gainsVersion = _gainsVersion - 1;
+    uint32_t lastSample_us = 0;
+    int32_t measured_uV = 0;
+    int32_t measured_uA = 0;
+    ModeEngine::Mode mode = ModeEngine::MODE_CC;
+    int32_t target_uA = 0;
+    bool closedLoop = false;
+    uint16_t dacCode = 0;
+    bool dacWritten = false;
+    bool knobEventPending = false;
+    KnobEvent knobEvent;
+
+    uint32_t lastWake_us = uint32_t(esp_timer_get_time());
+    TickType_t lastWake = xTaskGetTickCount();
+    while (true)
+    {
+        uint32_t now_us = uint32_t(esp_timer_get_time());
+        uint32_t period_us = now_us - lastWake_us;
+        lastWake_us = now_us;
+        if (period_us > _controlMaxPeriod_us)
+        {
+            _controlMaxPeriod_us = period_us;
+        }
+        if (period_us > (2 * g_controlPeriod_ticks * portTICK_PERIOD_MS * 1000))
+        {
+            _controlOverruns++;
+        }
+
+        if (_knobLatencyReset)
+        {
+            memset(&_knobLatency, 0, sizeof(_knobLatency));
+            _knobLatencyReset = false;
+        }
+
+        // Set after the settings it goes with, so they are in place
+        if (_controlKnobEventPending)
+        {
+            knobEvent = _controlKnobEvent;
+            _controlKnobEventPending = false;
+            knobEventPending = true;
+        }
+
+        if (_calibrationVersion != calibrationVersion)
+        {
+            _mutex.take();
+            _controlCalibration = _calibration;
+            calibrationVersion = _calibrationVersion;
+            _mutex.give();
+        }
+
+        // Gains change as a set, and never halfway through a pass
+        if (_gainsVersion != gainsVersion)
+        {
+            _mutex.take();
+            Gains gains = _gains;
+            gainsVersion = _gainsVersion;
+            _mutex.give();
+
+            _regulator.setGains(gains.kp_q16, gains.ki_q16);
+            _modeEngine.setVoltageGains(gains.voltageKp_q16, gains.voltageKi_q16);
+        }
+
+        // Average whatever arrived since the last period
+        int64_t sum_uV = 0;
+        int64_t sum_uA = 0;
+        size_t total = 0;
+        size_t count;
+        while ((count = _samples.read(&_controlReader, samples, g_drainChunkSamples)) > 0)
+        {
+            for (size_t i = 0; i < count; i++)
+            {
+                sum_uV += _controlCalibration.apply(Calibration::CH_LOAD_VOLTAGE,
+                                                    Measurement::countsToMicroVolts(samples[i].ain0));
+                sum_uA += _controlCalibration.apply(Calibration::CH_LOAD_CURRENT,
+                                                    Measurement::countsToMicroAmps(samples[i].ain1));
+            }
+            total += count;
+            lastSample_us = samples[count - 1].timestamp_us;
+        }
+        bool fresh = total > 0;
+        if (fresh)
+        {
+            measured_uV = int32_t(sum_uV / int64_t(total));
+            measured_uA = int32_t(sum_uA / int64_t(total));
+        }
+        bool stale = (now_us - lastSample_us) > g_controlMaxSampleAge_us;
+
+        bool enabled = _controlEnabled && !_batteryTest.loadCut();
+        if (_controlMode != mode)
+        {
+            mode = _controlMode;
+            _modeEngine.setMode(mode);
+        }
+        _modeEngine.setSetpoint(_controlSetpoint);
+        if (!enabled)
+        {
+            _modeEngine.reset();
+        }
+
+        // The CV, CR and CP targets follow the voltage, so they
+        // only move on fresh samples and shed the load once the
+        // samples go stale; CC doesn't depend on the voltage
+        if (mode == ModeEngine::MODE_CC)
+        {
+            target_uA = _modeEngine.update(measured_uV);
+        }
+        else if (stale)
+        {
+            target_uA = 0;
+            _modeEngine.reset();
+        }
+        else if (fresh && enabled)
+        {
+            target_uA = _modeEngine.update(measured_uV);
+            _modeUpdates++;
+        }
+        _modeTarget_uA = target_uA;
+
+        if (_closedLoop != closedLoop)
+        {
+            closedLoop = _closedLoop;
+            _regulator.reset();
+        }
+
+        int32_t command_uA = 0;
+        if (enabled)
+        {
+            if (!closedLoop || stale)
+            {
+                // Fall back to open loop rather than integrate
+                // against a measurement we no longer have
+                command_uA = target_uA;
+                _regulator.reset();
+            }
+            else if (fresh)
+            {
+                command_uA = _regulator.update(target_uA, measured_uA);
+            }
+            else
+            {
+                command_uA = _dacCommand_uA;
+            }
         }
+        else
+        {
+            _regulator.reset();
+        }
+        _dacCommand_uA = command_uA;
+
+        // Off means off, whatever the calibration offset says
+        int32_t applied_uA = 0;
+        if (command_uA != 0)
+        {
+            applied_uA = _controlCalibration.apply(Calibration::CH_DAC_CURRENT, command_uA);
+        }
+        _dacApplied_uA = applied_uA;
+        uint16_t newDacCode = Measurement::microAmpsToDacCode(applied_uA);
+        if (_dacSequencer.running())
+        {
+            // The sequencer has the DAC; rewrite our own command
+            // as soon as it lets go
+            dacWritten = false;
+        }
+        else if (!dacWritten || (newDacCode != dacCode))
+        {
+            tss->takeI2c();
+            if (_batteryTest.loadCut())
+            {
+                // Cut since this period started; the battery test
+                // has already written zero and must stay last
+                newDacCode = 0;
+            }
+            dacWritten = _mcp4726.writeDAC(newDacCode);
+            tss->giveI2c();
+            dacCode = newDacCode;
 
-        _readADC();
+            LOG_DEBUG("Set dac value %d", newDacCode);
+        }
+
+        // The edit has reached the DAC, or left it where it was
+        if (knobEventPending)
+        {
+            _recordKnobLatency(knobEvent, uint32_t(esp_timer_get_time()));
+            knobEventPending = false;
+        }
 
-        vTaskDelay(500 / portTICK_PERIOD_MS);
+        // A settings change wakes us early
+        delayUntilOrNotified(&lastWake, g_controlPeriod_ticks);
     }
 }
 
-void ElectronicLoadV2::desiredCurrentChanged(TextUI *source, double desiredCurrent)
+void ElectronicLoadV2::modeChanged(TextUI *source, ModeEngine::Mode mode)
+{
+    _mutex.take();
+    _newSettings.mode = mode;
+    _settingsChanged = true;
+    _noteKnobEvent(source);
+    _mutex.give();
+
+    _wakeMainTask();
+}
+
+void ElectronicLoadV2::setpointChanged(TextUI *source, ModeEngine::Mode mode, int32_t setpoint)
+{
+    _mutex.take();
+    _newSettings.setpoints[mode] = setpoint;
+    _settingsChanged = true;
+    _noteKnobEvent(source);
+    _mutex.give();
+
+    _wakeMainTask();
+}
+
+void ElectronicLoadV2::dynamicChanged(TextUI *source, const DynamicLoad::Config &config)
 {
-    xSemaphoreTake(_mutex, portMAX_DELAY);
-    _newDesiredCurrent = desiredCurrent;
+    _mutex.take();
+    _newSettings.dynamic = config;
     _settingsChanged = true;
-    xSemaphoreGive(_mutex);
+    _noteKnobEvent(source);
+    _mutex.give();
+
+    _wakeMainTask();
 }
 
 void ElectronicLoadV2::enabledChanged(TextUI *source, bool isEnabled)
 {
-    xSemaphoreTake(_mutex, portMAX_DELAY);
-    _newIsEnabled = isEnabled;
+    _mutex.take();
+    _newSettings.isEnabled = isEnabled;
     _settingsChanged = true;
-    xSemaphoreGive(_mutex);
+    _noteKnobEvent(source);
+    _mutex.give();
+
+    _wakeMainTask();
 }
 
-bool ElectronicLoadV2::_readADC()
+void ElectronicLoadV2::graphChanged(TextUI *source, bool visible, Statistics::Quantity quantity)
 {
-    TaskSyncShared *tss = TaskSyncShared::getInstance();
+    _mutex.take();
+    _newGraphVisible = visible;
+    _newGraphQuantity = quantity;
+    _graphChanged = true;
+    _mutex.give();
 
-    tss->takeI2c();
-    uint16_t *result = _max11645.readSamples(_data, 2);
-    tss->giveI2c();
+    _wakeMainTask();
+}
+
+void ElectronicLoadV2::lineReceived(Console *source, const char *line)
+{
+    // Commands run on mainTask, which owns the state they touch
+    _mutex.take();
+    strncpy(_pendingCommand, line, sizeof(_pendingCommand) - 1);
+    _pendingCommand[sizeof(_pendingCommand) - 1] = '\0';
+    _commandPending = true;
+    _mutex.give();
+
+    _wakeMainTask();
+}
+
+void ElectronicLoadV2::_noteKnobEvent(TextUI *source)
+{
+    // Called with _mutex held; edits that queue up before the main
+    // task gets to them are timed from the first
+    if (!_newKnobEventValid)
+    {
+        _newKnobEvent.edge_us = source->editEdge_us();
+        _newKnobEvent.edit_us = uint32_t(esp_timer_get_time());
+        _newKnobEventValid = true;
+    }
+}
+
+void ElectronicLoadV2::_recordKnobLatency(const KnobEvent &knobEvent, uint32_t dac_us)
+{
+    uint32_t latency_us = dac_us - knobEvent.edge_us;
+
+    _knobLatency.count++;
+    _knobLatency.sum_us += latency_us;
+    _knobLatency.last_us = latency_us;
+    if (latency_us > _knobLatency.max_us)
+    {
+        _knobLatency.max_us = latency_us;
+    }
+    if (latency_us > g_knobLatencyTarget_us)
+    {
+        _knobLatency.overTarget++;
+    }
+    _knobLatency.lastEvent = knobEvent;
+}
+
+void ElectronicLoadV2::_wakeMainTask()
+{
+    if (_mainTaskHandle != NULL)
+    {
+        xTaskNotifyGive(_mainTaskHandle);
+    }
+}
+
+void ElectronicLoadV2::_drainSamples()
+{
+    Sample samples[g_drainChunkSamples];
+
+    size_t count;
+    while ((count = _samples.read(&_statsReader, samples, g_drainChunkSamples)) > 0)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            int32_t voltage_uV = _calibration.apply(Calibration::CH_LOAD_VOLTAGE,
+                                                    Measurement::countsToMicroVolts(samples[i].ain0));
+            int32_t current_uA = _calibration.apply(Calibration::CH_LOAD_CURRENT,
+                                                    Measurement::countsToMicroAmps(samples[i].ain1));
+
+            _statistics.update(samples[i].timestamp_us, voltage_uV, current_uA);
 
-    if (result != _data)
+            Trace::Column column;
+            if (_graphVisible &&
+                _trace.update(samples[i].timestamp_us, voltage_uV, current_uA, &column))
+            {
+                _textUI.graphColumn(column);
+            }
+        }
+    }
+}
+
+void ElectronicLoadV2::_updateGraph(bool visible, Statistics::Quantity quantity, uint32_t column_us)
+{
+    // Restarts the trace either way, columns of the old quantity
+    // or period mean nothing on the new graph
+    _trace.configure(quantity, column_us);
+    _graphVisible = visible;
+    _textUI.setGraph(visible, quantity);
+}
+
+bool ElectronicLoadV2::_updateReadings()
+{
+    // The display shows the 10ms mean, the serial line the 1s window
+    Statistics::Snapshot shortWindow;
+    Statistics::Snapshot longWindow;
+    if (!_statistics.snapshot(0, &shortWindow) ||
+        !_statistics.snapshot(1, &longWindow))
     {
         return false;
     }
 
-    double loadVoltage = (_data[0] * 0.0005) * 15;
-    double loadCurrent = ((_data[1] * 0.0005) / 67) / 0.01;
+    const Statistics::Summary &v = longWindow.q[Statistics::Q_VOLTAGE];
+    const Statistics::Summary &i = longWindow.q[Statistics::Q_CURRENT];
+    const Statistics::Summary &p = longWindow.q[Statistics::Q_POWER];
 
-    tss->takeSerial();
-    Serial.printf("AIN0: %4d [%5.3lfV] (%5.3lfV) AIN1: %4d [%5.3lfV] (%8.3lfmA)\r\n", _data[0], _data[0] * 0.0005, loadVoltage, _data[1], _data[1] * 0.0005, loadCurrent * 1000);
-    tss->giveSerial();
+    LOG_INFO("V %8ld uV (pp %7ld rms %8ld) I %8ld uA (pp %7ld rms %8ld) P %9ld uW (pp %8ld)",
+             (long)v.mean, (long)v.ripple, (long)v.rms,
+             (long)i.mean, (long)i.ripple, (long)i.rms,
+             (long)p.mean, (long)p.ripple);
+
+    if (_batteryTest.state() != BatteryTest::BT_IDLE)
+    {
+        BatteryTest::Result result;
+        _batteryTest.result(&result);
+        _textUI.batteryChanged(true, int32_t(result.charge_uAh), int32_t(result.energy_uWh));
+    }
 
-    _textUI.loadVoltageChanged(loadVoltage);
-    _textUI.loadCurrentChanged(loadCurrent);
+    _textUI.loadVoltageChanged(shortWindow.q[Statistics::Q_VOLTAGE].mean);
+    _textUI.loadCurrentChanged(shortWindow.q[Statistics::Q_CURRENT].mean);
 
     return true;
 }
 
-void ElectronicLoadV2::_updateSettings(double newDesiredCurrent,
-                                       bool newIsEnabled)
+void ElectronicLoadV2::_reportSamplerStats()
 {
-    if (_desiredCurrent != newDesiredCurrent)
+    unsigned long now = millis();
+    unsigned long elapsed_ms = now - _lastSamplerStats_ms;
+    if (elapsed_ms < g_samplerStatsInterval_ms)
     {
-        _desiredCurrent = newDesiredCurrent;
+        return;
     }
 
-    if (_isEnabled != newIsEnabled)
+    uint32_t samplesTaken = _sampler.samplesTaken();
+    uint32_t samplesPerSec = uint32_t((uint64_t(samplesTaken - _lastSamplesTaken) * 1000) / elapsed_ms);
+    _lastSamplesTaken = samplesTaken;
+
+    uint32_t samplesSent = _telemetry.samplesSent();
+    uint32_t sentPerSec = uint32_t((uint64_t(samplesSent - _lastSamplesSent) * 1000) / elapsed_ms);
+    _lastSamplesSent = samplesSent;
+
+    uint32_t modeUpdates = _modeUpdates;
+    uint32_t modeUpdatesPerSec = uint32_t((uint64_t(modeUpdates - _lastModeUpdates) * 1000) / elapsed_ms);
+    _lastModeUpdates = modeUpdates;
+
+    _lastSamplerStats_ms = now;
+
+    LOG_INFO("Sampler: %s profile, %u samples/s, %u failed reads, %u dropped", Sampler::profileName(_sampler.profile()), (unsigned)samplesPerSec, (unsigned)_sampler.failedReads(), (unsigned)_statsReader.dropped());
+    if (_telemetry.mode() != Telemetry::TM_OFF)
+    {
+        LOG_INFO("Telemetry: %s, %u samples/s, %u dropped", Telemetry::modeName(_telemetry.mode()), (unsigned)sentPerSec, (unsigned)_telemetry.dropped());
+    }
+    if (_dynamicLoad.running() || _listMode.running())
+    {
+        LOG_INFO("Sequencer: %u steps, %u writes, late mean %u us max %u us, %u missed", (unsigned)_dacSequencer.stepsPlayed(), (unsigned)_dacSequencer.writesIssued(), (unsigned)_dacSequencer.meanLate_us(), (unsigned)_dacSequencer.maxLate_us(), (unsigned)_dacSequencer.missedSteps());
+    }
+    else if (_settings.isEnabled && (_settings.mode != ModeEngine::MODE_CC))
     {
-        _isEnabled = newIsEnabled;
+        LOG_INFO("Mode: %s, %u updates/s, target %ld uA", ModeEngine::modeName(_settings.mode), (unsigned)modeUpdatesPerSec, (long)_modeTarget_uA);
     }
+}
 
-    TaskSyncShared *tss = TaskSyncShared::getInstance();
-    tss->takeI2c();
-    if (_isEnabled)
+void ElectronicLoadV2::_updateSettings(const Settings &newSettings, const KnobEvent *knobEvent /* = 0 */)
+{
+    bool dynamicChanged = (memcmp(&_settings.dynamic, &newSettings.dynamic, sizeof(DynamicLoad::Config)) != 0);
+
+    memcpy(_settings.setpoints, newSettings.setpoints, sizeof(_settings.setpoints));
+    _settings.dynamic = newSettings.dynamic;
+
+    if (_settings.isEnabled != newSettings.isEnabled)
     {
-        double desiredSenseVoltage = _desiredCurrent * 0.01;
-        uint16_t dacValue = uint16_t(desiredSenseVoltage * 67 / 0.0005);
-        tss->takeSerial();
-        Serial.printf("Set dac value %d\r\n", dacValue);
-        tss->giveSerial();
-        _mcp4726.writeDAC(dacValue);
+        _settings.isEnabled = newSettings.isEnabled;
     }
-    else
+
+    if (_settings.mode != newSettings.mode)
     {
-        tss->takeSerial();
-        Serial.printf("Set dac value %d\r\n", 0);
-        tss->giveSerial();
-        _mcp4726.writeDAC(0);
+        // A setpoint that was safe in one mode can mean a very
+        // different current in another, so switching turns the load off
+        _settings.mode = newSettings.mode;
+        _settings.isEnabled = false;
+    }
+
+    // Keep the pending copy in step so a later UI edit starts from
+    // what was applied here, unless the UI already has another edit queued
+    _mutex.take();
+    if (!_settingsChanged)
+    {
+        _newSettings = _settings;
+    }
+    _mutex.give();
+
+    if (!_settings.isEnabled ||
+        ((_settings.mode != ModeEngine::MODE_CC) && (_settings.mode != ModeEngine::MODE_CP)))
+    {
+        _batteryTest.stop();
     }
-    tss->giveI2c();
 
-    _textUI.setDesiredCurrent(_desiredCurrent);
-    _textUI.setEnabled(_isEnabled);
+    // A mode change has just turned the load off, so the samples
+    // already taken without the voltage go nowhere
+    if (_voltageNeeded() && (_sampler.profile() == Sampler::PROFILE_CURRENT_ONLY))
+    {
+        _sampler.setProfile(Sampler::PROFILE_FAST);
+        LOG_WARN("%s mode needs the voltage, sampler back to %s", ModeEngine::modeName(_settings.mode), Sampler::profileName(Sampler::PROFILE_FAST));
+    }
+
+    // The control task owns the DAC and picks these up next period;
+    // it is off before the mode and setpoint can disagree
+    if (!_settings.isEnabled)
+    {
+        _controlEnabled = false;
+    }
+    _updateSequencer(dynamicChanged);
+    _controlMode = _settings.mode;
+    _controlSetpoint = _settings.setpoints[_settings.mode];
+    _controlEnabled = _settings.isEnabled;
+    if (knobEvent != 0)
+    {
+        _controlKnobEvent = *knobEvent;
+        _controlKnobEvent.applied_us = uint32_t(esp_timer_get_time());
+        _controlKnobEventPending = true;
+    }
+    if (_controlTaskHandle != NULL)
+    {
+        xTaskNotifyGive(_controlTaskHandle);
+    }
+    _stageSettings();
+
+    LOG_INFO("Mode %s, setpoint %ld, %s", ModeEngine::modeName(_settings.mode), (long)_settings.setpoints[_settings.mode], _settings.isEnabled ? "on" : "off");
+
+    _textUI.setMode(_settings.mode);
+    for (int i = 0; i < ModeEngine::MODE_COUNT; i++)
+    {
+        _textUI.setSetpoint(ModeEngine::Mode(i), _settings.setpoints[i]);
+    }
+    _textUI.setDynamic(_settings.dynamic);
+    _textUI.setEnabled(_settings.isEnabled);
 }
 
-void mainTaskHelper(void *objPtr)
+void ElectronicLoadV2::_updateSequencer(bool dynamicChanged)
 {
-    if (objPtr != 0)
+    bool wantDynamic = _settings.isEnabled && (_settings.mode == ModeEngine::MODE_DYNAMIC);
+    bool wantList = _settings.isEnabled && (_settings.mode == ModeEngine::MODE_LIST);
+
+    // Both share the sequencer, so let go of it before starting
+    if (!wantDynamic)
     {
-        ElectronicLoadV2 *app = (ElectronicLoadV2 *)objPtr;
+        _dynamicLoad.stop();
+    }
+    if (!wantList)
+    {
+        _listMode.stop();
+    }
 
-        app->mainTask();
+    if ((wantDynamic && (dynamicChanged || !_dynamicLoad.running())) ||
+        (wantList && !_listMode.running() && !_listMode.finished()))
+    {
+        // Compiling reads the calibration, playback doesn't
+        _mutex.take();
+        Calibration calibration = _calibration;
+        _mutex.give();
+
+        if (wantDynamic)
+        {
+            _dacSequencer.resetStats();
+            if (!_dynamicLoad.start(_settings.dynamic, calibration))
+            {
+                LOG_WARN("Dynamic load config rejected: %ld Hz", (long)_settings.dynamic.frequency_Hz);
+            }
+            else
+            {
+                LOG_INFO("Dynamic load %ld/%ld uA, %u us period, %ld%% duty", (long)_settings.dynamic.high_uA, (long)_settings.dynamic.low_uA, (unsigned)_dynamicLoad.period_us(), (long)_settings.dynamic.duty_pct);
+            }
+        }
+        else
+        {
+            if (!_listMode.compile(calibration) || !_listMode.start(_listLoop))
+            {
+                LOG_WARN("List profile doesn't compile into %u steps", (unsigned)ListMode::g_maxTableSteps);
+            }
+            else
+            {
+                LOG_INFO("List %s, %u steps, %u ms", ListMode::shapeName(_listMode.profile().shape), (unsigned)_listMode.tableSize(), (unsigned)(_listMode.tableDuration_us() / 1000));
+            }
+        }
+    }
+}
+
+void ElectronicLoadV2::_checkBatteryTest()
+{
+    if (_batteryTest.state() != BatteryTest::BT_CUTOFF)
+    {
+        return;
+    }
+
+    // The load is already cut; bring the settings in line and
+    // release the DAC back to the control task
+    Settings settings = _settings;
+    settings.isEnabled = false;
+    _updateSettings(settings);
+    _batteryTest.finish();
+
+    BatteryTest::Result result;
+    _batteryTest.result(&result);
+    LOG_INFO("Battery cutoff at %ld uV: %ld uAh, %ld uWh in %u s, cut in %u us",
+             (long)result.lastVoltage_uV,
+             (long)result.charge_uAh,
+             (long)result.energy_uWh,
+             (unsigned)(result.elapsed_ms / 1000),
+             (unsigned)result.cutoffLatency_us);
+}
+
+void ElectronicLoadV2::_initDac()
+{
+    TaskSyncShared *tss = TaskSyncShared::getInstance();
+
+    LOG_INFO("Initializing MCP4726...");
+
+    // The EEPROM sets what the DAC drives from power-up until we
+    // take over, so it must hold zero; only program it when it
+    // doesn't, since every write is slow and wears the cell
+    MCP4726::Memory eeprom;
+    tss->takeI2c();
+    bool eepromRead = _mcp4726.readMem(0, &eeprom);
+    tss->giveI2c();
+
+    bool program = !eepromRead ||
+                   (eeprom.ref != MCP4726::REF_VREF_BUFFERED) ||
+                   (eeprom.pd != MCP4726::PD_RUN) ||
+                   (eeprom.gain != MCP4726::G_1X) ||
+                   (eeprom.dacValue != 0);
+
+    tss->takeI2c();
+    _mcp4726.writeMem(MCP4726::REF_VREF_BUFFERED, MCP4726::PD_RUN, MCP4726::G_1X, 0, program);
+    tss->giveI2c();
+
+    if (program)
+    {
+        LOG_INFO("Programmed MCP4726 EEPROM");
+
+        // Further commands are ignored until the write cycle ends
+        for (int i = 0; i < g_eepromWritePolls; i++)
+        {
+            delay(g_eepromWritePoll_ms);
+
+            tss->takeI2c();
+            bool read = _mcp4726.readMem(0, &eeprom);
+            tss->giveI2c();
+
+            if (read && eeprom.ready)
+            {
+                break;
+            }
+        }
+    }
+}
+
+void ElectronicLoadV2::_loadStoredSettings()
+{
+    // The load always comes up off, whatever it was when stored
+    Settings settings;
+    if (_settingsStore.load(SettingsStore::SLOT_SETTINGS, &settings, sizeof(settings)) &&
+        (settings.mode < ModeEngine::MODE_COUNT))
+    {
+        settings.isEnabled = false;
+        _settings = settings;
+        _newSettings = settings;
+        LOG_INFO("Restored %s mode settings", ModeEngine::modeName(_settings.mode));
+    }
+
+    Calibration::Stored stored;
+    if (_settingsStore.load(SettingsStore::SLOT_CALIBRATION, &stored, sizeof(stored)))
+    {
+        _mutex.take();
+        bool restored = _calibration.restore(stored);
+        if (restored)
+        {
+            _calibrationVersion++;
+        }
+        _mutex.give();
+
+        if (restored)
+        {
+            LOG_INFO("Restored calibration");
+        }
+    }
+    _storedCalibrationVersion = _calibrationVersion;
+}
+
+void ElectronicLoadV2::_stageSettings()
+{
+    // Turning the load on and off isn't worth a flash write; cleared
+    // first so padding can't make identical settings look changed
+    Settings settings;
+    memset(&settings, 0, sizeof(settings));
+    settings.mode = _settings.mode;
+    memcpy(settings.setpoints, _settings.setpoints, sizeof(settings.setpoints));
+    settings.dynamic = _settings.dynamic;
+    settings.isEnabled = false;
+    _settingsStore.stage(SettingsStore::SLOT_SETTINGS, &settings, sizeof(settings));
+}
+
+void ElectronicLoadV2::_checkListFinished()
+{
+    if (!_settings.isEnabled ||
+        (_settings.mode != ModeEngine::MODE_LIST) ||
+        !_listMode.finished())
+    {
+        return;
+    }
+
+    LOG_INFO("List finished: %u steps in %u us, late mean %u us max %u us", (unsigned)_dacSequencer.stepsPlayed(), (unsigned)_dacSequencer.elapsed_us(), (unsigned)_dacSequencer.meanLate_us(), (unsigned)_dacSequencer.maxLate_us());
+
+    Settings settings = _settings;
+    settings.isEnabled = false;
+    _updateSettings(settings);
+}
+
+void ElectronicLoadV2::_runCommand(char *line)
+{
+    char *argv[6];
+    int argc = Console::split(line, argv, 6);
+    if (argc == 0)
+    {
+        return;
+    }
+
+    TaskSyncShared *tss = TaskSyncShared::getInstance();
+
+    if (strcmp(argv[0], "cal") == 0)
+    {
+        _calibrationCommand(argc - 1, argv + 1);
+    }
+    else if (strcmp(argv[0], "telemetry") == 0)
+    {
+        _telemetryCommand(argc - 1, argv + 1);
+    }
+    else if (strcmp(argv[0], "loop") == 0)
+    {
+        _loopCommand(argc - 1, argv + 1);
+    }
+    else if (strcmp(argv[0], "mode") == 0)
+    {
+        _modeCommand(argc - 1, argv + 1);
+    }
+    else if (strcmp(argv[0], "dyn") == 0)
+    {
+        _dynamicCommand(argc - 1, argv + 1);
+    }
+    else if (strcmp(argv[0], "list") == 0)
+    {
+        _listCommand(argc - 1, argv + 1);
+    }
+    else if (strcmp(argv[0], "bat") == 0)
+    {
+        _batteryCommand(argc - 1, argv + 1);
+    }
+    else if (strcmp(argv[0], "adc") == 0)
+    {
+        _adcCommand(argc - 1, argv + 1);
+    }
+    else if (strcmp(argv[0], "bus") == 0)
+    {
+        if ((argc == 2) && (strcmp(argv[1], "reset") == 0))
+        {
+            tss->resetI2cStats();
+        }
+
+        TaskSyncShared::I2cStats i2cStats[TaskSyncShared::I2C_PRIO_COUNT];
+        for (int i = 0; i < TaskSyncShared::I2C_PRIO_COUNT; i++)
+        {
+            tss->i2cStats(TaskSyncShared::I2cPriority(i), &i2cStats[i]);
+        }
+
+        tss->takeSerial();
+        for (int i = 0; i < TaskSyncShared::I2C_PRIO_COUNT; i++)
+        {
+            Serial.printf("bus: %-11s %u takes, wait %u us mean %u us max, hold %u us max\r\n",
+                          TaskSyncShared::i2cPriorityName(TaskSyncShared::I2cPriority(i)),
+                          (unsigned)i2cStats[i].count,
+                          (unsigned)i2cStats[i].meanWait_us,
+                          (unsigned)i2cStats[i].maxWait_us,
+                          (unsigned)i2cStats[i].maxHold_us);
+        }
+        Serial.printf("bus: dac %u writes issued, %u suppressed\r\n",
+                      (unsigned)_mcp4726.writesIssued(),
+                      (unsigned)_mcp4726.writesSuppressed());
+        Serial.printf("bus: adc %u writes issued, %u suppressed, %u samples\r\n",
+                      (unsigned)_max11645.writesIssued(),
+                      (unsigned)_max11645.writesSuppressed(),
+                      (unsigned)_sampler.samplesTaken());
+        Serial.printf("bus: display %u flushes, %u bytes, %u bytes last flush\r\n",
+                      (unsigned)_textUI.displayFlushes(),
+                      (unsigned)_textUI.displayBytes(),
+                      (unsigned)_textUI.lastFlushBytes());
+        tss->giveSerial();
+    }
+    else if (strcmp(argv[0], "ui") == 0)
+    {
+        tss->takeSerial();
+        Serial.printf("ui: loop %u us last, %u us max, %u frames dropped\r\n",
+                      (unsigned)_textUI.lastLoop_us(),
+                      (unsigned)_textUI.maxLoop_us(),
+                      (unsigned)_textUI.framesDropped());
+        Serial.printf("ui: %u bytes of stack never used\r\n",
+                      (unsigned)_textUI.stackHighWater());
+        Serial.printf("ui: text render %u us last, %u us max\r\n",
+                      (unsigned)_textUI.lastRender_us(),
+                      (unsigned)_textUI.maxRender_us());
+        Serial.printf("ui: graph %u columns, %u dropped, %u us per column last, %u us max, %u us redraw\r\n",
+                      (unsigned)_textUI.graphColumns(),
+                      (unsigned)_textUI.graphColumnsDropped(),
+                      (unsigned)_textUI.lastColumn_us(),
+                      (unsigned)_textUI.maxColumn_us(),
+                      (unsigned)_textUI.lastGraphRedraw_us());
+        Serial.printf("ui: graph %u bytes per update\r\n",
+                      (unsigned)_textUI.lastGraphBytes());
+        tss->giveSerial();
+    }
+    else if (strcmp(argv[0], "locks") == 0)
+    {
+        _locksCommand(argc - 1, argv + 1);
+    }
+    else if (strcmp(argv[0], "store") == 0)
+    {
+        _storeCommand(argc - 1, argv + 1);
+    }
+    else if (strcmp(argv[0], "graph") == 0)
+    {
+        _graphCommand(argc - 1, argv + 1);
+    }
+    else if (strcmp(argv[0], "knob") == 0)
+    {
+        _knobCommand(argc - 1, argv + 1);
+    }
+    else if (strcmp(argv[0], "log") == 0)
+    {
+        _logCommand(argc - 1, argv + 1);
+    }
+    else
+    {
+        tss->takeSerial();
+        Serial.printf("Unknown command: %s\r\n", argv[0]);
+        tss->giveSerial();
+    }
+}
+
+void ElectronicLoadV2::_calibrationCommand(int argc, char **argv)
+{
+    // cal [show]
+    // cal reset <v|i|dac>
+    // cal linear <v|i|dac> <gain_q16> <offset>
+    // cal capture <v|i> <reference uV|uA>
+    // cal capture dac <measured uA>
+    TaskSyncShared *tss = TaskSyncShared::getInstance();
+
+    Calibration::Channel ch = Calibration::CH_COUNT;
+    if ((argc >= 2) && !Calibration::channelFromName(argv[1], &ch))
+    {
+        tss->takeSerial();
+        Serial.printf("Unknown calibration channel: %s\r\n", argv[1]);
+        tss->giveSerial();
+        return;
+    }
+
+    if ((argc == 0) || (strcmp(argv[0], "show") == 0))
+    {
+        _printCalibration();
+    }
+    else if ((argc == 2) && (strcmp(argv[0], "reset") == 0))
+    {
+        _mutex.take();
+        _calibration.reset(ch);
+        _calibrationVersion++;
+        _mutex.give();
+        _printCalibration();
+    }
+    else if ((argc == 4) && (strcmp(argv[0], "linear") == 0))
+    {
+        _mutex.take();
+        _calibration.setLinear(ch, strtol(argv[2], 0, 0), strtol(argv[3], 0, 0));
+        _calibrationVersion++;
+        _mutex.give();
+        _printCalibration();
+    }
+    else if ((argc == 3) && (strcmp(argv[0], "capture") == 0))
+    {
+        int32_t reference = strtol(argv[2], 0, 0);
+        bool success = false;
+
+        if (ch == Calibration::CH_DAC_CURRENT)
+        {
+            // Map the current actually measured by the reference
+            // meter to what the DAC was asked for, after any
+            // calibration already in place
+            if (_settings.isEnabled)
+            {
+                _mutex.take();
+                success = _calibration.addPoint(ch, reference, _dacApplied_uA);
+                _calibrationVersion++;
+                _mutex.give();
+            }
+        }
+        else
+        {
+            Sample samples[g_calCaptureSamples];
+            size_t count = _samples.recent(samples, g_calCaptureSamples);
+
+            if (count > 0)
+            {
+                int64_t sum = 0;
+                for (size_t i = 0; i < count; i++)
+                {
+                    if (ch == Calibration::CH_LOAD_VOLTAGE)
+                    {
+                        sum += Measurement::countsToMicroVolts(samples[i].ain0);
+                    }
+                    else
+                    {
+                        sum += Measurement::countsToMicroAmps(samples[i].ain1);
+                    }
+                }
+
+                _mutex.take();
+                success = _calibration.addPoint(ch, int32_t(sum / int64_t(count)), reference);
+                _calibrationVersion++;
+                _mutex.give();
+            }
+        }
+
+        if (!success)
+        {
+            tss->takeSerial();
+            Serial.println("Calibration capture failed");
+            tss->giveSerial();
+        }
+        _printCalibration();
+    }
+    else
+    {
+        tss->takeSerial();
+        Serial.println("Usage: cal [show|reset <ch>|linear <ch> <gain_q16> <offset>|capture <ch> <reference>]");
+        tss->giveSerial();
+    }
+}
+
+void ElectronicLoadV2::_telemetryCommand(int argc, char **argv)
+{
+    // telemetry [off|text|binary]
+    TaskSyncShared *tss = TaskSyncShared::getInstance();
+
+    Telemetry::Mode mode;
+    if (argc == 1 && Telemetry::modeFromName(argv[0], &mode))
+    {
+        _telemetry.setMode(mode);
+    }
+    else if (argc != 0)
+    {
+        tss->takeSerial();
+        Serial.println("Usage: telemetry [off|text|binary]");
+        tss->giveSerial();
+        return;
+    }
+
+    tss->takeSerial();
+    Serial.printf("Telemetry: %s\r\n", Telemetry::modeName(_telemetry.mode()));
+    tss->giveSerial();
+}
+
+void ElectronicLoadV2::_loopCommand(int argc, char **argv)
+{
+    // loop [open|closed]
+    // loop gains <kp_q16> <ki_q16>
+    TaskSyncShared *tss = TaskSyncShared::getInstance();
+
+    if ((argc == 1) && (strcmp(argv[0], "open") == 0))
+    {
+        _closedLoop = false;
+    }
+    else if ((argc == 1) && (strcmp(argv[0], "closed") == 0))
+    {
+        _closedLoop = true;
+    }
+    else if ((argc == 3) && (strcmp(argv[0], "gains") == 0))
+    {
+        _mutex.take();
+        _gains.kp_q16 = strtol(argv[1], 0, 0);
+        _gains.ki_q16 = strtol(argv[2], 0, 0);
+        _gainsVersion++;
+        _mutex.give();
+    }
+    else if (argc != 0)
+    {
+        tss->takeSerial();
+        Serial.println("Usage: loop [open|closed|gains <kp_q16> <ki_q16>]");
+        tss->giveSerial();
+        return;
+    }
+
+    _mutex.take();
+    Gains gains = _gains;
+    _mutex.give();
+
+    tss->takeSerial();
+    Serial.printf("loop: %s, kp_q16 %ld ki_q16 %ld, error %ld uA, integral %ld uA, command %ld uA\r\n",
+                  _closedLoop ? "closed" : "open",
+                  (long)gains.kp_q16,
+                  (long)gains.ki_q16,
+                  (long)_regulator.lastError_uA(),
+                  (long)_regulator.integral_uA(),
+                  (long)_dacCommand_uA);
+    Serial.printf("loop: max period %u us, %u overruns\r\n",
+                  (unsigned)_controlMaxPeriod_us,
+                  (unsigned)_controlOverruns);
+    tss->giveSerial();
+}
+
+void ElectronicLoadV2::_modeCommand(int argc, char **argv)
+{
+    // mode [cc|cv|cr|cp|dyn|lst] [setpoint uA|uV|mOhm|uW]
+    // mode gains <kp_q16> <ki_q16>
+    TaskSyncShared *tss = TaskSyncShared::getInstance();
+
+    ModeEngine::Mode mode;
+    if ((argc == 3) && (strcmp(argv[0], "gains") == 0))
+    {
+        _mutex.take();
+        _gains.voltageKp_q16 = strtol(argv[1], 0, 0);
+        _gains.voltageKi_q16 = strtol(argv[2], 0, 0);
+        _gainsVersion++;
+        _mutex.give();
+    }
+    else if (((argc == 1) || (argc == 2)) && ModeEngine::modeFromName(argv[0], &mode))
+    {
+        Settings settings = _settings;
+        settings.mode = mode;
+        if (argc == 2)
+        {
+            settings.setpoints[mode] = strtol(argv[1], 0, 0);
+        }
+
+        _updateSettings(settings);
+    }
+    else if (argc != 0)
+    {
+        tss->takeSerial();
+        Serial.println("Usage: mode [cc|cv|cr|cp|dyn|lst [setpoint]|gains <kp_q16> <ki_q16>]");
+        tss->giveSerial();
+        return;
+    }
+
+    _mutex.take();
+    Gains gains = _gains;
+    _mutex.give();
+
+    tss->takeSerial();
+    Serial.printf("mode: %s, setpoint %ld, target %ld uA, cv kp_q16 %ld ki_q16 %ld\r\n",
+                  ModeEngine::modeName(_settings.mode),
+                  (long)_settings.setpoints[_settings.mode],
+                  (long)_modeTarget_uA,
+                  (long)gains.voltageKp_q16,
+                  (long)gains.voltageKi_q16);
+    tss->giveSerial();
+}
+
+void ElectronicLoadV2::_dynamicCommand(int argc, char **argv)
+{
+    // dyn [<high uA> <low uA> <frequency Hz> <duty %>]
+    // dyn reset
+    TaskSyncShared *tss = TaskSyncShared::getInstance();
+
+    if (argc == 4)
+    {
+        Settings settings = _settings;
+        settings.dynamic.high_uA = strtol(argv[0], 0, 0);
+        settings.dynamic.low_uA = strtol(argv[1], 0, 0);
+        settings.dynamic.frequency_Hz = strtol(argv[2], 0, 0);
+        settings.dynamic.duty_pct = strtol(argv[3], 0, 0);
+
+        _updateSettings(settings);
+    }
+    else if ((argc == 1) && (strcmp(argv[0], "reset") == 0))
+    {
+        _dacSequencer.resetStats();
+    }
+    else if (argc != 0)
+    {
+        tss->takeSerial();
+        Serial.println("Usage: dyn [<high uA> <low uA> <frequency Hz> <duty %>|reset]");
+        tss->giveSerial();
+        return;
+    }
+
+    tss->takeSerial();
+    Serial.printf("dyn: %ld/%ld uA, %ld Hz, %ld%% duty, %s\r\n",
+                  (long)_settings.dynamic.high_uA,
+                  (long)_settings.dynamic.low_uA,
+                  (long)_settings.dynamic.frequency_Hz,
+                  (long)_settings.dynamic.duty_pct,
+                  _dynamicLoad.running() ? "running" : "stopped");
+    Serial.printf("dyn: %u steps, %u writes, %u failed, late mean %u us max %u us, %u missed\r\n",
+                  (unsigned)_dacSequencer.stepsPlayed(),
+                  (unsigned)_dacSequencer.writesIssued(),
+                  (unsigned)_dacSequencer.failedWrites(),
+                  (unsigned)_dacSequencer.meanLate_us(),
+                  (unsigned)_dacSequencer.maxLate_us(),
+                  (unsigned)_dacSequencer.missedSteps());
+    tss->giveSerial();
+}
+
+void ElectronicLoadV2::_listCommand(int argc, char **argv)
+{
+    // list [show]
+    // list clear
+    // list add <uA> <dwell us>
+    // list ramp <start uA> <end uA> <steps> <dwell us>
+    // list stair <start uA> <step uA> <steps> <dwell us>
+    // list save|load
+    // list run [once|loop]
+    // list stop
+    TaskSyncShared *tss = TaskSyncShared::getInstance();
+
+    bool success = true;
+    if ((argc == 0) || (strcmp(argv[0], "show") == 0))
+    {
+        // Just the status below
+    }
+    else if ((argc == 1) && (strcmp(argv[0], "clear") == 0))
+    {
+        _listMode.clear();
+    }
+    else if ((argc == 3) && (strcmp(argv[0], "add") == 0))
+    {
+        // Uploads are one point per line, so stay quiet on success
+        if (_listMode.addPoint(strtol(argv[1], 0, 0), strtoul(argv[2], 0, 0)))
+        {
+            return;
+        }
+        success = false;
+    }
+    else if ((argc == 5) && (strcmp(argv[0], "ramp") == 0))
+    {
+        success = _listMode.setRamp(strtol(argv[1], 0, 0), strtol(argv[2], 0, 0),
+                                    strtoul(argv[3], 0, 0), strtoul(argv[4], 0, 0));
+    }
+    else if ((argc == 5) && (strcmp(argv[0], "stair") == 0))
+    {
+        success = _listMode.setStaircase(strtol(argv[1], 0, 0), strtol(argv[2], 0, 0),
+                                         strtoul(argv[3], 0, 0), strtoul(argv[4], 0, 0));
+    }
+    else if ((argc == 1) && (strcmp(argv[0], "save") == 0))
+    {
+        success = _listMode.save();
+    }
+    else if ((argc == 1) && (strcmp(argv[0], "load") == 0))
+    {
+        _listMode.stop();
+        success = _listMode.load();
+    }
+    else if (((argc == 1) || (argc == 2)) && (strcmp(argv[0], "run") == 0))
+    {
+        _listLoop = (argc == 2) && (strcmp(argv[1], "loop") == 0);
+
+        Settings settings = _settings;
+        if (settings.mode != ModeEngine::MODE_LIST)
+        {
+            settings.mode = ModeEngine::MODE_LIST;
+            _updateSettings(settings);
+        }
+
+        // Start over even if a run is in progress
+        _listMode.stop();
+        settings.isEnabled = true;
+        _updateSettings(settings);
+        success = _listMode.running() || _listMode.finished();
+    }
+    else if ((argc == 1) && (strcmp(argv[0], "stop") == 0))
+    {
+        Settings settings = _settings;
+        settings.isEnabled = false;
+        _updateSettings(settings);
+    }
+    else
+    {
+        tss->takeSerial();
+        Serial.println("Usage: list [show|clear|add <uA> <dwell>|ramp <start> <end> <steps> <dwell>|stair <start> <step> <steps> <dwell>|save|load|run [once|loop]|stop]");
+        tss->giveSerial();
+        return;
+    }
+
+    if (!success)
+    {
+        tss->takeSerial();
+        Serial.printf("list %s failed\r\n", argv[0]);
+        tss->giveSerial();
+    }
+    _printList();
+}
+
+void ElectronicLoadV2::_printList()
+{
+    TaskSyncShared *tss = TaskSyncShared::getInstance();
+
+    const ListMode::Profile &profile = _listMode.profile();
+
+    uint32_t steps = _dacSequencer.stepsPlayed();
+    uint32_t elapsed_us = _dacSequencer.elapsed_us();
+    uint32_t stepsPerSec = 0;
+    if ((steps > 1) && (elapsed_us > 0))
+    {
+        stepsPerSec = uint32_t((uint64_t(steps - 1) * 1000000) / elapsed_us);
+    }
+
+    tss->takeSerial();
+    if (profile.shape == ListMode::SHAPE_POINTS)
+    {
+        Serial.printf("list: points, %u of %u\r\n",
+                      (unsigned)_listMode.pointCount(),
+                      (unsigned)ListMode::g_maxPoints);
+    }
+    else
+    {
+        Serial.printf("list: %s, %ld to %ld uA, %u steps of %u us\r\n",
+                      ListMode::shapeName(profile.shape),
+                      (long)profile.start_uA,
+                      (long)profile.end_uA,
+                      (unsigned)profile.steps,
+                      (unsigned)profile.dwell_us);
+    }
+    Serial.printf("list: table %u of %u steps, %u ms, %s%s\r\n",
+                  (unsigned)_listMode.tableSize(),
+                  (unsigned)ListMode::g_maxTableSteps,
+                  (unsigned)(_listMode.tableDuration_us() / 1000),
+                  _listMode.running() ? "running" : "stopped",
+                  _listLoop ? ", looping" : "");
+    Serial.printf("list: %u steps in %u us (%u steps/s), late mean %u us max %u us, %u missed\r\n",
+                  (unsigned)steps,
+                  (unsigned)elapsed_us,
+                  (unsigned)stepsPerSec,
+                  (unsigned)_dacSequencer.meanLate_us(),
+                  (unsigned)_dacSequencer.maxLate_us(),
+                  (unsigned)_dacSequencer.missedSteps());
+    tss->giveSerial();
+}
+
+void ElectronicLoadV2::_batteryCommand(int argc, char **argv)
+{
+    // bat [show]
+    // bat start <cutoff mV> [confirm samples]
+    // bat stop
+    TaskSyncShared *tss = TaskSyncShared::getInstance();
+
+    if ((argc == 0) || (strcmp(argv[0], "show") == 0))
+    {
+        // Just the status below
+    }
+    else if (((argc == 2) || (argc == 3)) && (strcmp(argv[0], "start") == 0))
+    {
+        if (((_settings.mode != ModeEngine::MODE_CC) && (_settings.mode != ModeEngine::MODE_CP)) ||
+            (_settings.setpoints[_settings.mode] <= 0))
+        {
+            tss->takeSerial();
+            Serial.println("Battery test needs a CC or CP setpoint");
+            tss->giveSerial();
+            return;
+        }
+        if (_sampler.profile() == Sampler::PROFILE_CURRENT_ONLY)
+        {
+            tss->takeSerial();
+            Serial.println("Battery test needs the voltage; select another adc profile");
+            tss->giveSerial();
+            return;
+        }
+
+        _mutex.take();
+        Calibration calibration = _calibration;
+        _mutex.give();
+
+        _batteryTest.start(strtol(argv[1], 0, 0) * 1000,
+                           (argc == 3) ? strtoul(argv[2], 0, 0) : 1,
+                           calibration);
+
+        Settings settings = _settings;
+        settings.isEnabled = true;
+        _updateSettings(settings);
+    }
+    else if ((argc == 1) && (strcmp(argv[0], "stop") == 0))
+    {
+        Settings settings = _settings;
+        settings.isEnabled = false;
+        _updateSettings(settings);
+    }
+    else
+    {
+        tss->takeSerial();
+        Serial.println("Usage: bat [show|start <cutoff mV> [confirm samples]|stop]");
+        tss->giveSerial();
+        return;
+    }
+
+    _printBatteryTest();
+}
+
+void ElectronicLoadV2::_adcCommand(int argc, char **argv)
+{
+    // adc [show]
+    // adc <fast|average-8x|current-only>
+    TaskSyncShared *tss = TaskSyncShared::getInstance();
+
+    Sampler::Profile profile = _sampler.profile();
+    if ((argc == 1) && Sampler::profileFromName(argv[0], &profile))
+    {
+        if ((profile == Sampler::PROFILE_CURRENT_ONLY) && _voltageNeeded())
+        {
+            tss->takeSerial();
+            Serial.println("Current-only sampling can't be used in CV, CR or CP mode or during a battery test");
+            tss->giveSerial();
+            return;
+        }
+
+        _sampler.setProfile(profile);
+    }
+    else if ((argc != 0) && !((argc == 1) && (strcmp(argv[0], "show") == 0)))
+    {
+        tss->takeSerial();
+        Serial.println("Usage: adc [show|fast|average-8x|current-only]");
+        tss->giveSerial();
+        return;
+    }
+
+    tss->takeSerial();
+    Serial.printf("adc: %s profile, %u samples, %u failed reads\r\n",
+                  Sampler::profileName(_sampler.profile()),
+                  (unsigned)_sampler.samplesTaken(),
+                  (unsigned)_sampler.failedReads());
+    tss->giveSerial();
+}
+
+bool ElectronicLoadV2::_voltageNeeded()
+{
+    // Regulating on voltage, resistance or power, or watching for
+    // the cutoff, all act on the latest voltage sample
+    return (_settings.mode == ModeEngine::MODE_CV) ||
+           (_settings.mode == ModeEngine::MODE_CR) ||
+           (_settings.mode == ModeEngine::MODE_CP) ||
+           (_batteryTest.state() == BatteryTest::BT_RUNNING);
+}
+
+void ElectronicLoadV2::_printBatteryTest()
+{
+    TaskSyncShared *tss = TaskSyncShared::getInstance();
+
+    BatteryTest::Result result;
+    _batteryTest.result(&result);
+
+    tss->takeSerial();
+    Serial.printf("bat: %s, cutoff %ld uV, last %ld uV\r\n",
+                  BatteryTest::stateName(result.state),
+                  (long)_batteryTest.cutoff_uV(),
+                  (long)result.lastVoltage_uV);
+    Serial.printf("bat: %ld uAh, %ld uWh in %u s, %u gaps, cut in %u us\r\n",
+                  (long)result.charge_uAh,
+                  (long)result.energy_uWh,
+                  (unsigned)(result.elapsed_ms / 1000),
+                  (unsigned)result.gaps,
+                  (unsigned)result.cutoffLatency_us);
+    tss->giveSerial();
+}
+
+void ElectronicLoadV2::_storeCommand(int argc, char **argv)
+{
+    // store [show|flush]
+    TaskSyncShared *tss = TaskSyncShared::getInstance();
+
+    if ((argc == 1) && (strcmp(argv[0], "flush") == 0))
+    {
+        if (!_settingsStore.flush())
+        {
+            tss->takeSerial();
+            Serial.println("store flush failed");
+            tss->giveSerial();
+        }
+    }
+    else if ((argc != 0) && !((argc == 1) && (strcmp(argv[0], "show") == 0)))
+    {
+        tss->takeSerial();
+        Serial.println("Usage: store [show|flush]");
+        tss->giveSerial();
+        return;
+    }
+
+    tss->takeSerial();
+    Serial.printf("store: %u changes staged, %u written, %u unchanged, %u failed%s\r\n",
+                  (unsigned)_settingsStore.staged(),
+                  (unsigned)_settingsStore.written(),
+                  (unsigned)_settingsStore.skipped(),
+                  (unsigned)_settingsStore.failed(),
+                  _settingsStore.pending() ? ", pending" : "");
+    tss->giveSerial();
+}
+
+void ElectronicLoadV2::_graphCommand(int argc, char **argv)
+{
+    // graph [show]
+    // graph off
+    // graph <v|i|p> [column ms]
+    TaskSyncShared *tss = TaskSyncShared::getInstance();
+
+    Statistics::Quantity quantity = _trace.quantity();
+    if ((argc == 1) && (strcmp(argv[0], "off") == 0))
+    {
+        _updateGraph(false, quantity, _trace.column_us());
+    }
+    else if (((argc == 1) || (argc == 2)) && Trace::quantityFromName(argv[0], &quantity))
+    {
+        uint32_t column_us = argc == 2 ? uint32_t(strtoul(argv[1], 0, 0) * 1000) : _trace.column_us();
+        if (column_us == 0)
+        {
+            tss->takeSerial();
+            Serial.println("Column period must be at least 1 ms");
+            tss->giveSerial();
+            return;
+        }
+
+        _updateGraph(true, quantity, column_us);
+    }
+    else if ((argc != 0) && !((argc == 1) && (strcmp(argv[0], "show") == 0)))
+    {
+        tss->takeSerial();
+        Serial.println("Usage: graph [show|off|<v|i|p> [column ms]]");
+        tss->giveSerial();
+        return;
+    }
+
+    tss->takeSerial();
+    Serial.printf("graph: %s %s, %u ms per column\r\n",
+                  _graphVisible ? "on" : "off",
+                  Trace::quantityName(_trace.quantity()),
+                  (unsigned)(_trace.column_us() / 1000));
+    tss->giveSerial();
+}
+
+void ElectronicLoadV2::_knobCommand(int argc, char **argv)
+{
+    // knob [reset]
+    TaskSyncShared *tss = TaskSyncShared::getInstance();
+
+    KnobLatency latency = _knobLatency;
+    const KnobEvent &event = latency.lastEvent;
+    uint32_t mean_us = latency.count > 0 ? uint32_t(latency.sum_us / latency.count) : 0;
+
+    tss->takeSerial();
+    Serial.printf("knob: %u edits to the DAC, mean %u us, max %u us, %u over %u ms\r\n",
+                  (unsigned)latency.count,
+                  (unsigned)mean_us,
+                  (unsigned)latency.max_us,
+                  (unsigned)latency.overTarget,
+                  (unsigned)(g_knobLatencyTarget_us / 1000));
+    Serial.printf("knob: last %u us from the edge, ui %u us, settings %u us\r\n",
+                  (unsigned)latency.last_us,
+                  (unsigned)(event.edit_us - event.edge_us),
+                  (unsigned)(event.applied_us - event.edge_us));
+    Serial.printf("knob: %u encoder wakeups, %u ui wakeups\r\n",
+                  (unsigned)_encoder.wakeups(),
+                  (unsigned)_textUI.wakeups());
+
+    // Per-detent cost outside the encoder task, to compare the
+    // backends on the same knob
+    uint32_t detents = _encoder.detentsCounted();
+    uint32_t cycles = _encoder.isrCycles() + _encoder.callbackCycles();
+    Serial.printf("knob: %s backend, %u detents, %u isr entries (%u cycles), %u timer callbacks (%u cycles), %u cycles per detent\r\n",
+                  RotaryEncoder::backendName(),
+                  (unsigned)detents,
+                  (unsigned)_encoder.isrEntries(),
+                  (unsigned)_encoder.isrCycles(),
+                  (unsigned)_encoder.callbackEntries(),
+                  (unsigned)_encoder.callbackCycles(),
+                  (unsigned)(detents > 0 ? cycles / detents : 0));
+    tss->giveSerial();
+
+    if ((argc == 1) && (strcmp(argv[0], "reset") == 0))
+    {
+        _knobLatencyReset = true;
+    }
+}
+
+void ElectronicLoadV2::_locksCommand(int argc, char **argv)
+{
+    // locks [reset]
+    TaskSyncShared *tss = TaskSyncShared::getInstance();
+
+#if LOCK_STATS
+    bool reset = (argc == 1) && (strcmp(argv[0], "reset") == 0);
+
+    for (InstrumentedMutex *lock = InstrumentedMutex::first(); lock != 0; lock = lock->next())
+    {
+        InstrumentedMutex::TaskStats stats;
+        for (int slot = 0; lock->taskStats(slot, &stats); slot++)
+        {
+            // Copied first; printing takes the serial lock, which
+            // is one of those being dumped
+            tss->takeSerial();
+            Serial.printf("lock %s, task %s: %u takes, wait %u us max, hold %u us max\r\n",
+                          lock->name(),
+                          stats.taskName,
+                          (unsigned)stats.count,
+                          (unsigned)stats.maxWait_us,
+                          (unsigned)stats.maxHold_us);
+            _printHistogram("wait", stats.wait);
+            _printHistogram("hold", stats.hold);
+            tss->giveSerial();
+        }
+
+        uint32_t overflowTakes = lock->overflowTakes();
+        if (overflowTakes != 0)
+        {
+            tss->takeSerial();
+            Serial.printf("lock %s: %u takes by tasks past the %d tracked, not shown\r\n",
+                          lock->name(),
+                          (unsigned)overflowTakes,
+                          InstrumentedMutex::g_maxTasks);
+            tss->giveSerial();
+        }
+
+        if (reset)
+        {
+            lock->resetStats();
+        }
+    }
+#else
+    tss->takeSerial();
+    Serial.println("Lock statistics are compiled out (LOCK_STATS=0)");
+    tss->giveSerial();
+#endif
+}
+
+void ElectronicLoadV2::_logCommand(int argc, char **argv)
+{
+    // log [show]
+    // log bench
+    TaskSyncShared *tss = TaskSyncShared::getInstance();
+    Log *log = Log::getInstance();
+
+    if ((argc == 1) && (strcmp(argv[0], "bench") == 0))
+    {
+        // The same line both ways: printed in place under the serial
+        // lock, as call sites did before the logger, then queued.
+        // Fewer than the queue holds, so none are dropped
+        const int calls = 16;
+        uint32_t directSum = 0;
+        uint32_t directMax = 0;
+        uint32_t queuedSum = 0;
+        uint32_t queuedMax = 0;
+        for (int i = 0; i < calls; i++)
+        {
+            uint32_t start = ESP.getCycleCount();
+            tss->takeSerial();
+            Serial.printf("Set dac value %d\r\n", i);
+            tss->giveSerial();
+            uint32_t cycles = ESP.getCycleCount() - start;
+            directSum += cycles;
+            directMax = cycles > directMax ? cycles : directMax;
+        }
+        for (int i = 0; i < calls; i++)
+        {
+            uint32_t start = ESP.getCycleCount();
+            LOG_INFO("Set dac value %d", i);
+            uint32_t cycles = ESP.getCycleCount() - start;
+            queuedSum += cycles;
+            queuedMax = cycles > queuedMax ? cycles : queuedMax;
+        }
+
+        tss->takeSerial();
+        Serial.printf("log: direct printf %u cycles mean, %u max\r\n",
+                      (unsigned)(directSum / calls),
+                      (unsigned)directMax);
+        Serial.printf("log: queued %u cycles mean, %u max\r\n",
+                      (unsigned)(queuedSum / calls),
+                      (unsigned)queuedMax);
+        tss->giveSerial();
+    }
+    else if ((argc != 0) && !((argc == 1) && (strcmp(argv[0], "show") == 0)))
+    {
+        tss->takeSerial();
+        Serial.println("Usage: log [show|bench]");
+        tss->giveSerial();
+        return;
+    }
+
+    uint32_t maxCycles = log->maxWriteCycles();
+
+    tss->takeSerial();
+    Serial.printf("log: %u written, %u dropped, worst call %u cycles (%u ns)\r\n",
+                  (unsigned)log->written(),
+                  (unsigned)log->dropped(),
+                  (unsigned)maxCycles,
+                  (unsigned)((uint64_t(maxCycles) * 1000) / ESP.getCpuFreqMHz()));
+    tss->giveSerial();
+}
+
+void ElectronicLoadV2::_printHistogram(const char *label, const uint32_t *buckets)
+{
+    // Only the non-empty buckets, as "from us:count"
+    Serial.printf("  %s", label);
+    for (int i = 0; i < InstrumentedMutex::g_bucketCount; i++)
+    {
+        if (buckets[i] != 0)
+        {
+            Serial.printf(" %u:%u",
+                          (unsigned)InstrumentedMutex::bucketFloor_us(i),
+                          (unsigned)buckets[i]);
+        }
+    }
+    Serial.print("\r\n");
+}
+
+void ElectronicLoadV2::_printCalibration()
+{
+    TaskSyncShared *tss = TaskSyncShared::getInstance();
+    tss->takeSerial();
+    for (int i = 0; i < Calibration::CH_COUNT; i++)
+    {
+        Calibration::Channel ch = Calibration::Channel(i);
+        Serial.printf("cal %s: gain_q16 %ld offset %ld points %u\r\n",
+                      Calibration::channelName(ch),
+                      (long)_calibration.gain_q16(ch),
+                      (long)_calibration.offset(ch),
+                      (unsigned)_calibration.pointCount(ch));
+
+        const Calibration::Point *points = _calibration.points(ch);
+        for (size_t j = 0; j < _calibration.pointCount(ch); j++)
+        {
+            Serial.printf("  %ld -> %ld\r\n", (long)points[j].x, (long)points[j].y);
+        }
+    }
+    tss->giveSerial();
+}
+
+void delayUntilOrNotified(TickType_t *lastWake, TickType_t period)
+{
+    // Like vTaskDelayUntil(), except that a task notification ends the
+    // wait early and the next period counts from then
+    TickType_t elapsed = xTaskGetTickCount() - *lastWake;
+    if (elapsed >= period)
+    {
+        *lastWake = xTaskGetTickCount();
+        return;
+    }
+
+    if (ulTaskNotifyTake(pdTRUE, period - elapsed) != 0)
+    {
+        *lastWake = xTaskGetTickCount();
+    }
+    else
+    {
+        *lastWake += period;
+    }
+}
+
+void mainTaskHelper(void *objPtr)
+{
+    if (objPtr != 0)
+    {
+        ElectronicLoadV2 *app = (ElectronicLoadV2 *)objPtr;
+
+        app->mainTask();
+    }
+
+    vTaskDelete(NULL);
+}
+
+void controlTaskHelper(void *objPtr)
+{
+    if (objPtr != 0)
+    {
+        ElectronicLoadV2 *app = (ElectronicLoadV2 *)objPtr;
+
+        app->controlTask();
     }
 
     vTaskDelete(NULL);
@@ -0,0 +1,90 @@
+#include "EncoderPcnt.hpp"
+
+const pcnt_unit_t EncoderPcnt::g_countUnit = PCNT_UNIT_0;
+const pcnt_unit_t EncoderPcnt::g_wakeUnit = PCNT_UNIT_1;
+// The longest glitch the filter can reject, in 80 MHz APB cycles,
+// about 12.8 us; longer contact bounce on A is counted both ways and
+// cancels out
+const uint16_t EncoderPcnt::g_filter = 1023;
+const int16_t EncoderPcnt::g_limit = INT16_MAX;
+// Both edges of A are counted, and there is a full cycle of A
+// between detents
+const int EncoderPcnt::g_countsPerDetent = 2;
+
+EncoderPcnt::EncoderPcnt(int aPin, int bPin, bool invert)
+    : _aPin(aPin),
+      _bPin(bPin),
+      _invert(invert),
+      _detentCounter(g_countsPerDetent, g_limit) {}
+
+bool EncoderPcnt::begin(void (*handler)(void *), void *arg)
+{
+    // With B low the edge A counts on is a step up, as in the
+    // software decoder
+    pcnt_config_t config = {};
+    config.pulse_gpio_num = _aPin;
+    config.ctrl_gpio_num = _bPin;
+    config.channel = PCNT_CHANNEL_0;
+    config.unit = g_countUnit;
+    config.pos_mode = _invert ? PCNT_COUNT_INC : PCNT_COUNT_DEC;
+    config.neg_mode = _invert ? PCNT_COUNT_DEC : PCNT_COUNT_INC;
+    config.lctrl_mode = PCNT_MODE_KEEP;
+    config.hctrl_mode = PCNT_MODE_REVERSE;
+    // Symmetric, so the counter holds the position modulo the limit
+    config.counter_h_lim = g_limit;
+    config.counter_l_lim = -g_limit;
+    if (pcnt_unit_config(&config) != ESP_OK)
+    {
+        return false;
+    }
+
+    // Any edge of A at all, to wake the event task
+    config.ctrl_gpio_num = PCNT_PIN_NOT_USED;
+    config.unit = g_wakeUnit;
+    config.pos_mode = PCNT_COUNT_INC;
+    config.neg_mode = PCNT_COUNT_INC;
+    config.hctrl_mode = PCNT_MODE_KEEP;
+    if (pcnt_unit_config(&config) != ESP_OK)
+    {
+        return false;
+    }
+
+    pcnt_set_filter_value(g_countUnit, g_filter);
+    pcnt_filter_enable(g_countUnit);
+    pcnt_set_filter_value(g_wakeUnit, g_filter);
+    pcnt_filter_enable(g_wakeUnit);
+
+    pcnt_event_disable(g_wakeUnit, PCNT_EVT_ZERO);
+    pcnt_event_disable(g_wakeUnit, PCNT_EVT_H_LIM);
+    pcnt_event_disable(g_wakeUnit, PCNT_EVT_L_LIM);
+    pcnt_set_event_value(g_wakeUnit, PCNT_EVT_THRES_0, 1);
+    pcnt_event_enable(g_wakeUnit, PCNT_EVT_THRES_0);
+
+    pcnt_counter_pause(g_countUnit);
+    pcnt_counter_pause(g_wakeUnit);
+    pcnt_counter_clear(g_countUnit);
+    pcnt_counter_clear(g_wakeUnit);
+    _detentCounter.reset(0);
+    if ((pcnt_isr_service_install(0) != ESP_OK) ||
+        (pcnt_isr_handler_add(g_wakeUnit, handler, arg) != ESP_OK))
+    {
+        return false;
+    }
+    pcnt_counter_resume(g_countUnit);
+    pcnt_counter_resume(g_wakeUnit);
+
+    return true;
+}
+
+int EncoderPcnt::take()
+{
+    // Rearm the wake-up before reading, so an edge that lands after
+    // the read still interrupts; at worst it wakes the task for
+    // counts it has already taken
+    pcnt_counter_clear(g_wakeUnit);
+
+    int16_t count = 0;
+    pcnt_get_counter_value(g_countUnit, &count);
+
+    return _detentCounter.update(count);
+}
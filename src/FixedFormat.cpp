@@ -0,0 +1,105 @@
+#include <string.h>
+#include "FixedFormat.hpp"
+
+size_t FixedFormat::format(char *buf, int32_t value,
+                           int intDigits, int fracDigits,
+                           Padding padding /* = PAD_SPACE */)
+{
+    size_t len = width(intDigits, fracDigits);
+    char *p = buf + len;
+    *p = '\0';
+
+    bool negative = value < 0;
+    uint32_t mag = negative ? uint32_t(-int64_t(value)) : uint32_t(value);
+
+    // Filled from the right: fraction, point, then at least one
+    // integer digit, or all of them when zero padding
+    for (int i = 0; i < fracDigits; i++)
+    {
+        *--p = char('0' + (mag % 10));
+        mag /= 10;
+    }
+    if (fracDigits > 0)
+    {
+        *--p = '.';
+    }
+
+    int digits = 0;
+    do
+    {
+        *--p = char('0' + (mag % 10));
+        mag /= 10;
+        digits++;
+    } while ((digits < intDigits) && ((mag != 0) || (padding == PAD_ZERO)));
+
+    bool fits = mag == 0;
+    if (negative)
+    {
+        if (p > buf)
+        {
+            *--p = '-';
+        }
+        else if ((padding == PAD_ZERO) && (*p == '0') && (intDigits > 1))
+        {
+            *p = '-';
+        }
+        else
+        {
+            fits = false;
+        }
+    }
+
+    if (!fits)
+    {
+        memset(buf, '#', len);
+        return len;
+    }
+
+    while (p > buf)
+    {
+        *--p = ' ';
+    }
+
+    return len;
+}
+
+size_t FixedFormat::formatScaled(char *buf, int32_t value, int32_t scale,
+                                 int intDigits, int fracDigits,
+                                 Padding padding /* = PAD_SPACE */)
+{
+    // One count of the field in counts of the value, or the other
+    // way round when the field is finer than the value
+    int32_t perUnit = pow10(fracDigits);
+    int64_t rounded;
+    if (scale >= perUnit)
+    {
+        int32_t resolution = scale / perUnit;
+        int64_t half = resolution / 2;
+        rounded = (value < 0 ? (int64_t(value) - half) : (int64_t(value) + half)) / resolution;
+    }
+    else
+    {
+        rounded = int64_t(value) * (perUnit / scale);
+    }
+    if (rounded > INT32_MAX)
+    {
+        rounded = INT32_MAX;
+    }
+    if (rounded < -INT32_MAX)
+    {
+        rounded = -INT32_MAX;
+    }
+
+    return format(buf, int32_t(rounded), intDigits, fracDigits, padding);
+}
+
+char *FixedFormat::append(char *buf, const char *text)
+{
+    while (*text != '\0')
+    {
+        *buf++ = *text++;
+    }
+    *buf = '\0';
+
+    return buf;
+}
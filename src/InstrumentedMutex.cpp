@@ -0,0 +1,169 @@
+#include <string.h>
+#include <esp_timer.h>
+#include "InstrumentedMutex.hpp"
+
+const int InstrumentedMutex::g_bucketCount;
+const int InstrumentedMutex::g_maxTasks;
+InstrumentedMutex *InstrumentedMutex::g_first = 0;
+
+InstrumentedMutex::InstrumentedMutex(const char *name)
+    : _name(name),
+      _mutex(0),
+      _next(0)
+#if LOCK_STATS
+      ,
+      _tasks(),
+      _taskHandles(),
+      _taskCount(0),
+      _holderSlot(0),
+      _taken_us(0),
+      _reset(false)
+#endif
+{
+    _mutex = xSemaphoreCreateMutex();
+
+    // Locks are created during start-up and never destroyed
+    _next = g_first;
+    g_first = this;
+}
+
+void InstrumentedMutex::take()
+{
+#if LOCK_STATS
+    // esp_timer rather than the cycle counter: the tasks here aren't
+    // pinned, and the two cores' counters don't agree
+    uint32_t start_us = uint32_t(esp_timer_get_time());
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    uint32_t now_us = uint32_t(esp_timer_get_time());
+
+    if (_reset)
+    {
+        _reset = false;
+        memset(_tasks, 0, sizeof(_tasks));
+        memset(_taskHandles, 0, sizeof(_taskHandles));
+        _taskCount = 0;
+    }
+
+    _holderSlot = _taskSlot();
+    TaskStats *stats = &_tasks[_holderSlot];
+    uint32_t wait_us = now_us - start_us;
+    stats->count++;
+    stats->wait[_bucket(wait_us)]++;
+    if (wait_us > stats->maxWait_us)
+    {
+        stats->maxWait_us = wait_us;
+    }
+
+    _taken_us = now_us;
+#else
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+#endif
+}
+
+void InstrumentedMutex::give()
+{
+#if LOCK_STATS
+    uint32_t hold_us = uint32_t(esp_timer_get_time()) - _taken_us;
+    TaskStats *stats = &_tasks[_holderSlot];
+    stats->hold[_bucket(hold_us)]++;
+    if (hold_us > stats->maxHold_us)
+    {
+        stats->maxHold_us = hold_us;
+    }
+#endif
+
+    xSemaphoreGive(_mutex);
+}
+
+const char *InstrumentedMutex::name()
+{
+    return _name;
+}
+
+bool InstrumentedMutex::taskStats(int slot, TaskStats *stats)
+{
+#if LOCK_STATS
+    // Read without the lock; a dump racing an update may be off by one
+    if ((slot < 0) || (slot >= _taskCount))
+    {
+        return false;
+    }
+
+    memcpy(stats, &_tasks[slot], sizeof(TaskStats));
+    stats->taskName[configMAX_TASK_NAME_LEN - 1] = '\0';
+
+    return true;
+#else
+    return false;
+#endif
+}
+
+uint32_t InstrumentedMutex::overflowTakes()
+{
+#if LOCK_STATS
+    return _tasks[g_maxTasks].count;
+#else
+    return 0;
+#endif
+}
+
+void InstrumentedMutex::resetStats()
+{
+#if LOCK_STATS
+    // Applied by the next taker, which owns the stats
+    _reset = true;
+#endif
+}
+
+InstrumentedMutex *InstrumentedMutex::next()
+{
+    return _next;
+}
+
+InstrumentedMutex *InstrumentedMutex::first()
+{
+    return g_first;
+}
+
+uint32_t InstrumentedMutex::bucketFloor_us(int bucket)
+{
+    return bucket <= 0 ? 0 : uint32_t(1) << (bucket - 1);
+}
+
+#if LOCK_STATS
+int InstrumentedMutex::_taskSlot()
+{
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+
+    for (int i = 0; i < _taskCount; i++)
+    {
+        if (_taskHandles[i] == task)
+        {
+            return i;
+        }
+    }
+
+    if (_taskCount == g_maxTasks)
+    {
+        return g_maxTasks;
+    }
+
+    // Copied now, the task may be gone by the time we're dumped
+    _taskHandles[_taskCount] = task;
+    strncpy(_tasks[_taskCount].taskName, pcTaskGetTaskName(task), configMAX_TASK_NAME_LEN - 1);
+
+    return _taskCount++;
+}
+
+int InstrumentedMutex::_bucket(uint32_t time_us)
+{
+    int bucket = 0;
+    while ((time_us != 0) && (bucket < (g_bucketCount - 1)))
+    {
+        time_us >>= 1;
+        bucket++;
+    }
+
+    return bucket;
+}
+#endif
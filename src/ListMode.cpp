@@ -0,0 +1,314 @@
+#include <string.h>
+#include <Preferences.h>
+#include "DynamicLoad.hpp"
+#include "ListMode.hpp"
+
+const size_t ListMode::g_maxPoints;
+const size_t ListMode::g_maxTableSteps;
+const uint32_t ListMode::g_minDwell_us = 100;
+const char *ListMode::g_prefsNamespace = "list";
+
+ListMode::ListMode(DacSequencer *sequencer)
+    : _sequencer(sequencer),
+      _profile(),
+      _points(),
+      _pointCount(0),
+      _table(),
+      _tableSize(0),
+      _tableDuration_us(0),
+      _compiled(false),
+      _started(false)
+{
+    clear();
+}
+
+void ListMode::clear()
+{
+    _profile.shape = SHAPE_POINTS;
+    _profile.start_uA = 0;
+    _profile.end_uA = 0;
+    _profile.steps = 0;
+    _profile.dwell_us = 0;
+    _pointCount = 0;
+    _compiled = false;
+}
+
+bool ListMode::addPoint(int32_t current_uA, uint32_t dwell_us)
+{
+    if ((_profile.shape != SHAPE_POINTS) ||
+        (_pointCount >= g_maxPoints) ||
+        (dwell_us < g_minDwell_us))
+    {
+        return false;
+    }
+
+    _points[_pointCount].current_uA = current_uA;
+    _points[_pointCount].dwell_us = dwell_us;
+    _pointCount++;
+    _compiled = false;
+
+    return true;
+}
+
+bool ListMode::setRamp(int32_t start_uA, int32_t end_uA, uint32_t steps, uint32_t dwell_us)
+{
+    Profile profile;
+    profile.shape = SHAPE_RAMP;
+    profile.start_uA = start_uA;
+    profile.end_uA = end_uA;
+    profile.steps = steps;
+    profile.dwell_us = dwell_us;
+    if (!_profileValid(profile, 0))
+    {
+        return false;
+    }
+
+    clear();
+    _profile = profile;
+
+    return true;
+}
+
+bool ListMode::setStaircase(int32_t start_uA, int32_t step_uA, uint32_t steps, uint32_t dwell_us)
+{
+    // Up the stairs and back down again
+    Profile profile;
+    profile.shape = SHAPE_STAIRCASE;
+    profile.start_uA = start_uA;
+    profile.end_uA = 0;
+    profile.steps = steps;
+    profile.dwell_us = dwell_us;
+    if (!_profileValid(profile, 0))
+    {
+        return false;
+    }
+    profile.end_uA = int32_t(start_uA + (int64_t(step_uA) * (steps - 1)));
+
+    clear();
+    _profile = profile;
+
+    return true;
+}
+
+const ListMode::Profile &ListMode::profile()
+{
+    return _profile;
+}
+
+size_t ListMode::pointCount()
+{
+    return _pointCount;
+}
+
+bool ListMode::compile(const Calibration &calibration)
+{
+    // The table is about to change under the sequencer
+    stop();
+
+    _tableSize = 0;
+    _tableDuration_us = 0;
+    _compiled = false;
+
+    bool success = true;
+    switch (_profile.shape)
+    {
+    case SHAPE_RAMP:
+    case SHAPE_STAIRCASE:
+    {
+        int64_t span_uA = int64_t(_profile.end_uA) - _profile.start_uA;
+        for (uint32_t i = 0; success && (i < _profile.steps); i++)
+        {
+            int32_t current_uA = int32_t(_profile.start_uA + ((span_uA * i) / (_profile.steps - 1)));
+            success = _append(current_uA, _profile.dwell_us, calibration);
+        }
+        if (_profile.shape == SHAPE_STAIRCASE)
+        {
+            for (uint32_t i = _profile.steps - 1; success && (i-- > 0);)
+            {
+                int32_t current_uA = int32_t(_profile.start_uA + ((span_uA * i) / (_profile.steps - 1)));
+                success = _append(current_uA, _profile.dwell_us, calibration);
+            }
+        }
+        break;
+    }
+
+    default:
+        for (size_t i = 0; success && (i < _pointCount); i++)
+        {
+            success = _append(_points[i].current_uA, _points[i].dwell_us, calibration);
+        }
+        break;
+    }
+
+    _compiled = success && (_tableSize > 0);
+    return _compiled;
+}
+
+size_t ListMode::tableSize()
+{
+    return _tableSize;
+}
+
+uint64_t ListMode::tableDuration_us()
+{
+    return _tableDuration_us;
+}
+
+bool ListMode::start(bool loop)
+{
+    if (!_compiled)
+    {
+        return false;
+    }
+
+    _sequencer->stop();
+    _sequencer->resetStats();
+    _sequencer->play(_table, _tableSize, loop);
+    _started = true;
+
+    return true;
+}
+
+void ListMode::stop()
+{
+    // The sequencer is shared, only stop what we started
+    if (_started)
+    {
+        _sequencer->stop();
+        _started = false;
+    }
+}
+
+bool ListMode::running()
+{
+    return _started && _sequencer->running();
+}
+
+bool ListMode::finished()
+{
+    return _started && !_sequencer->running();
+}
+
+bool ListMode::save()
+{
+    Preferences prefs;
+    if (!prefs.begin(g_prefsNamespace, false))
+    {
+        return false;
+    }
+
+    prefs.clear();
+    bool success = (prefs.putBytes("profile", &_profile, sizeof(_profile)) == sizeof(_profile));
+    if (success && (_pointCount > 0))
+    {
+        size_t len = _pointCount * sizeof(Point);
+        success = (prefs.putBytes("points", _points, len) == len);
+    }
+    prefs.end();
+
+    return success;
+}
+
+bool ListMode::load()
+{
+    Preferences prefs;
+    if (!prefs.begin(g_prefsNamespace, true))
+    {
+        return false;
+    }
+
+    // Everything is read aside and checked before any of it is
+    // used; a bad profile would divide by zero in compile()
+    Profile profile;
+    bool success = (prefs.getBytesLength("profile") == sizeof(profile)) &&
+                   (prefs.getBytes("profile", &profile, sizeof(profile)) == sizeof(profile));
+
+    Point *points = new Point[g_maxPoints];
+    size_t len = 0;
+    if (success && prefs.isKey("points"))
+    {
+        len = prefs.getBytesLength("points");
+        success = (len <= (g_maxPoints * sizeof(Point))) && ((len % sizeof(Point)) == 0) &&
+                  (prefs.getBytes("points", points, len) == len);
+    }
+    prefs.end();
+
+    size_t pointCount = len / sizeof(Point);
+    success = success && _profileValid(profile, pointCount);
+    for (size_t i = 0; success && (i < pointCount); i++)
+    {
+        success = points[i].dwell_us >= g_minDwell_us;
+    }
+
+    if (success)
+    {
+        _profile = profile;
+        memcpy(_points, points, len);
+        _pointCount = pointCount;
+        _compiled = false;
+    }
+    delete[] points;
+
+    return success;
+}
+
+const char *ListMode::shapeName(Shape shape)
+{
+    switch (shape)
+    {
+    case SHAPE_RAMP:
+        return "ramp";
+    case SHAPE_STAIRCASE:
+        return "staircase";
+    default:
+        return "points";
+    }
+}
+
+bool ListMode::_profileValid(const Profile &profile, size_t pointCount)
+{
+    switch (profile.shape)
+    {
+    case SHAPE_POINTS:
+        return pointCount <= g_maxPoints;
+
+    case SHAPE_RAMP:
+        return (pointCount == 0) &&
+               (profile.steps >= 2) && (profile.steps <= g_maxTableSteps) &&
+               (profile.dwell_us >= g_minDwell_us);
+
+    case SHAPE_STAIRCASE:
+        // Every step but the top one is played twice
+        return (pointCount == 0) &&
+               (profile.steps >= 2) && (profile.steps <= g_maxTableSteps) &&
+               (((2 * profile.steps) - 1) <= g_maxTableSteps) &&
+               (profile.dwell_us >= g_minDwell_us);
+
+    default:
+        return false;
+    }
+}
+
+bool ListMode::_append(int32_t current_uA, uint32_t dwell_us, const Calibration &calibration)
+{
+    // Refuse rather than cut a long dwell short at the end of the table
+    uint64_t needed = (uint64_t(dwell_us) + DacSequencer::g_maxStepDwell_us - 1) / DacSequencer::g_maxStepDwell_us;
+    if (needed > (g_maxTableSteps - _tableSize))
+    {
+        return false;
+    }
+
+    size_t used = DacSequencer::fill(_table + _tableSize,
+                                     g_maxTableSteps - _tableSize,
+                                     DynamicLoad::encodeCurrent(current_uA, calibration),
+                                     dwell_us);
+    if (used == 0)
+    {
+        return false;
+    }
+
+    _tableSize += used;
+    _tableDuration_us += dwell_us;
+
+    return true;
+}
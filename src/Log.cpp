@@ -0,0 +1,201 @@
+#include <esp_timer.h>
+#include "TaskSyncShared.hpp"
+#include "Log.hpp"
+
+static void logTaskHelper(void *objPtr);
+
+Log Log::g_instance;
+
+const size_t Log::g_maxArgs;
+const size_t Log::g_capacity;
+
+Log *Log::getInstance()
+{
+    return &g_instance;
+}
+
+bool Log::start()
+{
+    if (xTaskCreate(logTaskHelper,
+                    "log",
+                    3000,
+                    (void *)this,
+                    0,
+                    &_logTaskHandle) != pdPASS)
+    {
+        return false;
+    }
+
+    return true;
+}
+
+void Log::logTask()
+{
+    uint32_t reportedDropped = 0;
+
+    while (true)
+    {
+        Entry entry;
+        bool any = false;
+        while (_pop(&entry))
+        {
+            _print(entry);
+            any = true;
+        }
+
+        uint32_t dropped = _dropped.load(std::memory_order_relaxed);
+        if (dropped != reportedDropped)
+        {
+            TaskSyncShared *tss = TaskSyncShared::getInstance();
+            tss->takeSerial();
+            Serial.printf("log: %u messages dropped\r\n", (unsigned)(dropped - reportedDropped));
+            tss->giveSerial();
+            reportedDropped = dropped;
+        }
+
+        if (!any)
+        {
+            vTaskDelay(10 / portTICK_PERIOD_MS);
+        }
+    }
+}
+
+uint32_t Log::written()
+{
+    return _written.load(std::memory_order_relaxed);
+}
+
+uint32_t Log::dropped()
+{
+    return _dropped.load(std::memory_order_relaxed);
+}
+
+uint32_t Log::maxWriteCycles()
+{
+    return _maxWriteCycles;
+}
+
+Log::Log()
+    : _enqueuePos(0),
+      _dequeuePos(0),
+      _written(0),
+      _dropped(0),
+      _maxWriteCycles(0),
+      _logTaskHandle(NULL)
+{
+    for (size_t i = 0; i < g_capacity; i++)
+    {
+        _entries[i].seq.store(i, std::memory_order_relaxed);
+    }
+}
+
+void Log::_push(Level level, const char *fmt, const uint32_t *args, size_t argc)
+{
+    // Bounded multi-producer queue: each entry's sequence number
+    // says whether it is free for the producer claiming position
+    // pos (seq == pos) or holds data for the consumer (seq == pos + 1)
+    uint32_t pos = _enqueuePos.load(std::memory_order_relaxed);
+    Entry *entry;
+    while (true)
+    {
+        entry = &_entries[pos % g_capacity];
+        uint32_t seq = entry->seq.load(std::memory_order_acquire);
+        int32_t diff = int32_t(seq - pos);
+        if (diff == 0)
+        {
+            if (_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if (diff < 0)
+        {
+            _dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        else
+        {
+            pos = _enqueuePos.load(std::memory_order_relaxed);
+        }
+    }
+
+    entry->fmt = fmt;
+    entry->timestamp_ms = uint32_t(esp_timer_get_time() / 1000);
+    entry->level = uint8_t(level);
+    entry->argc = uint8_t(argc);
+    for (size_t i = 0; i < argc; i++)
+    {
+        entry->args[i] = args[i];
+    }
+
+    entry->seq.store(pos + 1, std::memory_order_release);
+    _written.fetch_add(1, std::memory_order_relaxed);
+}
+
+bool Log::_pop(Entry *out)
+{
+    // Only the log task consumes
+    uint32_t pos = _dequeuePos.load(std::memory_order_relaxed);
+    Entry *entry = &_entries[pos % g_capacity];
+
+    uint32_t seq = entry->seq.load(std::memory_order_acquire);
+    if (seq != pos + 1)
+    {
+        return false;
+    }
+
+    out->fmt = entry->fmt;
+    out->timestamp_ms = entry->timestamp_ms;
+    out->level = entry->level;
+    out->argc = entry->argc;
+    for (size_t i = 0; i < g_maxArgs; i++)
+    {
+        out->args[i] = i < entry->argc ? entry->args[i] : 0;
+    }
+
+    entry->seq.store(pos + g_capacity, std::memory_order_release);
+    _dequeuePos.store(pos + 1, std::memory_order_relaxed);
+
+    return true;
+}
+
+void Log::_print(const Entry &entry)
+{
+    static const char levels[] = "?EWID";
+
+    const size_t bufLen = 160;
+    char buf[bufLen];
+
+    int len = snprintf(buf, bufLen, "[%8lu] %c: ",
+                       (unsigned long)entry.timestamp_ms,
+                       levels[entry.level < 5 ? entry.level : 0]);
+
+    // Every argument was packed as a 32-bit word, which is how
+    // the ESP32 passes int, long and pointer varargs; unused
+    // trailing words are ignored by the format
+    const uint32_t *a = entry.args;
+    len += snprintf(buf + len, bufLen - len, entry.fmt,
+                    a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7]);
+    if (len > int(bufLen - 1))
+    {
+        len = bufLen - 1;
+    }
+
+    TaskSyncShared *tss = TaskSyncShared::getInstance();
+    tss->takeSerial();
+    Serial.write((const uint8_t *)buf, len);
+    Serial.print("\r\n");
+    tss->giveSerial();
+}
+
+void logTaskHelper(void *objPtr)
+{
+    if (objPtr != 0)
+    {
+        Log *log = (Log *)objPtr;
+
+        log->logTask();
+    }
+
+    vTaskDelete(NULL);
+}
@@ -0,0 +1,155 @@
+#include <string.h>
+#include "ModeEngine.hpp"
+
+const int32_t ModeEngine::g_defaultVoltageKp_q16 = 6554;  // 0.1 A/V
+const int32_t ModeEngine::g_defaultVoltageKi_q16 = 655;   // 0.01 A/V per period
+const int32_t ModeEngine::g_minVoltage_uV = 100000;
+
+ModeEngine::ModeEngine()
+    : _mode(MODE_CC),
+      _setpoint(0),
+      _maxCurrent_uA(3000000),
+      _voltageKp_q16(g_defaultVoltageKp_q16),
+      _voltageKi_q16(g_defaultVoltageKi_q16),
+      _voltageIntegral_uA(0) {}
+
+void ModeEngine::setMode(Mode mode)
+{
+    if ((mode < MODE_COUNT) && (mode != _mode))
+    {
+        _mode = mode;
+        reset();
+    }
+}
+
+ModeEngine::Mode ModeEngine::mode()
+{
+    return _mode;
+}
+
+void ModeEngine::setSetpoint(int32_t setpoint)
+{
+    _setpoint = setpoint;
+}
+
+int32_t ModeEngine::setpoint()
+{
+    return _setpoint;
+}
+
+void ModeEngine::setVoltageGains(int32_t kp_q16, int32_t ki_q16)
+{
+    _voltageKp_q16 = kp_q16;
+    _voltageKi_q16 = ki_q16;
+}
+
+int32_t ModeEngine::voltageKp_q16()
+{
+    return _voltageKp_q16;
+}
+
+int32_t ModeEngine::voltageKi_q16()
+{
+    return _voltageKi_q16;
+}
+
+void ModeEngine::setMaxCurrent(int32_t maxCurrent_uA)
+{
+    _maxCurrent_uA = maxCurrent_uA;
+}
+
+void ModeEngine::reset()
+{
+    _voltageIntegral_uA = 0;
+}
+
+int32_t ModeEngine::update(int32_t voltage_uV)
+{
+    switch (_mode)
+    {
+    case MODE_CV:
+    {
+        // Sink more current while the source is above the
+        // setpoint; the integrator carries the steady-state current
+        int32_t error_uV = voltage_uV - _setpoint;
+
+        int64_t integral_uA = int64_t(_voltageIntegral_uA) + ((int64_t(error_uV) * _voltageKi_q16) >> 16);
+        _voltageIntegral_uA = _clamp(integral_uA);
+
+        return _clamp(_voltageIntegral_uA + ((int64_t(error_uV) * _voltageKp_q16) >> 16));
+    }
+
+    case MODE_CR:
+        // I = V / R, with R in milliohms
+        if ((_setpoint <= 0) || (voltage_uV < g_minVoltage_uV))
+        {
+            return 0;
+        }
+        return _clamp((int64_t(voltage_uV) * 1000) / _setpoint);
+
+    case MODE_CP:
+        // I = P / V; below the minimum voltage the current
+        // would run away, so don't load the source at all
+        if ((_setpoint <= 0) || (voltage_uV < g_minVoltage_uV))
+        {
+            return 0;
+        }
+        return _clamp((int64_t(_setpoint) * 1000000) / voltage_uV);
+
+    case MODE_DYNAMIC:
+    case MODE_LIST:
+        return 0;
+
+    default:
+        return _clamp(_setpoint);
+    }
+}
+
+const char *ModeEngine::modeName(Mode mode)
+{
+    switch (mode)
+    {
+    case MODE_CC:
+        return "CC";
+    case MODE_CV:
+        return "CV";
+    case MODE_CR:
+        return "CR";
+    case MODE_CP:
+        return "CP";
+    case MODE_DYNAMIC:
+        return "DYN";
+    case MODE_LIST:
+        return "LST";
+    default:
+        return "??";
+    }
+}
+
+bool ModeEngine::modeFromName(const char *name, Mode *mode)
+{
+    for (int i = 0; i < MODE_COUNT; i++)
+    {
+        if (strcasecmp(name, modeName(Mode(i))) == 0)
+        {
+            *mode = Mode(i);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+int32_t ModeEngine::_clamp(int64_t current_uA)
+{
+    if (current_uA < 0)
+    {
+        return 0;
+    }
+    if (current_uA > _maxCurrent_uA)
+    {
+        return _maxCurrent_uA;
+    }
+
+    return int32_t(current_uA);
+}
@@ -0,0 +1,399 @@
+#include <string.h>
+#include "PageFrame.hpp"
+
+const int PageFrame::g_glyphFirst;
+const int PageFrame::g_glyphCount;
+const int PageFrame::g_glyphWidth;
+// The classic 5x7 font, ASCII 0x20 to 0x7e, one byte per column with
+// the top row in bit 0, the same layout as an SSD1306 page
+const uint8_t PageFrame::g_font[g_glyphCount][g_glyphWidth - 1] = {
+    {0x00, 0x00, 0x00, 0x00, 0x00}, // ' '
+    {0x00, 0x00, 0x5f, 0x00, 0x00}, // '!'
+    {0x00, 0x07, 0x00, 0x07, 0x00}, // '"'
+    {0x14, 0x7f, 0x14, 0x7f, 0x14}, // '#'
+    {0x24, 0x2a, 0x7f, 0x2a, 0x12}, // '$'
+    {0x23, 0x13, 0x08, 0x64, 0x62}, // '%'
+    {0x36, 0x49, 0x56, 0x20, 0x50}, // '&'
+    {0x00, 0x08, 0x07, 0x03, 0x00}, // '''
+    {0x00, 0x1c, 0x22, 0x41, 0x00}, // '('
+    {0x00, 0x41, 0x22, 0x1c, 0x00}, // ')'
+    {0x2a, 0x1c, 0x7f, 0x1c, 0x2a}, // '*'
+    {0x08, 0x08, 0x3e, 0x08, 0x08}, // '+'
+    {0x00, 0x80, 0x70, 0x30, 0x00}, // ','
+    {0x08, 0x08, 0x08, 0x08, 0x08}, // '-'
+    {0x00, 0x00, 0x60, 0x60, 0x00}, // '.'
+    {0x20, 0x10, 0x08, 0x04, 0x02}, // '/'
+    {0x3e, 0x51, 0x49, 0x45, 0x3e}, // '0'
+    {0x00, 0x42, 0x7f, 0x40, 0x00}, // '1'
+    {0x72, 0x49, 0x49, 0x49, 0x46}, // '2'
+    {0x21, 0x41, 0x49, 0x4d, 0x33}, // '3'
+    {0x18, 0x14, 0x12, 0x7f, 0x10}, // '4'
+    {0x27, 0x45, 0x45, 0x45, 0x39}, // '5'
+    {0x3c, 0x4a, 0x49, 0x49, 0x31}, // '6'
+    {0x41, 0x21, 0x11, 0x09, 0x07}, // '7'
+    {0x36, 0x49, 0x49, 0x49, 0x36}, // '8'
+    {0x46, 0x49, 0x49, 0x29, 0x1e}, // '9'
+    {0x00, 0x00, 0x14, 0x00, 0x00}, // ':'
+    {0x00, 0x40, 0x34, 0x00, 0x00}, // ';'
+    {0x00, 0x08, 0x14, 0x22, 0x41}, // '<'
+    {0x14, 0x14, 0x14, 0x14, 0x14}, // '='
+    {0x00, 0x41, 0x22, 0x14, 0x08}, // '>'
+    {0x02, 0x01, 0x59, 0x09, 0x06}, // '?'
+    {0x3e, 0x41, 0x5d, 0x59, 0x4e}, // '@'
+    {0x7c, 0x12, 0x11, 0x12, 0x7c}, // 'A'
+    {0x7f, 0x49, 0x49, 0x49, 0x36}, // 'B'
+    {0x3e, 0x41, 0x41, 0x41, 0x22}, // 'C'
+    {0x7f, 0x41, 0x41, 0x41, 0x3e}, // 'D'
+    {0x7f, 0x49, 0x49, 0x49, 0x41}, // 'E'
+    {0x7f, 0x09, 0x09, 0x09, 0x01}, // 'F'
+    {0x3e, 0x41, 0x41, 0x51, 0x73}, // 'G'
+    {0x7f, 0x08, 0x08, 0x08, 0x7f}, // 'H'
+    {0x00, 0x41, 0x7f, 0x41, 0x00}, // 'I'
+    {0x20, 0x40, 0x41, 0x3f, 0x01}, // 'J'
+    {0x7f, 0x08, 0x14, 0x22, 0x41}, // 'K'
+    {0x7f, 0x40, 0x40, 0x40, 0x40}, // 'L'
+    {0x7f, 0x02, 0x1c, 0x02, 0x7f}, // 'M'
+    {0x7f, 0x04, 0x08, 0x10, 0x7f}, // 'N'
+    {0x3e, 0x41, 0x41, 0x41, 0x3e}, // 'O'
+    {0x7f, 0x09, 0x09, 0x09, 0x06}, // 'P'
+    {0x3e, 0x41, 0x51, 0x21, 0x5e}, // 'Q'
+    {0x7f, 0x09, 0x19, 0x29, 0x46}, // 'R'
+    {0x26, 0x49, 0x49, 0x49, 0x32}, // 'S'
+    {0x03, 0x01, 0x7f, 0x01, 0x03}, // 'T'
+    {0x3f, 0x40, 0x40, 0x40, 0x3f}, // 'U'
+    {0x1f, 0x20, 0x40, 0x20, 0x1f}, // 'V'
+    {0x3f, 0x40, 0x38, 0x40, 0x3f}, // 'W'
+    {0x63, 0x14, 0x08, 0x14, 0x63}, // 'X'
+    {0x03, 0x04, 0x78, 0x04, 0x03}, // 'Y'
+    {0x61, 0x59, 0x49, 0x4d, 0x43}, // 'Z'
+    {0x00, 0x7f, 0x41, 0x41, 0x41}, // '['
+    {0x02, 0x04, 0x08, 0x10, 0x20}, // backslash
+    {0x00, 0x41, 0x41, 0x41, 0x7f}, // ']'
+    {0x04, 0x02, 0x01, 0x02, 0x04}, // '^'
+    {0x40, 0x40, 0x40, 0x40, 0x40}, // '_'
+    {0x00, 0x03, 0x07, 0x08, 0x00}, // '`'
+    {0x20, 0x54, 0x54, 0x78, 0x40}, // 'a'
+    {0x7f, 0x28, 0x44, 0x44, 0x38}, // 'b'
+    {0x38, 0x44, 0x44, 0x44, 0x28}, // 'c'
+    {0x38, 0x44, 0x44, 0x28, 0x7f}, // 'd'
+    {0x38, 0x54, 0x54, 0x54, 0x18}, // 'e'
+    {0x00, 0x08, 0x7e, 0x09, 0x02}, // 'f'
+    {0x18, 0xa4, 0xa4, 0x9c, 0x78}, // 'g'
+    {0x7f, 0x08, 0x04, 0x04, 0x78}, // 'h'
+    {0x00, 0x44, 0x7d, 0x40, 0x00}, // 'i'
+    {0x20, 0x40, 0x40, 0x3d, 0x00}, // 'j'
+    {0x7f, 0x10, 0x28, 0x44, 0x00}, // 'k'
+    {0x00, 0x41, 0x7f, 0x40, 0x00}, // 'l'
+    {0x7c, 0x04, 0x78, 0x04, 0x78}, // 'm'
+    {0x7c, 0x08, 0x04, 0x04, 0x78}, // 'n'
+    {0x38, 0x44, 0x44, 0x44, 0x38}, // 'o'
+    {0xfc, 0x18, 0x24, 0x24, 0x18}, // 'p'
+    {0x18, 0x24, 0x24, 0x18, 0xfc}, // 'q'
+    {0x7c, 0x08, 0x04, 0x04, 0x08}, // 'r'
+    {0x48, 0x54, 0x54, 0x54, 0x24}, // 's'
+    {0x04, 0x04, 0x3f, 0x44, 0x24}, // 't'
+    {0x3c, 0x40, 0x40, 0x20, 0x7c}, // 'u'
+    {0x1c, 0x20, 0x40, 0x20, 0x1c}, // 'v'
+    {0x3c, 0x40, 0x30, 0x40, 0x3c}, // 'w'
+    {0x44, 0x28, 0x10, 0x28, 0x44}, // 'x'
+    {0x4c, 0x90, 0x90, 0x90, 0x7c}, // 'y'
+    {0x44, 0x64, 0x54, 0x4c, 0x44}, // 'z'
+    {0x00, 0x08, 0x36, 0x41, 0x00}, // '{'
+    {0x00, 0x00, 0x77, 0x00, 0x00}, // '|'
+    {0x00, 0x41, 0x36, 0x08, 0x00}, // '}'
+    {0x02, 0x01, 0x02, 0x04, 0x02}}; // '~'
+// About 0.8 ms on the bus at 400 kHz, which bounds how long a
+// DAC write can be held up behind the display
+const size_t PageFrame::g_chunkBytes = 32;
+// SSD1306 control bytes: Co = 0, then D/C# picks commands or data
+const uint8_t PageFrame::g_commands = 0x00;
+const uint8_t PageFrame::g_data = 0x40;
+const uint8_t PageFrame::g_columnAddr = 0x21;
+const uint8_t PageFrame::g_pageAddr = 0x22;
+
+PageFrame::PageFrame(int width, int height)
+    : _width(width),
+      _pages(height / 8),
+      _back(0),
+      _front(0),
+      _backWindows(0),
+      _frontWindows(0),
+      _pageBytes(0),
+      _lastFlushBytes(0),
+      _drawn(false)
+{
+    // Each glyph gets its blank spacing column, plus an inverted copy
+    // for the cursor, so drawing a character is a single copy
+    for (int i = 0; i < g_glyphCount; i++)
+    {
+        memcpy(_glyphs[GS_NORMAL][i], g_font[i], g_glyphWidth - 1);
+        _glyphs[GS_NORMAL][i][g_glyphWidth - 1] = 0;
+
+        for (int j = 0; j < g_glyphWidth; j++)
+        {
+            _glyphs[GS_INVERTED][i][j] = ~_glyphs[GS_NORMAL][i][j];
+        }
+    }
+}
+
+PageFrame::~PageFrame()
+{
+    delete[] _front;
+    delete[] _backWindows;
+    delete[] _frontWindows;
+    delete[] _pageBytes;
+}
+
+bool PageFrame::begin(uint8_t *back)
+{
+    if (back == 0)
+    {
+        return false;
+    }
+
+    _back = back;
+    _front = new uint8_t[_width * _pages];
+    _backWindows = new Window[_pages];
+    _frontWindows = new Window[_pages];
+    _pageBytes = new uint32_t[_pages];
+
+    memset(_front, 0, _width * _pages);
+    memset(_pageBytes, 0, _pages * sizeof(uint32_t));
+
+    return true;
+}
+
+uint8_t *PageFrame::buffer()
+{
+    return _back;
+}
+
+int PageFrame::width()
+{
+    return _width;
+}
+
+int PageFrame::pages()
+{
+    return _pages;
+}
+
+void PageFrame::clear()
+{
+    memset(_back, 0, _width * _pages);
+    markDirty(0, 0, _width, _pages * 8);
+}
+
+void PageFrame::markDirty(int pixX, int pixY, int pixWidth, int pixHeight)
+{
+    int colLo = pixX < 0 ? 0 : pixX;
+    int colHi = pixX + pixWidth - 1;
+    if (colHi >= _width)
+    {
+        colHi = _width - 1;
+    }
+
+    int pageLo = (pixY < 0 ? 0 : pixY) / 8;
+    int pageHi = (pixY + pixHeight - 1) / 8;
+    if (pageHi >= _pages)
+    {
+        pageHi = _pages - 1;
+    }
+
+    for (int page = pageLo; (page <= pageHi) && (colLo <= colHi); page++)
+    {
+        Window *window = &_backWindows[page];
+        _drawn = true;
+        if ((window->colLo == -1) || (colLo < window->colLo))
+        {
+            window->colLo = colLo;
+        }
+        if (colHi > window->colHi)
+        {
+            window->colHi = colHi;
+        }
+    }
+}
+
+void PageFrame::drawText(int col, int row, const char *text, size_t len,
+                         GlyphStyle style /* = GS_NORMAL */)
+{
+    int cols = _width / g_glyphWidth;
+    if ((col < 0) || (row < 0) || (col >= cols) || (row >= _pages))
+    {
+        return;
+    }
+    if ((col + int(len)) > cols)
+    {
+        len = cols - col;
+    }
+
+    uint8_t *dest = _back + (row * _width) + (col * g_glyphWidth);
+    for (size_t i = 0; i < len; i++)
+    {
+        int glyph = uint8_t(text[i]) - g_glyphFirst;
+        if ((glyph < 0) || (glyph >= g_glyphCount))
+        {
+            glyph = '?' - g_glyphFirst;
+        }
+
+        memcpy(dest, _glyphs[style][glyph], g_glyphWidth);
+        dest += g_glyphWidth;
+    }
+
+    markDirty(col * g_glyphWidth, row * 8, len * g_glyphWidth, 8);
+}
+
+void PageFrame::scrollLeft(int pageLo, int pageCount, int count)
+{
+    if ((count <= 0) || (count > _width))
+    {
+        return;
+    }
+
+    for (int page = pageLo; page < (pageLo + pageCount); page++)
+    {
+        uint8_t *row = _back + (page * _width);
+        memmove(row, row + count, _width - count);
+    }
+
+    // Scrolling touches every column, but only of the band's pages
+    markDirty(0, pageLo * 8, _width, pageCount * 8);
+}
+
+void PageFrame::drawColumn(int x, int pageLo, int pageCount, int top, int bottom)
+{
+    if ((x < 0) || (x >= _width))
+    {
+        return;
+    }
+
+    uint8_t *dest = _back + (pageLo * _width) + x;
+    for (int page = 0; page < pageCount; page++)
+    {
+        int first = top - (page * 8);
+        int last = bottom - (page * 8);
+        if (first < 0)
+        {
+            first = 0;
+        }
+        if (last > 7)
+        {
+            last = 7;
+        }
+
+        dest[page * _width] = first <= last ? uint8_t((0xff << first) & (0xff >> (7 - last))) : 0;
+    }
+
+    markDirty(x, pageLo * 8, 1, pageCount * 8);
+}
+
+void PageFrame::clearPages(int pageLo, int pageCount)
+{
+    memset(_back + (pageLo * _width), 0, pageCount * _width);
+    markDirty(0, pageLo * 8, _width, pageCount * 8);
+}
+
+bool PageFrame::takeDrawn()
+{
+    bool drawn = _drawn;
+    _drawn = false;
+
+    return drawn;
+}
+
+void PageFrame::present()
+{
+    for (int page = 0; page < _pages; page++)
+    {
+        Window *back = &_backWindows[page];
+        if (back->colLo == -1)
+        {
+            continue;
+        }
+
+        size_t offset = (page * _width) + back->colLo;
+        memcpy(_front + offset, _back + offset, back->colHi - back->colLo + 1);
+
+        // Whatever was still waiting to go out goes with it
+        Window *front = &_frontWindows[page];
+        if ((front->colLo == -1) || (back->colLo < front->colLo))
+        {
+            front->colLo = back->colLo;
+        }
+        if (back->colHi > front->colHi)
+        {
+            front->colHi = back->colHi;
+        }
+
+        back->colLo = -1;
+        back->colHi = -1;
+    }
+}
+
+bool PageFrame::flush(Writer writer, void *context)
+{
+    uint32_t bytes = 0;
+    bool success = true;
+
+    for (int page = 0; page < _pages; page++)
+    {
+        _pageBytes[page] = 0;
+
+        Window *window = &_frontWindows[page];
+        if (!success || (window->colLo == -1))
+        {
+            continue;
+        }
+
+        const uint8_t commands[] = {
+            g_pageAddr, uint8_t(page), uint8_t(page),
+            g_columnAddr, uint8_t(window->colLo), uint8_t(window->colHi)};
+        success = writer(context, g_commands, commands, sizeof(commands));
+        _pageBytes[page] += sizeof(commands) + 1;
+
+        const uint8_t *data = _front + (page * _width);
+        size_t colEnd = window->colHi + 1;
+        for (size_t col = window->colLo; success && (col < colEnd); col += g_chunkBytes)
+        {
+            size_t len = colEnd - col;
+            if (len > g_chunkBytes)
+            {
+                len = g_chunkBytes;
+            }
+
+            success = writer(context, g_data, data + col, len);
+            _pageBytes[page] += len + 1;
+        }
+
+        if (success)
+        {
+            window->colLo = -1;
+            window->colHi = -1;
+        }
+
+        bytes += _pageBytes[page];
+    }
+
+    _lastFlushBytes = bytes;
+
+    return success;
+}
+
+uint32_t PageFrame::lastFlushBytes()
+{
+    return _lastFlushBytes;
+}
+
+uint32_t PageFrame::lastPageBytes(int page)
+{
+    if ((page < 0) || (page >= _pages))
+    {
+        return 0;
+    }
+
+    return _pageBytes[page];
+}
+
+PageFrame::Window::Window()
+    : colLo(-1), colHi(-1) {}
@@ -1,6 +1,7 @@
 #include <Arduino.h>
 #include <FunctionalInterrupt.h>
 #include "RotaryEncoder.hpp"
+#include "Log.hpp"
 
 // #define AZ_INVERT
 
@@ -14,15 +15,32 @@ RotaryEncoder::RotaryEncoder(int aPin, int bPin, int buttonPin,
       _aPin(aPin),
       _bPin(bPin),
       _zPin(buttonPin),
-      _detents(detents),
+      _detents(detents > 0 ? detents : 1),
       _lastRotaryTick_ms(0),
       _eventTaskHandle(NULL),
+#if ENCODER_BACKEND_PCNT
+#ifdef AZ_INVERT
+      _pcnt(aPin, bPin, true),
+#else
+      _pcnt(aPin, bPin, false),
+#endif
+#else
       _aPinPending(false),
-      _zPinPending(false),
       _aPinDelta(0),
       _aPinTotalTriggers(0),
       _bPinValue(0),
-      _zPinTriggered(false)
+#endif
+      _zPinPending(false),
+      _zPinTriggered(false),
+      _edgePending(false),
+      _edge_us(0),
+      _eventEdge_us(0),
+      _wakeups(0),
+      _isrEntries(0),
+      _isrCycles(0),
+      _callbackEntries(0),
+      _callbackCycles(0),
+      _detentsCounted(0)
 {
 }
 
@@ -38,23 +56,35 @@ bool RotaryEncoder::init()
     pinMode(_zPin, INPUT_PULLUP);
 
 #ifdef AZ_INVERT
-    attachInterrupt(_aPin, std::bind(&RotaryEncoder::_aPinHandler, this), RISING);
     attachInterrupt(_zPin, std::bind(&RotaryEncoder::_zPinHandler, this), RISING);
 #else
-    attachInterrupt(_aPin, std::bind(&RotaryEncoder::_aPinHandler, this), FALLING);
     attachInterrupt(_zPin, std::bind(&RotaryEncoder::_zPinHandler, this), FALLING);
 #endif
 
-    _aPinTimerArgs.callback = &RotaryEncoder::g_aPinDebounce;
-    _aPinTimerArgs.arg = this;
-    esp_timer_create(&_aPinTimerArgs, &_aPinTimer);
-
     _zPinTimerArgs.callback = &RotaryEncoder::g_zPinDebounce;
     _zPinTimerArgs.arg = this;
     esp_timer_create(&_zPinTimerArgs, &_zPinTimer);
 
+#if ENCODER_BACKEND_PCNT
+    if (!_pcnt.begin(&RotaryEncoder::g_pcntHandler, this))
+    {
+        LOG_ERROR("Failed to set up the pulse counter");
+        return false;
+    }
+#else
+#ifdef AZ_INVERT
+    attachInterrupt(_aPin, std::bind(&RotaryEncoder::_aPinHandler, this), RISING);
+#else
+    attachInterrupt(_aPin, std::bind(&RotaryEncoder::_aPinHandler, this), FALLING);
+#endif
+
+    _aPinTimerArgs.callback = &RotaryEncoder::g_aPinDebounce;
+    _aPinTimerArgs.arg = this;
+    esp_timer_create(&_aPinTimerArgs, &_aPinTimer);
+#endif
+
     if (xTaskCreate(eventTaskHelper,
-                    "RotaryEncoder::loop",
+                    "encoder",
                     1000,
                     (void *)this,
                     1,
@@ -70,18 +100,31 @@ void RotaryEncoder::eventTask()
 {
     while (true)
     {
+        // Sleeps until a debounced edge comes in
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        _wakeups++;
+
         unsigned long now = millis();
 
-        if (_aPinTotalTriggers != 0)
+        int tempDelta = 0;
+        int tempTotalTriggers = 0;
+        _takeCounts(&tempDelta, &tempTotalTriggers);
+
+        if (tempTotalTriggers != 0)
         {
-            int tempTotalTriggers = _aPinTotalTriggers;
-            int tempDelta = _aPinDelta;
-            _aPinTotalTriggers = 0;
-            _aPinDelta = 0;
+            _detentsCounted += tempTotalTriggers;
+            _eventEdge_us = _edge_us;
+            _edgePending = false;
             int tickTime_ms = now > _lastRotaryTick_ms ? (now - _lastRotaryTick_ms) / tempTotalTriggers : 50;
             _lastRotaryTick_ms = now;
+            // Several detents within the same millisecond would
+            // otherwise take no time at all
+            if (tickTime_ms < 1)
+            {
+                tickTime_ms = 1;
+            }
 
-            int rpm = int(60000.0 / (double(tickTime_ms) * 24.0));
+            int rpm = int(60000 / (int64_t(tickTime_ms) * _detents));
 
             if (_listener != 0)
             {
@@ -98,17 +141,104 @@ void RotaryEncoder::eventTask()
                 _listener->clicked(this);
             }
         }
+    }
+}
+
+uint32_t RotaryEncoder::eventEdge_us()
+{
+    return _eventEdge_us;
+}
+
+uint32_t RotaryEncoder::wakeups()
+{
+    return _wakeups;
+}
+
+uint32_t RotaryEncoder::isrEntries()
+{
+    return _isrEntries;
+}
+
+uint32_t RotaryEncoder::isrCycles()
+{
+    return _isrCycles;
+}
+
+uint32_t RotaryEncoder::callbackEntries()
+{
+    return _callbackEntries;
+}
+
+uint32_t RotaryEncoder::callbackCycles()
+{
+    return _callbackCycles;
+}
+
+uint32_t RotaryEncoder::detentsCounted()
+{
+    return _detentsCounted;
+}
+
+const char *RotaryEncoder::backendName()
+{
+#if ENCODER_BACKEND_PCNT
+    return "pcnt";
+#else
+    return "software";
+#endif
+}
+
+#if ENCODER_BACKEND_PCNT
+void RotaryEncoder::_takeCounts(int *delta, int *triggers)
+{
+    *delta = _pcnt.take();
+    *triggers = *delta < 0 ? -*delta : *delta;
+}
+
+void IRAM_ATTR RotaryEncoder::_pcntHandler()
+{
+    uint32_t start = ESP.getCycleCount();
+
+    _startEdge();
+
+    BaseType_t woken = pdFALSE;
+    if (_eventTaskHandle != NULL)
+    {
+        vTaskNotifyGiveFromISR(_eventTaskHandle, &woken);
+    }
 
-        vTaskDelay(15 / portTICK_PERIOD_MS);
+    _isrEntries++;
+    _isrCycles += ESP.getCycleCount() - start;
+
+    if (woken == pdTRUE)
+    {
+        portYIELD_FROM_ISR();
     }
 }
 
+void IRAM_ATTR RotaryEncoder::g_pcntHandler(void *arg)
+{
+    RotaryEncoder *obj = (RotaryEncoder *)arg;
+    obj->_pcntHandler();
+}
+#else
+void RotaryEncoder::_takeCounts(int *delta, int *triggers)
+{
+    *triggers = _aPinTotalTriggers;
+    *delta = _aPinDelta;
+    _aPinTotalTriggers = 0;
+    _aPinDelta = 0;
+}
+
 void IRAM_ATTR RotaryEncoder::_aPinHandler()
 {
+    uint32_t start = ESP.getCycleCount();
+
     if (!_aPinPending)
     {
         detachInterrupt(_aPin);
         _aPinPending = true;
+        _startEdge();
         _bPinValue = digitalRead(_bPin) == LOW;
         if (_aPinTimer != 0)
         {
@@ -116,29 +246,18 @@ void IRAM_ATTR RotaryEncoder::_aPinHandler()
         }
         else
         {
-            Serial.println("Holy shit its null (A)");
+            LOG_ERROR("Holy shit its null (A)");
         }
     }
-}
 
-void IRAM_ATTR RotaryEncoder::_zPinHandler()
-{
-    if (!_zPinPending)
-    {
-        _zPinPending = true;
-        if (_zPinTimer != 0)
-        {
-            esp_timer_start_once(_zPinTimer, g_debounceTime_us);
-        }
-        else
-        {
-            Serial.println("Holy shit its null (Z)");
-        }
-    }
+    _isrEntries++;
+    _isrCycles += ESP.getCycleCount() - start;
 }
 
 void IRAM_ATTR RotaryEncoder::_aPinDebounce()
 {
+    uint32_t start = ESP.getCycleCount();
+
 #ifdef AZ_INVERT
     attachInterrupt(_aPin, std::bind(&RotaryEncoder::_aPinHandler, this), RISING);
 #else
@@ -162,10 +281,64 @@ void IRAM_ATTR RotaryEncoder::_aPinDebounce()
             _aPinDelta--;
         }
     }
+    else if (_aPinTotalTriggers == 0)
+    {
+        // A bounce; the next real edge starts the clock
+        _edgePending = false;
+    }
+
+    // esp_timer callbacks run on the esp_timer task, not in the ISR
+    if ((_aPinTotalTriggers != 0) && (_eventTaskHandle != NULL))
+    {
+        xTaskNotifyGive(_eventTaskHandle);
+    }
+
+    _callbackEntries++;
+    _callbackCycles += ESP.getCycleCount() - start;
 }
 
+void IRAM_ATTR RotaryEncoder::g_aPinDebounce(void *arg)
+{
+    RotaryEncoder *obj = (RotaryEncoder *)arg;
+    obj->_aPinDebounce();
+}
+#endif
+
+void IRAM_ATTR RotaryEncoder::_startEdge()
+{
+    if (!_edgePending)
+    {
+        _edge_us = uint32_t(esp_timer_get_time());
+        _edgePending = true;
+    }
+}
+
+void IRAM_ATTR RotaryEncoder::_zPinHandler()
+{
+    uint32_t start = ESP.getCycleCount();
+
+    if (!_zPinPending)
+    {
+        _zPinPending = true;
+        if (_zPinTimer != 0)
+        {
+            esp_timer_start_once(_zPinTimer, g_debounceTime_us);
+        }
+        else
+        {
+            LOG_ERROR("Holy shit its null (Z)");
+        }
+    }
+
+    _isrEntries++;
+    _isrCycles += ESP.getCycleCount() - start;
+}
+
+
 void IRAM_ATTR RotaryEncoder::_zPinDebounce()
 {
+    uint32_t start = ESP.getCycleCount();
+
     _zPinPending = false;
 #ifdef AZ_INVERT
     if (digitalRead(_zPin) == HIGH)
@@ -174,13 +347,14 @@ void IRAM_ATTR RotaryEncoder::_zPinDebounce()
 #endif
     {
         _zPinTriggered = true;
+        if (_eventTaskHandle != NULL)
+        {
+            xTaskNotifyGive(_eventTaskHandle);
+        }
     }
-}
 
-void IRAM_ATTR RotaryEncoder::g_aPinDebounce(void *arg)
-{
-    RotaryEncoder *obj = (RotaryEncoder *)arg;
-    obj->_aPinDebounce();
+    _callbackEntries++;
+    _callbackCycles += ESP.getCycleCount() - start;
 }
 
 void IRAM_ATTR RotaryEncoder::g_zPinDebounce(void *arg)
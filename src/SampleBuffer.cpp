@@ -0,0 +1,123 @@
+#include "SampleBuffer.hpp"
+
+const uint32_t SampleBuffer::g_capacity;
+const uint32_t SampleBuffer::g_mask;
+
+SampleBuffer::Reader::Reader()
+    : _next(0),
+      _dropped(0) {}
+
+uint32_t SampleBuffer::Reader::dropped() const
+{
+    return _dropped;
+}
+
+SampleBuffer::SampleBuffer()
+    : _head(0)
+{
+    for (uint32_t i = 0; i < g_capacity; i++)
+    {
+        _slots[i].seq.store(0, std::memory_order_relaxed);
+    }
+}
+
+void SampleBuffer::push(const Sample &sample)
+{
+    uint32_t head = _head.load(std::memory_order_relaxed);
+    Slot &slot = _slots[head & g_mask];
+
+    // Mark the slot as being written so a reader that
+    // races with us discards what it copied
+    slot.seq.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    slot.sample = sample;
+
+    slot.seq.store(head + 1, std::memory_order_release);
+    _head.store(head + 1, std::memory_order_release);
+}
+
+void SampleBuffer::attach(Reader *reader)
+{
+    reader->_next = _head.load(std::memory_order_acquire);
+    reader->_dropped = 0;
+}
+
+size_t SampleBuffer::read(Reader *reader, Sample *buf, size_t bufLen)
+{
+    uint32_t head = _head.load(std::memory_order_acquire);
+
+    if ((head - reader->_next) > g_capacity)
+    {
+        reader->_dropped += (head - reader->_next) - g_capacity;
+        reader->_next = head - g_capacity;
+    }
+
+    size_t count = 0;
+    while ((count < bufLen) && (reader->_next != head))
+    {
+        if (_readSlot(reader->_next, &buf[count]))
+        {
+            count++;
+        }
+        else
+        {
+            // Overwritten while we were copying it
+            reader->_dropped++;
+        }
+        reader->_next++;
+    }
+
+    return count;
+}
+
+bool SampleBuffer::latest(Sample *sample)
+{
+    uint32_t head = _head.load(std::memory_order_acquire);
+    if (head == 0)
+    {
+        return false;
+    }
+
+    return _readSlot(head - 1, sample);
+}
+
+size_t SampleBuffer::recent(Sample *buf, size_t count)
+{
+    Reader reader;
+    reader._next = _head.load(std::memory_order_acquire);
+
+    if (count > g_capacity)
+    {
+        count = g_capacity;
+    }
+    if (count > reader._next)
+    {
+        count = reader._next;
+    }
+    reader._next -= count;
+
+    return read(&reader, buf, count);
+}
+
+uint32_t SampleBuffer::totalPushed()
+{
+    return _head.load(std::memory_order_acquire);
+}
+
+bool SampleBuffer::_readSlot(uint32_t idx, Sample *sample)
+{
+    Slot &slot = _slots[idx & g_mask];
+
+    uint32_t seq = slot.seq.load(std::memory_order_acquire);
+    if (seq != idx + 1)
+    {
+        return false;
+    }
+
+    *sample = slot.sample;
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    return slot.seq.load(std::memory_order_relaxed) == seq;
+}
@@ -0,0 +1,306 @@
+#include <string.h>
+#include <esp_timer.h>
+#include "TaskSyncShared.hpp"
+#include "Sampler.hpp"
+
+static void samplerTaskHelper(void *objPtr);
+
+const TickType_t Sampler::g_period_ticks = 1;
+const UBaseType_t Sampler::g_taskPriority = 3;
+const size_t Sampler::g_framesPerBurst;
+const size_t Sampler::g_currentOnlyFramesPerBurst;
+const size_t Sampler::g_averageCount;
+
+Sampler::Sampler(MAX11645 *adc, SampleBuffer *buffer)
+    : _adc(adc),
+      _buffer(buffer),
+      _samplerTaskHandle(NULL),
+      _requestedProfile(PROFILE_FAST),
+      _activeProfile(PROFILE_FAST),
+      _profileApplied(false),
+      _lastAin0(0),
+      _samplesTaken(0),
+      _failedReads(0),
+      _listener(0) {}
+
+bool Sampler::start()
+{
+    if (xTaskCreate(samplerTaskHelper,
+                    "sampler",
+                    2000,
+                    (void *)this,
+                    g_taskPriority,
+                    &_samplerTaskHandle) != pdPASS)
+    {
+        return false;
+    }
+
+    return true;
+}
+
+void Sampler::setListener(SamplerListener *listener)
+{
+    _listener = listener;
+}
+
+void Sampler::samplerTask()
+{
+    TickType_t lastWake = xTaskGetTickCount();
+
+    while (true)
+    {
+        Profile requested = _requestedProfile;
+        if (!_profileApplied || (requested != _activeProfile))
+        {
+            _profileApplied = _applyProfile(requested);
+            _activeProfile = requested;
+        }
+
+        size_t frames = 0;
+        size_t expected = 0;
+        if (_profileApplied)
+        {
+            switch (_activeProfile)
+            {
+            case PROFILE_AVERAGE_8X:
+                frames = _acquireAveraged();
+                expected = 1;
+                break;
+
+            case PROFILE_CURRENT_ONLY:
+                frames = _acquireCurrentOnly();
+                expected = g_currentOnlyFramesPerBurst;
+                break;
+
+            default:
+                frames = _acquireScan();
+                expected = g_framesPerBurst;
+                break;
+            }
+        }
+        _samplesTaken += frames;
+
+        if (frames != expected || !_profileApplied)
+        {
+            _failedReads++;
+        }
+
+        vTaskDelayUntil(&lastWake, g_period_ticks);
+    }
+}
+
+void Sampler::setProfile(Profile profile)
+{
+    if (profile < PROFILE_COUNT)
+    {
+        _requestedProfile = profile;
+    }
+}
+
+Sampler::Profile Sampler::profile()
+{
+    return _requestedProfile;
+}
+
+uint32_t Sampler::samplesTaken()
+{
+    return _samplesTaken;
+}
+
+uint32_t Sampler::failedReads()
+{
+    return _failedReads;
+}
+
+const char *Sampler::profileName(Profile profile)
+{
+    switch (profile)
+    {
+    case PROFILE_FAST:
+        return "fast";
+    case PROFILE_AVERAGE_8X:
+        return "average-8x";
+    case PROFILE_CURRENT_ONLY:
+        return "current-only";
+    default:
+        return "unknown";
+    }
+}
+
+bool Sampler::profileFromName(const char *name, Profile *profile)
+{
+    for (int i = 0; i < PROFILE_COUNT; i++)
+    {
+        if (strcmp(name, profileName(Profile(i))) == 0)
+        {
+            *profile = Profile(i);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool Sampler::_applyProfile(Profile profile)
+{
+    MAX11645::ScanMode scanMode = MAX11645::SM_UP_FROM_AIN0_TO_CS0;
+    MAX11645::ChanSel chanSel = MAX11645::CS_AIN1;
+
+    switch (profile)
+    {
+    case PROFILE_AVERAGE_8X:
+        // Channel is selected per conversion group
+        scanMode = MAX11645::SM_CS0_8X;
+        chanSel = MAX11645::CS_AIN0;
+        break;
+
+    case PROFILE_CURRENT_ONLY:
+        scanMode = MAX11645::SM_CS0;
+        break;
+
+    default:
+        break;
+    }
+
+    TaskSyncShared *tss = TaskSyncShared::getInstance();
+    tss->takeI2c(TaskSyncShared::I2C_PRIO_MEASUREMENT);
+    bool success = _adc->writeConfig(scanMode, chanSel, MAX11645::MODE_SINGLE_ENDED);
+    tss->giveI2c();
+
+    return success;
+}
+
+size_t Sampler::_acquireScan()
+{
+    uint16_t ain0[g_framesPerBurst];
+    uint16_t ain1[g_framesPerBurst];
+    uint16_t *const channels[2] = {ain0, ain1};
+
+    TaskSyncShared *tss = TaskSyncShared::getInstance();
+    tss->takeI2c(TaskSyncShared::I2C_PRIO_MEASUREMENT);
+    uint32_t start_us = uint32_t(esp_timer_get_time());
+    size_t frames = _adc->readFrames(channels, 2, g_framesPerBurst);
+    uint32_t end_us = uint32_t(esp_timer_get_time());
+    tss->giveI2c();
+
+    if (frames > 0)
+    {
+        _lastAin0 = ain0[frames - 1];
+    }
+
+    _pushFrames(ain0, ain1, frames, start_us, end_us);
+
+    return frames;
+}
+
+size_t Sampler::_acquireAveraged()
+{
+    // The MAX11645 returns all eight results of an 8x conversion
+    // rather than averaging them, so sum them here
+    uint16_t results[g_averageCount];
+    uint16_t averages[2];
+
+    TaskSyncShared *tss = TaskSyncShared::getInstance();
+    tss->takeI2c(TaskSyncShared::I2C_PRIO_MEASUREMENT);
+    uint32_t start_us = uint32_t(esp_timer_get_time());
+    bool success = true;
+    for (int ch = 0; success && (ch < 2); ch++)
+    {
+        // The channel alternates, so this goes out on the bus
+        // for both conversion groups of every sample
+        MAX11645::ChanSel chanSel = ch == 0 ? MAX11645::CS_AIN0 : MAX11645::CS_AIN1;
+        success = _adc->writeConfig(MAX11645::SM_CS0_8X, chanSel, MAX11645::MODE_SINGLE_ENDED);
+
+        if (success)
+        {
+            success = _adc->readSamples(results, g_averageCount) == results;
+        }
+
+        if (success)
+        {
+            uint32_t sum = 0;
+            for (size_t i = 0; i < g_averageCount; i++)
+            {
+                sum += results[i];
+            }
+            averages[ch] = uint16_t((sum + (g_averageCount / 2)) / g_averageCount);
+        }
+    }
+    uint32_t end_us = uint32_t(esp_timer_get_time());
+    tss->giveI2c();
+
+    if (!success)
+    {
+        return 0;
+    }
+
+    _lastAin0 = averages[0];
+
+    _pushFrames(&averages[0], &averages[1], 1, start_us, end_us);
+
+    return 1;
+}
+
+size_t Sampler::_acquireCurrentOnly()
+{
+    uint16_t ain0[g_currentOnlyFramesPerBurst];
+    uint16_t ain1[g_currentOnlyFramesPerBurst];
+    uint16_t *const channels[1] = {ain1};
+
+    TaskSyncShared *tss = TaskSyncShared::getInstance();
+    tss->takeI2c(TaskSyncShared::I2C_PRIO_MEASUREMENT);
+    uint32_t start_us = uint32_t(esp_timer_get_time());
+    size_t frames = _adc->readFrames(channels, 1, g_currentOnlyFramesPerBurst);
+    uint32_t end_us = uint32_t(esp_timer_get_time());
+    tss->giveI2c();
+
+    for (size_t i = 0; i < frames; i++)
+    {
+        ain0[i] = _lastAin0;
+    }
+
+    _pushFrames(ain0, ain1, frames, start_us, end_us);
+
+    return frames;
+}
+
+void Sampler::_pushFrames(const uint16_t *ain0, const uint16_t *ain1,
+                          size_t frames,
+                          uint32_t start_us, uint32_t end_us)
+{
+    // The frames were converted back to back while the
+    // read was in progress, so spread their timestamps
+    // evenly across it
+    // The current-only profile reads the largest bursts
+    Sample samples[g_currentOnlyFramesPerBurst];
+    if (frames > g_currentOnlyFramesPerBurst)
+    {
+        frames = g_currentOnlyFramesPerBurst;
+    }
+
+    for (size_t i = 0; i < frames; i++)
+    {
+        samples[i].timestamp_us = start_us + (((end_us - start_us) * (i + 1)) / frames);
+        samples[i].ain0 = ain0[i];
+        samples[i].ain1 = ain1[i];
+
+        _buffer->push(samples[i]);
+    }
+
+    if ((_listener != 0) && (frames > 0))
+    {
+        _listener->samplesAcquired(this, samples, frames);
+    }
+}
+
+void samplerTaskHelper(void *objPtr)
+{
+    if (objPtr != 0)
+    {
+        Sampler *sampler = (Sampler *)objPtr;
+
+        sampler->samplerTask();
+    }
+
+    vTaskDelete(NULL);
+}
@@ -0,0 +1,179 @@
+#include <string.h>
+#include <Arduino.h>
+#include <Preferences.h>
+#include "Log.hpp"
+#include "SettingsStore.hpp"
+
+const unsigned long SettingsStore::g_quietTime_ms = 2000;
+const unsigned long SettingsStore::g_minWriteInterval_ms = 10000;
+const char *SettingsStore::g_prefsNamespace = "settings";
+// Indexed by SettingsStore::Slot
+const char *SettingsStore::g_keys[SLOT_COUNT] = {
+    "settings",
+    "calibration"};
+
+SettingsStore::SettingsStore()
+    : _slots(),
+      _staged(0),
+      _written(0),
+      _skipped(0),
+      _failed(0) {}
+
+bool SettingsStore::load(Slot slot, void *data, size_t len)
+{
+    if (!_reserve(slot, len))
+    {
+        return false;
+    }
+
+    Preferences prefs;
+    if (!prefs.begin(g_prefsNamespace, true))
+    {
+        return false;
+    }
+
+    // A blob of a different size was written by other firmware
+    bool success = (prefs.getBytesLength(g_keys[slot]) == len) &&
+                   (prefs.getBytes(g_keys[slot], data, len) == len);
+    prefs.end();
+
+    if (success)
+    {
+        _slots[slot].known = true;
+        memcpy(_slots[slot].stored, data, len);
+    }
+
+    return success;
+}
+
+void SettingsStore::stage(Slot slot, const void *data, size_t len)
+{
+    if (!_reserve(slot, len))
+    {
+        return;
+    }
+
+    SlotState *state = &_slots[slot];
+    if (state->dirty && (memcmp(state->data, data, len) == 0))
+    {
+        return;
+    }
+
+    memcpy(state->data, data, len);
+    state->lastChange_ms = millis();
+    _staged++;
+
+    // Back to what is already in flash, so nothing to write
+    state->dirty = !state->known || (memcmp(data, state->stored, len) != 0);
+}
+
+void SettingsStore::service(unsigned long now_ms)
+{
+    for (int i = 0; i < SLOT_COUNT; i++)
+    {
+        const SlotState &state = _slots[i];
+        if (state.dirty &&
+            ((now_ms - state.lastChange_ms) >= g_quietTime_ms) &&
+            (!state.hasWritten || ((now_ms - state.lastWrite_ms) >= g_minWriteInterval_ms)))
+        {
+            _write(Slot(i));
+        }
+    }
+}
+
+bool SettingsStore::flush()
+{
+    bool success = true;
+    for (int i = 0; i < SLOT_COUNT; i++)
+    {
+        if (_slots[i].dirty)
+        {
+            success = _write(Slot(i)) && success;
+        }
+    }
+
+    return success;
+}
+
+bool SettingsStore::pending()
+{
+    for (int i = 0; i < SLOT_COUNT; i++)
+    {
+        if (_slots[i].dirty)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+uint32_t SettingsStore::staged()
+{
+    return _staged;
+}
+
+uint32_t SettingsStore::written()
+{
+    return _written;
+}
+
+uint32_t SettingsStore::skipped()
+{
+    return _skipped;
+}
+
+uint32_t SettingsStore::failed()
+{
+    return _failed;
+}
+
+bool SettingsStore::_reserve(Slot slot, size_t len)
+{
+    SlotState *state = &_slots[slot];
+
+    if (state->data == 0)
+    {
+        state->data = new uint8_t[len];
+        state->stored = new uint8_t[len];
+        state->len = len;
+    }
+
+    return state->len == len;
+}
+
+bool SettingsStore::_write(Slot slot)
+{
+    SlotState *state = &_slots[slot];
+
+    state->lastWrite_ms = millis();
+    state->hasWritten = true;
+
+    // NVS skips identical values itself, but reading them back
+    // costs more than comparing with our copy
+    if (state->known && (memcmp(state->data, state->stored, state->len) == 0))
+    {
+        state->dirty = false;
+        _skipped++;
+        return true;
+    }
+
+    Preferences prefs;
+    bool success = prefs.begin(g_prefsNamespace, false) &&
+                   (prefs.putBytes(g_keys[slot], state->data, state->len) == state->len);
+    prefs.end();
+
+    if (!success)
+    {
+        _failed++;
+        LOG_WARN("Failed to store %s", g_keys[slot]);
+        return false;
+    }
+
+    state->dirty = false;
+    state->known = true;
+    memcpy(state->stored, state->data, state->len);
+    _written++;
+
+    return true;
+}
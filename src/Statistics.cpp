@@ -0,0 +1,191 @@
+#include <math.h>
+#include "Statistics.hpp"
+
+const int Statistics::g_windowCount;
+const int Statistics::g_bucketCount;
+
+// Values are squared at 64 micro-unit resolution so a full 60s
+// window of 8kHz power samples still fits a 64-bit sum
+const int Statistics::g_squareShift = 6;
+
+const uint32_t Statistics::g_defaultWindows_us[g_windowCount] = {
+    10000,
+    1000000,
+    60000000};
+
+Statistics::Statistics()
+{
+    for (int i = 0; i < g_windowCount; i++)
+    {
+        _windows[i].duration_us = 0;
+        setWindow(i, g_defaultWindows_us[i]);
+    }
+}
+
+void Statistics::setWindow(int idx, uint32_t duration_us)
+{
+    if ((idx < 0) || (idx >= g_windowCount) || (duration_us < g_bucketCount))
+    {
+        return;
+    }
+
+    Window *window = &_windows[idx];
+    window->duration_us = duration_us;
+    window->bucket_us = duration_us / g_bucketCount;
+    window->bucketStart_us = 0;
+    window->started = false;
+    window->current = 0;
+    for (int i = 0; i < g_bucketCount; i++)
+    {
+        _clearBucket(&window->buckets[i]);
+    }
+}
+
+void Statistics::reset()
+{
+    for (int i = 0; i < g_windowCount; i++)
+    {
+        setWindow(i, _windows[i].duration_us);
+    }
+}
+
+void Statistics::update(uint32_t timestamp_us,
+                        int32_t voltage_uV,
+                        int32_t current_uA)
+{
+    int32_t values[Q_COUNT];
+    values[Q_VOLTAGE] = voltage_uV;
+    values[Q_CURRENT] = current_uA;
+    values[Q_POWER] = int32_t((int64_t(voltage_uV) * current_uA) / 1000000);
+
+    for (int i = 0; i < g_windowCount; i++)
+    {
+        Window *window = &_windows[i];
+
+        _advance(window, timestamp_us);
+
+        Bucket *bucket = &window->buckets[window->current];
+        bucket->count++;
+        for (int q = 0; q < Q_COUNT; q++)
+        {
+            Accumulator *acc = &bucket->acc[q];
+            int32_t value = values[q];
+            int64_t scaled = (int64_t(value) + (1 << (g_squareShift - 1))) >> g_squareShift;
+
+            if (value < acc->min)
+            {
+                acc->min = value;
+            }
+            if (value > acc->max)
+            {
+                acc->max = value;
+            }
+            acc->sum += value;
+            acc->sumSq += uint64_t(scaled * scaled);
+        }
+    }
+}
+
+bool Statistics::snapshot(int idx, Snapshot *snap)
+{
+    if ((idx < 0) || (idx >= g_windowCount))
+    {
+        return false;
+    }
+
+    Window *window = &_windows[idx];
+
+    Accumulator total[Q_COUNT];
+    uint32_t count = 0;
+    for (int q = 0; q < Q_COUNT; q++)
+    {
+        total[q].min = INT32_MAX;
+        total[q].max = INT32_MIN;
+        total[q].sum = 0;
+        total[q].sumSq = 0;
+    }
+
+    for (int i = 0; i < g_bucketCount; i++)
+    {
+        Bucket *bucket = &window->buckets[i];
+        if (bucket->count == 0)
+        {
+            continue;
+        }
+
+        count += bucket->count;
+        for (int q = 0; q < Q_COUNT; q++)
+        {
+            if (bucket->acc[q].min < total[q].min)
+            {
+                total[q].min = bucket->acc[q].min;
+            }
+            if (bucket->acc[q].max > total[q].max)
+            {
+                total[q].max = bucket->acc[q].max;
+            }
+            total[q].sum += bucket->acc[q].sum;
+            total[q].sumSq += bucket->acc[q].sumSq;
+        }
+    }
+
+    snap->window_us = window->duration_us;
+    snap->count = count;
+    if (count == 0)
+    {
+        return false;
+    }
+
+    for (int q = 0; q < Q_COUNT; q++)
+    {
+        Summary *summary = &snap->q[q];
+        summary->min = total[q].min;
+        summary->max = total[q].max;
+        summary->mean = int32_t(total[q].sum / int64_t(count));
+        summary->rms = int32_t(sqrtf(float(total[q].sumSq) / float(count)) * (1 << g_squareShift));
+        summary->ripple = total[q].max - total[q].min;
+    }
+
+    return true;
+}
+
+void Statistics::_clearBucket(Bucket *bucket)
+{
+    bucket->count = 0;
+    for (int q = 0; q < Q_COUNT; q++)
+    {
+        bucket->acc[q].min = INT32_MAX;
+        bucket->acc[q].max = INT32_MIN;
+        bucket->acc[q].sum = 0;
+        bucket->acc[q].sumSq = 0;
+    }
+}
+
+void Statistics::_advance(Window *window, uint32_t timestamp_us)
+{
+    if (!window->started)
+    {
+        window->started = true;
+        window->bucketStart_us = timestamp_us;
+        return;
+    }
+
+    uint32_t elapsed_us = timestamp_us - window->bucketStart_us;
+    if (elapsed_us < window->bucket_us)
+    {
+        return;
+    }
+
+    uint32_t steps = elapsed_us / window->bucket_us;
+    window->bucketStart_us += steps * window->bucket_us;
+
+    if (steps > uint32_t(g_bucketCount))
+    {
+        steps = g_bucketCount;
+    }
+    for (uint32_t i = 0; i < steps; i++)
+    {
+        window->current = (window->current + 1) % g_bucketCount;
+        _clearBucket(&window->buckets[window->current]);
+    }
+}
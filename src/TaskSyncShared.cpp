@@ -1,5 +1,7 @@
+#include <esp_timer.h>
 #include "TaskSyncShared.hpp"
 
+const TickType_t TaskSyncShared::g_i2cBackoff_ticks = 1;
 TaskSyncShared *TaskSyncShared::g_instance = 0;
 
 TaskSyncShared *TaskSyncShared::getInstance()
@@ -12,30 +14,136 @@ TaskSyncShared *TaskSyncShared::getInstance()
     return g_instance;
 }
 
-void TaskSyncShared::takeI2c()
+void TaskSyncShared::takeI2c(I2cPriority priority /* = I2C_PRIO_CONTROL */)
 {
-    xSemaphoreTake(_i2cMutex, portMAX_DELAY);
+    if (priority >= I2C_PRIO_COUNT)
+    {
+        priority = I2C_PRIO_CONTROL;
+    }
+
+    uint32_t start_us = uint32_t(esp_timer_get_time());
+
+    // The mutex hands over by task priority, so a low priority
+    // task of a more urgent class could still lose to the UI; back
+    // off whenever a more urgent class is queued behind us
+    I2cClass *cls = &_i2cClasses[priority];
+    cls->waiting++;
+    while (true)
+    {
+        _i2cMutex.take();
+        if (!_higherWaiting(priority))
+        {
+            break;
+        }
+        _i2cMutex.give();
+        vTaskDelay(g_i2cBackoff_ticks);
+    }
+    cls->waiting--;
+
+    uint32_t now_us = uint32_t(esp_timer_get_time());
+
+    // Only the holder touches the counters, so the lock covers them
+    if (_resetI2cStats)
+    {
+        _resetI2cStats = false;
+        for (int i = 0; i < I2C_PRIO_COUNT; i++)
+        {
+            _i2cClasses[i].count = 0;
+            _i2cClasses[i].totalWait_us = 0;
+            _i2cClasses[i].maxWait_us = 0;
+            _i2cClasses[i].maxHold_us = 0;
+        }
+    }
+
+    uint32_t wait_us = now_us - start_us;
+    cls->count++;
+    cls->totalWait_us += wait_us;
+    if (wait_us > cls->maxWait_us)
+    {
+        cls->maxWait_us = wait_us;
+    }
+
+    _i2cHolder = priority;
+    _i2cTaken_us = now_us;
 }
 
 void TaskSyncShared::giveI2c()
 {
-    xSemaphoreGive(_i2cMutex);
+    uint32_t hold_us = uint32_t(esp_timer_get_time()) - _i2cTaken_us;
+    I2cClass *cls = &_i2cClasses[_i2cHolder];
+    if (hold_us > cls->maxHold_us)
+    {
+        cls->maxHold_us = hold_us;
+    }
+
+    _i2cMutex.give();
+}
+
+void TaskSyncShared::i2cStats(I2cPriority priority, I2cStats *stats)
+{
+    if (priority >= I2C_PRIO_COUNT)
+    {
+        memset(stats, 0, sizeof(I2cStats));
+        return;
+    }
+
+    const I2cClass *cls = &_i2cClasses[priority];
+    stats->count = cls->count;
+    stats->meanWait_us = cls->count > 0 ? uint32_t(cls->totalWait_us / cls->count) : 0;
+    stats->maxWait_us = cls->maxWait_us;
+    stats->maxHold_us = cls->maxHold_us;
+}
+
+void TaskSyncShared::resetI2cStats()
+{
+    // Applied by the next taker, which owns the counters
+    _resetI2cStats = true;
 }
 
 void TaskSyncShared::takeSerial()
 {
-    xSemaphoreTake(_serialMutex, portMAX_DELAY);
+    _serialMutex.take();
 }
 
 void TaskSyncShared::giveSerial()
 {
-    xSemaphoreGive(_serialMutex);
+    _serialMutex.give();
+}
+
+const char *TaskSyncShared::i2cPriorityName(I2cPriority priority)
+{
+    switch (priority)
+    {
+    case I2C_PRIO_CONTROL:
+        return "control";
+    case I2C_PRIO_MEASUREMENT:
+        return "measurement";
+    case I2C_PRIO_DISPLAY:
+        return "display";
+    default:
+        return "unknown";
+    }
 }
 
 TaskSyncShared::TaskSyncShared()
-    : _i2cMutex(0),
-      _serialMutex(0)
+    : _i2cMutex("i2c"),
+      _serialMutex("serial"),
+      _i2cClasses(),
+      _i2cHolder(I2C_PRIO_CONTROL),
+      _i2cTaken_us(0),
+      _resetI2cStats(false)
 {
-    _i2cMutex = xSemaphoreCreateMutex();
-    _serialMutex = xSemaphoreCreateMutex();
+}
+
+bool TaskSyncShared::_higherWaiting(I2cPriority priority)
+{
+    for (int i = 0; i < priority; i++)
+    {
+        if (_i2cClasses[i].waiting > 0)
+        {
+            return true;
+        }
+    }
+
+    return false;
 }
@@ -0,0 +1,167 @@
+#include <string.h>
+#include "TaskSyncShared.hpp"
+#include "Telemetry.hpp"
+
+static void telemetryTaskHelper(void *objPtr);
+
+Telemetry::Telemetry(SampleBuffer *buffer)
+    : _buffer(buffer),
+      _reader(),
+      _telemetryTaskHandle(NULL),
+      _mode(TM_OFF),
+      _activeMode(TM_OFF),
+      _frameEncoder(),
+      _samplesSent(0),
+      _frame() {}
+
+bool Telemetry::start()
+{
+    if (xTaskCreate(telemetryTaskHelper,
+                    "telemetry",
+                    3000,
+                    (void *)this,
+                    1,
+                    &_telemetryTaskHandle) != pdPASS)
+    {
+        return false;
+    }
+
+    return true;
+}
+
+void Telemetry::telemetryTask()
+{
+    Sample samples[TelemetryFrame::g_samplesPerRecord];
+
+    while (true)
+    {
+        Mode mode = _mode;
+        if (mode != _activeMode)
+        {
+            // Start streaming from "now" rather than from
+            // whatever is left in the ring
+            _buffer->attach(&_reader);
+            _activeMode = mode;
+        }
+
+        size_t count = 0;
+        if (_activeMode != TM_OFF)
+        {
+            count = _buffer->read(&_reader, samples, TelemetryFrame::g_samplesPerRecord);
+        }
+
+        if (count > 0)
+        {
+            if (_activeMode == TM_BINARY)
+            {
+                _sendBinary(samples, count);
+            }
+            else
+            {
+                _sendText(samples, count);
+            }
+        }
+
+        if (count < TelemetryFrame::g_samplesPerRecord)
+        {
+            vTaskDelay(10 / portTICK_PERIOD_MS);
+        }
+    }
+}
+
+void Telemetry::setMode(Mode mode)
+{
+    _mode = mode;
+}
+
+Telemetry::Mode Telemetry::mode()
+{
+    return _mode;
+}
+
+uint32_t Telemetry::samplesSent()
+{
+    return _samplesSent;
+}
+
+uint32_t Telemetry::dropped()
+{
+    return _reader.dropped();
+}
+
+const char *Telemetry::modeName(Mode mode)
+{
+    switch (mode)
+    {
+    case TM_OFF:
+        return "off";
+    case TM_TEXT:
+        return "text";
+    case TM_BINARY:
+        return "binary";
+    default:
+        return "unknown";
+    }
+}
+
+bool Telemetry::modeFromName(const char *name, Mode *mode)
+{
+    for (int i = TM_OFF; i <= TM_BINARY; i++)
+    {
+        if (strcmp(name, modeName(Mode(i))) == 0)
+        {
+            *mode = Mode(i);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void Telemetry::_sendText(const Sample *samples, size_t count)
+{
+    TaskSyncShared *tss = TaskSyncShared::getInstance();
+
+    for (size_t i = 0; i < count; i++)
+    {
+        tss->takeSerial();
+        Serial.printf("%lu,%u,%u\r\n",
+                      (unsigned long)samples[i].timestamp_us,
+                      (unsigned)samples[i].ain0,
+                      (unsigned)samples[i].ain1);
+        tss->giveSerial();
+    }
+
+    _samplesSent += count;
+}
+
+void Telemetry::_sendBinary(const Sample *samples, size_t count)
+{
+    TaskSyncShared *tss = TaskSyncShared::getInstance();
+
+    size_t first = 0;
+    while (first < count)
+    {
+        size_t used = 0;
+        size_t frameLen = _frameEncoder.encode(samples + first, count - first, _frame, &used);
+
+        tss->takeSerial();
+        Serial.write(_frame, frameLen);
+        tss->giveSerial();
+
+        _samplesSent += used;
+        first += used;
+    }
+}
+
+void telemetryTaskHelper(void *objPtr)
+{
+    if (objPtr != 0)
+    {
+        Telemetry *telemetry = (Telemetry *)objPtr;
+
+        telemetry->telemetryTask();
+    }
+
+    vTaskDelete(NULL);
+}
@@ -0,0 +1,144 @@
+#include "TelemetryFrame.hpp"
+
+const size_t TelemetryFrame::g_samplesPerRecord;
+const size_t TelemetryFrame::g_maxPayloadLen;
+const size_t TelemetryFrame::g_maxFrameLen;
+const uint8_t TelemetryFrame::g_recordTypeSamples = 0x01;
+// The most three varint bytes hold, about two seconds
+const uint32_t TelemetryFrame::g_maxDelta_us = 0x1fffff;
+
+TelemetryFrame::TelemetryFrame()
+    : _sequence(0),
+      _payload() {}
+
+size_t TelemetryFrame::encode(const Sample *samples, size_t count, uint8_t *frame, size_t *used)
+{
+    *used = recordLength(samples, count);
+    if (*used == 0)
+    {
+        return 0;
+    }
+
+    size_t payloadLen = _encodeRecord(samples, *used);
+
+    return cobsEncode(_payload, payloadLen, frame);
+}
+
+uint8_t TelemetryFrame::sequence() const
+{
+    return _sequence;
+}
+
+size_t TelemetryFrame::recordLength(const Sample *samples, size_t count)
+{
+    if (count == 0)
+    {
+        return 0;
+    }
+
+    // A gap too long for a delta starts a new record, which
+    // carries the absolute timestamp again
+    size_t end = 1;
+    while ((end < count) && (end < g_samplesPerRecord) &&
+           ((samples[end].timestamp_us - samples[end - 1].timestamp_us) <= g_maxDelta_us))
+    {
+        end++;
+    }
+
+    return end;
+}
+
+size_t TelemetryFrame::_encodeRecord(const Sample *samples, size_t count)
+{
+    uint8_t *payload = _payload;
+    size_t len = 0;
+
+    payload[len++] = g_recordTypeSamples;
+    payload[len++] = _sequence++;
+    payload[len++] = uint8_t(samples[0].timestamp_us);
+    payload[len++] = uint8_t(samples[0].timestamp_us >> 8);
+    payload[len++] = uint8_t(samples[0].timestamp_us >> 16);
+    payload[len++] = uint8_t(samples[0].timestamp_us >> 24);
+    payload[len++] = uint8_t(count);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        // Timestamp delta as a little-endian base-128 varint of at
+        // most g_maxDelta_us; recordLength() splits at longer gaps
+        if (i > 0)
+        {
+            uint32_t delta = samples[i].timestamp_us - samples[i - 1].timestamp_us;
+            while (delta >= 0x80)
+            {
+                payload[len++] = uint8_t(delta | 0x80);
+                delta >>= 7;
+            }
+            payload[len++] = uint8_t(delta);
+        }
+
+        // Two 12-bit counts in three bytes
+        payload[len++] = uint8_t(samples[i].ain0);
+        payload[len++] = uint8_t(((samples[i].ain0 >> 8) & 0x0f) | ((samples[i].ain1 & 0x0f) << 4));
+        payload[len++] = uint8_t(samples[i].ain1 >> 4);
+    }
+
+    uint16_t crc = crc16(payload, len);
+    payload[len++] = uint8_t(crc);
+    payload[len++] = uint8_t(crc >> 8);
+
+    return len;
+}
+
+size_t TelemetryFrame::cobsEncode(const uint8_t *in, size_t len, uint8_t *out)
+{
+    // Frames are delimited by a zero on both sides so any text
+    // printed between frames is discarded by the decoder as a
+    // single corrupt frame instead of corrupting the next one
+    size_t outLen = 0;
+    out[outLen++] = 0x00;
+
+    size_t codeIdx = outLen++;
+    uint8_t code = 1;
+    for (size_t i = 0; i < len; i++)
+    {
+        if (in[i] == 0x00)
+        {
+            out[codeIdx] = code;
+            codeIdx = outLen++;
+            code = 1;
+        }
+        else
+        {
+            out[outLen++] = in[i];
+            code++;
+            if (code == 0xff)
+            {
+                out[codeIdx] = code;
+                codeIdx = outLen++;
+                code = 1;
+            }
+        }
+    }
+    out[codeIdx] = code;
+
+    out[outLen++] = 0x00;
+
+    return outLen;
+}
+
+uint16_t TelemetryFrame::crc16(const uint8_t *data, size_t len)
+{
+    // CRC-16/CCITT-FALSE
+    uint16_t crc = 0xffff;
+
+    for (size_t i = 0; i < len; i++)
+    {
+        crc ^= uint16_t(data[i]) << 8;
+        for (int bit = 0; bit < 8; bit++)
+        {
+            crc = (crc & 0x8000) ? uint16_t((crc << 1) ^ 0x1021) : uint16_t(crc << 1);
+        }
+    }
+
+    return crc;
+}
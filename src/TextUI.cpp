@@ -1,17 +1,109 @@
 #include <string.h>
+#include <esp_timer.h>
 #include "TaskSyncShared.hpp"
+#include "Log.hpp"
+#include "FixedFormat.hpp"
+#include "RotaryEncoder.hpp"
 #include "TextUI.hpp"
 
 static void uiTaskHelper(void *objPtr);
+static void flushTaskHelper(void *objPtr);
+
+// Values are held in uA, uV, milliohm, uW, Hz and percent
+const TextUI::ValueFormat TextUI::g_ampsFormat = {"A", 1, 4, 1000000, 0, 3000000};
+const TextUI::ValueFormat TextUI::g_voltsFormat = {"V", 2, 3, 1000000, 0, 30000000};
+const TextUI::ValueFormat TextUI::g_ohmsFormat = {"Ohm", 3, 2, 1000, 0, 999990};
+const TextUI::ValueFormat TextUI::g_wattsFormat = {"W", 2, 3, 1000000, 0, 90000000};
+const TextUI::ValueFormat TextUI::g_hertzFormat = {"Hz", 4, 0, 1, 1, 5000};
+const TextUI::ValueFormat TextUI::g_percentFormat = {"%", 2, 0, 1, 1, 99};
+
+// Readouts, from micro-units; the readings switch to mV and mA below
+// one volt or amp, charge and energy are shown in mAh and mWh
+static size_t formatVoltage(char *buf, int32_t value_uV)
+{
+    return Fixed<2, 3>::engineering(buf, value_uV, "V");
+}
+
+static size_t formatCurrent(char *buf, int32_t value_uA)
+{
+    return Fixed<1, 4>::engineering(buf, value_uA, "A");
+}
 
-const int TextUI::g_cursorPointsCount = 6;
-const TextUI::Point TextUI::g_cursorPoints[] = {
-    {2, 5},
-    {4, 5},
-    {5, 5},
-    {6, 5},
-    {7, 5},
-    {0, 7}};
+static size_t formatCharge(char *buf, int32_t value_uAh)
+{
+    char *end = buf + Fixed<4, 1, 1000>::format(buf, value_uAh);
+    return FixedFormat::append(end, "mAh") - buf;
+}
+
+static size_t formatEnergy(char *buf, int32_t value_uWh)
+{
+    char *end = buf + Fixed<5, 1, 1000>::format(buf, value_uWh);
+    return FixedFormat::append(end, "mWh") - buf;
+}
+
+// Every screen is framed by the header and footer widgets, the mode
+// screens add the controls and the mode's settings, the graph screen
+// the trace. Edit stops follow table order: mode, setting digits,
+// then on/off and the view
+const TextUI::Widget TextUI::g_headerWidgets[] = {
+    {W_LABEL, 1, 0, V_NONE, V_NONE, "Electronic Load V2"},
+    {W_READOUT, 2, 2, V_LOAD_VOLTAGE, V_NONE, 0, 0, formatVoltage},
+    {W_READOUT, 11, 2, V_LOAD_CURRENT, V_NONE, 0, 0, formatCurrent}};
+const TextUI::Widget TextUI::g_controlWidgets[] = {
+    {W_READOUT, 0, 3, V_BATTERY_CHARGE, V_BATTERY_VISIBLE, 0, 0, formatCharge},
+    {W_READOUT, 10, 3, V_BATTERY_ENERGY, V_BATTERY_VISIBLE, 0, 0, formatEnergy},
+    {W_MODE, 0, 4, V_MODE},
+    {W_LABEL, 4, 4, V_NONE, V_NONE, "SET"}};
+const TextUI::Widget TextUI::g_footerWidgets[] = {
+    {W_TOGGLE, 0, 7, V_ENABLED},
+    {W_VIEW, 17, 7, V_VIEW}};
+// The trace fills g_graphRows rows down from its own, the span sits
+// in the footer row
+const TextUI::Widget TextUI::g_graphWidgets[] = {
+    {W_GRAPH, 0, 3, V_GRAPH, V_VIEW},
+    {W_SPAN, 4, 7, V_GRAPH_SPAN, V_VIEW}};
+const TextUI::Widget TextUI::g_ccWidgets[] = {
+    {W_SETTING, 2, 5, V_SETPOINT_CC, V_NONE, 0, &g_ampsFormat}};
+const TextUI::Widget TextUI::g_cvWidgets[] = {
+    {W_SETTING, 2, 5, V_SETPOINT_CV, V_NONE, 0, &g_voltsFormat}};
+const TextUI::Widget TextUI::g_crWidgets[] = {
+    {W_SETTING, 2, 5, V_SETPOINT_CR, V_NONE, 0, &g_ohmsFormat}};
+const TextUI::Widget TextUI::g_cpWidgets[] = {
+    {W_SETTING, 2, 5, V_SETPOINT_CP, V_NONE, 0, &g_wattsFormat}};
+const TextUI::Widget TextUI::g_dynamicWidgets[] = {
+    {W_SETTING, 2, 5, V_DYNAMIC_HIGH, V_NONE, 0, &g_ampsFormat},
+    {W_SETTING, 12, 5, V_DYNAMIC_LOW, V_NONE, 0, &g_ampsFormat},
+    {W_SETTING, 2, 6, V_DYNAMIC_FREQUENCY, V_NONE, 0, &g_hertzFormat},
+    {W_SETTING, 12, 6, V_DYNAMIC_DUTY, V_NONE, 0, &g_percentFormat}};
+// Indexed by ModeEngine::Mode
+const TextUI::Screen TextUI::g_screens[ModeEngine::MODE_COUNT] = {
+    {g_ccWidgets, 1},
+    {g_cvWidgets, 1},
+    {g_crWidgets, 1},
+    {g_cpWidgets, 1},
+    {g_dynamicWidgets, 4},
+    {0, 0}};
+const TextUI::Screen TextUI::g_header = {g_headerWidgets, sizeof(g_headerWidgets) / sizeof(Widget)};
+const TextUI::Screen TextUI::g_controls = {g_controlWidgets, sizeof(g_controlWidgets) / sizeof(Widget)};
+const TextUI::Screen TextUI::g_footer = {g_footerWidgets, sizeof(g_footerWidgets) / sizeof(Widget)};
+const TextUI::Screen TextUI::g_graph = {g_graphWidgets, sizeof(g_graphWidgets) / sizeof(Widget)};
+// Screens past the modes
+const int TextUI::g_graphScreen = ModeEngine::MODE_COUNT;
+const int TextUI::g_maxWidgets;
+const int TextUI::g_maxSections;
+const int TextUI::g_maxPendingColumns;
+const int TextUI::g_graphRows;
+// 1 mV, 1 mA or 1 mW, below which the trace would only show noise
+const int32_t TextUI::g_minGraphSpan = 1000;
+// Indexed by Statistics::Quantity
+const char *const TextUI::g_graphUnits[Statistics::Q_COUNT] = {"V", "A", "W"};
+// As it was with printf; the task has since taken on the graph and
+// the notifications, so only shrink it against the high-water mark
+// the "ui" command reports from a unit
+const uint32_t TextUI::g_uiTaskStack = 4000;
+const uint32_t TextUI::g_displayClock_Hz = 400000;
+// No higher than the UI, which must never wait on the bus
+const UBaseType_t TextUI::g_flushTaskPriority = 1;
 
 TextUI::TextUI(uint8_t i2cAddr)
     : _i2cAddr(i2cAddr),
@@ -26,25 +118,61 @@ TextUI::TextUI(uint8_t i2cAddr)
       _display(128,
                64,
                &Wire, -1),
-      _loadVoltage(0.0),
-      _loadCurrent(0.0),
-      _desiredCurrent(0.0),
-      _isEnabled(false),
+      _frame(128, 64),
+      _uiTaskHandle(NULL),
+      _mutex("ui"),
+      _values(),
+      _versions(),
+      _drawnScreen(ModeEngine::MODE_CC),
+      _drawnView(0),
+      _drawnStamps(),
+      _pendingColumns(),
+      _pendingColumnCount(0),
+      _graphColumnsDropped(0),
+      _graphHistory(0),
+      _graphHead(0),
+      _graphFilled(0),
+      _graphBottom(0),
+      _graphSpan(0),
+      _graphRedraw(false),
+      _graphPages(0),
+      _graphColumns(0),
+      _lastColumn_us(0),
+      _maxColumn_us(0),
+      _lastGraphRedraw_us(0),
+      _lastGraphBytes(0),
       _encoderDelta(0),
       _encoderClicked(false),
+      _encoderEdgePending(false),
+      _encoderEdge_us(0),
+      _editEdge_us(0),
+      _wakeups(0),
       _uiDirty(false),
       _cursorIdx(-1),
-      _listener(0) {}
+      _listener(0),
+      _displayFlushes(0),
+      _displayBytes(0),
+      _lastFlushBytes(0),
+      _lastRender_us(0),
+      _maxRender_us(0),
+      _flushTaskHandle(NULL),
+      _frameMutex("frame"),
+      _flushBusy(false),
+      _frameWaiting(false),
+      _framesDrawn(0),
+      _framesDropped(0),
+      _lastLoop_us(0),
+      _maxLoop_us(0) {}
 
 bool TextUI::init()
 {
     TaskSyncShared *tss = tss->getInstance();
 
     // SSD1306_SWITCHCAPVCC = generate display voltage from 3.3V internally
-    tss->takeI2c();
+    tss->takeI2c(TaskSyncShared::I2C_PRIO_DISPLAY);
     bool success = _display.begin(SSD1306_SWITCHCAPVCC, _i2cAddr);
     tss->giveI2c();
-    if (!success)
+    if (!success || !_frame.begin(_display.getBuffer()))
     {
         return false;
     }
@@ -53,17 +181,26 @@ bool TextUI::init()
 
     _screenBuf = new char[screenBufSize];
     _dirtyRegions = new Dirty[_heightChars];
+    _graphHistory = new Trace::Column[_screenWidth];
 
     for (int i = 0; i < screenBufSize; i++)
     {
         _screenBuf[i] = ' ';
     }
 
-    _mutex = xSemaphoreCreateMutex();
+    if (xTaskCreate(flushTaskHelper,
+                    "ui flush",
+                    2000,
+                    (void *)this,
+                    g_flushTaskPriority,
+                    &_flushTaskHandle) != pdPASS)
+    {
+        return false;
+    }
 
     if (xTaskCreate(uiTaskHelper,
-                    "TextUI::uiTask",
-                    4000,
+                    "ui",
+                    g_uiTaskStack,
                     (void *)this,
                     1,
                     &_uiTaskHandle) != pdPASS)
@@ -81,42 +218,52 @@ void TextUI::setListener(TextUIListener *listener)
 
 void TextUI::uiTask()
 {
-    TaskSyncShared *tss = TaskSyncShared::getInstance();
-
     clear();
     splash();
+    _presentFrame();
 
     vTaskDelay(2000 / portTICK_PERIOD_MS);
 
     clear();
     _drawUI();
-    _moveCursor(2);
+    _moveCursor(3);
+    _presentFrame();
 
     while (true)
     {
+        // Sleeps until the encoder, a value change or the flush task
+        // has something for us
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        _wakeups++;
+
+        uint32_t loopStart_us = uint32_t(esp_timer_get_time());
+
         bool encoderClicked = false;
         int encoderDelta = 0;
-        xSemaphoreTake(_mutex, portMAX_DELAY);
+        _mutex.take();
         if (_encoderDelta != 0)
         {
             encoderDelta = _encoderDelta;
             _encoderDelta = 0;
         }
+        if (_encoderEdgePending)
+        {
+            _editEdge_us = _encoderEdge_us;
+            _encoderEdgePending = false;
+        }
         if (_encoderClicked)
         {
             encoderClicked = true;
             _encoderClicked = false;
         }
-        xSemaphoreGive(_mutex);
+        _mutex.give();
 
         if (encoderClicked)
         {
-            tss->takeSerial();
-            Serial.println("Encoder clicked!");
-            tss->giveSerial();
+            LOG_DEBUG("Encoder clicked!");
 
             int newCursorIdx = _cursorIdx + 1;
-            if (!(newCursorIdx < g_cursorPointsCount))
+            if (!(newCursorIdx < _stopCount()))
             {
                 newCursorIdx = 0;
             }
@@ -125,33 +272,11 @@ void TextUI::uiTask()
 
         if (encoderDelta != 0)
         {
-            tss->takeSerial();
-            Serial.printf("Encoder moved %d clicks\r\n", encoderDelta);
-            tss->giveSerial();
+            LOG_DEBUG("Encoder moved %d clicks", encoderDelta);
 
             if (_listener != 0)
             {
-                if (g_cursorPoints[_cursorIdx].y == 5)
-                {
-                    double newDesiredCurrent = _desiredCurrent + (encoderDelta / exp10(_cursorIdx));
-                    if (newDesiredCurrent > 3.0)
-                    {
-                        newDesiredCurrent = 3.0;
-                    }
-                    if (newDesiredCurrent < 0.0)
-                    {
-                        newDesiredCurrent = 0;
-                    }
-
-                    _listener->desiredCurrentChanged(this, newDesiredCurrent);
-                }
-                else
-                {
-                    if ((encoderDelta & 1) == 1)
-                    {
-                        _listener->enabledChanged(this, !_isEnabled);
-                    }
-                }
+                _edit(encoderDelta);
             }
         }
 
@@ -161,7 +286,13 @@ void TextUI::uiTask()
             _drawUI();
         }
 
-        vTaskDelay(15 / portTICK_PERIOD_MS);
+        _presentFrame();
+
+        _lastLoop_us = uint32_t(esp_timer_get_time()) - loopStart_us;
+        if (_lastLoop_us > _maxLoop_us)
+        {
+            _maxLoop_us = _lastLoop_us;
+        }
     }
 }
 
@@ -176,24 +307,21 @@ void TextUI::clear()
         _dirtyRegions[i].y = -1;
     }
 
-    TaskSyncShared *tss = TaskSyncShared::getInstance();
-    tss->takeI2c();
-    _display.clearDisplay();
-    _display.display();
-    tss->giveI2c();
+    _frame.clear();
 }
 
 void TextUI::splash()
 {
-    const size_t bufLen = 100;
-    char buf[100];
-
     const char *tmp = "Electronic Load V2";
     int x = (_widthChars - strlen(tmp)) / 2;
     int y = (_heightChars - 5) / 2;
     _writeChars(x, y, tmp);
 
-    int len = snprintf(buf, bufLen - 1, "%s %s", __DATE__, __TIME__);
+    char buf[sizeof(__DATE__) + sizeof(__TIME__)];
+    char *end = FixedFormat::append(buf, __DATE__);
+    end = FixedFormat::append(end, " ");
+    end = FixedFormat::append(end, __TIME__);
+    int len = end - buf;
     x = (_widthChars - len) / 2;
     y += 2;
     _writeChars(x, y, buf);
@@ -208,102 +336,394 @@ void TextUI::splash()
 
 void TextUI::turned(RotaryEncoder *source, int deltaClicks, int rpm)
 {
-    xSemaphoreTake(_mutex, portMAX_DELAY);
+    _mutex.take();
     _encoderDelta += deltaClicks;
-    xSemaphoreGive(_mutex);
+    if (!_encoderEdgePending)
+    {
+        _encoderEdge_us = source->eventEdge_us();
+        _encoderEdgePending = true;
+    }
+    _mutex.give();
+
+    _wake();
 }
 
 void TextUI::clicked(RotaryEncoder *source)
 {
-    xSemaphoreTake(_mutex, portMAX_DELAY);
+    _mutex.take();
     _encoderClicked = true;
-    xSemaphoreGive(_mutex);
+    _mutex.give();
+
+    _wake();
+}
+
+uint32_t TextUI::editEdge_us()
+{
+    return _editEdge_us;
+}
+
+void TextUI::loadVoltageChanged(int32_t newVoltage_uV)
+{
+    _mutex.take();
+    _setValue(V_LOAD_VOLTAGE, newVoltage_uV);
+    _mutex.give();
 }
 
-void TextUI::loadVoltageChanged(double newVoltage)
+void TextUI::loadCurrentChanged(int32_t newCurrent_uA)
 {
-    if (newVoltage != _loadVoltage)
+    _mutex.take();
+    _setValue(V_LOAD_CURRENT, newCurrent_uA);
+    _mutex.give();
+}
+
+void TextUI::batteryChanged(bool visible, int32_t charge_uAh, int32_t energy_uWh)
+{
+    _mutex.take();
+    _setValue(V_BATTERY_VISIBLE, visible ? 1 : 0);
+    _setValue(V_BATTERY_CHARGE, charge_uAh);
+    _setValue(V_BATTERY_ENERGY, energy_uWh);
+    _mutex.give();
+}
+
+void TextUI::setMode(ModeEngine::Mode mode)
+{
+    _mutex.take();
+    _setValue(V_MODE, mode);
+    _mutex.give();
+}
+
+void TextUI::setSetpoint(ModeEngine::Mode mode, int32_t setpoint)
+{
+    // Only the modes with a single setpoint have one to show
+    if (mode > ModeEngine::MODE_CP)
     {
-        _loadVoltage = newVoltage;
-        _uiDirty = true;
+        return;
     }
+
+    _mutex.take();
+    _setValue(Value(V_SETPOINT_CC + mode), setpoint);
+    _mutex.give();
+}
+
+void TextUI::setDynamic(const DynamicLoad::Config &config)
+{
+    _mutex.take();
+    _setValue(V_DYNAMIC_HIGH, config.high_uA);
+    _setValue(V_DYNAMIC_LOW, config.low_uA);
+    _setValue(V_DYNAMIC_FREQUENCY, config.frequency_Hz);
+    _setValue(V_DYNAMIC_DUTY, config.duty_pct);
+    _mutex.give();
 }
 
-void TextUI::loadCurrentChanged(double newCurrent)
+void TextUI::setEnabled(bool isEnabled)
+{
+    _mutex.take();
+    _setValue(V_ENABLED, isEnabled ? 1 : 0);
+    _mutex.give();
+}
+
+void TextUI::setGraph(bool visible, Statistics::Quantity quantity)
 {
-    if (newCurrent != _loadCurrent)
+    _mutex.take();
+    int32_t view = visible ? 1 + int32_t(quantity) : 0;
+    if (view != _values[V_VIEW])
     {
-        _loadCurrent = newCurrent;
+        // Anything still waiting is of the last quantity
+        _pendingColumnCount = 0;
+    }
+    _setValue(V_VIEW, view);
+    _mutex.give();
+}
+
+void TextUI::graphColumn(const Trace::Column &column)
+{
+    _mutex.take();
+    if (_pendingColumnCount < g_maxPendingColumns)
+    {
+        _pendingColumns[_pendingColumnCount++] = column;
+        _setValue(V_GRAPH, _values[V_GRAPH] + 1);
+    }
+    else
+    {
+        _graphColumnsDropped++;
+    }
+    _mutex.give();
+}
+
+void TextUI::_setValue(Value value, int32_t newValue)
+{
+    // Called with _mutex held
+    if (newValue != _values[value])
+    {
+        _values[value] = newValue;
+        _versions[value]++;
         _uiDirty = true;
+        _wake();
     }
 }
 
-void TextUI::setDesiredCurrent(double desiredCurrent)
+void TextUI::_wake()
 {
-    xSemaphoreTake(_mutex, portMAX_DELAY);
-    if (desiredCurrent != _desiredCurrent)
+    if (_uiTaskHandle != NULL)
     {
-        _desiredCurrent = desiredCurrent;
+        xTaskNotifyGive(_uiTaskHandle);
+    }
+}
 
-        if (_listener != 0)
+void TextUI::_snapshot(int32_t *values, uint32_t *versions)
+{
+    _mutex.take();
+    memcpy(values, _values, sizeof(_values));
+    if (versions != 0)
+    {
+        memcpy(versions, _versions, sizeof(_versions));
+    }
+    _mutex.give();
+}
+
+void TextUI::_drawUI()
+{
+    int32_t values[V_COUNT];
+    uint32_t versions[V_COUNT];
+    _snapshot(values, versions);
+
+    int screen = values[V_VIEW] != 0 ? g_graphScreen : values[V_MODE];
+    bool screenChanged = screen != _drawnScreen;
+    if (screenChanged)
+    {
+        // Blank what the last screen drew that the new one doesn't
+        // share and start the new one from scratch
+        const Widget *cursorWidget = 0;
+        int cursorDigit = 0;
+        bool cursorPlaced = (_cursorIdx >= 0) && _locateStop(_cursorIdx, &cursorWidget, &cursorDigit);
+        WidgetType cursorType = cursorPlaced ? cursorWidget->type : W_LABEL;
+
+        const Screen *oldSections[g_maxSections];
+        const Screen *newSections[g_maxSections];
+        int oldCount = _sections(_drawnScreen, oldSections);
+        int newCount = _sections(screen, newSections);
+        for (int i = 0; i < oldCount; i++)
         {
-            _listener->desiredCurrentChanged(this, _desiredCurrent);
+            bool shared = false;
+            for (int j = 0; j < newCount; j++)
+            {
+                shared = shared || (oldSections[i] == newSections[j]);
+            }
+
+            for (int j = 0; !shared && (j < oldSections[i]->count); j++)
+            {
+                _drawWidget(oldSections[i]->widgets[j], values, false);
+            }
         }
 
-        _uiDirty = true;
+        _drawnScreen = screen;
+        memset(_drawnStamps, 0, sizeof(_drawnStamps));
+
+        // The cursor follows its widget rather than its index, which
+        // on the new screen may be a digit of a setting; only when
+        // there is no such widget is it kept in range
+        int newCursorIdx = cursorPlaced ? _findStop(cursorType, cursorDigit) : -1;
+        if (newCursorIdx >= 0)
+        {
+            _cursorIdx = newCursorIdx;
+        }
+        else
+        {
+            int stops = _stopCount();
+            if (_cursorIdx >= stops)
+            {
+                _cursorIdx = stops - 1;
+            }
+        }
+    }
+
+    if (values[V_VIEW] != _drawnView)
+    {
+        // A new quantity starts from an empty graph
+        _drawnView = values[V_VIEW];
+        _graphHead = 0;
+        _graphFilled = 0;
+        _graphSpan = 0;
+        _graphRedraw = true;
+    }
+
+    // Only widgets whose bound values moved on since they were
+    // last drawn are formatted again. The graph is drawn last, over
+    // the frame buffer the text has been committed to
+    const Widget *graph = 0;
+    for (int i = 0; (i < _widgetCount()) && (i < g_maxWidgets); i++)
+    {
+        const Widget &widget = _widget(i);
+        uint32_t stamp = 1 + versions[widget.value] + versions[widget.visibleIf];
+        if (stamp != _drawnStamps[i])
+        {
+            _drawnStamps[i] = stamp;
+            if (widget.type == W_GRAPH)
+            {
+                graph = &widget;
+            }
+            else
+            {
+                _drawWidget(widget, values, (widget.visibleIf == V_NONE) || (values[widget.visibleIf] != 0));
+            }
+        }
+    }
+
+    bool cursorAffected = screenChanged;
+    _commitChangesToDisplay(&cursorAffected);
+
+    if (graph != 0)
+    {
+        _drawGraph(*graph);
+    }
+
+    if (cursorAffected)
+    {
+        _drawCursor();
     }
-    xSemaphoreGive(_mutex);
 }
 
-void TextUI::setEnabled(bool isEnabled)
+void TextUI::_drawWidget(const Widget &widget, const int32_t *values, bool visible)
 {
-    xSemaphoreTake(_mutex, portMAX_DELAY);
-    if (isEnabled != _isEnabled)
+    char buf[g_maxWidgetChars];
+    buf[0] = '\0';
+
+    int32_t value = values[widget.value];
+    switch (widget.type)
+    {
+    case W_LABEL:
+        FixedFormat::append(buf, widget.text);
+        break;
+
+    case W_READOUT:
+        widget.formatter(buf, value);
+        break;
+
+    case W_SETTING:
     {
-        _isEnabled = isEnabled;
+        // Rounded to the last editable digit, and zero padded so that
+        // every digit the cursor can sit on is drawn
+        const ValueFormat *format = widget.format;
+        char *end = buf + FixedFormat::formatScaled(buf, value, format->unitScale,
+                                                    format->intDigits, format->fracDigits,
+                                                    FixedFormat::PAD_ZERO);
+        end = FixedFormat::append(end, " ");
+        FixedFormat::append(end, format->unit);
+        break;
+    }
 
-        if (_listener != 0)
+    case W_MODE:
+    {
+        const char *name = ModeEngine::modeName(ModeEngine::Mode(value));
+        char *end = FixedFormat::append(buf, name);
+        while ((end - buf) < 3)
         {
-            _listener->enabledChanged(this, _isEnabled);
+            end = FixedFormat::append(end, " ");
         }
+        break;
+    }
 
-        _uiDirty = true;
+    case W_TOGGLE:
+        FixedFormat::append(buf, value != 0 ? "ON " : "OFF");
+        break;
+
+    case W_VIEW:
+    {
+        char *end = FixedFormat::append(buf, value != 0 ? "GR " : "SET");
+        if ((value > 0) && (value <= Statistics::Q_COUNT))
+        {
+            FixedFormat::append(end, g_graphUnits[value - 1]);
+        }
+        else
+        {
+            FixedFormat::append(end, " ");
+        }
+        break;
     }
-    xSemaphoreGive(_mutex);
+
+    case W_GRAPH:
+        if (!visible)
+        {
+            _clearGraph(widget);
+            _graphPages = 0;
+        }
+        return;
+
+    case W_SPAN:
+    {
+        int32_t view = values[V_VIEW];
+        const char *unit = (view > 0) && (view <= Statistics::Q_COUNT) ? g_graphUnits[view - 1] : " ";
+        Fixed<3, 2>::engineering(buf, value, unit);
+        break;
+    }
+    }
+
+    if (!visible)
+    {
+        memset(buf, ' ', strlen(buf));
+    }
+
+    _writeChars(widget.x, widget.y, buf);
 }
 
-void TextUI::_drawUI()
+int TextUI::_sections(int screen, const Screen **sections)
 {
-    const char *tmp = "Electronic Load V2";
-    int x = (_widthChars - strlen(tmp)) / 2;
-    _writeChars(x, 0, tmp);
+    int count = 0;
+    sections[count++] = &g_header;
+    if (screen == g_graphScreen)
+    {
+        sections[count++] = &g_graph;
+    }
+    else
+    {
+        sections[count++] = &g_controls;
+        sections[count++] = &g_screens[screen];
+    }
+    sections[count++] = &g_footer;
 
-    _printf(2, 2, "%6.3lf V", _loadVoltage);
-    _printf(11, 2, "%6.4lf A", _loadCurrent);
+    return count;
+}
 
-    _writeChars(0, 4, "SET");
+int TextUI::_widgetCount()
+{
+    const Screen *sections[g_maxSections];
+    int sectionCount = _sections(_drawnScreen, sections);
 
-    _printf(2, 5, "%6.4lf A", _desiredCurrent);
+    int count = 0;
+    for (int i = 0; i < sectionCount; i++)
+    {
+        count += sections[i]->count;
+    }
 
-    _writeChars(0, 7, _isEnabled ? "ON " : "OFF");
+    return count;
+}
 
-    bool cursorAffected = false;
-    _commitChangesToDisplay(&cursorAffected);
+const TextUI::Widget &TextUI::_widget(int idx)
+{
+    const Screen *sections[g_maxSections];
+    int sectionCount = _sections(_drawnScreen, sections);
 
-    if (cursorAffected)
+    for (int i = 0; i < (sectionCount - 1); i++)
     {
-        _drawCursor();
+        if (idx < sections[i]->count)
+        {
+            return sections[i]->widgets[idx];
+        }
+        idx -= sections[i]->count;
     }
+
+    return sections[sectionCount - 1]->widgets[idx];
 }
 
 void TextUI::_moveCursor(int newCursorIdx)
 {
     if (_cursorIdx != -1)
     {
-        Dirty *dirty = _getDirtyForRow(g_cursorPoints[_cursorIdx].y);
+        Point point = _cursorPoint(_cursorIdx);
+        Dirty *dirty = _getDirtyForRow(point.y);
         if (dirty != 0)
         {
-            dirty->update(g_cursorPoints[_cursorIdx].y, g_cursorPoints[_cursorIdx].x, g_cursorPoints[_cursorIdx].x);
+            dirty->update(point.y, point.x, point.x);
             _commitChangesToDisplay();
         }
     }
@@ -315,12 +735,389 @@ void TextUI::_moveCursor(int newCursorIdx)
 
 void TextUI::_drawCursor()
 {
-    TaskSyncShared *tss = TaskSyncShared::getInstance();
-    tss->takeI2c();
-    int pixX = g_cursorPoints[_cursorIdx].x * _fontWidth;
-    int pixY = g_cursorPoints[_cursorIdx].y * _fontHeight + (_fontHeight - 2);
-    _display.fillRect(pixX, pixY, _fontWidth, 2, SSD1306_WHITE);
-    tss->giveI2c();
+    // No cursor yet while the splash is up
+    if (_cursorIdx < 0)
+    {
+        return;
+    }
+
+    Point point = _cursorPoint(_cursorIdx);
+    if (point.x < 0)
+    {
+        return;
+    }
+
+    const char *cell = _screenBuf + (point.y * _widthChars) + point.x;
+    _frame.drawText(point.x, point.y, cell, 1, PageFrame::GS_INVERTED);
+}
+
+int TextUI::_widgetStops(const Widget &widget)
+{
+    switch (widget.type)
+    {
+    case W_SETTING:
+        // One per digit
+        return widget.format->intDigits + widget.format->fracDigits;
+
+    case W_MODE:
+    case W_TOGGLE:
+    case W_VIEW:
+        return 1;
+
+    default:
+        return 0;
+    }
+}
+
+int TextUI::_stopCount()
+{
+    int count = 0;
+    for (int i = 0; i < _widgetCount(); i++)
+    {
+        count += _widgetStops(_widget(i));
+    }
+
+    return count;
+}
+
+bool TextUI::_locateStop(int cursorIdx, const Widget **widget, int *digit)
+{
+    int remaining = cursorIdx;
+    for (int i = 0; (i < _widgetCount()) && (remaining >= 0); i++)
+    {
+        int stops = _widgetStops(_widget(i));
+        if (remaining < stops)
+        {
+            *widget = &_widget(i);
+            *digit = remaining;
+            return true;
+        }
+        remaining -= stops;
+    }
+
+    return false;
+}
+
+int TextUI::_findStop(WidgetType type, int digit)
+{
+    int cursorIdx = 0;
+    for (int i = 0; i < _widgetCount(); i++)
+    {
+        int stops = _widgetStops(_widget(i));
+        if ((stops > 0) && (_widget(i).type == type))
+        {
+            return cursorIdx + (digit < stops ? digit : stops - 1);
+        }
+        cursorIdx += stops;
+    }
+
+    return -1;
+}
+
+TextUI::Point TextUI::_cursorPoint(int cursorIdx)
+{
+    const Widget *widget = 0;
+    int digit = 0;
+    if ((cursorIdx < 0) || !_locateStop(cursorIdx, &widget, &digit))
+    {
+        return Point(-1, -1);
+    }
+
+    // Skip over the decimal point
+    int x = widget->x + digit;
+    if ((widget->type == W_SETTING) && (digit >= widget->format->intDigits))
+    {
+        x++;
+    }
+
+    return Point(x, widget->y);
+}
+
+int32_t TextUI::_digitStep(const ValueFormat &format, int digit)
+{
+    // The first digit of a value is the most significant, each
+    // following one is a decade smaller
+    int32_t step = format.unitScale;
+    for (int i = 1; i < format.intDigits; i++)
+    {
+        step *= 10;
+    }
+    for (int i = 0; i < digit; i++)
+    {
+        step /= 10;
+    }
+
+    return step;
+}
+
+void TextUI::_edit(int encoderDelta)
+{
+    const Widget *widget = 0;
+    int digit = 0;
+    if (!_locateStop(_cursorIdx, &widget, &digit))
+    {
+        return;
+    }
+
+    int32_t values[V_COUNT];
+    _snapshot(values, 0);
+
+    switch (widget->type)
+    {
+    case W_MODE:
+    {
+        int newMode = (values[V_MODE] + encoderDelta) % ModeEngine::MODE_COUNT;
+        if (newMode < 0)
+        {
+            newMode += ModeEngine::MODE_COUNT;
+        }
+
+        _listener->modeChanged(this, ModeEngine::Mode(newMode));
+        break;
+    }
+
+    case W_SETTING:
+    {
+        const ValueFormat *format = widget->format;
+        int64_t newValue = int64_t(values[widget->value]) +
+                           (int64_t(encoderDelta) * _digitStep(*format, digit));
+        if (newValue > format->max)
+        {
+            newValue = format->max;
+        }
+        if (newValue < format->min)
+        {
+            newValue = format->min;
+        }
+        values[widget->value] = int32_t(newValue);
+
+        if ((widget->value >= V_DYNAMIC_HIGH) && (widget->value <= V_DYNAMIC_DUTY))
+        {
+            DynamicLoad::Config config;
+            config.high_uA = values[V_DYNAMIC_HIGH];
+            config.low_uA = values[V_DYNAMIC_LOW];
+            config.frequency_Hz = values[V_DYNAMIC_FREQUENCY];
+            config.duty_pct = values[V_DYNAMIC_DUTY];
+            _listener->dynamicChanged(this, config);
+        }
+        else
+        {
+            _listener->setpointChanged(this, ModeEngine::Mode(widget->value - V_SETPOINT_CC),
+                                       values[widget->value]);
+        }
+        break;
+    }
+
+    case W_TOGGLE:
+        if ((encoderDelta & 1) == 1)
+        {
+            _listener->enabledChanged(this, values[V_ENABLED] == 0);
+        }
+        break;
+
+    case W_VIEW:
+    {
+        int newView = (values[V_VIEW] + encoderDelta) % (1 + Statistics::Q_COUNT);
+        if (newView < 0)
+        {
+            newView += 1 + Statistics::Q_COUNT;
+        }
+
+        _listener->graphChanged(this, newView != 0,
+                                Statistics::Quantity(newView != 0 ? newView - 1 : 0));
+        break;
+    }
+
+    default:
+        break;
+    }
+}
+
+void TextUI::_drawGraph(const Widget &widget)
+{
+    Trace::Column columns[g_maxPendingColumns];
+    _mutex.take();
+    int count = _pendingColumnCount;
+    memcpy(columns, _pendingColumns, count * sizeof(Trace::Column));
+    _pendingColumnCount = 0;
+    _mutex.give();
+
+    uint32_t start_us = uint32_t(esp_timer_get_time());
+
+    for (int i = 0; i < count; i++)
+    {
+        _graphHistory[_graphHead] = columns[i];
+        _graphHead = (_graphHead + 1) % _screenWidth;
+        if (_graphFilled < _screenWidth)
+        {
+            _graphFilled++;
+        }
+    }
+
+    bool rescaled = _rescaleGraph();
+    bool redraw = _graphRedraw || rescaled;
+    if (!redraw && (count == 0))
+    {
+        return;
+    }
+
+    if (redraw)
+    {
+        _clearGraph(widget);
+        for (int idx = 0; idx < _graphFilled; idx++)
+        {
+            _drawGraphColumn(widget, _screenWidth - _graphFilled + idx, idx);
+        }
+    }
+    else
+    {
+        // Scroll what is already drawn and draw only the new columns
+        _frame.scrollLeft(widget.y, g_graphRows, count);
+        for (int i = 0; i < count; i++)
+        {
+            _drawGraphColumn(widget, _screenWidth - count + i, _graphFilled - count + i);
+        }
+    }
+
+    _graphPages = uint8_t(((1 << g_graphRows) - 1) << widget.y);
+    _graphRedraw = false;
+    _graphColumns += count;
+
+    uint32_t elapsed_us = uint32_t(esp_timer_get_time()) - start_us;
+    if (redraw)
+    {
+        _lastGraphRedraw_us = elapsed_us;
+    }
+    else
+    {
+        _lastColumn_us = elapsed_us / count;
+        if (_lastColumn_us > _maxColumn_us)
+        {
+            _maxColumn_us = _lastColumn_us;
+        }
+    }
+}
+
+bool TextUI::_rescaleGraph()
+{
+    // The span and bottom stay put until the trace leaves them or
+    // shrinks under a quarter of the span, so new columns only
+    // scroll the graph rather than redrawing it
+    if (_graphFilled == 0)
+    {
+        return false;
+    }
+
+    int32_t lo = _graphHistory[0].min;
+    int32_t hi = _graphHistory[0].max;
+    for (int i = 0; i < _graphFilled; i++)
+    {
+        int idx = (_graphHead - _graphFilled + i + _screenWidth) % _screenWidth;
+        if (_graphHistory[idx].min < lo)
+        {
+            lo = _graphHistory[idx].min;
+        }
+        if (_graphHistory[idx].max > hi)
+        {
+            hi = _graphHistory[idx].max;
+        }
+    }
+
+    int64_t needed = int64_t(hi) - lo;
+    bool fits = (_graphSpan != 0) &&
+                (lo >= _graphBottom) &&
+                (hi <= (int64_t(_graphBottom) + _graphSpan));
+    if (fits && ((needed * 4) > _graphSpan))
+    {
+        return false;
+    }
+
+    // The smallest 1-2-5 span that holds the trace from a bottom
+    // on a tenth of the span
+    static const int steps[] = {1, 2, 5};
+    int64_t span = g_minGraphSpan;
+    int64_t bottom = 0;
+    for (int64_t decade = g_minGraphSpan; decade <= INT32_MAX / 10; decade *= 10)
+    {
+        bool found = false;
+        for (int i = 0; !found && (i < 3); i++)
+        {
+            span = decade * steps[i];
+            int64_t grid = span / 10;
+            bottom = (lo / grid) * grid;
+            if (bottom > lo)
+            {
+                bottom -= grid;
+            }
+            found = (bottom + span) >= hi;
+        }
+
+        if (found)
+        {
+            break;
+        }
+    }
+
+    if (fits && (span >= _graphSpan))
+    {
+        return false;
+    }
+
+    _graphSpan = int32_t(span);
+    _graphBottom = int32_t(bottom);
+
+    _mutex.take();
+    _setValue(V_GRAPH_SPAN, _graphSpan);
+    _mutex.give();
+
+    return true;
+}
+
+void TextUI::_drawGraphColumn(const Widget &widget, int x, int idx)
+{
+    const Trace::Column &column = _graphHistory[(_graphHead - _graphFilled + idx + _screenWidth) % _screenWidth];
+
+    // Joined up to the column before, so that a step reads as an
+    // edge rather than two separate dots
+    int32_t lo = column.min;
+    int32_t hi = column.max;
+    if (idx > 0)
+    {
+        const Trace::Column &previous = _graphHistory[(_graphHead - _graphFilled + idx - 1 + _screenWidth) % _screenWidth];
+        if (previous.max < lo)
+        {
+            lo = previous.max;
+        }
+        if (previous.min > hi)
+        {
+            hi = previous.min;
+        }
+    }
+
+    _frame.drawColumn(x, widget.y, g_graphRows, _graphRow(widget, hi), _graphRow(widget, lo));
+}
+
+int TextUI::_graphRow(const Widget &widget, int32_t value)
+{
+    // Pixel row within the graph, counted down from its top
+    int height = g_graphRows * 8;
+    int64_t offset = int64_t(value) - _graphBottom;
+    int64_t row = ((offset * (height - 1)) + (_graphSpan / 2)) / _graphSpan;
+    if (row < 0)
+    {
+        row = 0;
+    }
+    if (row > (height - 1))
+    {
+        row = height - 1;
+    }
+
+    return (height - 1) - int(row);
+}
+
+void TextUI::_clearGraph(const Widget &widget)
+{
+    _frame.clearPages(widget.y, g_graphRows);
 }
 
 void TextUI::_writeChars(int x, int y, const char *text)
@@ -363,30 +1160,11 @@ void TextUI::_writeChars(int x, int y, const char *text)
     }
 }
 
-void TextUI::_printf(int x, int y, const char *fmt, ...)
-{
-    const size_t bufLen = 100;
-    char buf[bufLen];
-
-    va_list args;
-    va_start(args, fmt);
-
-    size_t maxLen = _widthChars - x;
-    if (maxLen > (bufLen - 1))
-    {
-        maxLen = bufLen - 1;
-    }
-    int len = vsnprintf(buf, maxLen, fmt, args);
-    buf[len] = '\0';
-
-    _writeChars(x, y, buf);
-}
-
 void TextUI::_commitChangesToDisplay(bool *cursorAffected /* = 0 */)
 {
-    TaskSyncShared *tss = TaskSyncShared::getInstance();
-
-    tss->takeI2c();
+    // Only draws into the back buffer, which is ours alone;
+    // _presentFrame() hands the result to the flush task
+    uint32_t start_us = uint32_t(esp_timer_get_time());
 
     for (int i = 0; i < _heightChars; i++)
     {
@@ -397,39 +1175,140 @@ void TextUI::_commitChangesToDisplay(bool *cursorAffected /* = 0 */)
 
         if (cursorAffected != 0)
         {
-            if (_dirtyRegions[i].y == g_cursorPoints[_cursorIdx].y)
+            Point point = _cursorPoint(_cursorIdx);
+            if (_dirtyRegions[i].y == point.y)
             {
-                *cursorAffected = (_dirtyRegions[i].xLo <= g_cursorPoints[_cursorIdx].x) &&
-                                  (g_cursorPoints[_cursorIdx].x <= _dirtyRegions[i].xHi);
+                *cursorAffected = (_dirtyRegions[i].xLo <= point.x) &&
+                                  (point.x <= _dirtyRegions[i].xHi);
             }
         }
 
         const char *screenBufStart = _screenBuf + ((_dirtyRegions[i].y * _widthChars) + _dirtyRegions[i].xLo);
         size_t len = _dirtyRegions[i].xHi - _dirtyRegions[i].xLo + 1;
 
-        _writeTextToDisplay(_dirtyRegions[i].xLo, _dirtyRegions[i].y, screenBufStart, len);
+        _frame.drawText(_dirtyRegions[i].xLo, _dirtyRegions[i].y, screenBufStart, len);
 
         _dirtyRegions[i].y = -1;
     }
 
-    _display.display();
+    _lastRender_us = uint32_t(esp_timer_get_time()) - start_us;
+    if (_lastRender_us > _maxRender_us)
+    {
+        _maxRender_us = _lastRender_us;
+    }
+}
 
-    tss->giveI2c();
+void TextUI::_presentFrame()
+{
+    // Copy what changed into the front buffer, unless the flush task
+    // is still sending the last frame; then keep it and try again next
+    // time round, by when it may have been drawn over again
+    if (_frame.takeDrawn())
+    {
+        _framesDrawn++;
+    }
+    if (_framesDrawn == 0)
+    {
+        return;
+    }
+
+    _frameMutex.take();
+    if (_flushBusy)
+    {
+        // The flush task wakes us when it is done
+        _frameWaiting = true;
+        _frameMutex.give();
+        return;
+    }
+    _frameWaiting = false;
+
+    _frame.present();
+    _flushBusy = true;
+    _frameMutex.give();
+
+    _framesDropped += _framesDrawn - 1;
+    _framesDrawn = 0;
+
+    xTaskNotifyGive(_flushTaskHandle);
 }
 
-void TextUI::_writeTextToDisplay(int x, int y, const char *text, size_t len)
+void TextUI::flushTask()
 {
-    int pixY = y * _fontHeight;
-    int pixHeight = _fontHeight;
-    int pixX = x * _fontWidth;
-    int pixWidth = _fontWidth * len;
+    while (true)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        // The UI task leaves the front buffer alone until we are done
+        _flushDisplay();
 
-    _display.fillRect(pixX, pixY, pixWidth, pixHeight, SSD1306_BLACK);
+        _frameMutex.take();
+        _flushBusy = false;
+        bool frameWaiting = _frameWaiting;
+        _frameMutex.give();
 
-    _display.setTextSize(1);
-    _display.setTextColor(SSD1306_WHITE);
-    _display.setCursor(pixX, pixY);
-    _display.printf("%.*s", len, text);
+        if (frameWaiting)
+        {
+            _wake();
+        }
+    }
+}
+
+bool TextUI::_flushDisplay()
+{
+    // Anything not sent stays marked and goes with the next frame
+    bool success = _frame.flush(_displayWriter, this);
+
+    uint32_t bytes = _frame.lastFlushBytes();
+    uint32_t graphBytes = 0;
+    uint8_t graphPages = _graphPages;
+    for (int page = 0; page < _frame.pages(); page++)
+    {
+        if ((graphPages & (1 << page)) != 0)
+        {
+            graphBytes += _frame.lastPageBytes(page);
+        }
+    }
+
+    if (bytes > 0)
+    {
+        _displayFlushes++;
+        _displayBytes += bytes;
+        _lastFlushBytes = bytes;
+    }
+    if (graphBytes > 0)
+    {
+        _lastGraphBytes = graphBytes;
+    }
+
+    return success;
+}
+
+bool TextUI::_writeDisplay(uint8_t control, const uint8_t *bytes, size_t len)
+{
+    TaskSyncShared *tss = TaskSyncShared::getInstance();
+
+    tss->takeI2c(TaskSyncShared::I2C_PRIO_DISPLAY);
+    uint32_t oldFreq = Wire.getClock();
+    Wire.setClock(g_displayClock_Hz);
+    Wire.beginTransmission(_i2cAddr);
+    Wire.write(control);
+    Wire.write(bytes, len);
+    uint8_t error = Wire.endTransmission();
+    Wire.setClock(oldFreq);
+    tss->giveI2c();
+
+    if (error)
+    {
+        LOG_ERROR("Display write failed: %s", Wire.getErrorText(error));
+        return false;
+    }
+
+    return true;
+}
+
+bool TextUI::_displayWriter(void *context, uint8_t control, const uint8_t *bytes, size_t len)
+{
+    return ((TextUI *)context)->_writeDisplay(control, bytes, len);
 }
 
 TextUI::Dirty *TextUI::_getDirtyForRow(int y)
@@ -446,6 +1325,86 @@ TextUI::Dirty *TextUI::_getDirtyForRow(int y)
     return 0;
 }
 
+uint32_t TextUI::lastRender_us()
+{
+    return _lastRender_us;
+}
+
+uint32_t TextUI::maxRender_us()
+{
+    return _maxRender_us;
+}
+
+uint32_t TextUI::stackHighWater()
+{
+    return _uiTaskHandle != NULL ? uxTaskGetStackHighWaterMark(_uiTaskHandle) : 0;
+}
+
+uint32_t TextUI::lastLoop_us()
+{
+    return _lastLoop_us;
+}
+
+uint32_t TextUI::maxLoop_us()
+{
+    return _maxLoop_us;
+}
+
+uint32_t TextUI::framesDropped()
+{
+    return _framesDropped;
+}
+
+uint32_t TextUI::wakeups()
+{
+    return _wakeups;
+}
+
+uint32_t TextUI::displayFlushes()
+{
+    return _displayFlushes;
+}
+
+uint32_t TextUI::displayBytes()
+{
+    return _displayBytes;
+}
+
+uint32_t TextUI::lastFlushBytes()
+{
+    return _lastFlushBytes;
+}
+
+uint32_t TextUI::graphColumns()
+{
+    return _graphColumns;
+}
+
+uint32_t TextUI::graphColumnsDropped()
+{
+    return _graphColumnsDropped;
+}
+
+uint32_t TextUI::lastColumn_us()
+{
+    return _lastColumn_us;
+}
+
+uint32_t TextUI::maxColumn_us()
+{
+    return _maxColumn_us;
+}
+
+uint32_t TextUI::lastGraphRedraw_us()
+{
+    return _lastGraphRedraw_us;
+}
+
+uint32_t TextUI::lastGraphBytes()
+{
+    return _lastGraphBytes;
+}
+
 TextUI::Dirty::Dirty()
     : y(-1), xLo(-1), xHi(-1) {}
 
@@ -490,3 +1449,15 @@ void uiTaskHelper(void *objPtr)
 
     vTaskDelete(NULL);
 }
+
+void flushTaskHelper(void *objPtr)
+{
+    if (objPtr != 0)
+    {
+        TextUI *ui = (TextUI *)objPtr;
+
+        ui->flushTask();
+    }
+
+    vTaskDelete(NULL);
+}
@@ -0,0 +1,125 @@
+#include <string.h>
+#include "Trace.hpp"
+
+Trace::Trace()
+    : _quantity(Statistics::Q_CURRENT),
+      _column_us(20000),
+      _columnStart_us(0),
+      _started(false),
+      _column() {}
+
+void Trace::configure(Statistics::Quantity quantity, uint32_t column_us)
+{
+    if ((quantity >= Statistics::Q_COUNT) || (column_us == 0))
+    {
+        return;
+    }
+
+    _quantity = quantity;
+    _column_us = column_us;
+    reset();
+}
+
+void Trace::reset()
+{
+    _started = false;
+}
+
+bool Trace::update(uint32_t timestamp_us,
+                   int32_t voltage_uV,
+                   int32_t current_uA,
+                   Column *column)
+{
+    int32_t value;
+    switch (_quantity)
+    {
+    case Statistics::Q_VOLTAGE:
+        value = voltage_uV;
+        break;
+    case Statistics::Q_CURRENT:
+        value = current_uA;
+        break;
+    default:
+        value = int32_t((int64_t(voltage_uV) * current_uA) / 1000000);
+        break;
+    }
+
+    bool closed = false;
+    if (_started && ((timestamp_us - _columnStart_us) >= _column_us))
+    {
+        *column = _column;
+        closed = true;
+
+        // Columns keep their phase, unless the samples stopped for
+        // longer than a column, when there is nothing to keep
+        _columnStart_us += _column_us;
+        if ((timestamp_us - _columnStart_us) >= _column_us)
+        {
+            _columnStart_us = timestamp_us;
+        }
+        _started = false;
+    }
+
+    if (!_started)
+    {
+        if (!closed)
+        {
+            _columnStart_us = timestamp_us;
+        }
+        _column.min = value;
+        _column.max = value;
+        _started = true;
+    }
+    else
+    {
+        if (value < _column.min)
+        {
+            _column.min = value;
+        }
+        if (value > _column.max)
+        {
+            _column.max = value;
+        }
+    }
+
+    return closed;
+}
+
+Statistics::Quantity Trace::quantity()
+{
+    return _quantity;
+}
+
+uint32_t Trace::column_us()
+{
+    return _column_us;
+}
+
+const char *Trace::quantityName(Statistics::Quantity quantity)
+{
+    switch (quantity)
+    {
+    case Statistics::Q_VOLTAGE:
+        return "v";
+    case Statistics::Q_CURRENT:
+        return "i";
+    case Statistics::Q_POWER:
+        return "p";
+    default:
+        return "?";
+    }
+}
+
+bool Trace::quantityFromName(const char *name, Statistics::Quantity *quantity)
+{
+    for (int i = 0; i < Statistics::Q_COUNT; i++)
+    {
+        if (strcmp(name, quantityName(Statistics::Quantity(i))) == 0)
+        {
+            *quantity = Statistics::Quantity(i);
+            return true;
+        }
+    }
+
+    return false;
+}
@@ -1,4 +1,5 @@
 #include <Arduino.h>
+#include "Log.hpp"
 #include "max11645.hpp"
 
 MAX11645::MAX11645(uint8_t address /* = 0x36 */,
@@ -6,7 +7,13 @@ MAX11645::MAX11645(uint8_t address /* = 0x36 */,
                    uint32_t frequency /* = 400000 */)
     : _address(address),
       _i2c(i2c),
-      _frequency(frequency) {}
+      _frequency(frequency),
+      _configValid(false),
+      _config(0),
+      _setupValid(false),
+      _setup(0),
+      _writesIssued(0),
+      _writesSuppressed(0) {}
 
 bool MAX11645::writeConfig(ScanMode scanMode,
                            ChanSel chanSel,
@@ -16,7 +23,22 @@ bool MAX11645::writeConfig(ScanMode scanMode,
 
     data[0] = makeConfig(scanMode, chanSel, mode);
 
-    return writeData(data, 1);
+    if (_configValid && (data[0] == _config))
+    {
+        _writesSuppressed++;
+        return true;
+    }
+
+    if (!writeData(data, 1))
+    {
+        _configValid = false;
+        return false;
+    }
+
+    _config = data[0];
+    _configValid = true;
+
+    return true;
 }
 
 bool MAX11645::writeSetup(Reference ref,
@@ -28,7 +50,27 @@ bool MAX11645::writeSetup(Reference ref,
 
     data[0] = makeSetup(ref, clkSel, subMode, resetConfig);
 
-    return writeData(data, 1);
+    // A reset is an action rather than a state, so it always goes out
+    if (!resetConfig && _setupValid && (data[0] == _setup))
+    {
+        _writesSuppressed++;
+        return true;
+    }
+
+    if (!writeData(data, 1))
+    {
+        _setupValid = false;
+        return false;
+    }
+
+    _setup = data[0];
+    _setupValid = true;
+    if (resetConfig)
+    {
+        _configValid = false;
+    }
+
+    return true;
 }
 
 bool MAX11645::writeAll(ScanMode scanMode,
@@ -43,21 +85,42 @@ bool MAX11645::writeAll(ScanMode scanMode,
     data[0] = makeSetup(ref, clkSel, subMode, false);
     data[1] = makeConfig(scanMode, chanSel, mode);
 
-    return writeData(data, 2);
+    if (_setupValid && (data[0] == _setup))
+    {
+        return writeConfig(scanMode, chanSel, mode);
+    }
+
+    if (!writeData(data, 2))
+    {
+        _setupValid = false;
+        _configValid = false;
+        return false;
+    }
+
+    _setup = data[0];
+    _setupValid = true;
+    _config = data[1];
+    _configValid = true;
+
+    return true;
 }
 
+#ifdef I2C_BUFFER_LENGTH
+const size_t MAX11645::g_maxReadBytes = I2C_BUFFER_LENGTH;
+#else
+const size_t MAX11645::g_maxReadBytes = 32;
+#endif
+
 uint16_t *MAX11645::readSamples(uint16_t *buf, size_t count)
 {
     uint32_t oldFreq = _i2c->getClock();
     _i2c->setClock(_frequency);
 
-    uint8_t byteCount = count * 2;
-    _i2c->requestFrom(_address, byteCount);
-    if (_i2c->available() == byteCount)
+    if (readWords(count))
     {
-        for (int i = 0; i < count; i++)
+        for (size_t i = 0; i < count; i++)
         {
-            buf[i] = ((_i2c->read() & 0x0f) << 8) | _i2c->read();
+            buf[i] = readResult();
         }
         _i2c->setClock(oldFreq);
         return buf;
@@ -69,6 +132,96 @@ uint16_t *MAX11645::readSamples(uint16_t *buf, size_t count)
     }
 }
 
+size_t MAX11645::readFrames(uint16_t *const *channels,
+                            size_t channelCount,
+                            size_t frameCount)
+{
+    // In internal clock mode the MAX11645 keeps converting and
+    // clocking out scans for as long as the master keeps reading,
+    // so each read below returns as many frames as fit in the
+    // Wire receive buffer for a single address/ACK overhead
+    if (channelCount == 0)
+    {
+        return 0;
+    }
+
+    size_t framesPerRead = g_maxReadBytes / (channelCount * 2);
+    if (framesPerRead == 0)
+    {
+        return 0;
+    }
+
+    uint32_t oldFreq = _i2c->getClock();
+    _i2c->setClock(_frequency);
+
+    size_t framesDone = 0;
+    while (framesDone < frameCount)
+    {
+        size_t frames = frameCount - framesDone;
+        if (frames > framesPerRead)
+        {
+            frames = framesPerRead;
+        }
+
+        if (!readWords(frames * channelCount))
+        {
+            break;
+        }
+
+        for (size_t i = 0; i < frames; i++)
+        {
+            for (size_t j = 0; j < channelCount; j++)
+            {
+                channels[j][framesDone + i] = readResult();
+            }
+        }
+
+        framesDone += frames;
+    }
+
+    _i2c->setClock(oldFreq);
+
+    return framesDone;
+}
+
+void MAX11645::invalidate()
+{
+    // Forces the next write of each register out to the device,
+    // e.g. after it may have been reset behind our back
+    _configValid = false;
+    _setupValid = false;
+}
+
+bool MAX11645::configValid()
+{
+    return _configValid;
+}
+
+MAX11645::ScanMode MAX11645::scanMode()
+{
+    return ScanMode((_config >> 5) & 0b11);
+}
+
+MAX11645::ChanSel MAX11645::chanSel()
+{
+    return ChanSel((_config >> 1) & 0b1);
+}
+
+MAX11645::Mode MAX11645::mode()
+{
+    return Mode(_config & 0b1);
+}
+
+uint32_t MAX11645::writesIssued()
+{
+    return _writesIssued;
+}
+
+uint32_t MAX11645::writesSuppressed()
+{
+    return _writesSuppressed;
+}
+
 uint8_t MAX11645::makeConfig(ScanMode scanMode,
                              ChanSel chanSel,
                              Mode mode)
@@ -87,6 +240,8 @@ uint8_t MAX11645::makeSetup(Reference ref,
 bool MAX11645::writeData(uint8_t *data,
                          uint8_t len)
 {
+    _writesIssued++;
+
     // Begin a transmission to the device
     // at "_address"
     uint32_t oldFreq = _i2c->getClock();
@@ -98,7 +253,7 @@ bool MAX11645::writeData(uint8_t *data,
     {
         if (_i2c->write(data[i]) != 1)
         {
-            Serial.println("Wire.write() failed");
+            LOG_ERROR("Wire.write() failed");
 
             _i2c->setClock(oldFreq);
             return false;
@@ -109,7 +264,7 @@ bool MAX11645::writeData(uint8_t *data,
     uint8_t error = _i2c->endTransmission();
     if (error)
     {
-        Serial.printf("Wire.endTransmission() failed: %s\r\n", _i2c->getErrorText(error));
+        LOG_ERROR("Wire.endTransmission() failed: %s", _i2c->getErrorText(error));
 
         _i2c->setClock(oldFreq);
         return false;
@@ -118,3 +273,25 @@ bool MAX11645::writeData(uint8_t *data,
 
     return true;
 }
+
+bool MAX11645::readWords(size_t wordCount)
+{
+    size_t byteCount = wordCount * 2;
+    if ((byteCount == 0) || (byteCount > g_maxReadBytes))
+    {
+        return false;
+    }
+
+    _i2c->requestFrom(uint16_t(_address), byteCount, true);
+
+    return size_t(_i2c->available()) == byteCount;
+}
+
+uint16_t MAX11645::readResult()
+{
+    // Evaluate in order: high byte first
+    uint16_t result = (_i2c->read() & 0x0f) << 8;
+    result |= _i2c->read();
+
+    return result;
+}
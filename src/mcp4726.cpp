@@ -1,4 +1,5 @@
 #include <Arduino.h>
+#include "Log.hpp"
 #include "mcp4726.hpp"
 
 MCP4726::MCP4726(uint8_t address /*  = 0x60 */,
@@ -6,17 +7,54 @@ MCP4726::MCP4726(uint8_t address /*  = 0x60 */,
                  uint32_t frequency /* = 400000 */)
     : _address(address),
       _i2c(i2c),
-      _frequency(frequency) {}
+      _frequency(frequency),
+      _dacValid(false),
+      _dacValue(0),
+      _powerDown(PD_RUN),
+      _configValid(false),
+      _ref(REF_VDD),
+      _gain(G_1X),
+      _writesIssued(0),
+      _writesSuppressed(0) {}
 
 bool MCP4726::writeDAC(uint16_t value,
                        MCP4726::PowerDown pd /* = PD_RUN */)
 {
+    return writeFrame(encodeDAC(value, pd));
+}
+
+bool MCP4726::writeFrame(const MCP4726::Frame &frame)
+{
+    uint16_t value = uint16_t(((frame.bytes[0] & 0x0f) << 8) | frame.bytes[1]);
+    PowerDown pd = PowerDown((frame.bytes[0] >> 4) & 0b11);
+
+    if (_dacValid && (value == _dacValue) && (pd == _powerDown))
+    {
+        _writesSuppressed++;
+        return true;
+    }
+
     uint8_t data[2];
 
-    data[0] = uint8_t((int(pd) << 4) | ((value >> 8) & 0x0f));
-    data[1] = uint8_t(value & 0x00ff);
+    data[0] = frame.bytes[0];
+    data[1] = frame.bytes[1];
+
+    _dacValid = writeData(data, 2);
+    _dacValue = value;
+    _powerDown = pd;
 
-    return writeData(data, 2);
+    return _dacValid;
+}
+
+MCP4726::Frame MCP4726::encodeDAC(uint16_t value,
+                                  MCP4726::PowerDown pd /* = PD_RUN */)
+{
+    Frame frame;
+
+    frame.bytes[0] = uint8_t((int(pd) << 4) | ((value >> 8) & 0x0f));
+    frame.bytes[1] = uint8_t(value & 0x00ff);
+
+    return frame;
 }
 
 bool MCP4726::writeMem(MCP4726::Reference ref,
@@ -25,6 +63,16 @@ bool MCP4726::writeMem(MCP4726::Reference ref,
                        uint16_t dacValue,
                        bool persistent /* = false */)
 {
+    // EEPROM writes always go out, the shadow only covers
+    // the volatile registers
+    if (!persistent &&
+        _dacValid && (dacValue == _dacValue) && (pd == _powerDown) &&
+        _configValid && (ref == _ref) && (g == _gain))
+    {
+        _writesSuppressed++;
+        return true;
+    }
+
     uint8_t data[3];
 
     int cmd = persistent ? 0b011 : 0b010;
@@ -33,20 +81,116 @@ bool MCP4726::writeMem(MCP4726::Reference ref,
     data[1] = uint8_t((dacValue >> 4) & 0x00ff);
     data[2] = uint8_t((dacValue << 4) & 0x00ff);
 
-    return writeData(data, 3);
+    bool success = writeData(data, 3);
+
+    _dacValid = success;
+    _dacValue = dacValue;
+    _powerDown = pd;
+    _configValid = success;
+    _ref = ref;
+    _gain = g;
+
+    return success;
 }
 
 bool MCP4726::writeVolatileConfig(MCP4726::Reference ref,
                                   MCP4726::PowerDown pd,
                                   MCP4726::Gain g)
 {
+    if (_configValid && (ref == _ref) && (pd == _powerDown) && (g == _gain))
+    {
+        _writesSuppressed++;
+        return true;
+    }
+
     uint8_t data[1];
 
     int cmd = 0b100;
 
     data[0] = uint8_t((cmd << 5) | (int(ref) << 3) | (int(pd) << 1) | int(g));
 
-    return writeData(data, 1);
+    bool success = writeData(data, 1);
+
+    _configValid = success;
+    _ref = ref;
+    _powerDown = pd;
+    _gain = g;
+
+    return success;
+}
+
+bool MCP4726::readMem(MCP4726::Memory *volatileMem,
+                      MCP4726::Memory *nonVolatileMem)
+{
+    // A read returns the volatile registers followed by the EEPROM,
+    // three bytes each
+    uint32_t oldFreq = _i2c->getClock();
+    _i2c->setClock(_frequency);
+
+    uint8_t requestLen = 6;
+    uint8_t data[6];
+    _i2c->requestFrom(_address, requestLen);
+    if (_i2c->available() < requestLen)
+    {
+        LOG_ERROR("Not enough data returned");
+
+        _i2c->setClock(oldFreq);
+        return false;
+    }
+    for (int i = 0; i < requestLen; i++)
+    {
+        data[i] = _i2c->read();
+    }
+    _i2c->setClock(oldFreq);
+
+    if (volatileMem != 0)
+    {
+        decodeMem(&data[0], volatileMem);
+    }
+    if (nonVolatileMem != 0)
+    {
+        decodeMem(&data[3], nonVolatileMem);
+    }
+
+    return true;
+}
+
+void MCP4726::invalidate()
+{
+    // Forces the next write of each register out to the device,
+    // e.g. after it may have been reset behind our back
+    _dacValid = false;
+    _configValid = false;
+}
+
+bool MCP4726::dacValid()
+{
+    return _dacValid;
+}
+
+uint16_t MCP4726::dacValue()
+{
+    return _dacValue;
+}
+
+uint32_t MCP4726::writesIssued()
+{
+    return _writesIssued;
+}
+
+uint32_t MCP4726::writesSuppressed()
+{
+    return _writesSuppressed;
+}
+
+void MCP4726::decodeMem(const uint8_t *data, MCP4726::Memory *mem)
+{
+    mem->ready = (data[0] & 0x80) != 0;
+    mem->powerOnReset = (data[0] & 0x40) != 0;
+    mem->ref = Reference((data[0] >> 3) & 0b11);
+    mem->pd = PowerDown((data[0] >> 1) & 0b11);
+    mem->gain = Gain(data[0] & 0b1);
+    mem->dacValue = uint16_t((uint16_t(data[1]) << 4) | (data[2] >> 4));
 }
 
 uint16_t MCP4726::getWord(uint8_t reg)
@@ -61,7 +205,7 @@ uint16_t MCP4726::getWord(uint8_t reg)
     // the specified register
     if (_i2c->write(reg) != 1)
     {
-        Serial.println("Wire.write() failed");
+        LOG_ERROR("Wire.write() failed");
 
         _i2c->setClock(oldFreq);
         return 0;
@@ -71,7 +215,7 @@ uint16_t MCP4726::getWord(uint8_t reg)
     uint8_t error = _i2c->endTransmission(false);
     if (error)
     {
-        Serial.printf("Wire.endTransmission() failed: %s\r\n", _i2c->getErrorText(error));
+        LOG_ERROR("Wire.endTransmission() failed: %s", _i2c->getErrorText(error));
 
         _i2c->setClock(oldFreq);
         return 0;
@@ -99,7 +243,7 @@ uint16_t MCP4726::getWord(uint8_t reg)
     }
     else
     {
-        Serial.println("Not enough data returned");
+        LOG_ERROR("Not enough data returned");
 
         _i2c->setClock(oldFreq);
         return 0;
@@ -109,6 +253,8 @@ uint16_t MCP4726::getWord(uint8_t reg)
 bool MCP4726::writeData(uint8_t *data,
                         uint8_t len)
 {
+    _writesIssued++;
+
     // Begin a transmission to the device
     // at "_address"
     uint32_t oldFreq = _i2c->getClock();
@@ -120,7 +266,7 @@ bool MCP4726::writeData(uint8_t *data,
     {
         if (_i2c->write(data[i]) != 1)
         {
-            Serial.println("Wire.write() failed");
+            LOG_ERROR("Wire.write() failed");
 
             _i2c->setClock(oldFreq);
             return false;
@@ -131,7 +277,7 @@ bool MCP4726::writeData(uint8_t *data,
     uint8_t error = _i2c->endTransmission();
     if (error)
     {
-        Serial.printf("Wire.endTransmission() failed: %s\r\n", _i2c->getErrorText(error));
+        LOG_ERROR("Wire.endTransmission() failed: %s", _i2c->getErrorText(error));
 
         _i2c->setClock(oldFreq);
         return false;
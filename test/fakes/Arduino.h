@@ -0,0 +1,266 @@
+#ifndef __H_FAKE_ARDUINO__
+#define __H_FAKE_ARDUINO__
+
+// The little of the Arduino core and FreeRTOS the host-tested modules
+// use, with a clock the tests move by hand. A task is a host thread
+// that only ever runs between its notification waits, and
+// fakeTasksSettle() returns once every task is back in one, so a test
+// steps tasks as deterministically as it calls its own code.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct FakeTask;
+
+typedef FakeTask *TaskHandle_t;
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef void (*TaskFunction_t)(void *);
+
+enum eNotifyAction
+{
+    eNoAction,
+    eSetBits,
+    eIncrement,
+    eSetValueWithOverwrite,
+    eSetValueWithoutOverwrite
+};
+
+#define pdFALSE 0
+#define pdTRUE 1
+#define pdPASS pdTRUE
+#define portMAX_DELAY ((TickType_t)0xffffffff)
+#define configMAX_TASK_NAME_LEN 16
+
+struct FakeSemaphore
+{
+    std::atomic<bool> taken;
+};
+
+typedef FakeSemaphore *SemaphoreHandle_t;
+
+inline SemaphoreHandle_t xSemaphoreCreateMutex()
+{
+    SemaphoreHandle_t semaphore = new FakeSemaphore;
+    semaphore->taken = false;
+    return semaphore;
+}
+
+// Only portMAX_DELAY waits; any shorter timeout gives up at once
+inline BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks)
+{
+    while (semaphore->taken.exchange(true))
+    {
+        if (ticks != portMAX_DELAY)
+        {
+            return pdFALSE;
+        }
+        std::this_thread::yield();
+    }
+    return pdTRUE;
+}
+
+inline BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore)
+{
+    return semaphore->taken.exchange(false) ? pdTRUE : pdFALSE;
+}
+
+struct FakeTask
+{
+    const char *name;
+    TaskFunction_t function;
+    void *arg;
+    uint32_t value;
+    bool pending;
+    bool waiting;
+    bool deleted;
+};
+
+// Never destroyed: tasks outlive main() blocked in their waits
+struct FakeScheduler
+{
+    std::mutex lock;
+    std::condition_variable changed;
+    std::vector<FakeTask *> tasks;
+};
+
+inline FakeScheduler &fakeScheduler()
+{
+    static FakeScheduler *scheduler = new FakeScheduler;
+    return *scheduler;
+}
+
+inline FakeTask *&fakeCurrentTask()
+{
+    static thread_local FakeTask *task = 0;
+    return task;
+}
+
+inline BaseType_t xTaskCreate(TaskFunction_t function,
+                              const char *name,
+                              uint32_t,
+                              void *arg,
+                              UBaseType_t,
+                              TaskHandle_t *handle)
+{
+    FakeTask *task = new FakeTask();
+    task->name = name;
+    task->function = function;
+    task->arg = arg;
+
+    FakeScheduler &scheduler = fakeScheduler();
+    {
+        std::lock_guard<std::mutex> guard(scheduler.lock);
+        scheduler.tasks.push_back(task);
+    }
+    if (handle != 0)
+    {
+        *handle = task;
+    }
+
+    std::thread([task]()
+                {
+                    fakeCurrentTask() = task;
+                    task->function(task->arg);
+                })
+        .detach();
+
+    return pdPASS;
+}
+
+inline void vTaskDelete(TaskHandle_t)
+{
+    FakeScheduler &scheduler = fakeScheduler();
+    std::lock_guard<std::mutex> guard(scheduler.lock);
+    fakeCurrentTask()->deleted = true;
+    scheduler.changed.notify_all();
+}
+
+inline BaseType_t xTaskNotify(TaskHandle_t task, uint32_t value, eNotifyAction action)
+{
+    FakeScheduler &scheduler = fakeScheduler();
+    std::lock_guard<std::mutex> guard(scheduler.lock);
+    switch (action)
+    {
+    case eSetBits:
+        task->value |= value;
+        break;
+    case eIncrement:
+        task->value++;
+        break;
+    case eSetValueWithOverwrite:
+    case eSetValueWithoutOverwrite:
+        task->value = value;
+        break;
+    default:
+        break;
+    }
+    task->pending = true;
+    scheduler.changed.notify_all();
+
+    return pdPASS;
+}
+
+// Timeouts aren't modelled, every wait is portMAX_DELAY
+inline BaseType_t xTaskNotifyWait(uint32_t clearOnEntry,
+                                  uint32_t clearOnExit,
+                                  uint32_t *value,
+                                  TickType_t)
+{
+    FakeScheduler &scheduler = fakeScheduler();
+    FakeTask *task = fakeCurrentTask();
+    std::unique_lock<std::mutex> guard(scheduler.lock);
+    if (!task->pending)
+    {
+        task->value &= ~clearOnEntry;
+    }
+    task->waiting = true;
+    scheduler.changed.notify_all();
+    scheduler.changed.wait(guard, [task]()
+                           { return task->pending; });
+    task->waiting = false;
+    task->pending = false;
+    if (value != 0)
+    {
+        *value = task->value;
+    }
+    task->value &= ~clearOnExit;
+
+    return pdTRUE;
+}
+
+// Test side: returns once every task is waiting with nothing pending
+inline void fakeTasksSettle()
+{
+    FakeScheduler &scheduler = fakeScheduler();
+    std::unique_lock<std::mutex> guard(scheduler.lock);
+    scheduler.changed.wait(guard, [&scheduler]()
+                           {
+                               for (size_t i = 0; i < scheduler.tasks.size(); i++)
+                               {
+                                   FakeTask *task = scheduler.tasks[i];
+                                   if (!task->deleted && (!task->waiting || task->pending))
+                                   {
+                                       return false;
+                                   }
+                               }
+                               return true;
+                           });
+}
+
+inline TaskHandle_t xTaskGetCurrentTaskHandle()
+{
+    static FakeTask test = {"test", 0, 0, 0, false, false, false};
+    FakeTask *task = fakeCurrentTask();
+    return task != 0 ? task : &test;
+}
+
+inline const char *pcTaskGetTaskName(TaskHandle_t task)
+{
+    return (task != 0 ? task : xTaskGetCurrentTaskHandle())->name;
+}
+
+inline unsigned long &fakeMillis()
+{
+    static unsigned long now_ms = 0;
+    return now_ms;
+}
+
+inline unsigned long millis()
+{
+    return fakeMillis();
+}
+
+inline void delay(unsigned long ms)
+{
+    fakeMillis() += ms;
+}
+
+inline void vTaskDelay(TickType_t ticks)
+{
+    fakeMillis() += ticks;
+    std::this_thread::yield();
+}
+
+class FakeEsp
+{
+public:
+    uint32_t getCycleCount() { return 0; }
+};
+
+inline FakeEsp &fakeEsp()
+{
+    static FakeEsp esp;
+    return esp;
+}
+
+#define ESP (fakeEsp())
+
+#endif
@@ -0,0 +1,126 @@
+#ifndef __H_FAKE_PREFERENCES__
+#define __H_FAKE_PREFERENCES__
+
+// In-memory stand-in for the ESP32 Preferences (NVS) library. All
+// instances share one store, as they share the flash, and count the
+// writes that reach it.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <map>
+#include <string>
+#include <vector>
+
+class Preferences
+{
+public:
+    Preferences() : _open(false), _readOnly(true) {}
+
+    bool begin(const char *name, bool readOnly = false)
+    {
+        _name = name;
+        _open = true;
+        _readOnly = readOnly;
+        return true;
+    }
+
+    void end()
+    {
+        _open = false;
+    }
+
+    size_t getBytesLength(const char *key)
+    {
+        Store::iterator it = store().find(_key(key));
+        return (_open && (it != store().end())) ? it->second.size() : 0;
+    }
+
+    size_t getBytes(const char *key, void *buf, size_t maxLen)
+    {
+        Store::iterator it = store().find(_key(key));
+        if (!_open || (it == store().end()) || (it->second.size() > maxLen))
+        {
+            return 0;
+        }
+
+        memcpy(buf, &it->second[0], it->second.size());
+        return it->second.size();
+    }
+
+    size_t putBytes(const char *key, const void *value, size_t len)
+    {
+        if (!_open || _readOnly || failWrites())
+        {
+            return 0;
+        }
+
+        const uint8_t *bytes = (const uint8_t *)value;
+        store()[_key(key)].assign(bytes, bytes + len);
+        writes()++;
+        return len;
+    }
+
+    bool isKey(const char *key)
+    {
+        return _open && (store().find(_key(key)) != store().end());
+    }
+
+    bool clear()
+    {
+        if (!_open || _readOnly || failWrites())
+        {
+            return false;
+        }
+
+        std::string prefix = _name + "/";
+        Store::iterator it = store().lower_bound(prefix);
+        while ((it != store().end()) && (it->first.compare(0, prefix.size(), prefix) == 0))
+        {
+            store().erase(it++);
+        }
+        writes()++;
+        return true;
+    }
+
+public:
+    typedef std::map<std::string, std::vector<uint8_t> > Store;
+
+    static Store &store()
+    {
+        static Store s;
+        return s;
+    }
+
+    static uint32_t &writes()
+    {
+        static uint32_t count = 0;
+        return count;
+    }
+
+    static bool &failWrites()
+    {
+        static bool fail = false;
+        return fail;
+    }
+
+    static void fakeReset()
+    {
+        store().clear();
+        writes() = 0;
+        failWrites() = false;
+    }
+
+private:
+    std::string _key(const char *key)
+    {
+        return _name + "/" + key;
+    }
+
+private:
+    std::string _name;
+    bool _open;
+    bool _readOnly;
+};
+
+#endif
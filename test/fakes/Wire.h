@@ -0,0 +1,123 @@
+#ifndef __H_FAKE_WIRE__
+#define __H_FAKE_WIRE__
+
+// Host stand-in for the Arduino TwoWire master. Every completed write
+// transaction is recorded with its bytes and the esp_timer time it
+// landed, so tests can see what reached the bus and when; reads are
+// served from bytes queued with respond().
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include <esp_timer.h>
+
+class TwoWire
+{
+public:
+    struct Transaction
+    {
+        uint16_t address;
+        std::vector<uint8_t> bytes;
+        int64_t time_us;
+    };
+
+public:
+    TwoWire() : _clock(100000), _address(0), _failWith(0), _reads(0) {}
+
+    bool setClock(uint32_t frequency)
+    {
+        _clock = frequency;
+        return true;
+    }
+
+    uint32_t getClock() { return _clock; }
+
+    void beginTransmission(uint16_t address)
+    {
+        _address = address;
+        _pending.clear();
+    }
+
+    size_t write(uint8_t data)
+    {
+        _pending.push_back(data);
+        return 1;
+    }
+
+    uint8_t endTransmission(bool sendStop = true)
+    {
+        (void)sendStop;
+        if (_failWith != 0)
+        {
+            return _failWith;
+        }
+
+        Transaction transaction;
+        transaction.address = _address;
+        transaction.bytes = _pending;
+        transaction.time_us = esp_timer_get_time();
+        _transactions.push_back(transaction);
+        return 0;
+    }
+
+    uint8_t requestFrom(uint16_t address, uint8_t size, bool sendStop = true)
+    {
+        (void)address;
+        (void)sendStop;
+        _reads++;
+        size_t count = size < _responses.size() ? size : _responses.size();
+        _received.assign(_responses.begin(), _responses.begin() + count);
+        _responses.erase(_responses.begin(), _responses.begin() + count);
+        return uint8_t(count);
+    }
+
+    int available() { return int(_received.size()); }
+
+    int read()
+    {
+        if (_received.empty())
+        {
+            return -1;
+        }
+        int data = _received.front();
+        _received.erase(_received.begin());
+        return data;
+    }
+
+    const char *getErrorText(uint8_t) { return "fake error"; }
+
+    // Test side
+    const std::vector<Transaction> &transactions() { return _transactions; }
+    size_t reads() { return _reads; }
+    void respond(const uint8_t *data, size_t length) { _responses.insert(_responses.end(), data, data + length); }
+    void failWith(uint8_t error) { _failWith = error; }
+
+    void reset()
+    {
+        _transactions.clear();
+        _responses.clear();
+        _received.clear();
+        _reads = 0;
+        _failWith = 0;
+    }
+
+private:
+    uint32_t _clock;
+    uint16_t _address;
+    uint8_t _failWith;
+    size_t _reads;
+    std::vector<uint8_t> _pending;
+    std::vector<uint8_t> _received;
+    std::vector<uint8_t> _responses;
+    std::vector<Transaction> _transactions;
+};
+
+inline TwoWire &fakeWire()
+{
+    static TwoWire wire;
+    return wire;
+}
+
+#define Wire (fakeWire())
+
+#endif
@@ -0,0 +1,388 @@
+#ifndef __H_FAKE_PCNT__
+#define __H_FAKE_PCNT__
+
+// Host model of the ESP32 pulse counter behind the legacy driver API.
+// Inputs are driven with FakePcnt::input() in time order, in 80 MHz
+// APB cycles. Each unit filters its pins like the hardware: a level
+// only gets through once it has held for the filter value. Counters
+// go back to zero on reaching either limit, and the threshold and
+// zero events call the registered handler straight away.
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef int esp_err_t;
+#ifndef ESP_OK
+#define ESP_OK 0
+#endif
+#ifndef ESP_FAIL
+#define ESP_FAIL -1
+#endif
+#ifndef ESP_ERR_INVALID_STATE
+#define ESP_ERR_INVALID_STATE 0x103
+#endif
+
+#define PCNT_PIN_NOT_USED (-1)
+
+typedef enum
+{
+    PCNT_UNIT_0,
+    PCNT_UNIT_1,
+    PCNT_UNIT_2,
+    PCNT_UNIT_3,
+    PCNT_UNIT_MAX
+} pcnt_unit_t;
+
+typedef enum
+{
+    PCNT_CHANNEL_0,
+    PCNT_CHANNEL_1,
+    PCNT_CHANNEL_MAX
+} pcnt_channel_t;
+
+typedef enum
+{
+    PCNT_COUNT_DIS,
+    PCNT_COUNT_INC,
+    PCNT_COUNT_DEC
+} pcnt_count_mode_t;
+
+typedef enum
+{
+    PCNT_MODE_KEEP,
+    PCNT_MODE_REVERSE,
+    PCNT_MODE_DISABLE
+} pcnt_ctrl_mode_t;
+
+typedef enum
+{
+    PCNT_EVT_THRES_1 = 1 << 2,
+    PCNT_EVT_THRES_0 = 1 << 3,
+    PCNT_EVT_L_LIM = 1 << 4,
+    PCNT_EVT_H_LIM = 1 << 5,
+    PCNT_EVT_ZERO = 1 << 6
+} pcnt_evt_type_t;
+
+typedef struct
+{
+    int pulse_gpio_num;
+    int ctrl_gpio_num;
+    pcnt_ctrl_mode_t lctrl_mode;
+    pcnt_ctrl_mode_t hctrl_mode;
+    pcnt_count_mode_t pos_mode;
+    pcnt_count_mode_t neg_mode;
+    int16_t counter_h_lim;
+    int16_t counter_l_lim;
+    pcnt_unit_t unit;
+    pcnt_channel_t channel;
+} pcnt_config_t;
+
+class FakePcnt
+{
+public:
+    static const int g_maxGpio = 40;
+
+    struct Pin
+    {
+        int gpio;
+        int level;
+        int raw;
+        uint64_t changed;
+    };
+
+    struct Unit
+    {
+        bool configured;
+        bool running;
+        pcnt_config_t config;
+        bool filterEnabled;
+        uint16_t filter;
+        int events;
+        int16_t thres0;
+        int16_t thres1;
+        int16_t count;
+        Pin pulse;
+        Pin ctrl;
+        void (*handler)(void *);
+        void *arg;
+    };
+
+    struct State
+    {
+        uint64_t now;
+        int levels[g_maxGpio];
+        bool serviceInstalled;
+        uint32_t interrupts;
+        Unit units[PCNT_UNIT_MAX];
+    };
+
+    static State &state()
+    {
+        static State s;
+        return s;
+    }
+
+    // Back to power-on, with every input at level
+    static void reset(int level)
+    {
+        State &s = state();
+        s = State();
+        for (int i = 0; i < g_maxGpio; i++)
+        {
+            s.levels[i] = level;
+        }
+        for (int u = 0; u < PCNT_UNIT_MAX; u++)
+        {
+            s.units[u].pulse.gpio = PCNT_PIN_NOT_USED;
+            s.units[u].ctrl.gpio = PCNT_PIN_NOT_USED;
+        }
+    }
+
+    // Sets a GPIO at the given time, first letting through whatever
+    // the filters were holding back before it
+    static void input(int gpio, int level, uint64_t at)
+    {
+        advance(at);
+        state().levels[gpio] = level;
+        for (int u = 0; u < PCNT_UNIT_MAX; u++)
+        {
+            _raw(&state().units[u].pulse, gpio, level, at);
+            _raw(&state().units[u].ctrl, gpio, level, at);
+        }
+    }
+
+    // Runs the filters up to the given time, in time order
+    static void advance(uint64_t to)
+    {
+        State &s = state();
+        while (true)
+        {
+            Unit *next = 0;
+            Pin *nextPin = 0;
+            uint64_t nextAt = to + 1;
+            for (int u = 0; u < PCNT_UNIT_MAX; u++)
+            {
+                Unit *unit = &s.units[u];
+                Pin *pins[2] = {&unit->pulse, &unit->ctrl};
+                for (int p = 0; p < 2; p++)
+                {
+                    if ((pins[p]->gpio < 0) || (pins[p]->raw == pins[p]->level))
+                    {
+                        continue;
+                    }
+                    uint64_t at = pins[p]->changed + (unit->filterEnabled ? unit->filter : 0);
+                    if (at < nextAt)
+                    {
+                        next = unit;
+                        nextPin = pins[p];
+                        nextAt = at;
+                    }
+                }
+            }
+
+            if (next == 0)
+            {
+                break;
+            }
+
+            s.now = nextAt;
+            nextPin->level = nextPin->raw;
+            if (nextPin == &next->pulse)
+            {
+                _count(next, nextPin->level != 0);
+            }
+        }
+
+        s.now = to;
+    }
+
+    static int16_t count(pcnt_unit_t unit)
+    {
+        return state().units[unit].count;
+    }
+
+    static uint32_t interrupts()
+    {
+        return state().interrupts;
+    }
+
+private:
+    static void _raw(Pin *pin, int gpio, int level, uint64_t at)
+    {
+        if ((pin->gpio == gpio) && (pin->raw != level))
+        {
+            // Each change restarts the filter's hold time
+            pin->raw = level;
+            pin->changed = at;
+        }
+    }
+
+    static void _count(Unit *unit, bool rising)
+    {
+        if (!unit->running)
+        {
+            return;
+        }
+
+        pcnt_count_mode_t mode = rising ? unit->config.pos_mode : unit->config.neg_mode;
+        pcnt_ctrl_mode_t ctrl = unit->ctrl.level ? unit->config.hctrl_mode : unit->config.lctrl_mode;
+        if ((mode == PCNT_COUNT_DIS) || (ctrl == PCNT_MODE_DISABLE))
+        {
+            return;
+        }
+        if (ctrl == PCNT_MODE_REVERSE)
+        {
+            mode = mode == PCNT_COUNT_INC ? PCNT_COUNT_DEC : PCNT_COUNT_INC;
+        }
+
+        unit->count += mode == PCNT_COUNT_INC ? 1 : -1;
+
+        int events = 0;
+        if (unit->count == unit->config.counter_h_lim)
+        {
+            events |= PCNT_EVT_H_LIM | PCNT_EVT_ZERO;
+            unit->count = 0;
+        }
+        else if (unit->count == unit->config.counter_l_lim)
+        {
+            events |= PCNT_EVT_L_LIM | PCNT_EVT_ZERO;
+            unit->count = 0;
+        }
+        else if (unit->count == 0)
+        {
+            events |= PCNT_EVT_ZERO;
+        }
+        if (unit->count == unit->thres0)
+        {
+            events |= PCNT_EVT_THRES_0;
+        }
+        if (unit->count == unit->thres1)
+        {
+            events |= PCNT_EVT_THRES_1;
+        }
+
+        if ((events & unit->events) && state().serviceInstalled && (unit->handler != 0))
+        {
+            state().interrupts++;
+            unit->handler(unit->arg);
+        }
+    }
+};
+
+inline esp_err_t pcnt_unit_config(const pcnt_config_t *config)
+{
+    if ((config->unit >= PCNT_UNIT_MAX) || (config->counter_h_lim <= 0) || (config->counter_l_lim >= 0))
+    {
+        return ESP_FAIL;
+    }
+
+    FakePcnt::Unit *unit = &FakePcnt::state().units[config->unit];
+    unit->configured = true;
+    unit->config = *config;
+    unit->count = 0;
+    // The driver leaves the limit and zero events on after configuring
+    unit->events = PCNT_EVT_L_LIM | PCNT_EVT_H_LIM | PCNT_EVT_ZERO;
+
+    int gpios[2] = {config->pulse_gpio_num, config->ctrl_gpio_num};
+    FakePcnt::Pin *pins[2] = {&unit->pulse, &unit->ctrl};
+    for (int p = 0; p < 2; p++)
+    {
+        pins[p]->gpio = gpios[p];
+        pins[p]->level = gpios[p] >= 0 ? FakePcnt::state().levels[gpios[p]] : 0;
+        pins[p]->raw = pins[p]->level;
+        pins[p]->changed = FakePcnt::state().now;
+    }
+
+    return ESP_OK;
+}
+
+inline esp_err_t pcnt_get_counter_value(pcnt_unit_t unit, int16_t *count)
+{
+    *count = FakePcnt::state().units[unit].count;
+    return ESP_OK;
+}
+
+inline esp_err_t pcnt_counter_pause(pcnt_unit_t unit)
+{
+    FakePcnt::state().units[unit].running = false;
+    return ESP_OK;
+}
+
+inline esp_err_t pcnt_counter_resume(pcnt_unit_t unit)
+{
+    FakePcnt::state().units[unit].running = true;
+    return ESP_OK;
+}
+
+inline esp_err_t pcnt_counter_clear(pcnt_unit_t unit)
+{
+    FakePcnt::state().units[unit].count = 0;
+    return ESP_OK;
+}
+
+inline esp_err_t pcnt_set_filter_value(pcnt_unit_t unit, uint16_t filter)
+{
+    if (filter > 1023)
+    {
+        return ESP_FAIL;
+    }
+
+    FakePcnt::state().units[unit].filter = filter;
+    return ESP_OK;
+}
+
+inline esp_err_t pcnt_filter_enable(pcnt_unit_t unit)
+{
+    FakePcnt::state().units[unit].filterEnabled = true;
+    return ESP_OK;
+}
+
+inline esp_err_t pcnt_set_event_value(pcnt_unit_t unit, pcnt_evt_type_t event, int16_t value)
+{
+    if (event == PCNT_EVT_THRES_0)
+    {
+        FakePcnt::state().units[unit].thres0 = value;
+    }
+    else if (event == PCNT_EVT_THRES_1)
+    {
+        FakePcnt::state().units[unit].thres1 = value;
+    }
+    else
+    {
+        return ESP_FAIL;
+    }
+
+    return ESP_OK;
+}
+
+inline esp_err_t pcnt_event_enable(pcnt_unit_t unit, pcnt_evt_type_t event)
+{
+    FakePcnt::state().units[unit].events |= event;
+    return ESP_OK;
+}
+
+inline esp_err_t pcnt_event_disable(pcnt_unit_t unit, pcnt_evt_type_t event)
+{
+    FakePcnt::state().units[unit].events &= ~event;
+    return ESP_OK;
+}
+
+inline esp_err_t pcnt_isr_service_install(int flags)
+{
+    // Only once per boot, as in ESP-IDF
+    if (FakePcnt::state().serviceInstalled)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    FakePcnt::state().serviceInstalled = true;
+    return ESP_OK;
+}
+
+inline esp_err_t pcnt_isr_handler_add(pcnt_unit_t unit, void (*handler)(void *), void *arg)
+{
+    FakePcnt::state().units[unit].handler = handler;
+    FakePcnt::state().units[unit].arg = arg;
+    return ESP_OK;
+}
+
+#endif
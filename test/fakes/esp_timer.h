@@ -0,0 +1,128 @@
+#ifndef __H_FAKE_ESP_TIMER__
+#define __H_FAKE_ESP_TIMER__
+
+// The ESP-IDF microsecond clock, moved by hand like fakeMillis(), and
+// one-shot timers whose callbacks run when a test moves the clock past
+// them with fakeTimerFireNext()
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+typedef int esp_err_t;
+#ifndef ESP_OK
+#define ESP_OK 0
+#endif
+#ifndef ESP_ERR_INVALID_STATE
+#define ESP_ERR_INVALID_STATE 0x103
+#endif
+
+typedef void (*esp_timer_cb_t)(void *arg);
+
+typedef enum
+{
+    ESP_TIMER_TASK
+} esp_timer_dispatch_t;
+
+struct esp_timer_create_args_t
+{
+    esp_timer_cb_t callback;
+    void *arg;
+    esp_timer_dispatch_t dispatch_method;
+    const char *name;
+    bool skip_unhandled_events;
+};
+
+struct FakeEspTimer
+{
+    esp_timer_cb_t callback;
+    void *arg;
+    bool armed;
+    int64_t due_us;
+};
+
+typedef FakeEspTimer *esp_timer_handle_t;
+
+inline int64_t &fakeTimer_us()
+{
+    static int64_t now_us = 0;
+    return now_us;
+}
+
+inline std::vector<FakeEspTimer *> &fakeTimers()
+{
+    static std::vector<FakeEspTimer *> *timers = new std::vector<FakeEspTimer *>;
+    return *timers;
+}
+
+inline int64_t esp_timer_get_time()
+{
+    return fakeTimer_us();
+}
+
+inline esp_err_t esp_timer_create(const esp_timer_create_args_t *args, esp_timer_handle_t *handle)
+{
+    FakeEspTimer *timer = new FakeEspTimer();
+    timer->callback = args->callback;
+    timer->arg = args->arg;
+    fakeTimers().push_back(timer);
+    *handle = timer;
+    return ESP_OK;
+}
+
+inline esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us)
+{
+    if (timer->armed)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->armed = true;
+    timer->due_us = fakeTimer_us() + int64_t(timeout_us);
+    return ESP_OK;
+}
+
+inline esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+{
+    if (!timer->armed)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->armed = false;
+    return ESP_OK;
+}
+
+// Test side: moves the clock to the earliest timer due by until_us and
+// runs its callback. Once none is left the clock stops at until_us and
+// this returns false.
+inline bool fakeTimerFireNext(int64_t until_us)
+{
+    FakeEspTimer *next = 0;
+    for (size_t i = 0; i < fakeTimers().size(); i++)
+    {
+        FakeEspTimer *timer = fakeTimers()[i];
+        if (timer->armed && (timer->due_us <= until_us) &&
+            ((next == 0) || (timer->due_us < next->due_us)))
+        {
+            next = timer;
+        }
+    }
+
+    if (next == 0)
+    {
+        if (fakeTimer_us() < until_us)
+        {
+            fakeTimer_us() = until_us;
+        }
+        return false;
+    }
+
+    if (fakeTimer_us() < next->due_us)
+    {
+        fakeTimer_us() = next->due_us;
+    }
+    next->armed = false;
+    next->callback(next->arg);
+    return true;
+}
+
+#endif
@@ -0,0 +1,223 @@
+#include <unity.h>
+#include <Arduino.h>
+#include <Wire.h>
+#include <esp_timer.h>
+#include <vector>
+
+#include "BatteryTest.hpp"
+#include "Measurement.hpp"
+
+static const uint8_t g_dacAddress = 0x60;
+
+static Calibration g_calibration;
+
+static Sample makeSample(uint32_t timestamp_us, uint16_t voltageCounts, uint16_t currentCounts)
+{
+    Sample sample;
+    sample.timestamp_us = timestamp_us;
+    sample.ain0 = voltageCounts;
+    sample.ain1 = currentCounts;
+    return sample;
+}
+
+// Hands samples over in bursts, as the sampler task does
+static void feed(BatteryTest *test, const std::vector<Sample> &samples, size_t burst = 16)
+{
+    for (size_t i = 0; i < samples.size(); i += burst)
+    {
+        size_t count = samples.size() - i < burst ? samples.size() - i : burst;
+        test->samplesAcquired(0, &samples[i], count);
+    }
+}
+
+// The DAC writes that reached the bus
+static size_t dacWrites()
+{
+    size_t writes = 0;
+    for (size_t i = 0; i < Wire.transactions().size(); i++)
+    {
+        if (Wire.transactions()[i].address == g_dacAddress)
+        {
+            writes++;
+        }
+    }
+    return writes;
+}
+
+void setUp(void)
+{
+    Wire.reset();
+    fakeTimer_us() = 0;
+}
+
+void tearDown(void)
+{
+}
+
+void test_integrates_closed_form_discharge(void)
+{
+    MCP4726 dac(g_dacAddress);
+    BatteryTest test(&dac);
+
+    // 1 A, from 4.2 V down one ADC count every 1000 samples of 10 ms
+    // to just above a 3.0 V cutoff, starting near the timestamp wrap
+    const uint16_t currentCounts = 1340;
+    const uint16_t startCounts = 560;
+    const uint16_t endCounts = 401;
+    const uint32_t dt_us = 10000;
+    const uint32_t perCount = 1000;
+    const uint32_t start_us = 0xffffffffu - 500000;
+
+    std::vector<Sample> samples;
+    for (uint16_t v = startCounts; v >= endCounts; v--)
+    {
+        for (uint32_t j = 0; j < perCount; j++)
+        {
+            samples.push_back(makeSample(start_us + uint32_t(samples.size()) * dt_us, v, currentCounts));
+        }
+    }
+
+    test.start(3000000, 1, g_calibration);
+    feed(&test, samples);
+
+    // Every sample but the first stands for dt, at its own voltage
+    double n = double(samples.size() - 1);
+    double current_uA = Measurement::countsToMicroAmps(currentCounts);
+    double voltSum_uV = 0;
+    for (size_t i = 1; i < samples.size(); i++)
+    {
+        voltSum_uV += Measurement::countsToMicroVolts(samples[i].ain0);
+    }
+    double charge_uAh = current_uA * n * dt_us / 3.6e9;
+    double energy_uWh = current_uA * voltSum_uV / 1e6 * dt_us / 3.6e9;
+
+    BatteryTest::Result result;
+    test.result(&result);
+    TEST_ASSERT_EQUAL_INT(BatteryTest::BT_RUNNING, result.state);
+    TEST_ASSERT_EQUAL_UINT32(uint32_t(n * dt_us / 1000), result.elapsed_ms);
+    TEST_ASSERT_EQUAL_UINT32(0, result.gaps);
+    // Whole units only, the remainder is carried
+    TEST_ASSERT_INT32_WITHIN(1, int32_t(charge_uAh), int32_t(result.charge_uAh));
+    TEST_ASSERT_INT32_WITHIN(2, int32_t(energy_uWh), int32_t(result.energy_uWh));
+    TEST_ASSERT_EQUAL_INT32(Measurement::countsToMicroVolts(endCounts), result.lastVoltage_uV);
+    TEST_ASSERT_EQUAL(0, dacWrites());
+}
+
+void test_gaps_are_counted_not_integrated(void)
+{
+    MCP4726 dac(g_dacAddress);
+    BatteryTest test(&dac);
+
+    std::vector<Sample> samples;
+    uint32_t now_us = 0;
+    samples.push_back(makeSample(now_us, 500, 1340));
+    // Exactly the limit still counts as samples
+    now_us += 100000;
+    samples.push_back(makeSample(now_us, 500, 1340));
+    // Two stalls just past it
+    now_us += 100001;
+    samples.push_back(makeSample(now_us, 500, 1340));
+    now_us += 250000;
+    samples.push_back(makeSample(now_us, 500, 1340));
+    now_us += 50000;
+    samples.push_back(makeSample(now_us, 500, 1340));
+
+    test.start(3000000, 1, g_calibration);
+    feed(&test, samples, 1);
+
+    BatteryTest::Result result;
+    test.result(&result);
+    TEST_ASSERT_EQUAL_UINT32(2, result.gaps);
+    // The stalls still count as elapsed time
+    TEST_ASSERT_EQUAL_UINT32(now_us / 1000, result.elapsed_ms);
+
+    // Only the 150 ms that weren't gaps was integrated: 41 uAh at 1 A
+    double current_uA = Measurement::countsToMicroAmps(1340);
+    TEST_ASSERT_EQUAL_INT32(int32_t(current_uA * 150000 / 3.6e9), int32_t(result.charge_uAh));
+}
+
+void test_cut_load_once_at_cutoff(void)
+{
+    MCP4726 dac(g_dacAddress);
+    BatteryTest test(&dac);
+
+    const int32_t cutoff_uV = 3000000;
+    const uint16_t cutoffCounts = uint16_t(cutoff_uV / Measurement::g_voltagePerCount_uV);
+    test.start(cutoff_uV, 3, g_calibration);
+
+    std::vector<Sample> samples;
+    uint32_t now_us = 1000;
+    // At the cutoff isn't below it
+    for (int i = 0; i < 10; i++)
+    {
+        samples.push_back(makeSample(now_us += 1000, cutoffCounts, 1340));
+    }
+    // Two samples below don't confirm
+    samples.push_back(makeSample(now_us += 1000, cutoffCounts - 1, 1340));
+    samples.push_back(makeSample(now_us += 1000, cutoffCounts - 1, 1340));
+    samples.push_back(makeSample(now_us += 1000, cutoffCounts, 1340));
+    feed(&test, samples, 4);
+    TEST_ASSERT_EQUAL_INT(BatteryTest::BT_RUNNING, test.state());
+    TEST_ASSERT_EQUAL(0, dacWrites());
+
+    // The third in a row cuts the load, in the middle of a burst
+    samples.clear();
+    for (int i = 0; i < 8; i++)
+    {
+        samples.push_back(makeSample(now_us += 1000, cutoffCounts - 2, 1340));
+    }
+    uint32_t third_us = samples[2].timestamp_us;
+    fakeTimer_us() = third_us + 250;
+    feed(&test, samples, 8);
+
+    TEST_ASSERT_EQUAL_INT(BatteryTest::BT_CUTOFF, test.state());
+    TEST_ASSERT_TRUE(test.loadCut());
+    TEST_ASSERT_EQUAL(1, dacWrites());
+    TEST_ASSERT_EQUAL(2, Wire.transactions()[0].bytes.size());
+    TEST_ASSERT_EQUAL_UINT8(0x00, Wire.transactions()[0].bytes[0]);
+    TEST_ASSERT_EQUAL_UINT8(0x00, Wire.transactions()[0].bytes[1]);
+
+    BatteryTest::Result result;
+    test.result(&result);
+    TEST_ASSERT_EQUAL_UINT32(250, result.cutoffLatency_us);
+    // Nothing after the cut was taken in
+    TEST_ASSERT_EQUAL_UINT32((third_us - 2000) / 1000, result.elapsed_ms);
+
+    // Further samples below the cutoff, and finishing, write nothing more
+    feed(&test, samples, 3);
+    test.finish();
+    feed(&test, samples, 3);
+    TEST_ASSERT_EQUAL_INT(BatteryTest::BT_DONE, test.state());
+    TEST_ASSERT_EQUAL(1, dacWrites());
+    TEST_ASSERT_EQUAL_UINT32(1, dac.writesIssued() + dac.writesSuppressed());
+}
+
+void test_stopped_test_ignores_samples(void)
+{
+    MCP4726 dac(g_dacAddress);
+    BatteryTest test(&dac);
+
+    test.start(3000000, 1, g_calibration);
+    test.stop();
+
+    std::vector<Sample> samples;
+    samples.push_back(makeSample(1000, 100, 1340));
+    samples.push_back(makeSample(2000, 100, 1340));
+    feed(&test, samples);
+
+    BatteryTest::Result result;
+    test.result(&result);
+    TEST_ASSERT_EQUAL_INT(BatteryTest::BT_STOPPED, result.state);
+    TEST_ASSERT_EQUAL_UINT32(0, result.elapsed_ms);
+    TEST_ASSERT_EQUAL(0, dacWrites());
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_integrates_closed_form_discharge);
+    RUN_TEST(test_gaps_are_counted_not_integrated);
+    RUN_TEST(test_cut_load_once_at_cutoff);
+    RUN_TEST(test_stopped_test_ignores_samples);
+    return UNITY_END();
+}
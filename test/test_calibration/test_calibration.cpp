@@ -0,0 +1,256 @@
+#include <unity.h>
+#include <string.h>
+#include <math.h>
+
+#include "Calibration.hpp"
+
+// Voltage readings in uV against what a reference meter showed
+static const Calibration::Point g_points[] = {
+    {0, 1200},
+    {5000000, 5012000},
+    {10000000, 10030000},
+    {20000000, 19990000},
+    {30000000, 30050000},
+};
+static const size_t g_pointCount = sizeof(g_points) / sizeof(g_points[0]);
+
+static Calibration *g_cal;
+
+// Straight-line interpolation in double over the same table,
+// extrapolating from the end segments
+static double referenceApply(const Calibration::Point *points, size_t count, int32_t value)
+{
+    size_t seg = 0;
+    while ((seg + 2 < count) && (points[seg + 1].x <= value))
+    {
+        seg++;
+    }
+
+    const Calibration::Point &a = points[seg];
+    const Calibration::Point &b = points[seg + 1];
+    double slope = double(b.y - a.y) / double(b.x - a.x);
+
+    return a.y + (double(value) - a.x) * slope;
+}
+
+static void addTable(Calibration::Channel ch)
+{
+    // Out of order on purpose, the table keeps itself sorted
+    for (size_t i = g_pointCount; i > 0; i--)
+    {
+        TEST_ASSERT_TRUE(g_cal->addPoint(ch, g_points[i - 1].x, g_points[i - 1].y));
+    }
+}
+
+void setUp(void)
+{
+    g_cal = new Calibration();
+}
+
+void tearDown(void)
+{
+    delete g_cal;
+}
+
+void test_uncalibrated_is_identity(void)
+{
+    for (int ch = 0; ch < Calibration::CH_COUNT; ch++)
+    {
+        TEST_ASSERT_EQUAL_INT32(0, g_cal->apply(Calibration::Channel(ch), 0));
+        TEST_ASSERT_EQUAL_INT32(1234567, g_cal->apply(Calibration::Channel(ch), 1234567));
+        TEST_ASSERT_EQUAL_INT32(-1234567, g_cal->apply(Calibration::Channel(ch), -1234567));
+    }
+}
+
+void test_linear_gain_and_offset(void)
+{
+    // x1.5 + 100
+    g_cal->setLinear(Calibration::CH_LOAD_CURRENT, Calibration::g_unityGain_q16 * 3 / 2, 100);
+    TEST_ASSERT_EQUAL_INT32(100, g_cal->apply(Calibration::CH_LOAD_CURRENT, 0));
+    TEST_ASSERT_EQUAL_INT32(1500100, g_cal->apply(Calibration::CH_LOAD_CURRENT, 1000000));
+    TEST_ASSERT_EQUAL_INT32(1000000, g_cal->apply(Calibration::CH_LOAD_VOLTAGE, 1000000));
+}
+
+void test_single_point_sets_offset(void)
+{
+    TEST_ASSERT_TRUE(g_cal->addPoint(Calibration::CH_DAC_CURRENT, 500000, 498000));
+    TEST_ASSERT_EQUAL_INT32(-2000, g_cal->offset(Calibration::CH_DAC_CURRENT));
+    TEST_ASSERT_EQUAL_INT32(Calibration::g_unityGain_q16, g_cal->gain_q16(Calibration::CH_DAC_CURRENT));
+    TEST_ASSERT_EQUAL_INT32(498000, g_cal->apply(Calibration::CH_DAC_CURRENT, 500000));
+    TEST_ASSERT_EQUAL_INT32(998000, g_cal->apply(Calibration::CH_DAC_CURRENT, 1000000));
+}
+
+void test_table_is_sorted(void)
+{
+    addTable(Calibration::CH_LOAD_VOLTAGE);
+
+    TEST_ASSERT_EQUAL_UINT(g_pointCount, g_cal->pointCount(Calibration::CH_LOAD_VOLTAGE));
+    const Calibration::Point *points = g_cal->points(Calibration::CH_LOAD_VOLTAGE);
+    for (size_t i = 0; i < g_pointCount; i++)
+    {
+        TEST_ASSERT_EQUAL_INT32(g_points[i].x, points[i].x);
+        TEST_ASSERT_EQUAL_INT32(g_points[i].y, points[i].y);
+    }
+}
+
+void test_reference_points_are_exact(void)
+{
+    addTable(Calibration::CH_LOAD_VOLTAGE);
+
+    for (size_t i = 0; i < g_pointCount; i++)
+    {
+        TEST_ASSERT_EQUAL_INT32(g_points[i].y, g_cal->apply(Calibration::CH_LOAD_VOLTAGE, g_points[i].x));
+    }
+}
+
+void test_interpolation_matches_double(void)
+{
+    addTable(Calibration::CH_LOAD_VOLTAGE);
+
+    // Every 7.5 mV across the table and a volt past each end
+    for (int32_t value = -1000000; value <= 31000000; value += 7500)
+    {
+        double expected = referenceApply(g_points, g_pointCount, value);
+        TEST_ASSERT_INT32_WITHIN_MESSAGE(1, int32_t(expected),
+                                         g_cal->apply(Calibration::CH_LOAD_VOLTAGE, value),
+                                         "interpolated value");
+    }
+}
+
+void test_decreasing_segment(void)
+{
+    // An inverting channel, with one segment going down
+    static const Calibration::Point points[] = {
+        {-2000000, 3000000},
+        {0, 1000},
+        {1000000, -1500000},
+        {4000000, -1400000},
+    };
+    const size_t count = sizeof(points) / sizeof(points[0]);
+    for (size_t i = 0; i < count; i++)
+    {
+        TEST_ASSERT_TRUE(g_cal->addPoint(Calibration::CH_DAC_CURRENT, points[i].x, points[i].y));
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        TEST_ASSERT_EQUAL_INT32(points[i].y, g_cal->apply(Calibration::CH_DAC_CURRENT, points[i].x));
+    }
+    for (int32_t value = -3000000; value <= 5000000; value += 997)
+    {
+        double expected = referenceApply(points, count, value);
+        TEST_ASSERT_INT32_WITHIN_MESSAGE(1, int32_t(floor(expected)),
+                                         g_cal->apply(Calibration::CH_DAC_CURRENT, value),
+                                         "interpolated value");
+    }
+}
+
+void test_steep_segment_is_clamped(void)
+{
+    // A rise of more than 31 bits in one step is limited, not wrapped
+    TEST_ASSERT_TRUE(g_cal->addPoint(Calibration::CH_LOAD_CURRENT, 0, INT32_MIN + 1));
+    TEST_ASSERT_TRUE(g_cal->addPoint(Calibration::CH_LOAD_CURRENT, 2, INT32_MAX));
+
+    TEST_ASSERT_EQUAL_INT32(INT32_MIN + 1, g_cal->apply(Calibration::CH_LOAD_CURRENT, 0));
+    TEST_ASSERT_EQUAL_INT32(INT32_MAX, g_cal->apply(Calibration::CH_LOAD_CURRENT, 2));
+    int32_t middle = g_cal->apply(Calibration::CH_LOAD_CURRENT, 1);
+    TEST_ASSERT_TRUE(middle > INT32_MIN + 1);
+    TEST_ASSERT_TRUE(middle < 0);
+}
+
+void test_repeated_x_replaces_point(void)
+{
+    addTable(Calibration::CH_LOAD_VOLTAGE);
+    TEST_ASSERT_TRUE(g_cal->addPoint(Calibration::CH_LOAD_VOLTAGE, 10000000, 10000000));
+
+    TEST_ASSERT_EQUAL_UINT(g_pointCount, g_cal->pointCount(Calibration::CH_LOAD_VOLTAGE));
+    TEST_ASSERT_EQUAL_INT32(10000000, g_cal->apply(Calibration::CH_LOAD_VOLTAGE, 10000000));
+}
+
+void test_table_full(void)
+{
+    for (size_t i = 0; i < Calibration::g_maxPoints; i++)
+    {
+        TEST_ASSERT_TRUE(g_cal->addPoint(Calibration::CH_LOAD_CURRENT, int32_t(i) * 1000, int32_t(i) * 1001));
+    }
+
+    TEST_ASSERT_FALSE(g_cal->addPoint(Calibration::CH_LOAD_CURRENT, 1000000, 1000000));
+    TEST_ASSERT_EQUAL_UINT(Calibration::g_maxPoints, g_cal->pointCount(Calibration::CH_LOAD_CURRENT));
+}
+
+void test_store_restore_round_trip(void)
+{
+    addTable(Calibration::CH_LOAD_VOLTAGE);
+    g_cal->setLinear(Calibration::CH_LOAD_CURRENT, 70000, -250);
+
+    Calibration::Stored stored;
+    g_cal->store(&stored);
+
+    Calibration restored;
+    TEST_ASSERT_TRUE(restored.restore(stored));
+
+    for (int32_t value = -1000000; value <= 31000000; value += 99991)
+    {
+        for (int ch = 0; ch < Calibration::CH_COUNT; ch++)
+        {
+            TEST_ASSERT_EQUAL_INT32(g_cal->apply(Calibration::Channel(ch), value),
+                                    restored.apply(Calibration::Channel(ch), value));
+        }
+    }
+}
+
+void test_restore_rejects_bad_tables(void)
+{
+    addTable(Calibration::CH_LOAD_VOLTAGE);
+
+    Calibration::Stored stored;
+    g_cal->store(&stored);
+
+    Calibration::Stored unsorted = stored;
+    unsorted.channels[Calibration::CH_LOAD_VOLTAGE].points[2].x = 0;
+
+    Calibration::Stored oversized = stored;
+    oversized.channels[Calibration::CH_LOAD_CURRENT].count = Calibration::g_maxPoints + 1;
+
+    Calibration target;
+    target.setLinear(Calibration::CH_DAC_CURRENT, 70000, 5);
+    TEST_ASSERT_FALSE(target.restore(unsorted));
+    TEST_ASSERT_FALSE(target.restore(oversized));
+
+    // A rejected restore leaves everything as it was
+    TEST_ASSERT_EQUAL_UINT(0, target.pointCount(Calibration::CH_LOAD_VOLTAGE));
+    TEST_ASSERT_EQUAL_INT32(70000, target.gain_q16(Calibration::CH_DAC_CURRENT));
+    TEST_ASSERT_EQUAL_INT32(5, target.offset(Calibration::CH_DAC_CURRENT));
+}
+
+void test_channel_names(void)
+{
+    for (int ch = 0; ch < Calibration::CH_COUNT; ch++)
+    {
+        Calibration::Channel found;
+        TEST_ASSERT_TRUE(Calibration::channelFromName(Calibration::channelName(Calibration::Channel(ch)), &found));
+        TEST_ASSERT_EQUAL_INT(ch, found);
+    }
+
+    Calibration::Channel found;
+    TEST_ASSERT_FALSE(Calibration::channelFromName("x", &found));
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_uncalibrated_is_identity);
+    RUN_TEST(test_linear_gain_and_offset);
+    RUN_TEST(test_single_point_sets_offset);
+    RUN_TEST(test_table_is_sorted);
+    RUN_TEST(test_reference_points_are_exact);
+    RUN_TEST(test_interpolation_matches_double);
+    RUN_TEST(test_decreasing_segment);
+    RUN_TEST(test_steep_segment_is_clamped);
+    RUN_TEST(test_repeated_x_replaces_point);
+    RUN_TEST(test_table_full);
+    RUN_TEST(test_store_restore_round_trip);
+    RUN_TEST(test_restore_rejects_bad_tables);
+    RUN_TEST(test_channel_names);
+    return UNITY_END();
+}
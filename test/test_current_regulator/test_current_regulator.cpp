@@ -0,0 +1,203 @@
+#include <unity.h>
+#include <stdio.h>
+
+#include "CurrentRegulator.hpp"
+#include "Measurement.hpp"
+
+// The load as the control task sees it: a first-order response to
+// the DAC command with a gain error and an offset, measured through
+// the 12-bit ADC one period late
+class Plant
+{
+public:
+    Plant(double gain, double offset_uA)
+        : _gain(gain),
+          _offset_uA(offset_uA),
+          _current_uA(0) {}
+
+    void setOffset(double offset_uA) { _offset_uA = offset_uA; }
+
+    int32_t measure()
+    {
+        double counts = _current_uA * Measurement::g_currentDen / Measurement::g_currentNum;
+        if (counts < 0)
+        {
+            counts = 0;
+        }
+        if (counts > Measurement::g_maxCode)
+        {
+            counts = Measurement::g_maxCode;
+        }
+        return Measurement::countsToMicroAmps(uint16_t(counts + 0.5));
+    }
+
+    void step(int32_t command_uA)
+    {
+        double target_uA = (command_uA * _gain) + _offset_uA;
+        if (target_uA < 0)
+        {
+            target_uA = 0;
+        }
+        _current_uA += (target_uA - _current_uA) * 0.5;
+    }
+
+    double current_uA() const { return _current_uA; }
+
+private:
+    double _gain;
+    double _offset_uA;
+    double _current_uA;
+};
+
+// One ADC count of current
+static const int32_t g_lsb_uA = int32_t(Measurement::g_currentNum / Measurement::g_currentDen) + 1;
+
+static CurrentRegulator *g_regulator;
+
+// Runs the loop for a number of periods and returns the first period
+// after which the true current stayed within band of the setpoint,
+// or -1 if it never settled
+static int run(Plant *plant, int32_t setpoint_uA, int periods, double band_uA)
+{
+    int settled = -1;
+    for (int i = 0; i < periods; i++)
+    {
+        int32_t measured_uA = plant->measure();
+        plant->step(g_regulator->update(setpoint_uA, measured_uA));
+
+        double error_uA = plant->current_uA() - setpoint_uA;
+        bool inside = (error_uA <= band_uA) && (error_uA >= -band_uA);
+        if (!inside)
+        {
+            settled = -1;
+        }
+        else if (settled < 0)
+        {
+            settled = i + 1;
+        }
+    }
+
+    return settled;
+}
+
+void setUp(void)
+{
+    g_regulator = new CurrentRegulator();
+}
+
+void tearDown(void)
+{
+    delete g_regulator;
+}
+
+void test_step_response_settles(void)
+{
+    // 7% low with a 5 mA offset, the drift the loop is there for
+    Plant plant(0.93, 5000);
+
+    int settled = run(&plant, 1000000, 300, 2000);
+    TEST_ASSERT_GREATER_THAN(0, settled);
+    TEST_ASSERT_LESS_OR_EQUAL(120, settled);
+
+    char message[64];
+    snprintf(message, sizeof(message), "1 A step settled within 2 mA in %d periods", settled);
+    TEST_MESSAGE(message);
+}
+
+void test_steady_state_error_within_one_lsb(void)
+{
+    Plant plant(1.05, -12000);
+    run(&plant, 2000000, 300, 2000);
+
+    double sum_uA = 0;
+    for (int i = 0; i < 200; i++)
+    {
+        int32_t measured_uA = plant.measure();
+        plant.step(g_regulator->update(2000000, measured_uA));
+        sum_uA += plant.current_uA() - 2000000;
+
+        double error_uA = plant.current_uA() - 2000000;
+        TEST_ASSERT_TRUE(error_uA <= 2 * g_lsb_uA);
+        TEST_ASSERT_TRUE(error_uA >= -2 * g_lsb_uA);
+    }
+
+    double mean_uA = sum_uA / 200;
+    TEST_ASSERT_TRUE(mean_uA <= g_lsb_uA);
+    TEST_ASSERT_TRUE(mean_uA >= -g_lsb_uA);
+}
+
+void test_trim_clamp(void)
+{
+    // More drift than the trim may correct; it stops at the clamp
+    Plant plant(1.0, -300000);
+    run(&plant, 1000000, 500, 2000);
+
+    TEST_ASSERT_EQUAL_INT32(CurrentRegulator::g_defaultMaxTrim_uA, g_regulator->integral_uA());
+    // The remaining 100 mA is split with the proportional term,
+    // e = 100 mA - 0.2 e
+    TEST_ASSERT_INT32_WITHIN(g_lsb_uA, 1000000 - (100000 / 1.2), int32_t(plant.current_uA() + 0.5));
+
+    // Once the drift goes away nothing wound up past the clamp has
+    // to unwind first
+    plant.setOffset(0);
+    int settled = run(&plant, 1000000, 300, 2000);
+    TEST_ASSERT_GREATER_THAN(0, settled);
+    TEST_ASSERT_LESS_OR_EQUAL(120, settled);
+}
+
+void test_no_windup_at_full_scale(void)
+{
+    // Asking for full scale from a load that is 10% low saturates
+    // the command; the integrator must not keep growing
+    Plant plant(0.9, 0);
+    g_regulator->setLimits(3000000, CurrentRegulator::g_defaultMaxTrim_uA);
+
+    run(&plant, 3000000, 20, 2000);
+    int32_t integral_uA = g_regulator->integral_uA();
+    run(&plant, 3000000, 500, 2000);
+    TEST_ASSERT_EQUAL_INT32(integral_uA, g_regulator->integral_uA());
+    TEST_ASSERT_LESS_OR_EQUAL(CurrentRegulator::g_defaultMaxTrim_uA, g_regulator->integral_uA());
+
+    // And it comes straight back down when asked for less
+    int settled = run(&plant, 1000000, 300, 2000);
+    TEST_ASSERT_GREATER_THAN(0, settled);
+    TEST_ASSERT_LESS_OR_EQUAL(120, settled);
+}
+
+void test_no_windup_at_zero(void)
+{
+    // An offset that holds current on with the command at zero
+    Plant plant(1.0, 50000);
+    run(&plant, 0, 50, 2000);
+    int32_t integral_uA = g_regulator->integral_uA();
+    run(&plant, 0, 500, 2000);
+    TEST_ASSERT_EQUAL_INT32(integral_uA, g_regulator->integral_uA());
+
+    TEST_ASSERT_EQUAL_INT32(0, g_regulator->update(0, 50000));
+}
+
+void test_reset(void)
+{
+    Plant plant(0.93, 5000);
+    run(&plant, 1000000, 100, 2000);
+    TEST_ASSERT_TRUE(g_regulator->integral_uA() != 0);
+
+    g_regulator->reset();
+    TEST_ASSERT_EQUAL_INT32(0, g_regulator->integral_uA());
+    TEST_ASSERT_EQUAL_INT32(0, g_regulator->lastError_uA());
+
+    // With nothing integrated the command is the setpoint plus P
+    TEST_ASSERT_EQUAL_INT32(1000000, g_regulator->update(1000000, 1000000));
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_step_response_settles);
+    RUN_TEST(test_steady_state_error_within_one_lsb);
+    RUN_TEST(test_trim_clamp);
+    RUN_TEST(test_no_windup_at_full_scale);
+    RUN_TEST(test_no_windup_at_zero);
+    RUN_TEST(test_reset);
+    return UNITY_END();
+}
@@ -0,0 +1,237 @@
+#include <unity.h>
+#include <Arduino.h>
+#include <Wire.h>
+#include <esp_timer.h>
+#include <vector>
+
+#include "DynamicLoad.hpp"
+
+static const uint8_t g_dacAddress = 0x60;
+
+static Calibration g_calibration;
+
+// One stepper task for the whole suite, as on the device
+static MCP4726 g_dac(g_dacAddress);
+static DacSequencer g_sequencer(&g_dac);
+
+// Runs every timer due by until_us, letting the stepper task finish
+// with each expiry before the clock moves on
+static void runUntil(int64_t until_us)
+{
+    while (fakeTimerFireNext(until_us))
+    {
+        fakeTasksSettle();
+    }
+}
+
+// The DAC writes that reached the bus
+static std::vector<TwoWire::Transaction> dacWrites()
+{
+    std::vector<TwoWire::Transaction> writes;
+    for (size_t i = 0; i < Wire.transactions().size(); i++)
+    {
+        if (Wire.transactions()[i].address == g_dacAddress)
+        {
+            writes.push_back(Wire.transactions()[i]);
+        }
+    }
+    return writes;
+}
+
+static void assertFrame(const MCP4726::Frame &expected, const TwoWire::Transaction &write)
+{
+    TEST_ASSERT_EQUAL(2, write.bytes.size());
+    TEST_ASSERT_EQUAL_UINT8(expected.bytes[0], write.bytes[0]);
+    TEST_ASSERT_EQUAL_UINT8(expected.bytes[1], write.bytes[1]);
+}
+
+static DynamicLoad::Config makeConfig(int32_t high_uA, int32_t low_uA, int32_t frequency_Hz, int32_t duty_pct)
+{
+    DynamicLoad::Config config;
+    config.high_uA = high_uA;
+    config.low_uA = low_uA;
+    config.frequency_Hz = frequency_Hz;
+    config.duty_pct = duty_pct;
+    return config;
+}
+
+// Asserts the edges of a 2-level square wave starting at t0
+static void assertSquareWave(int64_t t0, uint32_t high_us, uint32_t low_us, size_t periods)
+{
+    MCP4726::Frame high = DynamicLoad::encodeCurrent(2000000, g_calibration);
+    MCP4726::Frame low = DynamicLoad::encodeCurrent(500000, g_calibration);
+
+    std::vector<TwoWire::Transaction> writes = dacWrites();
+    TEST_ASSERT_EQUAL(2 * periods, writes.size());
+
+    int64_t edge_us = t0 + 500;
+    for (size_t i = 0; i < writes.size(); i++)
+    {
+        assertFrame((i % 2) == 0 ? high : low, writes[i]);
+        TEST_ASSERT_EQUAL_INT64(edge_us, writes[i].time_us);
+        edge_us += (i % 2) == 0 ? high_us : low_us;
+    }
+}
+
+void setUp(void)
+{
+    g_sequencer.stop();
+    fakeTasksSettle();
+    g_sequencer.resetStats();
+    g_dac.invalidate();
+    Wire.reset();
+}
+
+void tearDown(void)
+{
+}
+
+void test_fill_splits_long_dwells(void)
+{
+    MCP4726::Frame frame = MCP4726::encodeDAC(1234);
+    DacSequencer::Step steps[8];
+
+    // 1.5 s is two full steps and the rest
+    TEST_ASSERT_EQUAL(3, DacSequencer::fill(steps, 8, frame, 1500000));
+    TEST_ASSERT_EQUAL_UINT16(65535, steps[0].dwell_10us);
+    TEST_ASSERT_EQUAL_UINT16(65535, steps[1].dwell_10us);
+    TEST_ASSERT_EQUAL_UINT16(18930, steps[2].dwell_10us);
+    for (int i = 0; i < 3; i++)
+    {
+        TEST_ASSERT_EQUAL_UINT8(frame.bytes[0], steps[i].frame.bytes[0]);
+        TEST_ASSERT_EQUAL_UINT8(frame.bytes[1], steps[i].frame.bytes[1]);
+    }
+
+    // Exactly one step's worth, and a remainder too short to time
+    TEST_ASSERT_EQUAL(1, DacSequencer::fill(steps, 8, frame, DacSequencer::g_maxStepDwell_us));
+    TEST_ASSERT_EQUAL(1, DacSequencer::fill(steps, 8, frame, DacSequencer::g_maxStepDwell_us + 9));
+    TEST_ASSERT_EQUAL(2, DacSequencer::fill(steps, 8, frame, DacSequencer::g_maxStepDwell_us + 10));
+    TEST_ASSERT_EQUAL_UINT16(1, steps[1].dwell_10us);
+
+    // Never past the room given, nor anything for no time
+    TEST_ASSERT_EQUAL(2, DacSequencer::fill(steps, 2, frame, 2000000));
+    TEST_ASSERT_EQUAL(0, DacSequencer::fill(steps, 8, frame, 0));
+}
+
+void test_rejects_frequencies_out_of_range(void)
+{
+    DynamicLoad load(&g_sequencer);
+
+    TEST_ASSERT_FALSE(load.start(makeConfig(2000000, 500000, 0, 50), g_calibration));
+    TEST_ASSERT_FALSE(load.start(makeConfig(2000000, 500000, -1, 50), g_calibration));
+    TEST_ASSERT_FALSE(load.start(makeConfig(2000000, 500000, DynamicLoad::g_maxFrequency_Hz + 1, 50), g_calibration));
+    fakeTasksSettle();
+    TEST_ASSERT_FALSE(load.running());
+    TEST_ASSERT_FALSE(g_sequencer.running());
+
+    TEST_ASSERT_TRUE(load.start(makeConfig(2000000, 500000, DynamicLoad::g_maxFrequency_Hz, 50), g_calibration));
+    fakeTasksSettle();
+    TEST_ASSERT_TRUE(load.running());
+    TEST_ASSERT_EQUAL_UINT32(200, load.period_us());
+    load.stop();
+}
+
+void test_plays_square_wave_on_time(void)
+{
+    DynamicLoad load(&g_sequencer);
+
+    int64_t t0 = fakeTimer_us();
+    TEST_ASSERT_TRUE(load.start(makeConfig(2000000, 500000, 100, 25), g_calibration));
+    fakeTasksSettle();
+    TEST_ASSERT_EQUAL_UINT32(10000, load.period_us());
+
+    // Up to just before the 11th period's first edge
+    runUntil(t0 + 500 + (10 * 10000) - 1);
+    assertSquareWave(t0, 2500, 7500, 10);
+    TEST_ASSERT_TRUE(load.running());
+    TEST_ASSERT_EQUAL_UINT32(20, g_sequencer.stepsPlayed());
+    TEST_ASSERT_EQUAL_UINT32(20, g_sequencer.writesIssued());
+    TEST_ASSERT_EQUAL_UINT32(0, g_sequencer.missedSteps());
+    TEST_ASSERT_EQUAL_UINT32(0, g_sequencer.maxLate_us());
+
+    // Nothing reaches the DAC once stopped
+    load.stop();
+    fakeTasksSettle();
+    TEST_ASSERT_FALSE(load.running());
+    runUntil(fakeTimer_us() + 100000);
+    TEST_ASSERT_EQUAL(20, dacWrites().size());
+}
+
+void test_halves_never_shorter_than_min_dwell(void)
+{
+    DynamicLoad load(&g_sequencer);
+
+    // Either half of a 5 kHz wave at 1% or 99% would be 2 us
+    int32_t duties[] = {1, 99};
+    for (int i = 0; i < 2; i++)
+    {
+        Wire.reset();
+        g_dac.invalidate();
+
+        int64_t t0 = fakeTimer_us();
+        TEST_ASSERT_TRUE(load.start(makeConfig(2000000, 500000, 5000, duties[i]), g_calibration));
+        fakeTasksSettle();
+        runUntil(t0 + 500 + (5 * 200) - 1);
+        assertSquareWave(t0, 100, 100, 5);
+        load.stop();
+        fakeTasksSettle();
+    }
+
+    // At 1 kHz only the short half is stretched
+    Wire.reset();
+    g_dac.invalidate();
+    int64_t t0 = fakeTimer_us();
+    TEST_ASSERT_TRUE(load.start(makeConfig(2000000, 500000, 1000, 1), g_calibration));
+    fakeTasksSettle();
+    runUntil(t0 + 500 + (3 * 1000) - 1);
+    assertSquareWave(t0, DynamicLoad::g_minDwell_us, 1000 - DynamicLoad::g_minDwell_us, 3);
+    load.stop();
+}
+
+void test_long_half_is_split_without_extra_writes(void)
+{
+    DynamicLoad load(&g_sequencer);
+
+    // 900 ms high is longer than one step can hold
+    int64_t t0 = fakeTimer_us();
+    TEST_ASSERT_TRUE(load.start(makeConfig(2000000, 500000, 1, 90), g_calibration));
+    fakeTasksSettle();
+    runUntil(t0 + 500 + (2 * 1000000) - 1);
+    assertSquareWave(t0, 900000, 100000, 2);
+    TEST_ASSERT_EQUAL_UINT32(6, g_sequencer.stepsPlayed());
+    TEST_ASSERT_EQUAL_UINT32(4, g_sequencer.writesIssued());
+    load.stop();
+}
+
+void test_stop_leaves_other_users_alone(void)
+{
+    DynamicLoad load(&g_sequencer);
+    DynamicLoad other(&g_sequencer);
+
+    TEST_ASSERT_TRUE(load.start(makeConfig(2000000, 500000, 100, 50), g_calibration));
+    fakeTasksSettle();
+
+    // Never started, so it mustn't stop the one that was
+    other.stop();
+    fakeTasksSettle();
+    TEST_ASSERT_TRUE(load.running());
+    TEST_ASSERT_FALSE(other.running());
+
+    load.stop();
+    fakeTasksSettle();
+    TEST_ASSERT_FALSE(g_sequencer.running());
+}
+
+int main(int argc, char **argv)
+{
+    g_sequencer.init();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_fill_splits_long_dwells);
+    RUN_TEST(test_rejects_frequencies_out_of_range);
+    RUN_TEST(test_plays_square_wave_on_time);
+    RUN_TEST(test_halves_never_shorter_than_min_dwell);
+    RUN_TEST(test_long_half_is_split_without_extra_writes);
+    RUN_TEST(test_stop_leaves_other_users_alone);
+    return UNITY_END();
+}
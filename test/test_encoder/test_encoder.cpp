@@ -0,0 +1,372 @@
+#include <unity.h>
+#include <stdio.h>
+#include <vector>
+#include <driver/pcnt.h>
+
+#include "EncoderPcnt.hpp"
+
+// RotaryEncoder's PCNT backend against the fake counter. The event
+// task is modelled as taking the counts a fixed latency after the
+// wake interrupt notifies it.
+static const int g_aPin = 32;
+static const int g_bPin = 33;
+
+// APB cycles
+static const uint64_t g_us = 80;
+static const uint64_t g_taskLatency = 500 * g_us;
+// The software backend's debounce, during which A is detached
+static const uint64_t g_softwareDebounce = 250 * g_us;
+
+class PcntBackend
+{
+public:
+    PcntBackend(bool invert = false)
+        : _pcnt(g_aPin, g_bPin, invert),
+          _notified(false),
+          _takeAt(0),
+          _position(0),
+          _wakeups(0) {}
+
+    void begin()
+    {
+        TEST_ASSERT_TRUE(_pcnt.begin(&PcntBackend::_handler, this));
+    }
+
+    // Runs the event task for any wake-up due by the given time
+    void runUntil(uint64_t time)
+    {
+        while (_notified && (_takeAt <= time))
+        {
+            FakePcnt::advance(_takeAt);
+            _notified = false;
+            _wakeups++;
+
+            _position += _pcnt.take();
+        }
+    }
+
+    int position() const { return _position; }
+    uint32_t wakeups() const { return _wakeups; }
+
+private:
+    static void _handler(void *arg)
+    {
+        PcntBackend *backend = (PcntBackend *)arg;
+        if (!backend->_notified)
+        {
+            backend->_notified = true;
+            backend->_takeAt = FakePcnt::state().now + g_taskLatency;
+        }
+    }
+
+private:
+    EncoderPcnt _pcnt;
+    bool _notified;
+    uint64_t _takeAt;
+    int _position;
+    uint32_t _wakeups;
+};
+
+struct Edge
+{
+    uint64_t time;
+    int gpio;
+    int level;
+};
+
+// A quadrature knob with contact bounce. At rest A is high and B low;
+// a detent up is A falls, B rises, A rises, B falls.
+class Knob
+{
+public:
+    Knob()
+        : _time(1000 * g_us),
+          _a(1),
+          _b(0),
+          _position(0),
+          _random(2024),
+          _longBounces(false) {}
+
+    void setLongBounces(bool longBounces) { _longBounces = longBounces; }
+
+    void detent(int direction, uint64_t interval)
+    {
+        if (direction > 0)
+        {
+            _set(g_aPin, 0, interval);
+            _set(g_bPin, 1, interval);
+            _set(g_aPin, 1, interval);
+            _set(g_bPin, 0, interval);
+        }
+        else
+        {
+            _set(g_bPin, 1, interval);
+            _set(g_aPin, 0, interval);
+            _set(g_bPin, 0, interval);
+            _set(g_aPin, 1, interval);
+        }
+        _position += direction;
+    }
+
+    // Half way to the next detent and back again
+    void wobble(int direction, uint64_t interval)
+    {
+        int pin = direction > 0 ? g_aPin : g_bPin;
+        int level = direction > 0 ? 0 : 1;
+        _set(pin, level, interval);
+        _set(pin, !level, interval);
+    }
+
+    uint32_t random(uint32_t range)
+    {
+        _random = _random * 1664525u + 1013904223u;
+        return (_random >> 8) % range;
+    }
+
+    const std::vector<Edge> &edges() const { return _edges; }
+    int position() const { return _position; }
+    uint64_t time() const { return _time; }
+
+private:
+    void _set(int gpio, int level, uint64_t interval)
+    {
+        // A few short glitches, which the filter should swallow, and
+        // now and then one on A long enough to get through
+        int glitches = int(random(4));
+        for (int i = 0; i < glitches; i++)
+        {
+            _push(gpio, level);
+            _time += (1 + random(8)) * g_us;
+            _push(gpio, !level);
+            _time += (1 + random(4)) * g_us;
+        }
+        if (_longBounces && (gpio == g_aPin) && (random(8) == 0))
+        {
+            _push(gpio, level);
+            _time += 20 * g_us;
+            _push(gpio, !level);
+            _time += 20 * g_us;
+        }
+        _push(gpio, level);
+        _time += interval;
+    }
+
+    void _push(int gpio, int level)
+    {
+        Edge edge = {_time, gpio, level};
+        _edges.push_back(edge);
+        if (gpio == g_aPin)
+        {
+            _a = level;
+        }
+        else
+        {
+            _b = level;
+        }
+    }
+
+private:
+    uint64_t _time;
+    int _a;
+    int _b;
+    int _position;
+    uint32_t _random;
+    bool _longBounces;
+    std::vector<Edge> _edges;
+};
+
+// Interrupts the software backend would take for the same waveform:
+// every falling edge of A while it is attached, and it is detached
+// for the debounce time after each one. Each entry also costs a
+// debounce timer callback.
+static uint32_t softwareIsrEntries(const std::vector<Edge> &edges)
+{
+    uint32_t entries = 0;
+    int a = 1;
+    uint64_t detachedUntil = 0;
+    for (size_t i = 0; i < edges.size(); i++)
+    {
+        if (edges[i].gpio != g_aPin)
+        {
+            continue;
+        }
+        if ((a == 1) && (edges[i].level == 0) && (edges[i].time >= detachedUntil))
+        {
+            entries++;
+            detachedUntil = edges[i].time + g_softwareDebounce;
+        }
+        a = edges[i].level;
+    }
+
+    return entries;
+}
+
+// Plays the knob into the fake counter and returns the detents the
+// backend saw, with no extra reads after the last wake-up
+static int play(PcntBackend *backend, const Knob &knob)
+{
+    const std::vector<Edge> &edges = knob.edges();
+    for (size_t i = 0; i < edges.size(); i++)
+    {
+        backend->runUntil(edges[i].time);
+        FakePcnt::input(edges[i].gpio, edges[i].level, edges[i].time);
+    }
+
+    uint64_t end = knob.time() + 1000 * 1000 * g_us;
+    FakePcnt::advance(end);
+    backend->runUntil(end);
+
+    return backend->position();
+}
+
+static void report(const char *name, const Knob &knob)
+{
+    char message[160];
+    snprintf(message, sizeof(message),
+             "%s: %d detents, pcnt %u wake interrupts, software %u ISR entries + %u callbacks",
+             name, knob.position(), (unsigned)FakePcnt::interrupts(),
+             (unsigned)softwareIsrEntries(knob.edges()),
+             (unsigned)softwareIsrEntries(knob.edges()));
+    TEST_MESSAGE(message);
+}
+
+void setUp(void)
+{
+    // At rest A is high and B low; unused inputs idle high
+    FakePcnt::reset(1);
+    FakePcnt::state().levels[g_bPin] = 0;
+}
+
+void tearDown(void)
+{
+}
+
+void test_single_detents(void)
+{
+    PcntBackend backend;
+    backend.begin();
+
+    Knob knob;
+    knob.detent(1, 50000 * g_us);
+    TEST_ASSERT_EQUAL_INT(1, play(&backend, knob));
+
+    knob.detent(-1, 50000 * g_us);
+    knob.detent(-1, 50000 * g_us);
+    setUp();
+    PcntBackend again;
+    again.begin();
+    TEST_ASSERT_EQUAL_INT(-1, play(&again, knob));
+}
+
+void test_slow_turns_with_bounce(void)
+{
+    PcntBackend backend;
+    backend.begin();
+
+    Knob knob;
+    for (int i = 0; i < 3000; i++)
+    {
+        int direction = knob.random(3) == 0 ? -1 : 1;
+        uint64_t interval = (2000 + knob.random(20000)) * g_us;
+        if (knob.random(10) == 0)
+        {
+            knob.wobble(direction, interval);
+        }
+        knob.detent(direction, interval);
+    }
+
+    TEST_ASSERT_EQUAL_INT(knob.position(), play(&backend, knob));
+    TEST_ASSERT_LESS_OR_EQUAL(2 * softwareIsrEntries(knob.edges()), FakePcnt::interrupts());
+    report("slow", knob);
+}
+
+void test_long_bounces_cancel(void)
+{
+    PcntBackend backend;
+    backend.begin();
+
+    Knob knob;
+    knob.setLongBounces(true);
+    for (int i = 0; i < 2000; i++)
+    {
+        knob.detent(knob.random(2) ? 1 : -1, (1000 + knob.random(5000)) * g_us);
+    }
+
+    TEST_ASSERT_EQUAL_INT(knob.position(), play(&backend, knob));
+}
+
+void test_fast_spin_wraps_counter(void)
+{
+    PcntBackend backend;
+    backend.begin();
+
+    // About 80000 counts up, past the counter's limit, then most of
+    // the way back down
+    Knob knob;
+    for (int i = 0; i < 40000; i++)
+    {
+        knob.detent(1, 100 * g_us);
+    }
+    for (int i = 0; i < 30000; i++)
+    {
+        knob.detent(-1, 100 * g_us);
+    }
+
+    TEST_ASSERT_EQUAL_INT(10000, play(&backend, knob));
+    TEST_ASSERT_LESS_OR_EQUAL(2 * softwareIsrEntries(knob.edges()), FakePcnt::interrupts());
+    report("fast", knob);
+}
+
+void test_count_unit_is_never_cleared(void)
+{
+    PcntBackend backend;
+    backend.begin();
+
+    Knob knob;
+    for (int i = 0; i < 5; i++)
+    {
+        knob.detent(1, 50000 * g_us);
+    }
+
+    TEST_ASSERT_EQUAL_INT(5, play(&backend, knob));
+    TEST_ASSERT_EQUAL_INT(5 * EncoderPcnt::g_countsPerDetent, FakePcnt::count(EncoderPcnt::g_countUnit));
+    // Turned slowly, every edge of A wakes the task once
+    TEST_ASSERT_EQUAL_UINT32(5 * EncoderPcnt::g_countsPerDetent, backend.wakeups());
+}
+
+void test_inverted_knob(void)
+{
+    PcntBackend backend(true);
+    backend.begin();
+
+    Knob knob;
+    for (int i = 0; i < 3; i++)
+    {
+        knob.detent(1, 50000 * g_us);
+    }
+
+    TEST_ASSERT_EQUAL_INT(-3, play(&backend, knob));
+}
+
+void test_begins_once(void)
+{
+    // The interrupt service can only be installed once
+    PcntBackend backend;
+    backend.begin();
+
+    EncoderPcnt again(g_aPin, g_bPin, false);
+    TEST_ASSERT_FALSE(again.begin(0, 0));
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_single_detents);
+    RUN_TEST(test_slow_turns_with_bounce);
+    RUN_TEST(test_long_bounces_cancel);
+    RUN_TEST(test_fast_spin_wraps_counter);
+    RUN_TEST(test_count_unit_is_never_cleared);
+    RUN_TEST(test_inverted_knob);
+    RUN_TEST(test_begins_once);
+    return UNITY_END();
+}
@@ -0,0 +1,163 @@
+#include <unity.h>
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+
+#include "FixedFormat.hpp"
+
+// What printf makes of the same field, or the '#' fill when it
+// doesn't fit the width
+static void reference(char *buf, int32_t value, int intDigits, int fracDigits,
+                      FixedFormat::Padding padding)
+{
+    int width = int(FixedFormat::width(intDigits, fracDigits));
+    double number = double(value) / FixedFormat::pow10(fracDigits);
+    char text[32];
+    if (padding == FixedFormat::PAD_ZERO)
+    {
+        snprintf(text, sizeof(text), "%0*.*f", width, fracDigits, number);
+    }
+    else
+    {
+        snprintf(text, sizeof(text), "%*.*f", width, fracDigits, number);
+    }
+
+    if (int(strlen(text)) > width)
+    {
+        memset(text, '#', width);
+        text[width] = '\0';
+    }
+    strcpy(buf, text);
+}
+
+static void checkRange(int intDigits, int fracDigits, FixedFormat::Padding padding,
+                       int32_t from, int32_t to, int32_t step)
+{
+    char expected[32];
+    char actual[32];
+    for (int64_t value = from; value <= to; value += step)
+    {
+        reference(expected, int32_t(value), intDigits, fracDigits, padding);
+        size_t len = FixedFormat::format(actual, int32_t(value), intDigits, fracDigits, padding);
+        TEST_ASSERT_EQUAL_STRING(expected, actual);
+        TEST_ASSERT_EQUAL_UINT(FixedFormat::width(intDigits, fracDigits), len);
+    }
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+void test_matches_printf(void)
+{
+    checkRange(2, 3, FixedFormat::PAD_SPACE, -120000, 120000, 7);
+    checkRange(1, 4, FixedFormat::PAD_SPACE, -30000, 30000, 1);
+    checkRange(4, 1, FixedFormat::PAD_SPACE, -120000, 120000, 3);
+    checkRange(3, 0, FixedFormat::PAD_SPACE, -1200, 1200, 1);
+    checkRange(2, 3, FixedFormat::PAD_ZERO, -120000, 120000, 7);
+    checkRange(3, 0, FixedFormat::PAD_ZERO, -1200, 1200, 1);
+}
+
+void test_extremes(void)
+{
+    checkRange(9, 0, FixedFormat::PAD_SPACE, INT32_MIN + 1, INT32_MIN + 1, 1);
+    checkRange(9, 0, FixedFormat::PAD_SPACE, INT32_MAX, INT32_MAX, 1);
+    checkRange(10, 0, FixedFormat::PAD_SPACE, INT32_MAX, INT32_MAX, 1);
+    checkRange(2, 8, FixedFormat::PAD_SPACE, INT32_MAX, INT32_MAX, 1);
+
+    char buf[32];
+    FixedFormat::format(buf, INT32_MIN, 10, 0);
+    TEST_ASSERT_EQUAL_STRING("##########", buf);
+    FixedFormat::format(buf, INT32_MIN, 11, 0);
+    TEST_ASSERT_EQUAL_STRING("-2147483648", buf);
+}
+
+void test_scaled_rounds_half_away_from_zero(void)
+{
+    char buf[32];
+    FixedFormat::formatScaled(buf, 1234500, 1000000, 2, 3);
+    TEST_ASSERT_EQUAL_STRING(" 1.235", buf);
+    FixedFormat::formatScaled(buf, 1234499, 1000000, 2, 3);
+    TEST_ASSERT_EQUAL_STRING(" 1.234", buf);
+    FixedFormat::formatScaled(buf, -1234500, 1000000, 2, 3);
+    TEST_ASSERT_EQUAL_STRING("-1.235", buf);
+    FixedFormat::formatScaled(buf, -499, 1000000, 2, 3);
+    TEST_ASSERT_EQUAL_STRING(" 0.000", buf);
+
+    // More digits than the scale has
+    FixedFormat::formatScaled(buf, 12, 10, 2, 3);
+    TEST_ASSERT_EQUAL_STRING(" 1.200", buf);
+}
+
+void test_engineering_keeps_its_width(void)
+{
+    char buf[32];
+
+    Fixed<2, 3>::engineering(buf, 12345678, "V");
+    TEST_ASSERT_EQUAL_STRING("12.346 V ", buf);
+    Fixed<2, 3>::engineering(buf, 999000, "V");
+    TEST_ASSERT_EQUAL_STRING("   999 mV", buf);
+    Fixed<1, 4>::engineering(buf, 1500000, "A");
+    TEST_ASSERT_EQUAL_STRING("1.5000 A ", buf);
+    Fixed<1, 4>::engineering(buf, 12345, "A");
+    TEST_ASSERT_EQUAL_STRING("  12.3 mA", buf);
+
+    const size_t size = Fixed<2, 3>::g_engineeringSize + strlen("V");
+    size_t width = 0;
+    for (int32_t value = -99999000; value <= 99999000; value += 1237)
+    {
+        size_t len = Fixed<2, 3>::engineering(buf, value, "V");
+        if (width == 0)
+        {
+            width = len;
+        }
+        TEST_ASSERT_EQUAL_UINT(width, len);
+        TEST_ASSERT_EQUAL_UINT(len, strlen(buf));
+        // Fits the documented buffer, unit and terminator included
+        TEST_ASSERT_LESS_OR_EQUAL(size, len + 1);
+    }
+}
+
+void test_host_timing(void)
+{
+    // Host timings only show the relative cost; the firmware's own
+    // "ui" figures are what count on the device
+    const int rounds = 200000;
+    char buf[32];
+    volatile size_t sink = 0;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; i++)
+    {
+        sink += Fixed<1, 4>::engineering(buf, 1234567 + i, "A");
+    }
+    std::chrono::steady_clock::time_point middle = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; i++)
+    {
+        sink += snprintf(buf, sizeof(buf), "%6.4f A", (1234567 + i) / 1e6);
+    }
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+    double fixed_ns = std::chrono::duration<double, std::nano>(middle - start).count() / rounds;
+    double printf_ns = std::chrono::duration<double, std::nano>(end - middle).count() / rounds;
+
+    char message[96];
+    snprintf(message, sizeof(message), "current readout: Fixed %.0f ns, snprintf %.0f ns", fixed_ns, printf_ns);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_GREATER_THAN(0, sink);
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_matches_printf);
+    RUN_TEST(test_extremes);
+    RUN_TEST(test_scaled_rounds_half_away_from_zero);
+    RUN_TEST(test_engineering_keeps_its_width);
+    RUN_TEST(test_host_timing);
+    return UNITY_END();
+}
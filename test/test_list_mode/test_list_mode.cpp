@@ -0,0 +1,318 @@
+#include <unity.h>
+#include <Arduino.h>
+#include <Preferences.h>
+#include <Wire.h>
+#include <esp_timer.h>
+#include <vector>
+
+#include "DynamicLoad.hpp"
+#include "ListMode.hpp"
+
+static const uint8_t g_dacAddress = 0x60;
+
+static Calibration g_calibration;
+
+// One stepper task for the whole suite, as on the device
+static MCP4726 g_dac(g_dacAddress);
+static DacSequencer g_sequencer(&g_dac);
+
+// Runs every timer due by until_us, letting the stepper task finish
+// with each expiry before the clock moves on
+static void runUntil(int64_t until_us)
+{
+    while (fakeTimerFireNext(until_us))
+    {
+        fakeTasksSettle();
+    }
+}
+
+// The DAC writes that reached the bus
+static std::vector<TwoWire::Transaction> dacWrites()
+{
+    std::vector<TwoWire::Transaction> writes;
+    for (size_t i = 0; i < Wire.transactions().size(); i++)
+    {
+        if (Wire.transactions()[i].address == g_dacAddress)
+        {
+            writes.push_back(Wire.transactions()[i]);
+        }
+    }
+    return writes;
+}
+
+// Plays the compiled table once to the end and checks each write
+// against the currents expected and when they were due
+static void assertPlays(ListMode *list, const int32_t *currents_uA, const uint32_t *dwells_us, size_t count)
+{
+    int64_t t0 = fakeTimer_us();
+    TEST_ASSERT_TRUE(list->start(false));
+    fakeTasksSettle();
+    runUntil(t0 + 500 + int64_t(list->tableDuration_us()) + 1000);
+    TEST_ASSERT_TRUE(list->finished());
+
+    std::vector<TwoWire::Transaction> writes = dacWrites();
+    TEST_ASSERT_EQUAL(count, writes.size());
+
+    int64_t due_us = t0 + 500;
+    for (size_t i = 0; i < count; i++)
+    {
+        MCP4726::Frame frame = DynamicLoad::encodeCurrent(currents_uA[i], g_calibration);
+        TEST_ASSERT_EQUAL(2, writes[i].bytes.size());
+        TEST_ASSERT_EQUAL_UINT8(frame.bytes[0], writes[i].bytes[0]);
+        TEST_ASSERT_EQUAL_UINT8(frame.bytes[1], writes[i].bytes[1]);
+        TEST_ASSERT_EQUAL_INT64(due_us, writes[i].time_us);
+        due_us += dwells_us[i];
+    }
+}
+
+void setUp(void)
+{
+    g_sequencer.stop();
+    fakeTasksSettle();
+    g_sequencer.resetStats();
+    g_dac.invalidate();
+    Wire.reset();
+}
+
+void tearDown(void)
+{
+}
+
+void test_compiles_ramp(void)
+{
+    ListMode list(&g_sequencer);
+
+    TEST_ASSERT_TRUE(list.setRamp(0, 1000000, 5, 1000));
+    TEST_ASSERT_TRUE(list.compile(g_calibration));
+    TEST_ASSERT_EQUAL(5, list.tableSize());
+    TEST_ASSERT_EQUAL_UINT64(5000, list.tableDuration_us());
+
+    int32_t currents_uA[] = {0, 250000, 500000, 750000, 1000000};
+    uint32_t dwells_us[] = {1000, 1000, 1000, 1000, 1000};
+    assertPlays(&list, currents_uA, dwells_us, 5);
+}
+
+void test_compiles_staircase_up_and_back_down(void)
+{
+    ListMode list(&g_sequencer);
+
+    TEST_ASSERT_TRUE(list.setStaircase(100000, 100000, 3, 2000));
+    TEST_ASSERT_EQUAL_INT32(300000, list.profile().end_uA);
+    TEST_ASSERT_TRUE(list.compile(g_calibration));
+    TEST_ASSERT_EQUAL(5, list.tableSize());
+    TEST_ASSERT_EQUAL_UINT64(10000, list.tableDuration_us());
+
+    // The top step is played once
+    int32_t currents_uA[] = {100000, 200000, 300000, 200000, 100000};
+    uint32_t dwells_us[] = {2000, 2000, 2000, 2000, 2000};
+    assertPlays(&list, currents_uA, dwells_us, 5);
+}
+
+void test_compiles_points(void)
+{
+    ListMode list(&g_sequencer);
+
+    TEST_ASSERT_TRUE(list.addPoint(500000, 200));
+    TEST_ASSERT_TRUE(list.addPoint(1000000, 1500000));
+    TEST_ASSERT_TRUE(list.addPoint(0, 100));
+    TEST_ASSERT_EQUAL(3, list.pointCount());
+    TEST_ASSERT_TRUE(list.compile(g_calibration));
+
+    // The 1.5 s point takes three steps but is written once
+    TEST_ASSERT_EQUAL(5, list.tableSize());
+    TEST_ASSERT_EQUAL_UINT64(1500300, list.tableDuration_us());
+
+    int32_t currents_uA[] = {500000, 1000000, 0};
+    uint32_t dwells_us[] = {200, 1500000, 100};
+    assertPlays(&list, currents_uA, dwells_us, 3);
+    TEST_ASSERT_EQUAL_UINT32(5, g_sequencer.stepsPlayed());
+}
+
+void test_refuses_dwells_under_the_minimum(void)
+{
+    ListMode list(&g_sequencer);
+
+    TEST_ASSERT_FALSE(list.addPoint(500000, ListMode::g_minDwell_us - 1));
+    TEST_ASSERT_TRUE(list.addPoint(500000, ListMode::g_minDwell_us));
+    TEST_ASSERT_FALSE(list.setRamp(0, 1000000, 5, ListMode::g_minDwell_us - 1));
+    TEST_ASSERT_FALSE(list.setStaircase(0, 100000, 5, ListMode::g_minDwell_us - 1));
+
+    // Nothing to time a ramp of one step by
+    TEST_ASSERT_FALSE(list.setRamp(0, 1000000, 1, 1000));
+
+    // An empty list has nothing to play
+    list.clear();
+    TEST_ASSERT_FALSE(list.compile(g_calibration));
+    TEST_ASSERT_FALSE(list.start(false));
+}
+
+void test_table_is_capped(void)
+{
+    ListMode list(&g_sequencer);
+
+    TEST_ASSERT_TRUE(list.setRamp(0, 1000000, ListMode::g_maxTableSteps, 100));
+    TEST_ASSERT_TRUE(list.compile(g_calibration));
+    TEST_ASSERT_EQUAL(ListMode::g_maxTableSteps, list.tableSize());
+    TEST_ASSERT_FALSE(list.setRamp(0, 1000000, ListMode::g_maxTableSteps + 1, 100));
+
+    // Every step but the top is played twice
+    TEST_ASSERT_TRUE(list.setStaircase(0, 100, 2048, 100));
+    TEST_ASSERT_TRUE(list.compile(g_calibration));
+    TEST_ASSERT_EQUAL(4095, list.tableSize());
+    TEST_ASSERT_FALSE(list.setStaircase(0, 100, 2049, 100));
+    TEST_ASSERT_EQUAL(ListMode::SHAPE_STAIRCASE, list.profile().shape);
+    TEST_ASSERT_EQUAL_UINT32(2048, list.profile().steps);
+
+    // 455 points of nine full steps leave room for one more step
+    list.clear();
+    for (int i = 0; i < 455; i++)
+    {
+        TEST_ASSERT_TRUE(list.addPoint(i * 1000, 9 * DacSequencer::g_maxStepDwell_us));
+    }
+    TEST_ASSERT_TRUE(list.addPoint(0, DacSequencer::g_maxStepDwell_us + 10));
+    TEST_ASSERT_FALSE(list.compile(g_calibration));
+    TEST_ASSERT_FALSE(list.start(false));
+
+    // A last point that fits exactly is taken whole
+    list.clear();
+    for (int i = 0; i < 455; i++)
+    {
+        TEST_ASSERT_TRUE(list.addPoint(i * 1000, 9 * DacSequencer::g_maxStepDwell_us));
+    }
+    TEST_ASSERT_TRUE(list.addPoint(0, DacSequencer::g_maxStepDwell_us));
+    TEST_ASSERT_TRUE(list.compile(g_calibration));
+    TEST_ASSERT_EQUAL(ListMode::g_maxTableSteps, list.tableSize());
+}
+
+void test_last_step_keeps_its_dwell(void)
+{
+    ListMode list(&g_sequencer);
+
+    TEST_ASSERT_TRUE(list.addPoint(1000000, 1000));
+    TEST_ASSERT_TRUE(list.addPoint(500000, 2000));
+    TEST_ASSERT_TRUE(list.compile(g_calibration));
+
+    int64_t t0 = fakeTimer_us();
+    TEST_ASSERT_TRUE(list.start(false));
+    fakeTasksSettle();
+
+    // The last step is written at +1500 and held for its 2 ms
+    runUntil(t0 + 500 + 3000 - 1);
+    TEST_ASSERT_EQUAL(2, dacWrites().size());
+    TEST_ASSERT_EQUAL_INT64(t0 + 1500, dacWrites()[1].time_us);
+    TEST_ASSERT_TRUE(list.running());
+    TEST_ASSERT_FALSE(list.finished());
+
+    runUntil(t0 + 500 + 3000);
+    TEST_ASSERT_FALSE(list.running());
+    TEST_ASSERT_TRUE(list.finished());
+
+    // Its frame stays on the DAC
+    runUntil(t0 + 100000);
+    TEST_ASSERT_EQUAL(2, dacWrites().size());
+    TEST_ASSERT_EQUAL_UINT32(2, g_sequencer.stepsPlayed());
+}
+
+void test_looping_table_wraps_after_last_dwell(void)
+{
+    ListMode list(&g_sequencer);
+
+    TEST_ASSERT_TRUE(list.addPoint(1000000, 1000));
+    TEST_ASSERT_TRUE(list.addPoint(500000, 2000));
+    TEST_ASSERT_TRUE(list.compile(g_calibration));
+
+    int64_t t0 = fakeTimer_us();
+    TEST_ASSERT_TRUE(list.start(true));
+    fakeTasksSettle();
+
+    runUntil(t0 + 500 + (2 * 3000) - 1);
+    std::vector<TwoWire::Transaction> writes = dacWrites();
+    TEST_ASSERT_EQUAL(4, writes.size());
+    TEST_ASSERT_EQUAL_INT64(t0 + 3500, writes[2].time_us);
+    TEST_ASSERT_EQUAL_INT64(t0 + 4500, writes[3].time_us);
+    TEST_ASSERT_TRUE(list.running());
+
+    list.stop();
+    fakeTasksSettle();
+    TEST_ASSERT_FALSE(g_sequencer.running());
+}
+
+void test_profile_survives_save_and_load(void)
+{
+    Preferences::fakeReset();
+    ListMode saved(&g_sequencer);
+    TEST_ASSERT_TRUE(saved.addPoint(500000, 200));
+    TEST_ASSERT_TRUE(saved.addPoint(1000000, 1500000));
+    TEST_ASSERT_TRUE(saved.save());
+
+    ListMode loaded(&g_sequencer);
+    TEST_ASSERT_TRUE(loaded.load());
+    TEST_ASSERT_EQUAL(ListMode::SHAPE_POINTS, loaded.profile().shape);
+    TEST_ASSERT_EQUAL(2, loaded.pointCount());
+    TEST_ASSERT_TRUE(loaded.compile(g_calibration));
+    TEST_ASSERT_EQUAL(4, loaded.tableSize());
+    TEST_ASSERT_EQUAL_UINT64(1500200, loaded.tableDuration_us());
+
+    // A ramp saved over the points drops them
+    TEST_ASSERT_TRUE(saved.setRamp(0, 1000000, 5, 1000));
+    TEST_ASSERT_TRUE(saved.save());
+    TEST_ASSERT_TRUE(loaded.load());
+    TEST_ASSERT_EQUAL(ListMode::SHAPE_RAMP, loaded.profile().shape);
+    TEST_ASSERT_EQUAL(0, loaded.pointCount());
+}
+
+void test_load_rejects_bad_profile(void)
+{
+    Preferences::fakeReset();
+    ListMode list(&g_sequencer);
+    TEST_ASSERT_TRUE(list.setRamp(0, 1000000, 5, 1000));
+
+    // Nothing stored yet
+    TEST_ASSERT_FALSE(list.load());
+
+    // A ramp of one step would divide by zero in compile()
+    ListMode::Profile profile = list.profile();
+    profile.steps = 1;
+    Preferences prefs;
+    prefs.begin("list", false);
+    prefs.putBytes("profile", &profile, sizeof(profile));
+    prefs.end();
+    TEST_ASSERT_FALSE(list.load());
+
+    // Points with a torn length
+    profile.shape = ListMode::SHAPE_POINTS;
+    uint8_t torn[sizeof(ListMode::Point) + 1] = {};
+    prefs.begin("list", false);
+    prefs.putBytes("profile", &profile, sizeof(profile));
+    prefs.putBytes("points", torn, sizeof(torn));
+    prefs.end();
+    TEST_ASSERT_FALSE(list.load());
+
+    // A point too short to time
+    ListMode::Point point = {500000, ListMode::g_minDwell_us - 1};
+    prefs.begin("list", false);
+    prefs.putBytes("points", &point, sizeof(point));
+    prefs.end();
+    TEST_ASSERT_FALSE(list.load());
+
+    // What was there is left alone
+    TEST_ASSERT_EQUAL(ListMode::SHAPE_RAMP, list.profile().shape);
+    TEST_ASSERT_EQUAL_UINT32(5, list.profile().steps);
+}
+
+int main(int argc, char **argv)
+{
+    g_sequencer.init();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_compiles_ramp);
+    RUN_TEST(test_compiles_staircase_up_and_back_down);
+    RUN_TEST(test_compiles_points);
+    RUN_TEST(test_refuses_dwells_under_the_minimum);
+    RUN_TEST(test_table_is_capped);
+    RUN_TEST(test_last_step_keeps_its_dwell);
+    RUN_TEST(test_looping_table_wraps_after_last_dwell);
+    RUN_TEST(test_profile_survives_save_and_load);
+    RUN_TEST(test_load_rejects_bad_profile);
+    return UNITY_END();
+}
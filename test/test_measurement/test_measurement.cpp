@@ -0,0 +1,93 @@
+#include <unity.h>
+
+#include "Measurement.hpp"
+
+// The floating point conversions the integer scaling replaced
+static double referenceVolts(uint16_t counts)
+{
+    return counts * 0.0005 * 15;
+}
+
+static double referenceAmps(uint16_t counts)
+{
+    return counts * 0.0005 / 67 / 0.01;
+}
+
+static uint16_t referenceDacCode(double current)
+{
+    return uint16_t(current * 0.01 * 67 / 0.0005);
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+void test_voltage_is_exact_for_every_code(void)
+{
+    for (uint32_t counts = 0; counts <= Measurement::g_maxCode; counts++)
+    {
+        double expected_uV = referenceVolts(counts) * 1e6;
+        TEST_ASSERT_EQUAL_INT32_MESSAGE(int32_t(expected_uV + 0.5),
+                                        Measurement::countsToMicroVolts(counts),
+                                        "voltage");
+    }
+}
+
+void test_current_rounds_to_the_nearest_microamp(void)
+{
+    for (uint32_t counts = 0; counts <= Measurement::g_maxCode; counts++)
+    {
+        double expected_uA = referenceAmps(counts) * 1e6;
+        double error = Measurement::countsToMicroAmps(counts) - expected_uA;
+        TEST_ASSERT_TRUE_MESSAGE(error <= 0.5 && error >= -0.5, "current");
+    }
+}
+
+void test_dac_code_within_one_lsb(void)
+{
+    for (uint32_t counts = 1; counts <= Measurement::g_maxCode; counts++)
+    {
+        int32_t current_uA = Measurement::countsToMicroAmps(counts);
+        uint16_t expected = referenceDacCode(current_uA / 1e6);
+        TEST_ASSERT_INT_WITHIN_MESSAGE(1, expected,
+                                       Measurement::microAmpsToDacCode(current_uA),
+                                       "DAC code");
+    }
+}
+
+void test_dac_code_round_trips_adc_current(void)
+{
+    for (uint32_t counts = 0; counts <= Measurement::g_maxCode; counts++)
+    {
+        int32_t current_uA = Measurement::countsToMicroAmps(counts);
+        TEST_ASSERT_EQUAL_UINT16_MESSAGE(counts,
+                                         Measurement::microAmpsToDacCode(current_uA),
+                                         "round trip");
+    }
+}
+
+void test_dac_code_clamps(void)
+{
+    TEST_ASSERT_EQUAL_UINT16(0, Measurement::microAmpsToDacCode(0));
+    TEST_ASSERT_EQUAL_UINT16(0, Measurement::microAmpsToDacCode(-1000));
+    TEST_ASSERT_EQUAL_UINT16(Measurement::g_maxCode, Measurement::microAmpsToDacCode(3100000));
+    // Past where a 32-bit product would wrap
+    TEST_ASSERT_EQUAL_UINT16(Measurement::g_maxCode, Measurement::microAmpsToDacCode(64200000));
+    TEST_ASSERT_EQUAL_UINT16(Measurement::g_maxCode, Measurement::microAmpsToDacCode(100000000));
+    TEST_ASSERT_EQUAL_UINT16(Measurement::g_maxCode, Measurement::microAmpsToDacCode(INT32_MAX));
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_voltage_is_exact_for_every_code);
+    RUN_TEST(test_current_rounds_to_the_nearest_microamp);
+    RUN_TEST(test_dac_code_within_one_lsb);
+    RUN_TEST(test_dac_code_round_trips_adc_current);
+    RUN_TEST(test_dac_code_clamps);
+    return UNITY_END();
+}
@@ -0,0 +1,275 @@
+#include <unity.h>
+#include <stdio.h>
+
+#include "ModeEngine.hpp"
+
+// A source with an open-circuit voltage and internal resistance, with
+// the load current following the target one period late, as it does
+// through the control task and the current loop
+class Source
+{
+public:
+    Source(double open_uV, double resistance_Ohm)
+        : _open_uV(open_uV),
+          _resistance_Ohm(resistance_Ohm),
+          _current_uA(0) {}
+
+    int32_t voltage_uV() const
+    {
+        double v = _open_uV - (_current_uA * _resistance_Ohm);
+        return int32_t(v < 0 ? 0 : v);
+    }
+
+    void step(int32_t target_uA)
+    {
+        _current_uA += (target_uA - _current_uA) * 0.5;
+    }
+
+    double current_uA() const { return _current_uA; }
+
+private:
+    double _open_uV;
+    double _resistance_Ohm;
+    double _current_uA;
+};
+
+static ModeEngine *g_engine;
+
+// Runs CV against the source, returning the period after which the
+// voltage stayed within band of the setpoint, or -1
+static int runVoltage(Source *source, int periods, int32_t band_uV, int32_t *maxOvershoot_uV)
+{
+    int settled = -1;
+    *maxOvershoot_uV = 0;
+    for (int i = 0; i < periods; i++)
+    {
+        source->step(g_engine->update(source->voltage_uV()));
+
+        int32_t error_uV = source->voltage_uV() - g_engine->setpoint();
+        if (-error_uV > *maxOvershoot_uV)
+        {
+            *maxOvershoot_uV = -error_uV;
+        }
+        if ((error_uV > band_uV) || (error_uV < -band_uV))
+        {
+            settled = -1;
+        }
+        else if (settled < 0)
+        {
+            settled = i + 1;
+        }
+    }
+
+    return settled;
+}
+
+void setUp(void)
+{
+    g_engine = new ModeEngine();
+}
+
+void tearDown(void)
+{
+    delete g_engine;
+}
+
+void test_cc_clamps_to_range(void)
+{
+    g_engine->setSetpoint(1234567);
+    TEST_ASSERT_EQUAL_INT32(1234567, g_engine->update(0));
+    g_engine->setSetpoint(5000000);
+    TEST_ASSERT_EQUAL_INT32(3000000, g_engine->update(12000000));
+    g_engine->setSetpoint(-1);
+    TEST_ASSERT_EQUAL_INT32(0, g_engine->update(12000000));
+
+    g_engine->setMaxCurrent(1000000);
+    g_engine->setSetpoint(2000000);
+    TEST_ASSERT_EQUAL_INT32(1000000, g_engine->update(12000000));
+}
+
+void test_cr_setpoint_math(void)
+{
+    g_engine->setMode(ModeEngine::MODE_CR);
+
+    // 12 V across 6 ohm, and 5 V across 3.3 ohm
+    g_engine->setSetpoint(6000);
+    TEST_ASSERT_EQUAL_INT32(2000000, g_engine->update(12000000));
+    g_engine->setSetpoint(3300);
+    TEST_ASSERT_EQUAL_INT32(1515151, g_engine->update(5000000));
+
+    // 30 V across 1 ohm would be 30 A
+    g_engine->setSetpoint(1000);
+    TEST_ASSERT_EQUAL_INT32(3000000, g_engine->update(30000000));
+
+    g_engine->setSetpoint(0);
+    TEST_ASSERT_EQUAL_INT32(0, g_engine->update(12000000));
+}
+
+void test_cp_setpoint_math(void)
+{
+    g_engine->setMode(ModeEngine::MODE_CP);
+
+    // 12 W from 12 V, and 10 W from 3.7 V
+    g_engine->setSetpoint(12000000);
+    TEST_ASSERT_EQUAL_INT32(1000000, g_engine->update(12000000));
+    g_engine->setSetpoint(10000000);
+    TEST_ASSERT_EQUAL_INT32(2702702, g_engine->update(3700000));
+
+    // 36 W from 10 V would be 3.6 A
+    g_engine->setSetpoint(36000000);
+    TEST_ASSERT_EQUAL_INT32(3000000, g_engine->update(10000000));
+
+    g_engine->setSetpoint(-5);
+    TEST_ASSERT_EQUAL_INT32(0, g_engine->update(12000000));
+}
+
+void test_minimum_voltage_cutoff(void)
+{
+    ModeEngine::Mode modes[] = {ModeEngine::MODE_CR, ModeEngine::MODE_CP};
+    for (size_t i = 0; i < sizeof(modes) / sizeof(modes[0]); i++)
+    {
+        g_engine->setMode(modes[i]);
+        g_engine->setSetpoint(100);
+
+        TEST_ASSERT_EQUAL_INT32(0, g_engine->update(0));
+        TEST_ASSERT_EQUAL_INT32(0, g_engine->update(-5000));
+        TEST_ASSERT_EQUAL_INT32(0, g_engine->update(ModeEngine::g_minVoltage_uV - 1));
+        TEST_ASSERT_GREATER_THAN(0, g_engine->update(ModeEngine::g_minVoltage_uV));
+    }
+
+    // At the cutoff CP would otherwise ask for the most current
+    g_engine->setMode(ModeEngine::MODE_CP);
+    g_engine->setSetpoint(100000);
+    TEST_ASSERT_EQUAL_INT32(1000000, g_engine->update(ModeEngine::g_minVoltage_uV));
+}
+
+void test_sequenced_modes_target_nothing(void)
+{
+    g_engine->setSetpoint(1000000);
+    g_engine->setMode(ModeEngine::MODE_DYNAMIC);
+    TEST_ASSERT_EQUAL_INT32(0, g_engine->update(12000000));
+    g_engine->setMode(ModeEngine::MODE_LIST);
+    TEST_ASSERT_EQUAL_INT32(0, g_engine->update(12000000));
+}
+
+void test_cv_converges(void)
+{
+    struct Case
+    {
+        const char *name;
+        double open_uV;
+        double resistance_Ohm;
+        int32_t setpoint_uV;
+    };
+    static const Case cases[] = {
+        {"soft 12 V / 1 ohm", 12000000, 1.0, 10000000},
+        {"bench supply 30 V / 0.1 ohm", 30000000, 0.1, 29800000},
+        {"weak 12 V / 5 ohm", 12000000, 5.0, 5000000},
+    };
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+    {
+        const Case &c = cases[i];
+        delete g_engine;
+        g_engine = new ModeEngine();
+        g_engine->setMode(ModeEngine::MODE_CV);
+        g_engine->setSetpoint(c.setpoint_uV);
+
+        Source source(c.open_uV, c.resistance_Ohm);
+        int32_t overshoot_uV = 0;
+        int settled = runVoltage(&source, 8000, 10000, &overshoot_uV);
+
+        char message[128];
+        snprintf(message, sizeof(message), "CV %s: within 10 mV after %d periods, %ld uV below at worst",
+                 c.name, settled, (long)overshoot_uV);
+        TEST_MESSAGE(message);
+
+        TEST_ASSERT_GREATER_THAN(0, settled);
+        // The integrator alone sets the pace into a stiff source
+        TEST_ASSERT_LESS_OR_EQUAL(4000, settled);
+        TEST_ASSERT_LESS_OR_EQUAL(10000, overshoot_uV);
+        TEST_ASSERT_INT32_WITHIN(1000, c.setpoint_uV, source.voltage_uV());
+    }
+}
+
+void test_cv_below_setpoint_sinks_nothing(void)
+{
+    g_engine->setMode(ModeEngine::MODE_CV);
+    g_engine->setSetpoint(15000000);
+
+    Source source(12000000, 1.0);
+    int32_t overshoot_uV = 0;
+    runVoltage(&source, 500, 10000, &overshoot_uV);
+    TEST_ASSERT_EQUAL_INT32(0, g_engine->update(source.voltage_uV()));
+
+    // Nor has it wound up negative while waiting: raising the
+    // source above the setpoint starts loading straight away
+    TEST_ASSERT_GREATER_THAN(0, g_engine->update(15500000));
+}
+
+void test_cv_integral_clamped(void)
+{
+    // A source the load can't pull down winds the integrator only
+    // to the current limit
+    g_engine->setMode(ModeEngine::MODE_CV);
+    g_engine->setSetpoint(1000000);
+    for (int i = 0; i < 10000; i++)
+    {
+        TEST_ASSERT_LESS_OR_EQUAL(3000000, g_engine->update(24000000));
+    }
+
+    // So it unwinds from 3 A, not from the 2 kA it would have
+    // summed, once the source drops 1 V below the setpoint
+    int periods = 0;
+    while ((g_engine->update(0) > 0) && (periods < 10000))
+    {
+        periods++;
+    }
+    TEST_ASSERT_LESS_OR_EQUAL(300, periods);
+}
+
+void test_mode_change_resets_integrator(void)
+{
+    g_engine->setMode(ModeEngine::MODE_CV);
+    g_engine->setSetpoint(10000000);
+    for (int i = 0; i < 100; i++)
+    {
+        g_engine->update(12000000);
+    }
+
+    g_engine->setMode(ModeEngine::MODE_CC);
+    g_engine->setMode(ModeEngine::MODE_CV);
+    // 0.1 A/V of 10 mV, plus the one step of integral just taken
+    TEST_ASSERT_INT32_WITHIN(1, 1000 + 99, g_engine->update(10010000));
+}
+
+void test_mode_names(void)
+{
+    for (int i = 0; i < ModeEngine::MODE_COUNT; i++)
+    {
+        ModeEngine::Mode mode;
+        TEST_ASSERT_TRUE(ModeEngine::modeFromName(ModeEngine::modeName(ModeEngine::Mode(i)), &mode));
+        TEST_ASSERT_EQUAL_INT(i, mode);
+    }
+
+    ModeEngine::Mode mode;
+    TEST_ASSERT_TRUE(ModeEngine::modeFromName("cv", &mode));
+    TEST_ASSERT_EQUAL_INT(ModeEngine::MODE_CV, mode);
+    TEST_ASSERT_FALSE(ModeEngine::modeFromName("xx", &mode));
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_cc_clamps_to_range);
+    RUN_TEST(test_cr_setpoint_math);
+    RUN_TEST(test_cp_setpoint_math);
+    RUN_TEST(test_minimum_voltage_cutoff);
+    RUN_TEST(test_sequenced_modes_target_nothing);
+    RUN_TEST(test_cv_converges);
+    RUN_TEST(test_cv_below_setpoint_sinks_nothing);
+    RUN_TEST(test_cv_integral_clamped);
+    RUN_TEST(test_mode_change_resets_integrator);
+    RUN_TEST(test_mode_names);
+    return UNITY_END();
+}
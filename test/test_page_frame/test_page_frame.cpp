@@ -0,0 +1,482 @@
+#include <unity.h>
+#include <stdio.h>
+#include <vector>
+#include <chrono>
+
+#include "PageFrame.hpp"
+
+static const int g_width = 128;
+static const int g_height = 64;
+static const int g_pages = g_height / 8;
+
+struct Transaction
+{
+    uint8_t control;
+    std::vector<uint8_t> bytes;
+};
+
+// Stands in for the display on the bus; can be told to fail the
+// transaction with a given index
+struct Bus
+{
+    std::vector<Transaction> sent;
+    int failAt;
+
+    size_t bytes()
+    {
+        size_t total = 0;
+        for (size_t i = 0; i < sent.size(); i++)
+        {
+            total += 1 + sent[i].bytes.size();
+        }
+        return total;
+    }
+};
+
+static bool busWriter(void *context, uint8_t control, const uint8_t *bytes, size_t len)
+{
+    Bus *bus = (Bus *)context;
+    if (int(bus->sent.size()) == bus->failAt)
+    {
+        bus->failAt = -1;
+        return false;
+    }
+
+    Transaction transaction;
+    transaction.control = control;
+    transaction.bytes.assign(bytes, bytes + len);
+    bus->sent.push_back(transaction);
+    return true;
+}
+
+static uint8_t g_back[g_width * g_pages];
+static PageFrame *g_frame;
+static Bus g_bus;
+
+static void present()
+{
+    g_frame->present();
+    g_bus.sent.clear();
+    g_bus.failAt = -1;
+    TEST_ASSERT_TRUE(g_frame->flush(busWriter, &g_bus));
+}
+
+static void assertWindow(const Transaction &transaction, int page, int colLo, int colHi)
+{
+    TEST_ASSERT_EQUAL_UINT8(PageFrame::g_commands, transaction.control);
+    TEST_ASSERT_EQUAL(6, transaction.bytes.size());
+    TEST_ASSERT_EQUAL_UINT8(PageFrame::g_pageAddr, transaction.bytes[0]);
+    TEST_ASSERT_EQUAL_UINT8(page, transaction.bytes[1]);
+    TEST_ASSERT_EQUAL_UINT8(page, transaction.bytes[2]);
+    TEST_ASSERT_EQUAL_UINT8(PageFrame::g_columnAddr, transaction.bytes[3]);
+    TEST_ASSERT_EQUAL_UINT8(colLo, transaction.bytes[4]);
+    TEST_ASSERT_EQUAL_UINT8(colHi, transaction.bytes[5]);
+}
+
+void setUp(void)
+{
+    memset(g_back, 0, sizeof(g_back));
+    g_frame = new PageFrame(g_width, g_height);
+    g_frame->begin(g_back);
+}
+
+void tearDown(void)
+{
+    delete g_frame;
+}
+
+void test_full_frame(void)
+{
+    g_frame->clear();
+    TEST_ASSERT_TRUE(g_frame->takeDrawn());
+    present();
+
+    // Each page: its address command, then 128 columns in 32 byte chunks
+    uint32_t perPage = (6 + 1) + (128 + (128 / PageFrame::g_chunkBytes));
+    TEST_ASSERT_EQUAL_UINT32(g_pages * perPage, g_frame->lastFlushBytes());
+    TEST_ASSERT_EQUAL(g_bus.bytes(), g_frame->lastFlushBytes());
+    TEST_ASSERT_EQUAL(g_pages * 5, g_bus.sent.size());
+    for (int page = 0; page < g_pages; page++)
+    {
+        TEST_ASSERT_EQUAL_UINT32(perPage, g_frame->lastPageBytes(page));
+        assertWindow(g_bus.sent[page * 5], page, 0, g_width - 1);
+    }
+
+    char message[64];
+    snprintf(message, sizeof(message), "full frame: %lu bytes", (unsigned long)g_frame->lastFlushBytes());
+    TEST_MESSAGE(message);
+}
+
+void test_readout_change(void)
+{
+    // Two digits of a readout on text row 3: 12 pixel columns of one page
+    g_back[(3 * g_width) + 60] = 0x7e;
+    g_frame->markDirty(60, 3 * 8, 12, 8);
+    present();
+
+    TEST_ASSERT_EQUAL(2, g_bus.sent.size());
+    assertWindow(g_bus.sent[0], 3, 60, 71);
+    TEST_ASSERT_EQUAL_UINT8(PageFrame::g_data, g_bus.sent[1].control);
+    TEST_ASSERT_EQUAL(12, g_bus.sent[1].bytes.size());
+    TEST_ASSERT_EQUAL_UINT8(0x7e, g_bus.sent[1].bytes[0]);
+    TEST_ASSERT_EQUAL_UINT32(7 + 13, g_frame->lastFlushBytes());
+
+    char message[64];
+    snprintf(message, sizeof(message), "two digit readout change: %lu bytes", (unsigned long)g_frame->lastFlushBytes());
+    TEST_MESSAGE(message);
+
+    // Nothing drawn, nothing sent
+    present();
+    TEST_ASSERT_EQUAL(0, g_bus.sent.size());
+    TEST_ASSERT_EQUAL_UINT32(0, g_frame->lastFlushBytes());
+}
+
+void test_windows_merge_per_page(void)
+{
+    // Two spans on one page go as one window over both; a span
+    // straddling pages marks each of them
+    g_frame->markDirty(10, 0, 6, 8);
+    g_frame->markDirty(40, 0, 6, 8);
+    g_frame->markDirty(100, 12, 4, 8);
+    present();
+
+    TEST_ASSERT_EQUAL(7, g_bus.sent.size());
+    assertWindow(g_bus.sent[0], 0, 10, 45);
+    TEST_ASSERT_EQUAL(32 + 4, g_bus.sent[1].bytes.size() + g_bus.sent[2].bytes.size());
+    assertWindow(g_bus.sent[3], 1, 100, 103);
+    assertWindow(g_bus.sent[5], 2, 100, 103);
+}
+
+void test_window_chunks(void)
+{
+    g_frame->markDirty(0, 8, 40, 8);
+    present();
+
+    TEST_ASSERT_EQUAL(3, g_bus.sent.size());
+    TEST_ASSERT_EQUAL(PageFrame::g_chunkBytes, g_bus.sent[1].bytes.size());
+    TEST_ASSERT_EQUAL(40 - PageFrame::g_chunkBytes, g_bus.sent[2].bytes.size());
+}
+
+void test_marks_are_clipped(void)
+{
+    g_frame->markDirty(-4, -4, 8, 8);
+    g_frame->markDirty(124, 60, 16, 16);
+    g_frame->markDirty(200, 0, 8, 8);
+    present();
+
+    TEST_ASSERT_EQUAL(4, g_bus.sent.size());
+    assertWindow(g_bus.sent[0], 0, 0, 3);
+    assertWindow(g_bus.sent[2], 7, 124, 127);
+}
+
+void test_failed_window_is_resent(void)
+{
+    g_frame->markDirty(0, 0, 8, 8);
+    g_frame->markDirty(0, 16, 8, 8);
+    g_frame->present();
+
+    // The first page's data doesn't make it; the rest waits
+    g_bus.sent.clear();
+    g_bus.failAt = 1;
+    TEST_ASSERT_FALSE(g_frame->flush(busWriter, &g_bus));
+
+    // Drawn on again before the retry, which sends the union
+    g_frame->markDirty(20, 0, 8, 8);
+    present();
+    TEST_ASSERT_EQUAL(4, g_bus.sent.size());
+    assertWindow(g_bus.sent[0], 0, 0, 27);
+    assertWindow(g_bus.sent[2], 2, 0, 7);
+}
+
+void test_front_buffer_holds_presented_frame(void)
+{
+    // Drawing after present() doesn't reach the frame being flushed
+    g_back[5] = 0x11;
+    g_frame->markDirty(5, 0, 1, 8);
+    g_frame->present();
+    g_back[5] = 0x22;
+
+    g_bus.sent.clear();
+    g_bus.failAt = -1;
+    TEST_ASSERT_TRUE(g_frame->flush(busWriter, &g_bus));
+    TEST_ASSERT_EQUAL_UINT8(0x11, g_bus.sent[1].bytes[0]);
+}
+
+// Text the way Adafruit_GFX drew it: clear the cells, then set the
+// glyph's pixels one drawPixel() at a time
+static void drawPixel(uint8_t *buf, int x, int y, bool on)
+{
+    if ((x < 0) || (x >= g_width) || (y < 0) || (y >= g_height))
+    {
+        return;
+    }
+    if (on)
+    {
+        buf[x + ((y / 8) * g_width)] |= uint8_t(1 << (y & 7));
+    }
+    else
+    {
+        buf[x + ((y / 8) * g_width)] &= uint8_t(~(1 << (y & 7)));
+    }
+}
+
+static void drawTextPerPixel(uint8_t *buf, int col, int row, const char *text, size_t len)
+{
+    int x0 = col * PageFrame::g_glyphWidth;
+    int y0 = row * 8;
+    for (int x = x0; x < x0 + int(len) * PageFrame::g_glyphWidth; x++)
+    {
+        for (int y = y0; y < y0 + 8; y++)
+        {
+            drawPixel(buf, x, y, false);
+        }
+    }
+
+    for (size_t i = 0; i < len; i++)
+    {
+        int glyph = uint8_t(text[i]) - PageFrame::g_glyphFirst;
+        for (int c = 0; c < PageFrame::g_glyphWidth - 1; c++)
+        {
+            uint8_t line = PageFrame::g_font[glyph][c];
+            for (int j = 0; j < 8; j++, line >>= 1)
+            {
+                if (line & 1)
+                {
+                    drawPixel(buf, x0 + (int(i) * PageFrame::g_glyphWidth) + c, y0 + j, true);
+                }
+            }
+        }
+    }
+}
+
+// A full screen of text, 8 rows of 21 characters
+static void screenText(int frame, char rows[8][22])
+{
+    for (int row = 0; row < 8; row++)
+    {
+        for (int col = 0; col < 21; col++)
+        {
+            rows[row][col] = char(0x20 + ((frame + (row * 21) + col) % 95));
+        }
+        rows[row][21] = '\0';
+    }
+}
+
+void test_glyph_cache_matches_per_pixel_text(void)
+{
+    static uint8_t reference[g_width * g_pages];
+    memset(reference, 0xa5, sizeof(reference));
+    memset(g_back, 0xa5, sizeof(g_back));
+
+    char rows[8][22];
+    for (int frame = 0; frame < 95; frame += 7)
+    {
+        screenText(frame, rows);
+        for (int row = 0; row < 8; row++)
+        {
+            g_frame->drawText(0, row, rows[row], 21);
+            drawTextPerPixel(reference, 0, row, rows[row], 21);
+        }
+        TEST_ASSERT_EQUAL_UINT8_ARRAY(reference, g_back, sizeof(g_back));
+    }
+}
+
+void test_inverted_and_unknown_glyphs(void)
+{
+    g_frame->drawText(2, 1, "A", 1);
+    const uint8_t *cell = g_back + g_width + (2 * 6);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(PageFrame::g_font['A' - 0x20], cell, 5);
+    TEST_ASSERT_EQUAL_UINT8(0x00, cell[5]);
+
+    g_frame->drawText(2, 1, "A", 1, PageFrame::GS_INVERTED);
+    for (int i = 0; i < 5; i++)
+    {
+        TEST_ASSERT_EQUAL_UINT8(uint8_t(~PageFrame::g_font['A' - 0x20][i]), cell[i]);
+    }
+    TEST_ASSERT_EQUAL_UINT8(0xff, cell[5]);
+
+    g_frame->drawText(2, 1, "\x7f", 1);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(PageFrame::g_font['?' - 0x20], cell, 5);
+}
+
+void test_text_is_clipped(void)
+{
+    // Runs off the right edge at column 21; whole cells only
+    g_frame->drawText(19, 0, "ABCD", 4);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(PageFrame::g_font['B' - 0x20], g_back + (20 * 6), 5);
+    TEST_ASSERT_EQUAL_UINT8(0, g_back[126]);
+    TEST_ASSERT_EQUAL_UINT8(0, g_back[127]);
+
+    present();
+    g_frame->takeDrawn();
+
+    // Cells off the screen draw nothing
+    g_frame->drawText(-1, 0, "A", 1);
+    g_frame->drawText(0, -1, "A", 1);
+    g_frame->drawText(21, 0, "A", 1);
+    g_frame->drawText(0, 8, "A", 1);
+    TEST_ASSERT_FALSE(g_frame->takeDrawn());
+    TEST_ASSERT_EQUAL_UINT8(0, g_back[0]);
+    present();
+    TEST_ASSERT_EQUAL(0, g_bus.sent.size());
+}
+
+void test_readout_digit_costs_one_cell(void)
+{
+    g_frame->drawText(4, 3, "1.2345A", 7);
+    present();
+
+    // The UI redraws only the changed span of a readout
+    g_frame->drawText(8, 3, "6", 1);
+    present();
+    TEST_ASSERT_EQUAL(2, g_bus.sent.size());
+    assertWindow(g_bus.sent[0], 3, 48, 53);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(PageFrame::g_font['6' - 0x20], &g_bus.sent[1].bytes[0], 5);
+    TEST_ASSERT_EQUAL_UINT32(7 + 7, g_frame->lastFlushBytes());
+}
+
+void test_text_render_time(void)
+{
+    // Microseconds per full screen of text into the frame buffer,
+    // glyph copies against the per-pixel path
+    static uint8_t reference[g_width * g_pages];
+    const int frames = 2000;
+    char rows[8][22];
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int frame = 0; frame < frames; frame++)
+    {
+        screenText(frame, rows);
+        for (int row = 0; row < 8; row++)
+        {
+            g_frame->drawText(0, row, rows[row], 21);
+        }
+    }
+    double glyph_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / frames;
+
+    start = std::chrono::steady_clock::now();
+    for (int frame = 0; frame < frames; frame++)
+    {
+        screenText(frame, rows);
+        for (int row = 0; row < 8; row++)
+        {
+            drawTextPerPixel(reference, 0, row, rows[row], 21);
+        }
+    }
+    double pixel_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / frames;
+
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(reference, g_back, sizeof(g_back));
+
+    char message[96];
+    snprintf(message, sizeof(message), "full screen of text: %.2f us from the glyph cache, %.2f us per pixel",
+             glyph_us, pixel_us);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_TRUE(glyph_us < pixel_us);
+}
+
+// The graph's band: pages 2 to 5, between the header and footer
+static const int g_graphPage = 2;
+static const int g_graphPages = 4;
+
+void test_graph_column_bits(void)
+{
+    // Rows 5 to 20 of the band cross three of its pages
+    memset(g_back, 0xff, sizeof(g_back));
+    g_frame->drawColumn(10, g_graphPage, g_graphPages, 5, 20);
+    TEST_ASSERT_EQUAL_UINT8(0xe0, g_back[(2 * g_width) + 10]);
+    TEST_ASSERT_EQUAL_UINT8(0xff, g_back[(3 * g_width) + 10]);
+    TEST_ASSERT_EQUAL_UINT8(0x1f, g_back[(4 * g_width) + 10]);
+    TEST_ASSERT_EQUAL_UINT8(0x00, g_back[(5 * g_width) + 10]);
+    // Nothing outside the band or the column
+    TEST_ASSERT_EQUAL_UINT8(0xff, g_back[(1 * g_width) + 10]);
+    TEST_ASSERT_EQUAL_UINT8(0xff, g_back[(6 * g_width) + 10]);
+    TEST_ASSERT_EQUAL_UINT8(0xff, g_back[(3 * g_width) + 11]);
+
+    // A single row, and the very bottom
+    g_frame->drawColumn(10, g_graphPage, g_graphPages, 31, 31);
+    TEST_ASSERT_EQUAL_UINT8(0x00, g_back[(2 * g_width) + 10]);
+    TEST_ASSERT_EQUAL_UINT8(0x80, g_back[(5 * g_width) + 10]);
+
+    present();
+    TEST_ASSERT_EQUAL(8, g_bus.sent.size());
+    assertWindow(g_bus.sent[0], 2, 10, 10);
+    assertWindow(g_bus.sent[6], 5, 10, 10);
+}
+
+void test_graph_scrolls_band_only(void)
+{
+    g_frame->drawText(0, 0, "header", 6);
+    g_frame->drawColumn(127, g_graphPage, g_graphPages, 0, 31);
+    present();
+
+    g_frame->scrollLeft(g_graphPage, g_graphPages, 1);
+    for (int page = g_graphPage; page < g_graphPage + g_graphPages; page++)
+    {
+        TEST_ASSERT_EQUAL_UINT8(0xff, g_back[(page * g_width) + 126]);
+    }
+    // The header isn't moved
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(PageFrame::g_font['h' - 0x20], g_back, 5);
+
+    // Scrolling too far does nothing
+    g_frame->scrollLeft(g_graphPage, g_graphPages, g_width + 1);
+    TEST_ASSERT_EQUAL_UINT8(0xff, g_back[(g_graphPage * g_width) + 126]);
+
+    g_frame->clearPages(g_graphPage, g_graphPages);
+    for (int page = g_graphPage; page < g_graphPage + g_graphPages; page++)
+    {
+        TEST_ASSERT_EQUAL_UINT8(0x00, g_back[(page * g_width) + 126]);
+    }
+}
+
+void test_graph_column_bytes_and_time(void)
+{
+    // Each new column scrolls the band and draws into its last column,
+    // so an update sends the band's four pages in full and nothing else
+    const int columns = 20000;
+    g_frame->clear();
+    present();
+
+    uint32_t perPage = (6 + 1) + (128 + (128 / PageFrame::g_chunkBytes));
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int i = 0; i < columns; i++)
+    {
+        int top = (i * 7) % 32;
+        g_frame->scrollLeft(g_graphPage, g_graphPages, 1);
+        g_frame->drawColumn(g_width - 1, g_graphPage, g_graphPages, top, top + 3);
+    }
+    double column_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / columns;
+
+    present();
+    TEST_ASSERT_EQUAL_UINT32(g_graphPages * perPage, g_frame->lastFlushBytes());
+    for (int page = 0; page < g_pages; page++)
+    {
+        bool inBand = (page >= g_graphPage) && (page < g_graphPage + g_graphPages);
+        TEST_ASSERT_EQUAL_UINT32(inBand ? perPage : 0, g_frame->lastPageBytes(page));
+    }
+
+    char message[96];
+    snprintf(message, sizeof(message), "graph column: %.3f us to scroll and draw, %lu bus bytes",
+             column_us, (unsigned long)g_frame->lastFlushBytes());
+    TEST_MESSAGE(message);
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_full_frame);
+    RUN_TEST(test_readout_change);
+    RUN_TEST(test_windows_merge_per_page);
+    RUN_TEST(test_window_chunks);
+    RUN_TEST(test_marks_are_clipped);
+    RUN_TEST(test_failed_window_is_resent);
+    RUN_TEST(test_front_buffer_holds_presented_frame);
+    RUN_TEST(test_glyph_cache_matches_per_pixel_text);
+    RUN_TEST(test_inverted_and_unknown_glyphs);
+    RUN_TEST(test_text_is_clipped);
+    RUN_TEST(test_readout_digit_costs_one_cell);
+    RUN_TEST(test_text_render_time);
+    RUN_TEST(test_graph_column_bits);
+    RUN_TEST(test_graph_scrolls_band_only);
+    RUN_TEST(test_graph_column_bytes_and_time);
+    return UNITY_END();
+}
@@ -0,0 +1,246 @@
+#include <unity.h>
+#include <Wire.h>
+
+#include "mcp4726.hpp"
+#include "max11645.hpp"
+
+static const uint8_t g_dacAddress = 0x60;
+static const uint8_t g_adcAddress = 0x36;
+
+// MAX11645 register bytes for the setups used below
+static const uint8_t g_adcSetup = 0xd2;      // internal ref, internal clock, unipolar
+static const uint8_t g_adcSetupReset = 0xd0; // the same with the reset bit
+static const uint8_t g_adcSetupVdd = 0x82;   // VDD ref
+static const uint8_t g_adcConfigAin1 = 0x63; // CS0 only, AIN1, single-ended
+static const uint8_t g_adcConfigAin0 = 0x61; // CS0 only, AIN0, single-ended
+
+static void assertTransaction(size_t index, uint8_t address, const uint8_t *bytes, size_t length)
+{
+    TEST_ASSERT_TRUE(index < Wire.transactions().size());
+    const TwoWire::Transaction &transaction = Wire.transactions()[index];
+    TEST_ASSERT_EQUAL(address, transaction.address);
+    TEST_ASSERT_EQUAL(length, transaction.bytes.size());
+    for (size_t i = 0; i < length; i++)
+    {
+        TEST_ASSERT_EQUAL_UINT8(bytes[i], transaction.bytes[i]);
+    }
+}
+
+static bool writeAdcAll(MAX11645 *adc, MAX11645::ChanSel chanSel, MAX11645::Reference ref)
+{
+    return adc->writeAll(MAX11645::SM_CS0,
+                         chanSel,
+                         MAX11645::MODE_SINGLE_ENDED,
+                         ref,
+                         MAX11645::CLK_INTERNAL,
+                         MAX11645::DSM_UNIPOLAR);
+}
+
+void setUp(void)
+{
+    Wire.reset();
+}
+
+void tearDown(void)
+{
+}
+
+void test_dac_repeated_value_is_written_once(void)
+{
+    MCP4726 dac(g_dacAddress);
+
+    for (int i = 0; i < 3; i++)
+    {
+        TEST_ASSERT_TRUE(dac.writeDAC(0x123));
+    }
+    TEST_ASSERT_EQUAL(1, Wire.transactions().size());
+    uint8_t expected[] = {0x01, 0x23};
+    assertTransaction(0, g_dacAddress, expected, 2);
+    TEST_ASSERT_EQUAL_UINT32(1, dac.writesIssued());
+    TEST_ASSERT_EQUAL_UINT32(2, dac.writesSuppressed());
+
+    // A new value or power-down state goes out
+    TEST_ASSERT_TRUE(dac.writeDAC(0x124));
+    TEST_ASSERT_TRUE(dac.writeDAC(0x124, MCP4726::PD_1K));
+    TEST_ASSERT_EQUAL(3, Wire.transactions().size());
+
+    // writeFrame() shares the shadow
+    TEST_ASSERT_TRUE(dac.writeFrame(MCP4726::encodeDAC(0x124, MCP4726::PD_1K)));
+    TEST_ASSERT_EQUAL(3, Wire.transactions().size());
+}
+
+void test_dac_mem_and_config_writes_are_shadowed(void)
+{
+    MCP4726 dac(g_dacAddress);
+
+    TEST_ASSERT_TRUE(dac.writeMem(MCP4726::REF_VREF_BUFFERED, MCP4726::PD_RUN, MCP4726::G_1X, 0x800));
+    TEST_ASSERT_TRUE(dac.writeMem(MCP4726::REF_VREF_BUFFERED, MCP4726::PD_RUN, MCP4726::G_1X, 0x800));
+    TEST_ASSERT_EQUAL(1, Wire.transactions().size());
+    uint8_t mem[] = {0x58, 0x80, 0x00};
+    assertTransaction(0, g_dacAddress, mem, 3);
+
+    // Everything writeMem() set is known, so neither of these is needed
+    TEST_ASSERT_TRUE(dac.writeDAC(0x800));
+    TEST_ASSERT_TRUE(dac.writeVolatileConfig(MCP4726::REF_VREF_BUFFERED, MCP4726::PD_RUN, MCP4726::G_1X));
+    TEST_ASSERT_EQUAL(1, Wire.transactions().size());
+
+    // A config change goes out once, and so does the gain
+    TEST_ASSERT_TRUE(dac.writeVolatileConfig(MCP4726::REF_VDD, MCP4726::PD_RUN, MCP4726::G_1X));
+    TEST_ASSERT_TRUE(dac.writeVolatileConfig(MCP4726::REF_VDD, MCP4726::PD_RUN, MCP4726::G_1X));
+    TEST_ASSERT_TRUE(dac.writeVolatileConfig(MCP4726::REF_VDD, MCP4726::PD_RUN, MCP4726::G_2X));
+    TEST_ASSERT_EQUAL(3, Wire.transactions().size());
+    uint8_t config[] = {0x80};
+    assertTransaction(1, g_dacAddress, config, 1);
+
+    // A changed gain means the same writeMem() is no longer a repeat
+    TEST_ASSERT_TRUE(dac.writeMem(MCP4726::REF_VREF_BUFFERED, MCP4726::PD_RUN, MCP4726::G_1X, 0x800));
+    TEST_ASSERT_EQUAL(4, Wire.transactions().size());
+}
+
+void test_dac_eeprom_writes_always_go_out(void)
+{
+    MCP4726 dac(g_dacAddress);
+
+    TEST_ASSERT_TRUE(dac.writeMem(MCP4726::REF_VDD, MCP4726::PD_RUN, MCP4726::G_1X, 0x400, true));
+    TEST_ASSERT_TRUE(dac.writeMem(MCP4726::REF_VDD, MCP4726::PD_RUN, MCP4726::G_1X, 0x400, true));
+    TEST_ASSERT_EQUAL(2, Wire.transactions().size());
+    uint8_t eeprom[] = {0x60, 0x40, 0x00};
+    assertTransaction(1, g_dacAddress, eeprom, 3);
+    TEST_ASSERT_EQUAL_UINT32(0, dac.writesSuppressed());
+}
+
+void test_dac_invalidate_forces_rewrite(void)
+{
+    MCP4726 dac(g_dacAddress);
+
+    TEST_ASSERT_TRUE(dac.writeMem(MCP4726::REF_VDD, MCP4726::PD_RUN, MCP4726::G_1X, 0x400));
+    TEST_ASSERT_TRUE(dac.dacValid());
+
+    dac.invalidate();
+    TEST_ASSERT_FALSE(dac.dacValid());
+    TEST_ASSERT_TRUE(dac.writeDAC(0x400));
+    TEST_ASSERT_TRUE(dac.writeVolatileConfig(MCP4726::REF_VDD, MCP4726::PD_RUN, MCP4726::G_1X));
+    TEST_ASSERT_EQUAL(3, Wire.transactions().size());
+}
+
+void test_dac_failed_write_is_not_shadowed(void)
+{
+    MCP4726 dac(g_dacAddress);
+
+    Wire.failWith(2);
+    TEST_ASSERT_FALSE(dac.writeDAC(0x123));
+    TEST_ASSERT_FALSE(dac.writeVolatileConfig(MCP4726::REF_VDD, MCP4726::PD_RUN, MCP4726::G_1X));
+    TEST_ASSERT_FALSE(dac.dacValid());
+
+    // The retry isn't taken for a repeat
+    Wire.failWith(0);
+    TEST_ASSERT_TRUE(dac.writeDAC(0x123));
+    TEST_ASSERT_TRUE(dac.writeVolatileConfig(MCP4726::REF_VDD, MCP4726::PD_RUN, MCP4726::G_1X));
+    TEST_ASSERT_EQUAL(2, Wire.transactions().size());
+    TEST_ASSERT_EQUAL_UINT32(4, dac.writesIssued());
+}
+
+void test_adc_repeated_registers_are_written_once(void)
+{
+    MAX11645 adc(g_adcAddress);
+
+    for (int i = 0; i < 3; i++)
+    {
+        TEST_ASSERT_TRUE(adc.writeSetup(MAX11645::REF_INTERNAL, MAX11645::CLK_INTERNAL, MAX11645::DSM_UNIPOLAR, false));
+        TEST_ASSERT_TRUE(adc.writeConfig(MAX11645::SM_CS0, MAX11645::CS_AIN1, MAX11645::MODE_SINGLE_ENDED));
+    }
+    TEST_ASSERT_EQUAL(2, Wire.transactions().size());
+    uint8_t setup[] = {g_adcSetup};
+    uint8_t config[] = {g_adcConfigAin1};
+    assertTransaction(0, g_adcAddress, setup, 1);
+    assertTransaction(1, g_adcAddress, config, 1);
+    TEST_ASSERT_EQUAL_UINT32(2, adc.writesIssued());
+    TEST_ASSERT_EQUAL_UINT32(4, adc.writesSuppressed());
+    TEST_ASSERT_EQUAL(MAX11645::CS_AIN1, adc.chanSel());
+}
+
+void test_adc_setup_reset_always_goes_out(void)
+{
+    MAX11645 adc(g_adcAddress);
+
+    TEST_ASSERT_TRUE(adc.writeConfig(MAX11645::SM_CS0, MAX11645::CS_AIN1, MAX11645::MODE_SINGLE_ENDED));
+    TEST_ASSERT_TRUE(adc.writeSetup(MAX11645::REF_INTERNAL, MAX11645::CLK_INTERNAL, MAX11645::DSM_UNIPOLAR, true));
+    TEST_ASSERT_TRUE(adc.writeSetup(MAX11645::REF_INTERNAL, MAX11645::CLK_INTERNAL, MAX11645::DSM_UNIPOLAR, true));
+    TEST_ASSERT_EQUAL(3, Wire.transactions().size());
+    uint8_t reset[] = {g_adcSetupReset};
+    assertTransaction(2, g_adcAddress, reset, 1);
+
+    // The reset cleared the config register
+    TEST_ASSERT_FALSE(adc.configValid());
+    TEST_ASSERT_TRUE(adc.writeConfig(MAX11645::SM_CS0, MAX11645::CS_AIN1, MAX11645::MODE_SINGLE_ENDED));
+    TEST_ASSERT_EQUAL(4, Wire.transactions().size());
+}
+
+void test_adc_write_all_falls_back_to_config(void)
+{
+    MAX11645 adc(g_adcAddress);
+
+    // Both registers in one transaction
+    TEST_ASSERT_TRUE(writeAdcAll(&adc, MAX11645::CS_AIN1, MAX11645::REF_INTERNAL));
+    TEST_ASSERT_EQUAL(1, Wire.transactions().size());
+    uint8_t both[] = {g_adcSetup, g_adcConfigAin1};
+    assertTransaction(0, g_adcAddress, both, 2);
+
+    // Nothing changed: nothing on the bus
+    TEST_ASSERT_TRUE(writeAdcAll(&adc, MAX11645::CS_AIN1, MAX11645::REF_INTERNAL));
+    TEST_ASSERT_EQUAL(1, Wire.transactions().size());
+
+    // Only the channel changed: the config byte alone
+    TEST_ASSERT_TRUE(writeAdcAll(&adc, MAX11645::CS_AIN0, MAX11645::REF_INTERNAL));
+    TEST_ASSERT_EQUAL(2, Wire.transactions().size());
+    uint8_t config[] = {g_adcConfigAin0};
+    assertTransaction(1, g_adcAddress, config, 1);
+    TEST_ASSERT_EQUAL(MAX11645::CS_AIN0, adc.chanSel());
+
+    // The setup changed: both again
+    TEST_ASSERT_TRUE(writeAdcAll(&adc, MAX11645::CS_AIN0, MAX11645::REF_VDD));
+    TEST_ASSERT_EQUAL(3, Wire.transactions().size());
+    uint8_t vdd[] = {g_adcSetupVdd, g_adcConfigAin0};
+    assertTransaction(2, g_adcAddress, vdd, 2);
+
+    // And writeConfig() knows what writeAll() sent
+    TEST_ASSERT_TRUE(adc.writeConfig(MAX11645::SM_CS0, MAX11645::CS_AIN0, MAX11645::MODE_SINGLE_ENDED));
+    TEST_ASSERT_EQUAL(3, Wire.transactions().size());
+    TEST_ASSERT_EQUAL_UINT32(3, adc.writesIssued());
+    TEST_ASSERT_EQUAL_UINT32(2, adc.writesSuppressed());
+}
+
+void test_adc_failed_or_invalidated_writes_go_out_again(void)
+{
+    MAX11645 adc(g_adcAddress);
+
+    Wire.failWith(2);
+    TEST_ASSERT_FALSE(writeAdcAll(&adc, MAX11645::CS_AIN1, MAX11645::REF_INTERNAL));
+    TEST_ASSERT_FALSE(adc.configValid());
+
+    Wire.failWith(0);
+    TEST_ASSERT_TRUE(writeAdcAll(&adc, MAX11645::CS_AIN1, MAX11645::REF_INTERNAL));
+    TEST_ASSERT_EQUAL(1, Wire.transactions().size());
+
+    adc.invalidate();
+    TEST_ASSERT_FALSE(adc.configValid());
+    TEST_ASSERT_TRUE(writeAdcAll(&adc, MAX11645::CS_AIN1, MAX11645::REF_INTERNAL));
+    TEST_ASSERT_EQUAL(2, Wire.transactions().size());
+    uint8_t both[] = {g_adcSetup, g_adcConfigAin1};
+    assertTransaction(1, g_adcAddress, both, 2);
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_dac_repeated_value_is_written_once);
+    RUN_TEST(test_dac_mem_and_config_writes_are_shadowed);
+    RUN_TEST(test_dac_eeprom_writes_always_go_out);
+    RUN_TEST(test_dac_invalidate_forces_rewrite);
+    RUN_TEST(test_dac_failed_write_is_not_shadowed);
+    RUN_TEST(test_adc_repeated_registers_are_written_once);
+    RUN_TEST(test_adc_setup_reset_always_goes_out);
+    RUN_TEST(test_adc_write_all_falls_back_to_config);
+    RUN_TEST(test_adc_failed_or_invalidated_writes_go_out_again);
+    return UNITY_END();
+}
@@ -0,0 +1,202 @@
+#include <unity.h>
+#include <Arduino.h>
+#include <Preferences.h>
+
+#include "SettingsStore.hpp"
+
+struct Settings
+{
+    int32_t setpoint;
+    int32_t mode;
+};
+
+static SettingsStore *g_store;
+
+static Settings makeSettings(int32_t setpoint)
+{
+    Settings s;
+    memset(&s, 0, sizeof(s));
+    s.setpoint = setpoint;
+    s.mode = 1;
+    return s;
+}
+
+// Moves the clock on and lets the store run, as the main loop does
+static void runUntil(unsigned long now_ms)
+{
+    fakeMillis() = now_ms;
+    g_store->service(millis());
+}
+
+static void stageAt(unsigned long now_ms, SettingsStore::Slot slot, int32_t setpoint)
+{
+    runUntil(now_ms);
+    Settings s = makeSettings(setpoint);
+    g_store->stage(slot, &s, sizeof(s));
+}
+
+static void putInFlash(const char *key, const void *data, size_t len)
+{
+    Preferences prefs;
+    prefs.begin("settings", false);
+    prefs.putBytes(key, data, len);
+    prefs.end();
+    Preferences::writes() = 0;
+}
+
+void setUp(void)
+{
+    Preferences::fakeReset();
+    fakeMillis() = 100000;
+    g_store = new SettingsStore();
+}
+
+void tearDown(void)
+{
+    delete g_store;
+}
+
+void test_waits_for_quiet_time(void)
+{
+    stageAt(100000, SettingsStore::SLOT_SETTINGS, 1000);
+
+    // Still turning the knob: every change restarts the quiet time
+    for (unsigned long t = 100500; t < 105000; t += 500)
+    {
+        stageAt(t, SettingsStore::SLOT_SETTINGS, int32_t(t));
+    }
+    TEST_ASSERT_EQUAL_UINT32(0, Preferences::writes());
+    TEST_ASSERT_TRUE(g_store->pending());
+
+    runUntil(104500 + SettingsStore::g_quietTime_ms - 1);
+    TEST_ASSERT_EQUAL_UINT32(0, Preferences::writes());
+
+    runUntil(104500 + SettingsStore::g_quietTime_ms);
+    TEST_ASSERT_EQUAL_UINT32(1, Preferences::writes());
+    TEST_ASSERT_FALSE(g_store->pending());
+    TEST_ASSERT_EQUAL_UINT32(1, g_store->written());
+
+    Settings loaded;
+    SettingsStore other;
+    TEST_ASSERT_TRUE(other.load(SettingsStore::SLOT_SETTINGS, &loaded, sizeof(loaded)));
+    TEST_ASSERT_EQUAL_INT32(104500, loaded.setpoint);
+}
+
+void test_rate_limit_is_per_slot(void)
+{
+    stageAt(100000, SettingsStore::SLOT_SETTINGS, 1);
+    runUntil(100000 + SettingsStore::g_quietTime_ms);
+    TEST_ASSERT_EQUAL_UINT32(1, Preferences::writes());
+
+    // A second settings change must wait out the interval...
+    unsigned long firstWrite_ms = millis();
+    stageAt(firstWrite_ms + 100, SettingsStore::SLOT_SETTINGS, 2);
+
+    // ...but calibration was never written and goes after its quiet time
+    stageAt(firstWrite_ms + 200, SettingsStore::SLOT_CALIBRATION, 3);
+    runUntil(firstWrite_ms + 200 + SettingsStore::g_quietTime_ms);
+    TEST_ASSERT_EQUAL_UINT32(2, Preferences::writes());
+    TEST_ASSERT_TRUE(g_store->pending());
+
+    runUntil(firstWrite_ms + SettingsStore::g_minWriteInterval_ms - 1);
+    TEST_ASSERT_EQUAL_UINT32(2, Preferences::writes());
+
+    runUntil(firstWrite_ms + SettingsStore::g_minWriteInterval_ms);
+    TEST_ASSERT_EQUAL_UINT32(3, Preferences::writes());
+    TEST_ASSERT_FALSE(g_store->pending());
+}
+
+void test_unchanged_bytes_are_not_written(void)
+{
+    Settings inFlash = makeSettings(500);
+    putInFlash("settings", &inFlash, sizeof(inFlash));
+
+    Settings loaded;
+    TEST_ASSERT_TRUE(g_store->load(SettingsStore::SLOT_SETTINGS, &loaded, sizeof(loaded)));
+    TEST_ASSERT_EQUAL_INT32(500, loaded.setpoint);
+
+    // Staging what is already stored is not a change
+    stageAt(100000, SettingsStore::SLOT_SETTINGS, 500);
+    TEST_ASSERT_FALSE(g_store->pending());
+
+    // Nor is changing it and turning it back before it was written
+    stageAt(100100, SettingsStore::SLOT_SETTINGS, 600);
+    TEST_ASSERT_TRUE(g_store->pending());
+    stageAt(100200, SettingsStore::SLOT_SETTINGS, 500);
+    TEST_ASSERT_FALSE(g_store->pending());
+
+    runUntil(200000);
+    TEST_ASSERT_EQUAL_UINT32(0, Preferences::writes());
+}
+
+void test_unknown_flash_is_written(void)
+{
+    // Nothing loaded, so even a default has to go out once
+    stageAt(100000, SettingsStore::SLOT_SETTINGS, 0);
+    TEST_ASSERT_TRUE(g_store->pending());
+    TEST_ASSERT_TRUE(g_store->flush());
+    TEST_ASSERT_EQUAL_UINT32(1, Preferences::writes());
+
+    // After which the same bytes are known to be there
+    stageAt(100100, SettingsStore::SLOT_SETTINGS, 0);
+    TEST_ASSERT_FALSE(g_store->pending());
+}
+
+void test_load_rejects_other_sizes(void)
+{
+    uint8_t old[3] = {1, 2, 3};
+    putInFlash("settings", old, sizeof(old));
+
+    Settings loaded;
+    TEST_ASSERT_FALSE(g_store->load(SettingsStore::SLOT_SETTINGS, &loaded, sizeof(loaded)));
+    TEST_ASSERT_FALSE(g_store->load(SettingsStore::SLOT_CALIBRATION, &loaded, sizeof(loaded)));
+
+    // A slot keeps the size it was first used with
+    uint8_t wrong[4] = {0};
+    g_store->stage(SettingsStore::SLOT_SETTINGS, wrong, sizeof(wrong));
+    TEST_ASSERT_FALSE(g_store->pending());
+    TEST_ASSERT_EQUAL_UINT32(0, g_store->staged());
+}
+
+void test_flush_ignores_timing(void)
+{
+    stageAt(100000, SettingsStore::SLOT_SETTINGS, 1);
+    stageAt(100000, SettingsStore::SLOT_CALIBRATION, 2);
+
+    TEST_ASSERT_TRUE(g_store->flush());
+    TEST_ASSERT_EQUAL_UINT32(2, Preferences::writes());
+    TEST_ASSERT_FALSE(g_store->pending());
+
+    // Nothing left for the rate limit to hold back
+    runUntil(300000);
+    TEST_ASSERT_EQUAL_UINT32(2, Preferences::writes());
+}
+
+void test_failed_write_is_retried(void)
+{
+    Preferences::failWrites() = true;
+    stageAt(100000, SettingsStore::SLOT_SETTINGS, 7);
+    runUntil(100000 + SettingsStore::g_quietTime_ms);
+
+    TEST_ASSERT_EQUAL_UINT32(1, g_store->failed());
+    TEST_ASSERT_TRUE(g_store->pending());
+
+    Preferences::failWrites() = false;
+    runUntil(100000 + SettingsStore::g_quietTime_ms + SettingsStore::g_minWriteInterval_ms);
+    TEST_ASSERT_EQUAL_UINT32(1, Preferences::writes());
+    TEST_ASSERT_EQUAL_UINT32(1, g_store->written());
+    TEST_ASSERT_FALSE(g_store->pending());
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_waits_for_quiet_time);
+    RUN_TEST(test_rate_limit_is_per_slot);
+    RUN_TEST(test_unchanged_bytes_are_not_written);
+    RUN_TEST(test_unknown_flash_is_written);
+    RUN_TEST(test_load_rejects_other_sizes);
+    RUN_TEST(test_flush_ignores_timing);
+    RUN_TEST(test_failed_write_is_retried);
+    return UNITY_END();
+}
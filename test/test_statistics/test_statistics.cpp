@@ -0,0 +1,227 @@
+#include <unity.h>
+#include <math.h>
+#include <vector>
+
+#include "Statistics.hpp"
+
+struct Recorded
+{
+    uint64_t time_us;
+    int32_t values[Statistics::Q_COUNT];
+};
+
+static Statistics *g_stats;
+static std::vector<Recorded> g_recorded;
+static uint32_t g_random;
+
+static int32_t nextRandom(int32_t lo, int32_t hi)
+{
+    g_random = g_random * 1664525u + 1013904223u;
+    return lo + int32_t((g_random >> 8) % uint32_t(hi - lo + 1));
+}
+
+// Feeds a sample to Statistics and keeps it for the reference. Time is
+// kept in 64 bits here and handed over truncated, as the sampler does.
+static void feed(uint64_t time_us, int32_t voltage_uV, int32_t current_uA)
+{
+    Recorded r;
+    r.time_us = time_us;
+    r.values[Statistics::Q_VOLTAGE] = voltage_uV;
+    r.values[Statistics::Q_CURRENT] = current_uA;
+    r.values[Statistics::Q_POWER] = int32_t((int64_t(voltage_uV) * current_uA) / 1000000);
+    g_recorded.push_back(r);
+
+    g_stats->update(uint32_t(time_us), voltage_uV, current_uA);
+}
+
+// Brute force over every recorded sample still inside the window. The
+// buckets are aligned to the first sample and the window holds the
+// current bucket plus the nine before it.
+static void checkAgainstReference(int idx, uint32_t window_us)
+{
+    uint32_t bucket_us = window_us / Statistics::g_bucketCount;
+    uint64_t first_us = g_recorded.front().time_us;
+    uint64_t last_us = g_recorded.back().time_us;
+    uint64_t bucketStart_us = first_us + ((last_us - first_us) / bucket_us) * bucket_us;
+    uint64_t history_us = uint64_t(Statistics::g_bucketCount - 1) * bucket_us;
+    uint64_t windowStart_us = bucketStart_us > history_us ? bucketStart_us - history_us : 0;
+
+    uint32_t count = 0;
+    int32_t min[Statistics::Q_COUNT];
+    int32_t max[Statistics::Q_COUNT];
+    int64_t sum[Statistics::Q_COUNT] = {0};
+    double sumSq[Statistics::Q_COUNT] = {0};
+    for (int q = 0; q < Statistics::Q_COUNT; q++)
+    {
+        min[q] = INT32_MAX;
+        max[q] = INT32_MIN;
+    }
+
+    for (size_t i = 0; i < g_recorded.size(); i++)
+    {
+        const Recorded &r = g_recorded[i];
+        if (r.time_us < windowStart_us)
+        {
+            continue;
+        }
+
+        count++;
+        for (int q = 0; q < Statistics::Q_COUNT; q++)
+        {
+            int32_t value = r.values[q];
+            min[q] = value < min[q] ? value : min[q];
+            max[q] = value > max[q] ? value : max[q];
+            sum[q] += value;
+            sumSq[q] += double(value) * value;
+        }
+    }
+
+    Statistics::Snapshot snap;
+    TEST_ASSERT_TRUE(g_stats->snapshot(idx, &snap));
+    TEST_ASSERT_EQUAL_UINT32(window_us, snap.window_us);
+    TEST_ASSERT_EQUAL_UINT32_MESSAGE(count, snap.count, "sample count");
+
+    for (int q = 0; q < Statistics::Q_COUNT; q++)
+    {
+        const Statistics::Summary &s = snap.q[q];
+        TEST_ASSERT_EQUAL_INT32_MESSAGE(min[q], s.min, "min");
+        TEST_ASSERT_EQUAL_INT32_MESSAGE(max[q], s.max, "max");
+        TEST_ASSERT_EQUAL_INT32_MESSAGE(int32_t(sum[q] / int64_t(count)), s.mean, "mean");
+        TEST_ASSERT_EQUAL_INT32_MESSAGE(max[q] - min[q], s.ripple, "ripple");
+
+        // Squares are taken at 64 micro-unit resolution and summed
+        // into a float, so allow half a step or 10 ppm
+        double rms = sqrt(sumSq[q] / count);
+        double tolerance = rms / 100000 > 32 ? rms / 100000 : 32;
+        TEST_ASSERT_INT32_WITHIN_MESSAGE(int32_t(tolerance), int32_t(rms), s.rms, "rms");
+    }
+}
+
+void setUp(void)
+{
+    g_stats = new Statistics();
+    g_recorded.clear();
+    g_random = 12345;
+}
+
+void tearDown(void)
+{
+    delete g_stats;
+}
+
+void test_empty_window_has_no_snapshot(void)
+{
+    Statistics::Snapshot snap;
+    TEST_ASSERT_FALSE(g_stats->snapshot(0, &snap));
+    TEST_ASSERT_EQUAL_UINT32(0, snap.count);
+    TEST_ASSERT_FALSE(g_stats->snapshot(Statistics::g_windowCount, &snap));
+}
+
+void test_single_sample(void)
+{
+    feed(1000, 12000000, -500000);
+
+    Statistics::Snapshot snap;
+    TEST_ASSERT_TRUE(g_stats->snapshot(0, &snap));
+    TEST_ASSERT_EQUAL_UINT32(1, snap.count);
+    TEST_ASSERT_EQUAL_INT32(12000000, snap.q[Statistics::Q_VOLTAGE].mean);
+    TEST_ASSERT_EQUAL_INT32(-500000, snap.q[Statistics::Q_CURRENT].min);
+    TEST_ASSERT_EQUAL_INT32(-6000000, snap.q[Statistics::Q_POWER].max);
+    TEST_ASSERT_EQUAL_INT32(0, snap.q[Statistics::Q_VOLTAGE].ripple);
+}
+
+void test_sliding_window_matches_brute_force(void)
+{
+    const uint32_t window_us = 10000;
+    const uint32_t period_us = 125;
+
+    // Check after every sample over a few windows' worth of data
+    uint64_t time_us = 5000;
+    for (int i = 0; i < 400; i++)
+    {
+        feed(time_us, nextRandom(11000000, 13000000), nextRandom(900000, 1100000));
+        checkAgainstReference(0, window_us);
+        time_us += period_us;
+    }
+}
+
+void test_timestamp_wrap(void)
+{
+    // Start 20 ms short of the 32-bit microsecond wrap
+    uint64_t time_us = (uint64_t(1) << 32) - 20000;
+    for (int i = 0; i < 400; i++)
+    {
+        feed(time_us, nextRandom(0, 30000000), nextRandom(0, 3000000));
+        checkAgainstReference(0, 10000);
+        time_us += 125;
+    }
+}
+
+void test_gap_clears_old_buckets(void)
+{
+    uint64_t time_us = 0;
+    for (int i = 0; i < 100; i++)
+    {
+        feed(time_us, 30000000, 3000000);
+        time_us += 125;
+    }
+
+    // Longer than the whole window; none of the above may remain
+    time_us += 50000;
+    for (int i = 0; i < 10; i++)
+    {
+        feed(time_us, nextRandom(1000000, 2000000), nextRandom(100000, 200000));
+        checkAgainstReference(0, 10000);
+        time_us += 125;
+    }
+
+    Statistics::Snapshot snap;
+    TEST_ASSERT_TRUE(g_stats->snapshot(0, &snap));
+    TEST_ASSERT_EQUAL_UINT32(10, snap.count);
+}
+
+void test_long_window_at_full_scale(void)
+{
+    // 60s at 8kHz of 30V, 3A; the square sums must not overflow
+    const uint32_t window_us = 60000000;
+    uint64_t time_us = 0;
+    for (int i = 0; i < 480000; i++)
+    {
+        feed(time_us, nextRandom(29000000, 30000000), nextRandom(2900000, 3000000));
+        time_us += 125;
+    }
+
+    checkAgainstReference(2, window_us);
+}
+
+void test_reset_and_set_window(void)
+{
+    feed(0, 1000000, 1000000);
+    g_stats->reset();
+
+    Statistics::Snapshot snap;
+    TEST_ASSERT_FALSE(g_stats->snapshot(1, &snap));
+
+    g_stats->setWindow(1, 2000);
+    g_recorded.clear();
+    uint64_t time_us = 0;
+    for (int i = 0; i < 100; i++)
+    {
+        feed(time_us, nextRandom(0, 5000000), nextRandom(0, 1000000));
+        checkAgainstReference(1, 2000);
+        time_us += 50;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_empty_window_has_no_snapshot);
+    RUN_TEST(test_single_sample);
+    RUN_TEST(test_sliding_window_matches_brute_force);
+    RUN_TEST(test_timestamp_wrap);
+    RUN_TEST(test_gap_clears_old_buckets);
+    RUN_TEST(test_long_window_at_full_scale);
+    RUN_TEST(test_reset_and_set_window);
+    return UNITY_END();
+}
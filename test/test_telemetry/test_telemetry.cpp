@@ -0,0 +1,352 @@
+#include <unity.h>
+#include <string.h>
+#include <vector>
+
+#include "TelemetryFrame.hpp"
+
+// A decoder for the byte stream, following tools/telemetry_decode.py
+struct Decoded
+{
+    std::vector<Sample> samples;
+    std::vector<uint8_t> sequences;
+    int corrupt;
+};
+
+static bool cobsDecode(const std::vector<uint8_t> &frame, std::vector<uint8_t> *out)
+{
+    out->clear();
+    size_t i = 0;
+    while (i < frame.size())
+    {
+        uint8_t code = frame[i];
+        if ((code == 0) || (i + code > frame.size() + 1))
+        {
+            return false;
+        }
+        out->insert(out->end(), frame.begin() + i + 1, frame.begin() + i + code);
+        i += code;
+        if ((code < 0xff) && (i < frame.size()))
+        {
+            out->push_back(0);
+        }
+    }
+
+    return true;
+}
+
+static bool parseRecord(const std::vector<uint8_t> &payload, Decoded *decoded)
+{
+    size_t len = payload.size();
+    if ((len < 9) ||
+        (TelemetryFrame::crc16(&payload[0], len - 2) != (payload[len - 2] | (payload[len - 1] << 8))) ||
+        (payload[0] != TelemetryFrame::g_recordTypeSamples))
+    {
+        return false;
+    }
+
+    uint32_t timestamp = payload[2] | (payload[3] << 8) | (payload[4] << 16) | (uint32_t(payload[5]) << 24);
+    uint8_t count = payload[6];
+    size_t pos = 7;
+    std::vector<Sample> samples;
+    for (int i = 0; i < count; i++)
+    {
+        if (i > 0)
+        {
+            uint32_t delta = 0;
+            int shift = 0;
+            uint8_t b;
+            do
+            {
+                if (pos >= len - 2)
+                {
+                    return false;
+                }
+                b = payload[pos++];
+                delta |= uint32_t(b & 0x7f) << shift;
+                shift += 7;
+            } while (b & 0x80);
+            timestamp += delta;
+        }
+
+        if (pos + 3 > len - 2)
+        {
+            return false;
+        }
+        Sample s;
+        s.timestamp_us = timestamp;
+        s.ain0 = uint16_t(payload[pos] | ((payload[pos + 1] & 0x0f) << 8));
+        s.ain1 = uint16_t((payload[pos + 1] >> 4) | (payload[pos + 2] << 4));
+        pos += 3;
+        samples.push_back(s);
+    }
+
+    if (pos != len - 2)
+    {
+        return false;
+    }
+
+    decoded->sequences.push_back(payload[1]);
+    decoded->samples.insert(decoded->samples.end(), samples.begin(), samples.end());
+
+    return true;
+}
+
+static void decodeStream(const std::vector<uint8_t> &stream, Decoded *decoded)
+{
+    decoded->samples.clear();
+    decoded->sequences.clear();
+    decoded->corrupt = 0;
+
+    std::vector<uint8_t> frame;
+    std::vector<uint8_t> payload;
+    for (size_t i = 0; i < stream.size(); i++)
+    {
+        if (stream[i] != 0)
+        {
+            frame.push_back(stream[i]);
+            continue;
+        }
+        if (frame.empty())
+        {
+            continue;
+        }
+        if (!cobsDecode(frame, &payload) || !parseRecord(payload, decoded))
+        {
+            decoded->corrupt++;
+        }
+        frame.clear();
+    }
+}
+
+// Frames samples the way Telemetry::_sendBinary does
+static void encodeAll(TelemetryFrame *encoder, const std::vector<Sample> &samples,
+                      std::vector<uint8_t> *stream)
+{
+    uint8_t frame[TelemetryFrame::g_maxFrameLen];
+
+    // Telemetry reads at most a record's worth from the ring at a time
+    for (size_t block = 0; block < samples.size(); block += TelemetryFrame::g_samplesPerRecord)
+    {
+        size_t count = samples.size() - block;
+        if (count > TelemetryFrame::g_samplesPerRecord)
+        {
+            count = TelemetryFrame::g_samplesPerRecord;
+        }
+
+        size_t first = 0;
+        while (first < count)
+        {
+            size_t used = 0;
+            size_t frameLen = encoder->encode(&samples[block + first], count - first, frame, &used);
+            TEST_ASSERT_GREATER_THAN(0, used);
+            TEST_ASSERT_LESS_OR_EQUAL(TelemetryFrame::g_maxFrameLen, frameLen);
+            stream->insert(stream->end(), frame, frame + frameLen);
+            first += used;
+        }
+    }
+}
+
+static uint32_t g_random;
+
+static uint32_t nextRandom()
+{
+    g_random = g_random * 1664525u + 1013904223u;
+    return g_random >> 8;
+}
+
+static Sample makeSample(uint32_t timestamp_us)
+{
+    Sample s;
+    s.timestamp_us = timestamp_us;
+    s.ain0 = uint16_t(nextRandom() & 0x0fff);
+    s.ain1 = uint16_t(nextRandom() & 0x0fff);
+    return s;
+}
+
+static void checkRoundTrip(const std::vector<Sample> &samples, size_t expectedRecords)
+{
+    TelemetryFrame encoder;
+    std::vector<uint8_t> stream;
+    encodeAll(&encoder, samples, &stream);
+
+    Decoded decoded;
+    decodeStream(stream, &decoded);
+
+    TEST_ASSERT_EQUAL_INT(0, decoded.corrupt);
+    TEST_ASSERT_EQUAL_UINT(expectedRecords, decoded.sequences.size());
+    TEST_ASSERT_EQUAL_UINT(samples.size(), decoded.samples.size());
+    for (size_t i = 0; i < samples.size(); i++)
+    {
+        TEST_ASSERT_EQUAL_UINT32(samples[i].timestamp_us, decoded.samples[i].timestamp_us);
+        TEST_ASSERT_EQUAL_UINT16(samples[i].ain0, decoded.samples[i].ain0);
+        TEST_ASSERT_EQUAL_UINT16(samples[i].ain1, decoded.samples[i].ain1);
+    }
+    for (size_t i = 0; i < decoded.sequences.size(); i++)
+    {
+        TEST_ASSERT_EQUAL_UINT8(uint8_t(i), decoded.sequences[i]);
+    }
+}
+
+void setUp(void)
+{
+    g_random = 4242;
+}
+
+void tearDown(void)
+{
+}
+
+void test_crc16_check_value(void)
+{
+    // The standard CRC-16/CCITT-FALSE check value
+    const uint8_t data[] = {'1', '2', '3', '4', '5', '6', '7', '8', '9'};
+    TEST_ASSERT_EQUAL_UINT16(0x29b1, TelemetryFrame::crc16(data, sizeof(data)));
+}
+
+void test_cobs_has_no_zeros_inside(void)
+{
+    uint8_t in[600];
+    uint8_t out[620];
+    for (size_t i = 0; i < sizeof(in); i++)
+    {
+        in[i] = (i % 7) == 0 ? 0 : uint8_t(i);
+    }
+    // Long runs without zeros need the 0xff code blocks
+    memset(in + 100, 0xaa, 300);
+
+    size_t len = TelemetryFrame::cobsEncode(in, sizeof(in), out);
+    TEST_ASSERT_EQUAL_UINT8(0, out[0]);
+    TEST_ASSERT_EQUAL_UINT8(0, out[len - 1]);
+    for (size_t i = 1; i + 1 < len; i++)
+    {
+        TEST_ASSERT_TRUE(out[i] != 0);
+    }
+
+    std::vector<uint8_t> frame(out + 1, out + len - 1);
+    std::vector<uint8_t> decoded;
+    TEST_ASSERT_TRUE(cobsDecode(frame, &decoded));
+    TEST_ASSERT_EQUAL_UINT(sizeof(in), decoded.size());
+    TEST_ASSERT_EQUAL_MEMORY(in, &decoded[0], sizeof(in));
+}
+
+void test_round_trip_at_sample_rate(void)
+{
+    // 8kHz with a little jitter, across the 32-bit wrap
+    std::vector<Sample> samples;
+    uint32_t timestamp_us = 0xffffffff - 20000;
+    for (int i = 0; i < 1000; i++)
+    {
+        samples.push_back(makeSample(timestamp_us));
+        timestamp_us += 120 + (nextRandom() % 11);
+    }
+
+    checkRoundTrip(samples, (1000 + TelemetryFrame::g_samplesPerRecord - 1) / TelemetryFrame::g_samplesPerRecord);
+}
+
+void test_full_scale_counts(void)
+{
+    std::vector<Sample> samples;
+    for (int i = 0; i < 32; i++)
+    {
+        Sample s;
+        s.timestamp_us = uint32_t(i) * 125;
+        s.ain0 = (i & 1) ? 0x0fff : 0;
+        s.ain1 = (i & 2) ? 0x0fff : 0;
+        samples.push_back(s);
+    }
+
+    checkRoundTrip(samples, 1);
+}
+
+void test_gaps_split_records(void)
+{
+    std::vector<Sample> samples;
+    uint32_t timestamp_us = 1000;
+    for (int i = 0; i < 20; i++)
+    {
+        samples.push_back(makeSample(timestamp_us));
+        // The longest delta that fits, one past it, and far past it
+        if (i == 4)
+        {
+            timestamp_us += TelemetryFrame::g_maxDelta_us;
+        }
+        else if (i == 9)
+        {
+            timestamp_us += TelemetryFrame::g_maxDelta_us + 1;
+        }
+        else if (i == 14)
+        {
+            timestamp_us += 60000000;
+        }
+        else
+        {
+            timestamp_us += 125;
+        }
+    }
+
+    TEST_ASSERT_EQUAL_UINT(10, TelemetryFrame::recordLength(&samples[0], samples.size()));
+    checkRoundTrip(samples, 3);
+}
+
+void test_sequence_wraps(void)
+{
+    TelemetryFrame encoder;
+    uint8_t frame[TelemetryFrame::g_maxFrameLen];
+    Sample sample = makeSample(0);
+
+    for (int i = 0; i < 300; i++)
+    {
+        TEST_ASSERT_EQUAL_UINT8(uint8_t(i), encoder.sequence());
+        size_t used = 0;
+        encoder.encode(&sample, 1, frame, &used);
+        TEST_ASSERT_EQUAL_UINT(1, used);
+    }
+}
+
+void test_corruption_is_detected(void)
+{
+    std::vector<Sample> samples;
+    for (int i = 0; i < 64; i++)
+    {
+        samples.push_back(makeSample(uint32_t(i) * 125));
+    }
+
+    TelemetryFrame encoder;
+    std::vector<uint8_t> stream;
+    encodeAll(&encoder, samples, &stream);
+
+    // Flip a bit in the first frame and add console text between frames
+    stream[10] ^= 0x01;
+    const char text[] = "W: settings write failed\r\n";
+    stream.insert(stream.begin() + stream.size() / 2 + 1, text, text + sizeof(text) - 1);
+
+    Decoded decoded;
+    decodeStream(stream, &decoded);
+    TEST_ASSERT_GREATER_OR_EQUAL(1, decoded.corrupt);
+    TEST_ASSERT_LESS_OR_EQUAL(1, decoded.sequences.size());
+}
+
+void test_empty_input(void)
+{
+    TelemetryFrame encoder;
+    uint8_t frame[TelemetryFrame::g_maxFrameLen];
+    size_t used = 1;
+
+    TEST_ASSERT_EQUAL_UINT(0, encoder.encode(0, 0, frame, &used));
+    TEST_ASSERT_EQUAL_UINT(0, used);
+    TEST_ASSERT_EQUAL_UINT8(0, encoder.sequence());
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_crc16_check_value);
+    RUN_TEST(test_cobs_has_no_zeros_inside);
+    RUN_TEST(test_round_trip_at_sample_rate);
+    RUN_TEST(test_full_scale_counts);
+    RUN_TEST(test_gaps_split_records);
+    RUN_TEST(test_sequence_wraps);
+    RUN_TEST(test_corruption_is_detected);
+    RUN_TEST(test_empty_input);
+    return UNITY_END();
+}
@@ -0,0 +1,146 @@
+#!/usr/bin/env python3
+"""Decode the binary telemetry stream from the electronic load into CSV.
+
+Reads COBS framed sample records (see src/TelemetryFrame.cpp) from a serial
+port or a capture file and writes one CSV row per sample. Text that the
+firmware prints between frames is skipped.
+
+    telemetry_decode.py /dev/ttyUSB0 > capture.csv
+    telemetry_decode.py capture.bin --scaled > capture.csv
+"""
+
+import argparse
+import sys
+
+RECORD_TYPE_SAMPLES = 0x01
+
+# Nominal front end scaling, matches include/Measurement.hpp
+VOLTAGE_UV_PER_COUNT = 500 * 15
+CURRENT_UA_NUM = 50000
+CURRENT_UA_DEN = 67
+
+
+def crc16(data):
+    crc = 0xFFFF
+    for b in data:
+        crc ^= b << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) & 0xFFFF if crc & 0x8000 else (crc << 1) & 0xFFFF
+    return crc
+
+
+def cobs_decode(frame):
+    out = bytearray()
+    i = 0
+    while i < len(frame):
+        code = frame[i]
+        if code == 0 or i + code > len(frame) + 1:
+            return None
+        out += frame[i + 1:i + code]
+        i += code
+        if code < 0xFF and i < len(frame):
+            out.append(0)
+    return bytes(out)
+
+
+def parse_record(payload):
+    if len(payload) < 9 or crc16(payload[:-2]) != payload[-2] | (payload[-1] << 8):
+        return None
+    if payload[0] != RECORD_TYPE_SAMPLES:
+        return None
+
+    seq = payload[1]
+    timestamp = int.from_bytes(payload[2:6], "little")
+    count = payload[6]
+    pos = 7
+    samples = []
+    for i in range(count):
+        if i > 0:
+            delta = 0
+            shift = 0
+            while True:
+                b = payload[pos]
+                pos += 1
+                delta |= (b & 0x7F) << shift
+                shift += 7
+                if not b & 0x80:
+                    break
+            timestamp = (timestamp + delta) & 0xFFFFFFFF
+        b0, b1, b2 = payload[pos:pos + 3]
+        pos += 3
+        ain0 = b0 | ((b1 & 0x0F) << 8)
+        ain1 = (b1 >> 4) | (b2 << 4)
+        samples.append((timestamp, ain0, ain1))
+
+    if pos != len(payload) - 2:
+        return None
+    return seq, samples
+
+
+def frames(stream):
+    buf = bytearray()
+    while True:
+        chunk = stream.read(1024)
+        if not chunk:
+            break
+        for b in chunk:
+            if b == 0:
+                if buf:
+                    yield bytes(buf)
+                    buf.clear()
+            else:
+                buf.append(b)
+
+
+def open_input(path, baud):
+    if path == "-":
+        return sys.stdin.buffer
+    try:
+        return open(path, "rb")
+    except OSError:
+        pass
+    import serial  # pyserial, only needed for live capture
+    return serial.Serial(path, baud, timeout=1)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("input", help="serial port, capture file or - for stdin")
+    parser.add_argument("--baud", type=int, default=115200)
+    parser.add_argument("--scaled", action="store_true",
+                        help="add nominal uV/uA columns")
+    args = parser.parse_args()
+
+    out = sys.stdout
+    header = "timestamp_us,ain0,ain1"
+    if args.scaled:
+        header += ",voltage_uV,current_uA"
+    out.write(header + "\n")
+
+    good = bad = lost = 0
+    last_seq = None
+    for frame in frames(open_input(args.input, args.baud)):
+        payload = cobs_decode(frame)
+        record = parse_record(payload) if payload else None
+        if record is None:
+            bad += 1
+            continue
+
+        seq, samples = record
+        if last_seq is not None and seq != (last_seq + 1) & 0xFF:
+            lost += (seq - last_seq - 1) & 0xFF
+        last_seq = seq
+        good += 1
+
+        for timestamp, ain0, ain1 in samples:
+            row = "%d,%d,%d" % (timestamp, ain0, ain1)
+            if args.scaled:
+                row += ",%d,%d" % (ain0 * VOLTAGE_UV_PER_COUNT,
+                                   (ain1 * CURRENT_UA_NUM + CURRENT_UA_DEN // 2) // CURRENT_UA_DEN)
+            out.write(row + "\n")
+
+    sys.stderr.write("%d records, %d corrupt frames, %d lost records\n" % (good, bad, lost))
+
+
+if __name__ == "__main__":
+    main()